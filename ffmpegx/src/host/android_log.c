@@ -0,0 +1,94 @@
+/**
+ * Host logging shim
+ * stderr implementation of the __android_log_* functions for the Linux build
+ */
+
+#include <android/log.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static pthread_once_t level_once = PTHREAD_ONCE_INIT;
+static atomic_int min_priority = ANDROID_LOG_INFO;
+
+static void read_level_env(void) {
+    static const struct {
+        const char *name;
+        int priority;
+    } levels[] = {
+        { "verbose", ANDROID_LOG_VERBOSE },
+        { "debug", ANDROID_LOG_DEBUG },
+        { "info", ANDROID_LOG_INFO },
+        { "warn", ANDROID_LOG_WARN },
+        { "error", ANDROID_LOG_ERROR },
+        { "silent", ANDROID_LOG_SILENT },
+    };
+
+    const char *env = getenv("FFMPEGX_LOG_LEVEL");
+    if (!env) {
+        return;
+    }
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        if (strcasecmp(env, levels[i].name) == 0) {
+            atomic_store(&min_priority, levels[i].priority);
+            return;
+        }
+    }
+}
+
+void ffmpegx_host_set_log_priority(int prio) {
+    // An explicit call wins over the environment, whichever comes first
+    pthread_once(&level_once, read_level_env);
+    atomic_store(&min_priority, prio);
+}
+
+static char priority_letter(int prio) {
+    switch (prio) {
+        case ANDROID_LOG_VERBOSE: return 'V';
+        case ANDROID_LOG_DEBUG: return 'D';
+        case ANDROID_LOG_INFO: return 'I';
+        case ANDROID_LOG_WARN: return 'W';
+        case ANDROID_LOG_ERROR: return 'E';
+        case ANDROID_LOG_FATAL: return 'F';
+        default: return '?';
+    }
+}
+
+int __android_log_write(int prio, const char *tag, const char *text) {
+    pthread_once(&level_once, read_level_env);
+    if (prio < atomic_load_explicit(&min_priority, memory_order_relaxed)) {
+        return 0;
+    }
+
+    // One locked write per line so lines from codec threads do not interleave
+    flockfile(stderr);
+    fprintf(stderr, "%c/%s: %s", priority_letter(prio), tag ? tag : "", text ? text : "");
+    size_t len = text ? strlen(text) : 0;
+    if (len == 0 || text[len - 1] != '\n') {
+        fputc('\n', stderr);
+    }
+    funlockfile(stderr);
+    return 1;
+}
+
+int __android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap) {
+    pthread_once(&level_once, read_level_env);
+    if (prio < atomic_load_explicit(&min_priority, memory_order_relaxed)) {
+        return 0;
+    }
+
+    char line[1024];
+    vsnprintf(line, sizeof(line), fmt, ap);
+    return __android_log_write(prio, tag, line);
+}
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = __android_log_vprint(prio, tag, fmt, ap);
+    va_end(ap);
+    return ret;
+}
@@ -0,0 +1,666 @@
+/**
+ * Native pipeline benchmarks
+ * Runs the library's command paths (trim, scale, filter, compress, audio extraction,
+ * complex filter, repeated short jobs, probing) and its hot-loop helpers on synthetic clips written at start-up.
+ * Heap allocations are counted process-wide and reported per frame next to the timings.
+ * Pass --benchmark_out=results.json --benchmark_out_format=json to keep results.
+ */
+
+#include <android/log.h>
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C" {
+#include "libavutil/frame.h"
+#include "libswscale/swscale.h"
+
+#include "ffmpeg_cache.h"
+#include "ffmpeg_convert.h"
+#include "ffmpeg_index.h"
+#include "ffmpeg_log_ring.h"
+#include "ffmpeg_pool.h"
+#include "ffmpeg_probe.h"
+#include "ffmpeg_progress.h"
+#include "ffmpeg_synth.h"
+#include "ffmpeg_thumbnail.h"
+
+// Implemented in ffmpeg_main.c and ffmpeg_transcoder.c
+int ffmpeg_main(int argc, char **argv);
+int compress_video_full(const char *input_file, const char *output_file, int quality,
+                        int thread_budget, int segments);
+}
+
+namespace {
+
+std::atomic<long> g_allocations{0};
+
+inline void count_allocation() {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+// The binary interposes glibc's allocator entry points to count every heap
+// allocation, including FFmpeg's (av_malloc() ends up in posix_memalign())
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size) noexcept {
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+    count_allocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+    count_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) noexcept {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept {
+    count_allocation();
+    void *block = __libc_memalign(alignment, size);
+    if (!block) {
+        return ENOMEM;
+    }
+    *ptr = block;
+    return 0;
+}
+}
+
+namespace {
+
+struct Fixture {
+    const char *name;
+    FFmpegxSynthConfig config;
+    std::string path;
+
+    long frames() const { return (long)(config.fps * config.duration); }
+};
+
+Fixture make_fixture(const char *name, int width, int height, double duration) {
+    Fixture fixture = { name, {}, {} };
+    ffmpegx_synth_default_config(&fixture.config);
+    fixture.config.width = width;
+    fixture.config.height = height;
+    fixture.config.duration = duration;
+    return fixture;
+}
+
+// Long enough for two segments of FFMPEGX_MIN_SEGMENT_SECONDS
+Fixture g_clip = make_fixture("clip_360p", 640, 360, 24);
+// Short but large frames, where codec threading pays off
+Fixture g_hd_clip = make_fixture("clip_1080p", 1920, 1080, 4);
+
+std::string g_work_dir;
+std::vector<std::string> g_outputs;
+
+std::string output_path(const char *name) {
+    std::string path = g_work_dir + "/" + name;
+    g_outputs.push_back(path);
+    return path;
+}
+
+void set_frame_counter(benchmark::State &state, long frames) {
+    state.counters["fps"] = benchmark::Counter((double)frames,
+                                               benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// Heap allocations since allocations_before, per frame of every iteration
+void set_allocation_counter(benchmark::State &state, long allocations_before, long frames) {
+    long allocations = g_allocations.load(std::memory_order_relaxed) - allocations_before;
+    state.counters["allocs_per_frame"] =
+        state.iterations() > 0 ? (double)allocations / ((double)state.iterations() * frames) : 0;
+}
+
+// Runs one ffmpeg_main() command per iteration
+void run_command(benchmark::State &state, std::vector<std::string> args) {
+    std::vector<char *> argv;
+    for (std::string &arg : args) {
+        argv.push_back(&arg[0]);
+    }
+
+    for (auto _ : state) {
+        int ret = ffmpeg_main((int)argv.size(), argv.data());
+        if (ret != 0) {
+            state.SkipWithError("ffmpeg_main failed");
+            break;
+        }
+    }
+}
+
+void BM_Trim(benchmark::State &state) {
+    run_command(state, { "ffmpeg", "-i", g_clip.path, "-ss", "2", "-t", "8",
+                         output_path("trim.mp4") });
+}
+BENCHMARK(BM_Trim)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The trim read through an "fd:<n>" descriptor (fd=1), as for content:// URIs, or by path
+void BM_FdTrim(benchmark::State &state) {
+    int fd = -1;
+    std::string input = g_clip.path;
+    if (state.range(0)) {
+        fd = open(g_clip.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            state.SkipWithError("open failed");
+            return;
+        }
+        input = "fd:" + std::to_string(fd);
+    }
+    run_command(state, { "ffmpeg", "-i", input, "-ss", "2", "-t", "8", output_path("fd_trim.mp4") });
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+BENCHMARK(BM_FdTrim)->ArgName("fd")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Repeated 3-second trims of one source, the pattern the warm context cache serves.
+// warm=0 empties the cache before every job, so each one probes the input again.
+void BM_ShortTrim(benchmark::State &state) {
+    bool warm = state.range(0) != 0;
+    std::string output = output_path("short_trim.mp4");
+    std::vector<std::string> args = { "ffmpeg", "-i", g_clip.path, "-ss", "4", "-t", "3", output };
+    std::vector<char *> argv;
+    for (std::string &arg : args) {
+        argv.push_back(&arg[0]);
+    }
+
+    FFmpegxCacheStats before;
+    ffmpegx_cache_clear();
+    ffmpegx_cache_stats(&before);
+    for (auto _ : state) {
+        if (!warm) {
+            ffmpegx_cache_clear();
+        }
+        if (ffmpeg_main((int)argv.size(), argv.data()) != 0) {
+            state.SkipWithError("ffmpeg_main failed");
+            break;
+        }
+    }
+
+    FFmpegxCacheStats after;
+    ffmpegx_cache_stats(&after);
+    long hits = (long)(after.input_hits - before.input_hits);
+    long misses = (long)(after.input_misses - before.input_misses);
+    state.counters["input_hit_rate"] = hits + misses > 0 ? (double)hits / (hits + misses) : 0;
+}
+BENCHMARK(BM_ShortTrim)->ArgName("warm")->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Cut points between keyframes. smart=0: stream copy from the keyframe before the start,
+// smart=1: frame-accurate, re-encoding the two partial GOPs
+void BM_SmartCut(benchmark::State &state) {
+    std::vector<std::string> args = { "ffmpeg", "-i", g_clip.path, "-ss", "2.3", "-t", "8.4" };
+    if (state.range(0)) {
+        args.push_back("-smartcut");
+    }
+    args.push_back(output_path("smart_cut.mp4"));
+    run_command(state, args);
+}
+BENCHMARK(BM_SmartCut)->ArgName("smart")->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Four 3-second clips: one command each (one=0) or one command with four outputs (one=1)
+void BM_TrimRanges(benchmark::State &state) {
+    static const char *const starts[] = { "1", "6", "12", "18" };
+    std::vector<std::vector<std::string>> commands(1, { "ffmpeg", "-i", g_clip.path });
+    for (int i = 0; i < 4; i++) {
+        std::string output = output_path(("clip" + std::to_string(i) + ".mp4").c_str());
+        if (!state.range(0) && i > 0) {
+            commands.push_back({ "ffmpeg", "-i", g_clip.path });
+        }
+        commands.back().insert(commands.back().end(), { "-ss", starts[i], "-t", "3", output });
+    }
+
+    for (auto _ : state) {
+        for (std::vector<std::string> &args : commands) {
+            std::vector<char *> argv;
+            for (std::string &arg : args) {
+                argv.push_back(&arg[0]);
+            }
+            if (ffmpeg_main((int)argv.size(), argv.data()) != 0) {
+                state.SkipWithError("ffmpeg_main failed");
+                return;
+            }
+        }
+    }
+}
+BENCHMARK(BM_TrimRanges)->ArgName("one")->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Three files through "-f concat". mixed=0: identical streams, all copied;
+// mixed=1: the middle one is 1080p and gets re-encoded to 360p
+void BM_Concat(benchmark::State &state) {
+    std::string list = output_path(state.range(0) ? "concat_mixed.txt" : "concat.txt");
+    FILE *f = fopen(list.c_str(), "w");
+    if (!f) {
+        state.SkipWithError("cannot write concat list");
+        return;
+    }
+    const std::string &middle = state.range(0) ? g_hd_clip.path : g_clip.path;
+    fprintf(f, "file '%s'\nfile '%s'\nfile '%s'\n", g_clip.path.c_str(), middle.c_str(),
+            g_clip.path.c_str());
+    fclose(f);
+
+    run_command(state, { "ffmpeg", "-f", "concat", "-safe", "0", "-i", list, "-c", "copy",
+                         output_path("concat.mp4") });
+}
+BENCHMARK(BM_Concat)->ArgName("mixed")->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// mode 0: full probe, 1: fast (header-only) probe, 2: in-memory cache hit
+void BM_Probe(benchmark::State &state) {
+    int mode = (int)state.range(0);
+    int flags = (mode > 0 ? FFMPEGX_PROBE_FAST : 0) | (mode < 2 ? FFMPEGX_PROBE_NO_CACHE : 0);
+    FFmpegxMediaInfo info;
+
+    if (ffmpegx_probe(g_clip.path.c_str(), FFMPEGX_PROBE_FAST, &info) < 0) {
+        state.SkipWithError("ffmpegx_probe failed");
+        return;
+    }
+    for (auto _ : state) {
+        if (ffmpegx_probe(g_clip.path.c_str(), flags, &info) < 0) {
+            state.SkipWithError("ffmpegx_probe failed");
+            break;
+        }
+        benchmark::DoNotOptimize(info.duration_us);
+    }
+}
+BENCHMARK(BM_Probe)->ArgName("mode")->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMicrosecond);
+
+// build=1: demux-only keyframe scan, build=0: read back from the sidecar
+void BM_KeyframeIndex(benchmark::State &state) {
+    bool build = state.range(0) != 0;
+    FFmpegxKeyframeIndex index;
+
+    for (auto _ : state) {
+        int ret = build ? ffmpegx_keyframe_index_build(g_clip.path.c_str(), &index)
+                        : ffmpegx_keyframe_index_load(g_clip.path.c_str(), &index);
+        if (ret < 0) {
+            state.SkipWithError("keyframe index failed");
+            break;
+        }
+        benchmark::DoNotOptimize(index.count);
+        ffmpegx_keyframe_index_free(&index);
+    }
+}
+BENCHMARK(BM_KeyframeIndex)->ArgName("build")->Arg(1)->Arg(0)->Unit(benchmark::kMicrosecond);
+
+// Thumbnails spread over the clip, one keyframe decode each, shared by up to `threads`
+// workers. first_ms is the latency until the first thumbnail is ready.
+void BM_Thumbnails(benchmark::State &state) {
+    int count = (int)state.range(0);
+    std::vector<int64_t> times;
+    for (int i = 0; i < count; i++) {
+        times.push_back((int64_t)(g_clip.config.duration * 1000000 * i / count));
+        output_path(("thumb_" + std::to_string(i + 1) + ".jpg").c_str());
+    }
+    std::string pattern = g_work_dir + "/thumb_%d.jpg";
+
+    struct Latency {
+        int64_t start;
+        std::atomic<int64_t> first;
+    } latency;
+    double first_ns = 0;
+    FFmpegxThumbnailReadyFn ready = [](void *opaque, int, int64_t, const char *, int) {
+        Latency *l = (Latency *)opaque;
+        int64_t none = 0;
+        l->first.compare_exchange_strong(none, ffmpegx_now_ns() - l->start);
+    };
+
+    for (auto _ : state) {
+        latency.start = ffmpegx_now_ns();
+        latency.first = 0;
+        if (ffmpegx_thumbnails_extract(g_clip.path.c_str(), times.data(), count, pattern.c_str(), 160, -1,
+                                       FFMPEGX_THUMBNAIL_JPEG, 0, (int)state.range(1), ready, &latency) < 0) {
+            state.SkipWithError("ffmpegx_thumbnails_extract failed");
+            break;
+        }
+        first_ns += latency.first;
+    }
+    state.counters["thumbnails"] = benchmark::Counter((double)count,
+                                                      benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["first_ms"] = state.iterations() > 0 ? first_ns / 1e6 / state.iterations() : 0;
+}
+BENCHMARK(BM_Thumbnails)->ArgNames({ "count", "threads" })->Args({ 1, 1 })->Args({ 12, 1 })->Args({ 12, 4 })
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// One tile per second of the clip into a single JPEG plus its WebVTT map
+void BM_SpriteSheet(benchmark::State &state) {
+    std::vector<int64_t> times;
+    for (int i = 0; i < (int)g_clip.config.duration; i++) {
+        times.push_back((int64_t)i * 1000000);
+    }
+    std::string image = output_path("sprite.jpg");
+    std::string vtt = output_path("sprite.vtt");
+
+    for (auto _ : state) {
+        if (ffmpegx_sprite_sheet(g_clip.path.c_str(), times.data(), (int)times.size(), 6, 160, -1,
+                                 FFMPEGX_THUMBNAIL_JPEG, 0, image.c_str(), vtt.c_str(),
+                                 (int)state.range(0)) < 0) {
+            state.SkipWithError("ffmpegx_sprite_sheet failed");
+            break;
+        }
+    }
+    state.counters["tiles"] = benchmark::Counter((double)times.size(),
+                                                 benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_SpriteSheet)->ArgName("threads")->Arg(1)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// One RGBA thumbnail: written to a file (file=1) or scaled straight into a caller
+// buffer (file=0), the path of the JNI direct buffer / Bitmap entry points
+void BM_ThumbnailInto(benchmark::State &state) {
+    bool file = state.range(0) != 0;
+    std::string path = output_path("thumb.rgba");
+    FFmpegxThumbnailLayout layout;
+    if (ffmpegx_thumbnail_layout(g_clip.path.c_str(), 320, -1, FFMPEGX_THUMBNAIL_RGBA, &layout) < 0) {
+        state.SkipWithError("ffmpegx_thumbnail_layout failed");
+        return;
+    }
+    std::vector<uint8_t> pixels((size_t)layout.size);
+    int64_t time_us = 10000000;
+
+    for (auto _ : state) {
+        int ret;
+        if (file) {
+            ret = ffmpegx_thumbnails_extract(g_clip.path.c_str(), &time_us, 1, path.c_str(), layout.width,
+                                             layout.height, FFMPEGX_THUMBNAIL_RGBA, 0, 1, nullptr, nullptr);
+        } else {
+            FFmpegxThumbnailer t;
+            ret = ffmpegx_thumbnailer_open(&t, g_clip.path.c_str(), 1);
+            if (ret >= 0) {
+                ret = ffmpegx_thumbnailer_grab_into(&t, time_us, pixels.data(), layout.size, layout.width,
+                                                    layout.height, layout.stride, FFMPEGX_THUMBNAIL_RGBA,
+                                                    nullptr);
+                ffmpegx_thumbnailer_close(&t);
+            }
+        }
+        if (ret < 0) {
+            state.SkipWithError("thumbnail failed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_ThumbnailInto)->ArgName("file")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+void BM_Scale(benchmark::State &state) {
+    long allocations_before = g_allocations.load();
+    run_command(state, { "ffmpeg", "-i", g_clip.path, "-vf", "scale=320:180",
+                         output_path("scale.mp4") });
+    set_frame_counter(state, g_clip.frames());
+    set_allocation_counter(state, allocations_before, g_clip.frames());
+}
+BENCHMARK(BM_Scale)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Filter pipeline fps by codec thread budget
+void BM_FilterThreads(benchmark::State &state) {
+    long allocations_before = g_allocations.load();
+    run_command(state, { "ffmpeg", "-i", g_hd_clip.path, "-vf", "hflip",
+                         "-threads", std::to_string(state.range(0)),
+                         output_path("filter.mp4") });
+    set_frame_counter(state, g_hd_clip.frames());
+    set_allocation_counter(state, allocations_before, g_hd_clip.frames());
+}
+BENCHMARK(BM_FilterThreads)->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Full transcoder by thread budget, single pass (segments = 1) and GOP-parallel (0)
+void BM_CompressFull(benchmark::State &state) {
+    std::string output = output_path("compress.mp4");
+    long allocations_before = g_allocations.load();
+    for (auto _ : state) {
+        int ret = compress_video_full(g_clip.path.c_str(), output.c_str(), 1,
+                                      (int)state.range(0), (int)state.range(1));
+        if (ret != 0) {
+            state.SkipWithError("compress_video_full failed");
+            break;
+        }
+    }
+    set_frame_counter(state, g_clip.frames());
+    set_allocation_counter(state, allocations_before, g_clip.frames());
+}
+BENCHMARK(BM_CompressFull)->ArgNames({ "threads", "segments" })
+    ->ArgsProduct({ { 1, 2, 4, 8 }, { 1, 0 } })
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The command lines compressVideo() builds for LOW (quality=0) and MEDIUM (1), single
+// pass (segments=1) or GOP-parallel (0), run through ffmpeg_main() so its option
+// parsing and routing are covered along with the transcode
+void BM_CompressCommand(benchmark::State &state) {
+    std::string output = output_path("compress_command.mp4");
+    bool low = state.range(0) == 0;
+    if (state.range(1) == 1) {
+        run_command(state, low ?
+            std::vector<std::string>{ "ffmpeg", "-i", g_clip.path, "-vf", "scale=640:360", "-c:v", "mpeg4",
+                                      "-vtag", "mp4v", "-b:v", "200k", "-c:a", "aac", "-b:a", "64k",
+                                      "-y", output } :
+            std::vector<std::string>{ "ffmpeg", "-i", g_clip.path, "-c:v", "mpeg4", "-b:v", "800k",
+                                      "-s", "854x480", "-r", "24", "-c:a", "aac", "-b:a", "96k",
+                                      "-ar", "44100", "-y", output });
+    } else {
+        std::string segments = std::to_string(state.range(1));
+        run_command(state, low ?
+            std::vector<std::string>{ "ffmpeg", "-i", g_clip.path, "-segments", segments,
+                                      "-vf", "scale=640:360", "-c:v", "mpeg4", "-b:v", "200k",
+                                      "-c:a", "copy", "-y", output } :
+            std::vector<std::string>{ "ffmpeg", "-i", g_clip.path, "-segments", segments,
+                                      "-c:v", "mpeg4", "-b:v", "800k", "-s", "854x480", "-r", "24",
+                                      "-c:a", "copy", "-y", output });
+    }
+    set_frame_counter(state, g_clip.frames());
+}
+BENCHMARK(BM_CompressCommand)->ArgNames({ "quality", "segments" })
+    ->ArgsProduct({ { 0, 1 }, { 1, 0 } })
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+void BM_ExtractAudio(benchmark::State &state) {
+    run_command(state, { "ffmpeg", "-i", g_clip.path, "-vn", output_path("audio.mp3") });
+}
+BENCHMARK(BM_ExtractAudio)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+void BM_ComplexFilter(benchmark::State &state) {
+    run_command(state, { "ffmpeg", "-i", g_clip.path, "-i", g_clip.path,
+                         "-filter_complex", "[0:v][1:v]hstack[out]",
+                         output_path("complex.mp4") });
+    set_frame_counter(state, g_clip.frames());
+}
+BENCHMARK(BM_ComplexFilter)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Source frame for the conversion benchmarks: 4:2:2 input to a 4:2:0 encoder, the
+// most common mismatch in the no-filter passthrough path
+AVFrame *alloc_source_frame(int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_YUV422P;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    // 4:2:2 chroma planes have full height, so every plane has height rows
+    for (int plane = 0; plane < 3; plane++) {
+        for (int y = 0; y < height; y++) {
+            uint8_t *row = frame->data[plane] + y * frame->linesize[plane];
+            for (int x = 0; x < frame->linesize[plane]; x++) {
+                row[x] = (uint8_t)(x * 3 + y + plane * 40);
+            }
+        }
+    }
+    return frame;
+}
+
+// What the passthrough path used to do for every frame
+void BM_ConvertPerFrameContext(benchmark::State &state) {
+    const int width = (int)state.range(0);
+    const int height = (int)state.range(1);
+    AVFrame *src = alloc_source_frame(width, height);
+    long allocations_before = g_allocations.load();
+
+    for (auto _ : state) {
+        SwsContext *sws = sws_getContext(width, height, (AVPixelFormat)src->format,
+                                         width, height, AV_PIX_FMT_YUV420P,
+                                         SWS_BILINEAR, nullptr, nullptr, nullptr);
+        AVFrame *dst = av_frame_alloc();
+        dst->format = AV_PIX_FMT_YUV420P;
+        dst->width = width;
+        dst->height = height;
+        av_frame_get_buffer(dst, 0);
+        sws_scale(sws, src->data, src->linesize, 0, height, dst->data, dst->linesize);
+        benchmark::DoNotOptimize(dst->data[0]);
+        av_frame_free(&dst);
+        sws_freeContext(sws);
+    }
+    state.SetItemsProcessed(state.iterations());
+    set_allocation_counter(state, allocations_before, 1);
+    av_frame_free(&src);
+}
+BENCHMARK(BM_ConvertPerFrameContext)->Args({ 1280, 720 })->Args({ 1920, 1080 })
+    ->Unit(benchmark::kMicrosecond);
+
+// Cached SwsContext, pooled output buffers and pooled frames (FFmpegxConverter)
+void BM_ConvertCached(benchmark::State &state) {
+    const int width = (int)state.range(0);
+    const int height = (int)state.range(1);
+    AVFrame *src = alloc_source_frame(width, height);
+    FFmpegxConverter conv;
+    ffmpegx_converter_init(&conv, SWS_BILINEAR);
+
+    // Steady state: the context, the buffer pool and a pooled frame already exist
+    AVFrame *dst = nullptr;
+    if (ffmpegx_converter_convert(&conv, src, width, height, AV_PIX_FMT_YUV420P, &dst) < 0) {
+        state.SkipWithError("conversion failed");
+    }
+    ffmpegx_frame_put(&dst);
+    long allocations_before = g_allocations.load();
+
+    for (auto _ : state) {
+        if (ffmpegx_converter_convert(&conv, src, width, height, AV_PIX_FMT_YUV420P, &dst) < 0) {
+            state.SkipWithError("conversion failed");
+            break;
+        }
+        benchmark::DoNotOptimize(dst->data[0]);
+        ffmpegx_frame_put(&dst);
+    }
+    state.SetItemsProcessed(state.iterations());
+    set_allocation_counter(state, allocations_before, 1);
+    ffmpegx_converter_uninit(&conv);
+    av_frame_free(&src);
+}
+BENCHMARK(BM_ConvertCached)->Args({ 1280, 720 })->Args({ 1920, 1080 })
+    ->Unit(benchmark::kMicrosecond);
+
+// Frame and packet structs one video frame passes through in the pipeline: demuxed
+// packet, decoded frame, frame queued for the encoder, encoded packet
+void BM_FrameStructsAlloc(benchmark::State &state) {
+    long allocations_before = g_allocations.load();
+    for (auto _ : state) {
+        AVPacket *demuxed = av_packet_alloc();
+        AVFrame *decoded = av_frame_alloc();
+        AVFrame *queued = av_frame_alloc();
+        AVPacket *encoded = av_packet_alloc();
+        benchmark::DoNotOptimize(queued);
+        av_packet_free(&encoded);
+        av_frame_free(&queued);
+        av_frame_free(&decoded);
+        av_packet_free(&demuxed);
+    }
+    set_allocation_counter(state, allocations_before, 1);
+}
+BENCHMARK(BM_FrameStructsAlloc)->Unit(benchmark::kNanosecond);
+
+// The same traffic through the shared pools
+void pooled_frame_structs() {
+    AVPacket *demuxed = ffmpegx_packet_get();
+    AVFrame *decoded = ffmpegx_frame_get();
+    AVFrame *queued = ffmpegx_frame_get();
+    AVPacket *encoded = ffmpegx_packet_get();
+    benchmark::DoNotOptimize(queued);
+    ffmpegx_packet_put(&encoded);
+    ffmpegx_frame_put(&queued);
+    ffmpegx_frame_put(&decoded);
+    ffmpegx_packet_put(&demuxed);
+}
+
+// Expected to report 0 allocs_per_frame once the pools are filled
+void BM_FrameStructsPooled(benchmark::State &state) {
+    pooled_frame_structs();
+    long allocations_before = g_allocations.load();
+    for (auto _ : state) {
+        pooled_frame_structs();
+    }
+    set_allocation_counter(state, allocations_before, 1);
+}
+BENCHMARK(BM_FrameStructsPooled)->Unit(benchmark::kNanosecond);
+
+bool write_fixture(Fixture &fixture) {
+    fixture.path = output_path((std::string(fixture.name) + ".mp4").c_str());
+    // Keyframe index sidecar written by trims and segmented compression
+    output_path((std::string(fixture.name) + ".mp4.ffxidx").c_str());
+    int ret = ffmpegx_synth_write_file(&fixture.config, fixture.path.c_str());
+    if (ret < 0) {
+        fprintf(stderr, "Could not write %s (%d)\n", fixture.path.c_str(), ret);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    // Per-frame library logging would dominate the measurements
+    if (!getenv("FFMPEGX_LOG_LEVEL")) {
+        ffmpegx_host_set_log_priority(ANDROID_LOG_ERROR);
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    const char *tmp = getenv("TMPDIR");
+    std::string dir_template = std::string(tmp ? tmp : "/tmp") + "/ffmpegx-bench-XXXXXX";
+    if (!mkdtemp(&dir_template[0])) {
+        perror("mkdtemp");
+        return 1;
+    }
+    g_work_dir = dir_template;
+
+    int status = 1;
+    if (write_fixture(g_clip) && write_fixture(g_hd_clip)) {
+        benchmark::RunSpecifiedBenchmarks();
+        status = 0;
+    }
+    benchmark::Shutdown();
+
+    ffmpegx_log_ring_stop();
+    for (const std::string &path : g_outputs) {
+        unlink(path.c_str());
+    }
+    rmdir(g_work_dir.c_str());
+    return status;
+}
@@ -0,0 +1,156 @@
+/**
+ * Host command line front end
+ * Runs the same ffmpeg_main() the Android library exposes through JNI, so commands
+ * can be reproduced and profiled on a Linux workstation:
+ *   ffmpegx -i input.mp4 -vf scale=640:360 output.mp4
+ * and writes synthetic test clips:
+ *   ffmpegx -synth clip.mp4 -s 1920x1080 -r 30 -g 60 -t 20 -c:v libx264 -ac 2 -ar 44100
+ * and records a Chrome trace of the pipeline threads:
+ *   ffmpegx -trace trace.json -i input.mp4 -vf hflip output.mp4
+ * and prints the media probe as JSON (-full skips the fast header-only path):
+ *   ffmpegx -probe input.mp4 [-full]
+ */
+
+#include <android/log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/error.h"
+
+#include "ffmpeg_log_ring.h"
+#include "ffmpeg_probe.h"
+#include "ffmpeg_synth.h"
+#include "ffmpeg_trace.h"
+
+#define LOG_TAG "FFmpegxCli"
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+// Implemented in ffmpeg_main.c
+extern int ffmpeg_main(int argc, char **argv);
+
+static int usage(const char *name) {
+    fprintf(stderr, "usage: %s [-trace trace.json] -i input [options] output\n"
+                    "       %s -synth output [-s WxH] [-r fps] [-g gop] [-bf frames] [-t seconds]\n"
+                    "                [-c:v encoder] [-c:a encoder] [-ac channels] [-ar rate] [-vn] [-an]\n"
+                    "       %s -probe input [-full]\n"
+                    "Set FFMPEGX_LOG_LEVEL=debug|info|warn|error|silent to control logging\n",
+            name, name, name);
+    return 2;
+}
+
+static int run_synth(int argc, char **argv) {
+    FFmpegxSynthConfig config;
+    ffmpegx_synth_default_config(&config);
+
+    for (int i = 3; i < argc; i++) {
+        const char *opt = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(opt, "-vn") == 0) {
+            config.width = config.height = 0;
+            continue;
+        }
+        if (strcmp(opt, "-an") == 0) {
+            config.channels = 0;
+            continue;
+        }
+        if (!value) {
+            return usage(argv[0]);
+        }
+        if (strcmp(opt, "-s") == 0) {
+            if (sscanf(value, "%dx%d", &config.width, &config.height) != 2) {
+                return usage(argv[0]);
+            }
+        } else if (strcmp(opt, "-r") == 0) {
+            config.fps = atoi(value);
+        } else if (strcmp(opt, "-g") == 0) {
+            config.gop = atoi(value);
+        } else if (strcmp(opt, "-bf") == 0) {
+            config.b_frames = atoi(value);
+        } else if (strcmp(opt, "-t") == 0) {
+            config.duration = atof(value);
+        } else if (strcmp(opt, "-c:v") == 0) {
+            config.video_codec = value;
+        } else if (strcmp(opt, "-c:a") == 0) {
+            config.audio_codec = value;
+        } else if (strcmp(opt, "-ac") == 0) {
+            config.channels = atoi(value);
+        } else if (strcmp(opt, "-ar") == 0) {
+            config.sample_rate = atoi(value);
+        } else {
+            return usage(argv[0]);
+        }
+        i++;
+    }
+
+    return ffmpegx_synth_write_file(&config, argv[2]);
+}
+
+static int run_probe(int argc, char **argv) {
+    int flags = FFMPEGX_PROBE_FAST;
+    if (argc > 3) {
+        if (strcmp(argv[3], "-full") != 0) {
+            return usage(argv[0]);
+        }
+        flags = 0;
+    }
+
+    FFmpegxMediaInfo info;
+    int ret = ffmpegx_probe(argv[2], flags, &info);
+    if (ret < 0) {
+        return ret;
+    }
+    char *json = ffmpegx_probe_to_json(&info);
+    if (!json) {
+        return AVERROR(ENOMEM);
+    }
+    printf("%s\n", json);
+    free(json);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        return usage(argv[0]);
+    }
+
+    int ret;
+    if (strcmp(argv[1], "-synth") == 0) {
+        if (argc < 3) {
+            return usage(argv[0]);
+        }
+        ret = run_synth(argc, argv);
+    } else if (strcmp(argv[1], "-probe") == 0) {
+        if (argc < 3) {
+            return usage(argv[0]);
+        }
+        ret = run_probe(argc, argv);
+    } else if (strcmp(argv[1], "-trace") == 0) {
+        if (argc < 4) {
+            return usage(argv[0]);
+        }
+        const char *trace_path = argv[2];
+        // Drop "-trace path" so ffmpeg_main sees a plain command line
+        argv[2] = argv[0];
+        ffmpegx_trace_start();
+        ret = ffmpeg_main(argc - 2, argv + 2);
+        int trace_ret = ffmpegx_trace_stop(trace_path);
+        if (trace_ret < 0) {
+            LOGE("Could not write %s: %s", trace_path, strerror(-trace_ret));
+        }
+    } else {
+        ret = ffmpeg_main(argc, argv);
+    }
+
+    // Joins the drainer so every queued line is printed before exiting
+    ffmpegx_log_ring_stop();
+
+    if (ret < 0) {
+        char err_buf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, err_buf, sizeof(err_buf));
+        LOGE("Command failed: %s (%d)", err_buf, ret);
+        return 1;
+    }
+    return ret;
+}
@@ -0,0 +1,42 @@
+/**
+ * Host logging shim
+ * Stands in for the NDK's <android/log.h> so the native sources build unchanged on
+ * Linux; messages are written to stderr in logcat's "P/Tag: message" form
+ */
+
+#ifndef FFMPEGX_HOST_ANDROID_LOG_H
+#define FFMPEGX_HOST_ANDROID_LOG_H
+
+#include <stdarg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+} android_LogPriority;
+
+int __android_log_write(int prio, const char *tag, const char *text);
+int __android_log_print(int prio, const char *tag, const char *fmt, ...)
+    __attribute__((__format__(printf, 3, 4)));
+int __android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap)
+    __attribute__((__format__(printf, 3, 0)));
+
+// Host only: lowest priority that is printed. Defaults to ANDROID_LOG_INFO, or to
+// the FFMPEGX_LOG_LEVEL environment variable (verbose, debug, info, warn, error, silent)
+void ffmpegx_host_set_log_priority(int prio);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FFMPEGX_HOST_ANDROID_LOG_H
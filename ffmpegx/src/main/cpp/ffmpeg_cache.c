@@ -0,0 +1,454 @@
+/**
+ * Warm context cache
+ * Two lists (inputs, codecs) of checked-out and idle entries behind one mutex.
+ * Contexts are opened, rewound, flushed and closed outside the lock.
+ */
+
+#include <android/log.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "ffmpeg_cache.h"
+
+#define LOG_TAG "FFmpegCache"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+static atomic_llong input_hits;
+static atomic_llong input_misses;
+static atomic_llong codec_hits;
+static atomic_llong codec_misses;
+
+void ffmpegx_cache_stats(FFmpegxCacheStats *stats) {
+    stats->input_hits = atomic_load(&input_hits);
+    stats->input_misses = atomic_load(&input_misses);
+    stats->codec_hits = atomic_load(&codec_hits);
+    stats->codec_misses = atomic_load(&codec_misses);
+}
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavutil/bprint.h"
+#include "libavutil/crc.h"
+
+#include "ffmpeg_codec.h"
+#include "ffmpeg_fdio.h"
+#include "ffmpeg_progress.h"
+#include "ffmpeg_session.h"
+
+typedef struct InputEntry {
+    struct InputEntry *next;
+    char *path;
+    int64_t mtime_ns;
+    int64_t size;
+    AVFormatContext *ctx;
+    // Session whose cancellation interrupts the context's I/O. libavformat copies
+    // the interrupt callback into the context's AVIOContext at open time, so the
+    // callback points at this slot rather than at a session.
+    _Atomic(FFmpegxSession *) session;
+    int in_use;
+    int64_t last_used_ns;
+} InputEntry;
+
+typedef struct CodecEntry {
+    struct CodecEntry *next;
+    char *key;
+    AVCodecContext *ctx;
+    AVDictionary *unused;   // options the codec did not consume when it was opened
+    int in_use;
+    int64_t last_used_ns;
+} CodecEntry;
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static InputEntry *inputs;
+static CodecEntry *codecs;
+
+static void free_input_entry(InputEntry *entry) {
+    if (!entry) return;
+    ffmpegx_close_input(&entry->ctx);
+    free(entry->path);
+    free(entry);
+}
+
+static void free_codec_entry(CodecEntry *entry) {
+    if (!entry) return;
+    avcodec_free_context(&entry->ctx);
+    av_dict_free(&entry->unused);
+    av_free(entry->key);
+    free(entry);
+}
+
+static int input_interrupt(void *opaque) {
+    InputEntry *entry = opaque;
+    return ffmpegx_session_is_cancelled(atomic_load(&entry->session));
+}
+
+// Regular files only: URLs, pipes and descriptors cannot be told apart by mtime
+static int stat_input(const char *url, int64_t *mtime_ns, int64_t *size) {
+    struct stat st;
+    if (strstr(url, "://") || ffmpegx_fd_url(url) >= 0 || stat(url, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    *mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    *size = st.st_size;
+    return 1;
+}
+
+// Unlinks the idle entry that was used least recently once more than max are idle.
+// Call with cache_mutex held.
+#define EVICT_IDLE(type, head, max)                                         \
+    do {                                                                    \
+        int idle = 0;                                                       \
+        type **oldest = NULL;                                               \
+        for (type **it = &(head); *it; it = &(*it)->next) {                 \
+            if ((*it)->in_use) continue;                                    \
+            idle++;                                                         \
+            if (!oldest || (*it)->last_used_ns < (*oldest)->last_used_ns) { \
+                oldest = it;                                                \
+            }                                                               \
+        }                                                                   \
+        if (idle > (max)) {                                                 \
+            evicted = *oldest;                                              \
+            *oldest = evicted->next;                                        \
+        }                                                                   \
+    } while (0)
+
+// Rewinds a context a previous job left anywhere in the file
+static int rewind_input(AVFormatContext *ctx) {
+    for (unsigned i = 0; i < ctx->nb_streams; i++) {
+        ctx->streams[i]->discard = AVDISCARD_DEFAULT;
+    }
+    int64_t start = ctx->start_time != AV_NOPTS_VALUE ? ctx->start_time : 0;
+    return av_seek_frame(ctx, -1, start, AVSEEK_FLAG_BACKWARD);
+}
+
+int ffmpegx_cache_open_input(AVFormatContext **ctx, const char *url) {
+    InputEntry *entry = NULL;
+    InputEntry *stale = NULL;
+    int64_t mtime_ns = 0, size = 0;
+    int ret;
+
+    *ctx = NULL;
+
+    if (!stat_input(url, &mtime_ns, &size)) {
+        ret = ffmpegx_open_input(ctx, url, NULL, NULL);
+        if (ret >= 0) {
+            ret = avformat_find_stream_info(*ctx, NULL);
+            if (ret < 0) {
+                ffmpegx_close_input(ctx);
+            }
+        }
+        return ret;
+    }
+
+    pthread_mutex_lock(&cache_mutex);
+    for (InputEntry **it = &inputs; *it;) {
+        InputEntry *e = *it;
+        if (e->in_use || strcmp(e->path, url) != 0) {
+            it = &e->next;
+        } else if (e->mtime_ns != mtime_ns || e->size != size) {
+            // The file changed since it was probed
+            *it = e->next;
+            e->next = stale;
+            stale = e;
+        } else if (!entry) {
+            entry = e;
+            entry->in_use = 1;
+            it = &e->next;
+        } else {
+            it = &e->next;
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    while (stale) {
+        InputEntry *next = stale->next;
+        free_input_entry(stale);
+        stale = next;
+    }
+
+    if (entry) {
+        atomic_store(&entry->session, ffmpegx_session_current());
+        ret = rewind_input(entry->ctx);
+        if (ret >= 0) {
+            atomic_fetch_add(&input_hits, 1);
+            LOGD("Reusing probed input %s", url);
+            *ctx = entry->ctx;
+            return 0;
+        }
+        LOGD("Could not rewind cached input %s, reopening", url);
+        pthread_mutex_lock(&cache_mutex);
+        for (InputEntry **it = &inputs; *it; it = &(*it)->next) {
+            if (*it == entry) {
+                *it = entry->next;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&cache_mutex);
+        free_input_entry(entry);
+    }
+
+    atomic_fetch_add(&input_misses, 1);
+    entry = calloc(1, sizeof(*entry));
+    if (!entry || !(entry->path = strdup(url))) {
+        free(entry);
+        return AVERROR(ENOMEM);
+    }
+    entry->mtime_ns = mtime_ns;
+    entry->size = size;
+    atomic_init(&entry->session, ffmpegx_session_current());
+
+    entry->ctx = avformat_alloc_context();
+    if (!entry->ctx) {
+        free_input_entry(entry);
+        return AVERROR(ENOMEM);
+    }
+    entry->ctx->interrupt_callback.callback = input_interrupt;
+    entry->ctx->interrupt_callback.opaque = entry;
+
+    // Frees the context and sets it to NULL on failure
+    ret = avformat_open_input(&entry->ctx, url, NULL, NULL);
+    if (ret >= 0) {
+        ret = avformat_find_stream_info(entry->ctx, NULL);
+    }
+    if (ret < 0) {
+        free_input_entry(entry);
+        return ret;
+    }
+
+    entry->in_use = 1;
+    pthread_mutex_lock(&cache_mutex);
+    entry->next = inputs;
+    inputs = entry;
+    pthread_mutex_unlock(&cache_mutex);
+
+    *ctx = entry->ctx;
+    return 0;
+}
+
+void ffmpegx_cache_close_input(AVFormatContext **ctx) {
+    InputEntry *entry = NULL;
+    InputEntry *evicted = NULL;
+
+    if (!*ctx) return;
+
+    pthread_mutex_lock(&cache_mutex);
+    for (InputEntry **it = &inputs; *it; it = &(*it)->next) {
+        if ((*it)->ctx == *ctx) {
+            entry = *it;
+            // A read error can leave the I/O context unusable
+            if ((*ctx)->pb && (*ctx)->pb->error) {
+                *it = entry->next;
+                evicted = entry;
+            }
+            break;
+        }
+    }
+    if (entry && !evicted) {
+        atomic_store(&entry->session, NULL);
+        entry->in_use = 0;
+        entry->last_used_ns = ffmpegx_now_ns();
+        EVICT_IDLE(InputEntry, inputs, FFMPEGX_CACHE_MAX_INPUTS);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    if (!entry) {
+        ffmpegx_close_input(ctx);
+    }
+    free_input_entry(evicted);
+    *ctx = NULL;
+}
+
+// Everything that shapes an opened codec context: the fields jobs set before
+// opening, the extradata of decoders, the options and the thread budget
+static char *codec_key(const AVCodecContext *ctx, const AVCodec *codec, AVDictionary *options,
+                       int threads) {
+    AVBPrint key;
+    char *options_str = NULL;
+    char *result = NULL;
+
+    av_bprint_init(&key, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&key, "%s:%s|%dx%d|%d|%d:%d|%d/%d|%d/%d|%d/%d",
+               av_codec_is_encoder(codec) ? "enc" : "dec", codec->name,
+               ctx->width, ctx->height, ctx->pix_fmt,
+               ctx->sample_aspect_ratio.num, ctx->sample_aspect_ratio.den,
+               ctx->time_base.num, ctx->time_base.den,
+               ctx->framerate.num, ctx->framerate.den,
+               ctx->pkt_timebase.num, ctx->pkt_timebase.den);
+    av_bprintf(&key, "|%d|%d|%d|%d|%d",
+               ctx->color_range, ctx->colorspace, ctx->color_primaries, ctx->color_trc,
+               ctx->field_order);
+    av_bprintf(&key, "|%d|%d|%d|%d:%" PRIu64,
+               ctx->sample_fmt, ctx->sample_rate, ctx->ch_layout.nb_channels,
+               ctx->ch_layout.order, ctx->ch_layout.order == AV_CHANNEL_ORDER_NATIVE ?
+                                     ctx->ch_layout.u.mask : 0);
+    av_bprintf(&key, "|%" PRId64 "|%" PRId64 "|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%u|t%d",
+               ctx->bit_rate, ctx->rc_max_rate, ctx->rc_buffer_size, ctx->global_quality,
+               ctx->gop_size, ctx->max_b_frames, ctx->qmin, ctx->qmax,
+               ctx->flags, ctx->flags2, ctx->profile, ctx->strict_std_compliance,
+               ctx->codec_tag, threads);
+    if (ctx->extradata_size > 0) {
+        av_bprintf(&key, "|x%d:%08" PRIx32, ctx->extradata_size,
+                   av_crc(av_crc_get_table(AV_CRC_32_IEEE), 0, ctx->extradata, ctx->extradata_size));
+    }
+    if (options && av_dict_get_string(options, &options_str, '=', ',') >= 0 && options_str) {
+        av_bprintf(&key, "|%s", options_str);
+        av_free(options_str);
+    }
+
+    if (av_bprint_finalize(&key, &result) < 0) {
+        return NULL;
+    }
+    return result;
+}
+
+static int codec_cacheable(const AVCodecContext *ctx, const AVCodec *codec) {
+    // Hardware contexts and custom callbacks belong to the job that set them up
+    if (ctx->hw_device_ctx || ctx->hw_frames_ctx || ctx->opaque ||
+        ctx->get_buffer2 != avcodec_default_get_buffer2) {
+        return 0;
+    }
+    // Drained encoders can only take a new stream after avcodec_flush_buffers()
+    return !av_codec_is_encoder(codec) || (codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH);
+}
+
+int ffmpegx_cache_open_codec(AVCodecContext **ctx, const AVCodec *codec, AVDictionary **options,
+                             int threads) {
+    CodecEntry *entry = NULL;
+    char *key = NULL;
+    int ret;
+
+    if (!*ctx || !codec) {
+        return AVERROR(EINVAL);
+    }
+    if (!codec_cacheable(*ctx, codec) ||
+        !(key = codec_key(*ctx, codec, options ? *options : NULL, threads))) {
+        return ffmpegx_codec_open(*ctx, codec, options, threads);
+    }
+
+    pthread_mutex_lock(&cache_mutex);
+    for (CodecEntry *e = codecs; e; e = e->next) {
+        if (!e->in_use && strcmp(e->key, key) == 0) {
+            entry = e;
+            entry->in_use = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    if (entry) {
+        atomic_fetch_add(&codec_hits, 1);
+        LOGD("Reusing opened %s", codec->name);
+        av_free(key);
+        avcodec_free_context(ctx);
+        *ctx = entry->ctx;
+        // The key holds the options, so the first open consumed the same ones;
+        // leave the caller what avcodec_open2() would have left
+        if (options) {
+            av_dict_free(options);
+            av_dict_copy(options, entry->unused, 0);
+        }
+        return 0;
+    }
+
+    atomic_fetch_add(&codec_misses, 1);
+    ret = ffmpegx_codec_open(*ctx, codec, options, threads);
+    if (ret < 0 || !(entry = calloc(1, sizeof(*entry)))) {
+        av_free(key);
+        return ret;
+    }
+    entry->key = key;
+    entry->ctx = *ctx;
+    entry->in_use = 1;
+    if (options) {
+        av_dict_copy(&entry->unused, *options, 0);
+    }
+
+    pthread_mutex_lock(&cache_mutex);
+    entry->next = codecs;
+    codecs = entry;
+    pthread_mutex_unlock(&cache_mutex);
+    return 0;
+}
+
+void ffmpegx_cache_close_codec(AVCodecContext **ctx) {
+    CodecEntry *entry = NULL;
+    CodecEntry *evicted = NULL;
+
+    if (!*ctx) return;
+
+    pthread_mutex_lock(&cache_mutex);
+    for (CodecEntry *e = codecs; e; e = e->next) {
+        if (e->ctx == *ctx) {
+            entry = e;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    if (!entry) {
+        avcodec_free_context(ctx);
+        return;
+    }
+
+    // Drops queued frames/packets and resets the codec for the next stream
+    avcodec_flush_buffers(*ctx);
+
+    pthread_mutex_lock(&cache_mutex);
+    entry->in_use = 0;
+    entry->last_used_ns = ffmpegx_now_ns();
+    EVICT_IDLE(CodecEntry, codecs, FFMPEGX_CACHE_MAX_CODECS);
+    pthread_mutex_unlock(&cache_mutex);
+
+    free_codec_entry(evicted);
+    *ctx = NULL;
+}
+
+void ffmpegx_cache_clear(void) {
+    InputEntry *idle_inputs = NULL;
+    CodecEntry *idle_codecs = NULL;
+
+    pthread_mutex_lock(&cache_mutex);
+    for (InputEntry **it = &inputs; *it;) {
+        InputEntry *e = *it;
+        if (e->in_use) {
+            it = &e->next;
+            continue;
+        }
+        *it = e->next;
+        e->next = idle_inputs;
+        idle_inputs = e;
+    }
+    for (CodecEntry **it = &codecs; *it;) {
+        CodecEntry *e = *it;
+        if (e->in_use) {
+            it = &e->next;
+            continue;
+        }
+        *it = e->next;
+        e->next = idle_codecs;
+        idle_codecs = e;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    while (idle_inputs) {
+        InputEntry *next = idle_inputs->next;
+        free_input_entry(idle_inputs);
+        idle_inputs = next;
+    }
+    while (idle_codecs) {
+        CodecEntry *next = idle_codecs->next;
+        free_codec_entry(idle_codecs);
+        idle_codecs = next;
+    }
+}
+
+#else
+
+void ffmpegx_cache_clear(void) {
+}
+
+#endif // HAVE_FFMPEG_STATIC
@@ -0,0 +1,66 @@
+/**
+ * Warm context cache
+ * Keeps probed input contexts (keyed by path, mtime and size) and opened codec
+ * contexts (keyed by codec, settings, options and thread count) between jobs, so
+ * repeated short jobs on the same source or with the same encoder settings skip
+ * avformat_open_input(), avformat_find_stream_info() and codec initialisation
+ */
+
+#ifndef FFMPEGX_CACHE_H
+#define FFMPEGX_CACHE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Idle contexts kept per kind; the least recently used one is closed beyond that
+#define FFMPEGX_CACHE_MAX_INPUTS 8
+#define FFMPEGX_CACHE_MAX_CODECS 8
+
+typedef struct FFmpegxCacheStats {
+    int64_t input_hits;
+    int64_t input_misses;
+    int64_t codec_hits;
+    int64_t codec_misses;
+} FFmpegxCacheStats;
+
+void ffmpegx_cache_stats(FFmpegxCacheStats *stats);
+
+// Closes every idle context, e.g. on memory pressure; checked-out ones are unaffected
+void ffmpegx_cache_clear(void);
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+
+// Opens and probes url like ffmpegx_open_input() + avformat_find_stream_info(), or
+// checks out an idle context already probed for the same unchanged regular file,
+// rewound to the start. Each context serves one job at a time. *ctx is NULL on failure.
+int ffmpegx_cache_open_input(AVFormatContext **ctx, const char *url);
+
+// Hands a context from ffmpegx_cache_open_input() back for the next job, or closes
+// it when it cannot be reused (I/O error, not cacheable). Accepts NULL, sets *ctx to NULL.
+void ffmpegx_cache_close_input(AVFormatContext **ctx);
+
+// ffmpegx_codec_open() that first looks for an idle context opened with the same
+// codec, settings, options and thread count. On a hit the caller's unopened *ctx is
+// freed and replaced by the warm one, flushed and ready for a new stream, and
+// *options keeps only what the first open did not consume, as with avcodec_open2().
+// Encoders are only cached when they can be flushed (AV_CODEC_CAP_ENCODER_FLUSH).
+int ffmpegx_cache_open_codec(AVCodecContext **ctx, const AVCodec *codec, AVDictionary **options,
+                             int threads);
+
+// Hands a context from ffmpegx_cache_open_codec() back for the next job, or frees
+// it. Accepts NULL, sets *ctx to NULL.
+void ffmpegx_cache_close_codec(AVCodecContext **ctx);
+
+#endif // HAVE_FFMPEG_STATIC
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FFMPEGX_CACHE_H
@@ -4,11 +4,22 @@
  */
 
 #include <jni.h>
+#include <android/bitmap.h>
 #include <android/log.h>
 #include <string.h>
 #include <stdlib.h>
 #include <pthread.h>
 
+#include "ffmpeg_cache.h"
+#include "ffmpeg_codec.h"
+#include "ffmpeg_index.h"
+#include "ffmpeg_log_ring.h"
+#include "ffmpeg_probe.h"
+#include "ffmpeg_progress.h"
+#include "ffmpeg_scheduler.h"
+#include "ffmpeg_session.h"
+#include "ffmpeg_thumbnail.h"
+
 #ifdef HAVE_FFMPEG_STATIC
 // Include FFmpeg headers
 #include "libavcodec/avcodec.h"
@@ -20,8 +31,9 @@
 #include "libswscale/swscale.h"
 #include "libswresample/swresample.h"
 
-// External FFmpeg main function implemented in ffmpeg_main.c
+// External FFmpeg main functions implemented in ffmpeg_main.c
 extern int ffmpeg_main(int argc, char **argv);
+extern int ffmpeg_main_session(FFmpegxSession *session, int argc, char **argv);
 #endif
 
 #define LOG_TAG "FFmpegCmd"
@@ -30,110 +42,229 @@ extern int ffmpeg_main(int argc, char **argv);
 #define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
 #define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
 
-// Global variables for callback (shared with ffmpeg_main.c)
+// Java callback object with its resolved method IDs
+typedef struct JavaCallback {
+    jobject object;
+    jmethodID on_progress;
+    jmethodID on_output;
+    jmethodID on_error;
+    jmethodID on_output_batch;      // optional
+    jmethodID on_complete;          // optional
+} JavaCallback;
+
 // Renamed to avoid conflict with FFmpeg's built-in jni.c
 JavaVM *ffmpegx_java_vm = NULL;
-jobject ffmpegx_java_callback = NULL;
-jmethodID ffmpegx_on_progress_method = NULL;
-jmethodID ffmpegx_on_output_method = NULL;
-jmethodID ffmpegx_on_error_method = NULL;
 
-#ifdef HAVE_FFMPEG_STATIC
-// Custom log callback to send FFmpeg logs to Android logcat and Java
-static void ffmpeg_log_callback(void *ptr, int level, const char *fmt, va_list vargs) {
-    char line[1024];
-    vsnprintf(line, sizeof(line), fmt, vargs);
+// Process-wide callback (nativeSetCallback); receives lines of jobs that run
+// without a session or whose session has no callback of its own
+static JavaCallback global_callback;
+
+// Guards global_callback against nativeSetCallback. It is held only to take a
+// reference (global_callback_ref), never across a call into Java, so callbacks may
+// create sessions or replace the callback. Session callbacks never change, the
+// session reference keeps them alive.
+static pthread_mutex_t callback_mutex = PTHREAD_MUTEX_INITIALIZER;
+static jclass ffmpegx_string_class = NULL;
+
+// Drainer thread's JNIEnv; it stays attached for the life of the thread
+static JNIEnv *drainer_env = NULL;
+
+static void java_callback_init(JNIEnv *env, JavaCallback *cb, jobject callback) {
+    memset(cb, 0, sizeof(*cb));
+    
+    // Store global reference to callback
+    cb->object = (*env)->NewGlobalRef(env, callback);
     
-    // Remove trailing newline
-    size_t len = strlen(line);
-    if (len > 0 && line[len - 1] == '\n') {
-        line[len - 1] = '\0';
+    // Get method IDs
+    jclass callback_class = (*env)->GetObjectClass(env, callback);
+    cb->on_progress = (*env)->GetMethodID(env, callback_class, "onProgress", "(Ljava/lang/String;)V");
+    cb->on_output = (*env)->GetMethodID(env, callback_class, "onOutput", "(Ljava/lang/String;)V");
+    cb->on_error = (*env)->GetMethodID(env, callback_class, "onError", "(Ljava/lang/String;)V");
+    
+    // Optional: callbacks without onOutputBatch get one onOutput call per line
+    cb->on_output_batch = (*env)->GetMethodID(env, callback_class, "onOutputBatch", "([Ljava/lang/String;)V");
+    if ((*env)->ExceptionCheck(env)) {
+        (*env)->ExceptionClear(env);
+        cb->on_output_batch = NULL;
+    }
+    cb->on_complete = (*env)->GetMethodID(env, callback_class, "onComplete", "(I)V");
+    if ((*env)->ExceptionCheck(env)) {
+        (*env)->ExceptionClear(env);
+        cb->on_complete = NULL;
     }
+    (*env)->DeleteLocalRef(env, callback_class);
     
-    // Log to Android logcat
-    switch (level) {
-        case AV_LOG_ERROR:
-            LOGE("%s", line);
-            break;
-        case AV_LOG_WARNING:
-            LOGW("%s", line);
-            break;
-        case AV_LOG_INFO:
-            LOGI("%s", line);
-            break;
-        case AV_LOG_DEBUG:
-        case AV_LOG_VERBOSE:
-            LOGD("%s", line);
-            break;
-        default:
-            LOGI("%s", line);
-            break;
+    if (!ffmpegx_string_class) {
+        jclass string_class = (*env)->FindClass(env, "java/lang/String");
+        ffmpegx_string_class = (*env)->NewGlobalRef(env, string_class);
+        (*env)->DeleteLocalRef(env, string_class);
     }
+}
+
+static void java_callback_clear(JNIEnv *env, JavaCallback *cb) {
+    if (cb->object) {
+        (*env)->DeleteGlobalRef(env, cb->object);
+    }
+    memset(cb, 0, sizeof(*cb));
+}
+
+// Copies the process-wide callback with its own global reference, so Java can be
+// called without callback_mutex; 0 when none is set. Release with java_callback_clear().
+static int global_callback_ref(JNIEnv *env, JavaCallback *out) {
+    pthread_mutex_lock(&callback_mutex);
+    *out = global_callback;
+    if (out->object) {
+        out->object = (*env)->NewGlobalRef(env, out->object);
+    }
+    pthread_mutex_unlock(&callback_mutex);
+    return out->object != NULL;
+}
+
+static void call_string_method(JNIEnv *env, const JavaCallback *cb, jmethodID method, const char *message) {
+    jstring jstr = (*env)->NewStringUTF(env, message);
+    if (jstr) {
+        (*env)->CallVoidMethod(env, cb->object, method, jstr);
+        (*env)->DeleteLocalRef(env, jstr);
+    }
+}
+
+// Hands consecutive output lines to Java, in one onOutputBatch() call when available
+static void deliver_output_lines(JNIEnv *env, const JavaCallback *cb,
+                                 const FFmpegxLogEntry *entries, int count) {
+    if (cb->on_output_batch && ffmpegx_string_class) {
+        if ((*env)->PushLocalFrame(env, count + 2) < 0) {
+            return;
+        }
+        jobjectArray lines = (*env)->NewObjectArray(env, count, ffmpegx_string_class, NULL);
+        if (lines) {
+            for (int i = 0; i < count; i++) {
+                jstring jstr = (*env)->NewStringUTF(env, entries[i].line);
+                (*env)->SetObjectArrayElement(env, lines, i, jstr);
+                (*env)->DeleteLocalRef(env, jstr);
+            }
+            (*env)->CallVoidMethod(env, cb->object, cb->on_output_batch, lines);
+        }
+        (*env)->PopLocalFrame(env, NULL);
+    } else if (cb->on_output) {
+        for (int i = 0; i < count; i++) {
+            call_string_method(env, cb, cb->on_output, entries[i].line);
+        }
+    }
+}
+
+// Delivers entries that all belong to one session (or to none)
+static void deliver_session_entries(JNIEnv *env, int64_t session_id,
+                                    const FFmpegxLogEntry *entries, int count) {
+    FFmpegxSession *session = session_id ? ffmpegx_session_find(session_id) : NULL;
+    const JavaCallback *cb = ffmpegx_session_callback(session);
+    JavaCallback global;
     
-    // Send to Java callback if available
-    if (ffmpegx_java_vm && ffmpegx_java_callback && ffmpegx_on_output_method) {
-        JNIEnv *env = NULL;
-        int attached = 0;
-        
-        if ((*ffmpegx_java_vm)->GetEnv(ffmpegx_java_vm, (void**)&env, JNI_VERSION_1_6) != JNI_OK) {
-            if ((*ffmpegx_java_vm)->AttachCurrentThread(ffmpegx_java_vm, &env, NULL) == JNI_OK) {
-                attached = 1;
+    memset(&global, 0, sizeof(global));
+    if (!cb || !cb->object) {
+        global_callback_ref(env, &global);
+        cb = &global;
+    }
+    
+    int start = 0;
+    while (cb->object && start < count) {
+        // Runs of output lines go out together, progress entries one by one
+        int end = start;
+        while (end < count && entries[end].kind == FFMPEGX_LOG_OUTPUT) {
+            end++;
+        }
+        if (end > start) {
+            deliver_output_lines(env, cb, entries + start, end - start);
+        }
+        if (end < count) {
+            if (cb->on_progress) {
+                call_string_method(env, cb, cb->on_progress, entries[end].line);
             }
+            end++;
         }
         
-        if (env) {
-            jstring jline = (*env)->NewStringUTF(env, line);
-            if (jline) {
-                (*env)->CallVoidMethod(env, ffmpegx_java_callback, ffmpegx_on_output_method, jline);
-                (*env)->DeleteLocalRef(env, jline);
-            }
-            
-            if (attached) {
-                (*ffmpegx_java_vm)->DetachCurrentThread(ffmpegx_java_vm);
+        // An exception from the Java callback must not poison the next calls
+        if ((*env)->ExceptionCheck(env)) {
+            (*env)->ExceptionDescribe(env);
+            (*env)->ExceptionClear(env);
+        }
+        start = end;
+    }
+    
+    java_callback_clear(env, &global);
+    ffmpegx_session_unref(session);
+}
+
+// Log ring sink: runs on the drainer thread only
+static void java_log_deliver(void *opaque, const FFmpegxLogEntry *entries, int count) {
+    (void)opaque;
+    
+    if (ffmpegx_java_vm) {
+        if (!drainer_env &&
+            (*ffmpegx_java_vm)->AttachCurrentThread(ffmpegx_java_vm, &drainer_env, NULL) != JNI_OK) {
+            drainer_env = NULL;
+        }
+        
+        int start = 0;
+        while (drainer_env && start < count) {
+            // Concurrent jobs interleave in the ring; split the batch per session
+            int end = start + 1;
+            while (end < count && entries[end].session_id == entries[start].session_id) {
+                end++;
             }
+            deliver_session_entries(drainer_env, entries[start].session_id, entries + start, end - start);
+            start = end;
         }
     }
 }
-#endif // HAVE_FFMPEG_STATIC
 
-#ifdef HAVE_FFMPEG_STATIC
+static void java_log_detach(void *opaque) {
+    (void)opaque;
+    if (drainer_env && ffmpegx_java_vm) {
+        (*ffmpegx_java_vm)->DetachCurrentThread(ffmpegx_java_vm);
+        drainer_env = NULL;
+    }
+}
 
-// Progress callback structure
-typedef struct {
-    int64_t total_size;
-    int64_t current_size;
-    double total_time;
-    double current_time;
-} ProgressInfo;
-
-static ProgressInfo progress_info = {0};
-
-// Report progress to Java
-static void report_progress(double percentage) {
-    if (ffmpegx_java_vm && ffmpegx_java_callback && ffmpegx_on_progress_method) {
-        JNIEnv *env = NULL;
-        int attached = 0;
-        
-        if ((*ffmpegx_java_vm)->GetEnv(ffmpegx_java_vm, (void**)&env, JNI_VERSION_1_6) != JNI_OK) {
+// Routes the log ring to Java; idempotent
+static void install_java_sink(void) {
+    FFmpegxLogSink sink = { java_log_deliver, java_log_detach, NULL };
+    ffmpegx_log_ring_set_sink(&sink);
+    ffmpegx_log_ring_start();
+}
+
+// Session release hook: drops the callback's global reference from whatever thread
+// let go of the session last
+static void java_session_callback_release(void *opaque) {
+    JavaCallback *cb = opaque;
+    JNIEnv *env = NULL;
+    int attached = 0;
+    
+    if (!cb) {
+        return;
+    }
+    if (ffmpegx_java_vm && cb->object) {
+        if ((*ffmpegx_java_vm)->GetEnv(ffmpegx_java_vm, (void **)&env, JNI_VERSION_1_6) == JNI_EDETACHED) {
             if ((*ffmpegx_java_vm)->AttachCurrentThread(ffmpegx_java_vm, &env, NULL) == JNI_OK) {
                 attached = 1;
+            } else {
+                env = NULL;
             }
         }
-        
         if (env) {
-            char progress_str[256];
-            snprintf(progress_str, sizeof(progress_str), "progress:%.1f", percentage);
-            jstring jprogress = (*env)->NewStringUTF(env, progress_str);
-            if (jprogress) {
-                (*env)->CallVoidMethod(env, ffmpegx_java_callback, ffmpegx_on_progress_method, jprogress);
-                (*env)->DeleteLocalRef(env, jprogress);
-            }
-            
-            if (attached) {
-                (*ffmpegx_java_vm)->DetachCurrentThread(ffmpegx_java_vm);
-            }
+            java_callback_clear(env, cb);
+        }
+        if (attached) {
+            (*ffmpegx_java_vm)->DetachCurrentThread(ffmpegx_java_vm);
         }
     }
+    free(cb);
+}
+
+#ifdef HAVE_FFMPEG_STATIC
+
+// Report progress through the shared progress block (read by Java without any formatting)
+static void report_progress(int64_t pts_us, int64_t bytes_written) {
+    ffmpegx_progress_update(ffmpegx_progress_default(), 0, pts_us, bytes_written, NULL);
 }
 
 // Simple transcoding function (example implementation)
@@ -150,7 +281,7 @@ static int transcode_file(const char *input_file, const char *output_file) {
     LOGI("Starting transcoding: %s -> %s", input_file, output_file);
     
     // Open input file
-    ret = avformat_open_input(&input_ctx, input_file, NULL, NULL);
+    ret = ffmpegx_open_input(&input_ctx, input_file, NULL, NULL);
     if (ret < 0) {
         LOGE("Could not open input file '%s'", input_file);
         return ret;
@@ -262,7 +393,7 @@ static int transcode_file(const char *input_file, const char *output_file) {
     
     // Open output file
     if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&output_ctx->pb, output_file, AVIO_FLAG_WRITE);
+        ret = ffmpegx_open_output(output_ctx, output_file);
         if (ret < 0) {
             LOGE("Could not open output file '%s'", output_file);
             goto cleanup;
@@ -285,12 +416,16 @@ static int transcode_file(const char *input_file, const char *output_file) {
     }
     
     // Simple copy loop (for demonstration - real transcoding would decode/encode)
-    while (av_read_frame(input_ctx, packet) >= 0) {
+    while (!ffmpegx_cancelled() && av_read_frame(input_ctx, packet) >= 0) {
         if (packet->stream_index == stream_index) {
             // Rescale timestamps
             av_packet_rescale_ts(packet, input_stream->time_base, output_stream->time_base);
             packet->stream_index = output_stream->index;
             
+            // The muxer takes the packet, so grab its position first
+            int64_t pts_us = packet->pts != AV_NOPTS_VALUE ?
+                av_rescale_q(packet->pts, output_stream->time_base, AV_TIME_BASE_Q) : AV_NOPTS_VALUE;
+            
             // Write packet
             ret = av_interleaved_write_frame(output_ctx, packet);
             if (ret < 0) {
@@ -299,14 +434,18 @@ static int transcode_file(const char *input_file, const char *output_file) {
             }
             
             // Report progress
-            if (input_ctx->duration > 0 && packet->pts != AV_NOPTS_VALUE) {
-                double progress = (double)packet->pts / (double)input_stream->duration * 100.0;
-                report_progress(progress);
+            if (pts_us != AV_NOPTS_VALUE) {
+                report_progress(pts_us, output_ctx->pb ? avio_tell(output_ctx->pb) : 0);
             }
         }
         av_packet_unref(packet);
     }
     
+    if (ffmpegx_cancelled()) {
+        ret = AVERROR(ECANCELED);
+        goto cleanup;
+    }
+    
     av_write_trailer(output_ctx);
     
     LOGI("Transcoding completed");
@@ -318,11 +457,11 @@ cleanup:
     if (decoder_ctx) avcodec_free_context(&decoder_ctx);
     if (output_ctx) {
         if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&output_ctx->pb);
+            ffmpegx_close_output(output_ctx);
         }
         avformat_free_context(output_ctx);
     }
-    if (input_ctx) avformat_close_input(&input_ctx);
+    if (input_ctx) ffmpegx_close_input(&input_ctx);
     
     return ret;
 }
@@ -348,28 +487,656 @@ int ffmpeg_main(int argc, char **argv) {
     return 0;
 }
 
+int ffmpeg_main_session(FFmpegxSession *session, int argc, char **argv) {
+    FFmpegxSession *previous = ffmpegx_session_set_current(session);
+    int ret = ffmpeg_main(argc, argv);
+    ffmpegx_session_set_current(previous);
+    return ret;
+}
+
 #endif // HAVE_FFMPEG_STATIC
 
+// Direct view of the process-wide progress block, see FFmpegNativeProgress.kt
+JNIEXPORT jobject JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeGetProgressBuffer(JNIEnv *env, jobject thiz) {
+    return (*env)->NewDirectByteBuffer(env, ffmpegx_progress_default(), FFMPEGX_PROGRESS_SHARED_SIZE);
+}
+
+// Copies a progress block obtained from one of the getters above into out, under the
+// seqlock: {version, state, error, frames, ptsUs, durationUs, bytesWritten, fps bits,
+// speed bits, elapsedNs, stageNs...}. Java cannot order the plain loads of a
+// ByteBuffer, so the copy is taken here with acquire loads.
+JNIEXPORT jboolean JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeReadProgress(JNIEnv *env, jobject thiz, jobject buffer, jlongArray out) {
+    const FFmpegxProgress *block = buffer ? (*env)->GetDirectBufferAddress(env, buffer) : NULL;
+    jlong values[10 + FFMPEGX_STAGE_COUNT];
+    FFmpegxProgress copy;
+    
+    if (!block || !out || (*env)->GetDirectBufferCapacity(env, buffer) < FFMPEGX_PROGRESS_SHARED_SIZE ||
+        (*env)->GetArrayLength(env, out) < (jsize)(sizeof(values) / sizeof(values[0]))) {
+        return JNI_FALSE;
+    }
+    
+    if (ffmpegx_progress_read(block, &copy) < 0) {
+        return JNI_FALSE;
+    }
+    values[0] = copy.version;
+    values[1] = copy.state;
+    values[2] = copy.error;
+    values[3] = copy.frames;
+    values[4] = copy.pts_us;
+    values[5] = copy.duration_us;
+    values[6] = copy.bytes_written;
+    memcpy(&values[7], &copy.fps, sizeof(jlong));
+    memcpy(&values[8], &copy.speed, sizeof(jlong));
+    values[9] = copy.elapsed_ns;
+    for (int i = 0; i < FFMPEGX_STAGE_COUNT; i++) {
+        values[10 + i] = copy.stage_ns[i];
+    }
+    (*env)->SetLongArrayRegion(env, out, 0, sizeof(values) / sizeof(values[0]), values);
+    return JNI_TRUE;
+}
+
 // JNI function to set callback
 JNIEXPORT void JNICALL
 Java_com_mzgs_ffmpegx_FFmpegNative_nativeSetCallback(JNIEnv *env, jobject thiz, jobject callback) {
+    pthread_mutex_lock(&callback_mutex);
+    
     // Store JavaVM reference
     (*env)->GetJavaVM(env, &ffmpegx_java_vm);
     
     // Clear previous callback
-    if (ffmpegx_java_callback) {
-        (*env)->DeleteGlobalRef(env, ffmpegx_java_callback);
-        ffmpegx_java_callback = NULL;
+    java_callback_clear(env, &global_callback);
+    if (callback) {
+        java_callback_init(env, &global_callback, callback);
     }
     
+    pthread_mutex_unlock(&callback_mutex);
+    
+    install_java_sink();
+}
+
+// Creates a session with its own callback (may be null) and progress block
+JNIEXPORT jlong JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeCreateSession(JNIEnv *env, jobject thiz, jobject callback) {
+    JavaCallback *cb = NULL;
+    
+    pthread_mutex_lock(&callback_mutex);
+    (*env)->GetJavaVM(env, &ffmpegx_java_vm);
     if (callback) {
-        // Store global reference to callback
-        ffmpegx_java_callback = (*env)->NewGlobalRef(env, callback);
-        
-        // Get method IDs
-        jclass callback_class = (*env)->GetObjectClass(env, callback);
-        ffmpegx_on_progress_method = (*env)->GetMethodID(env, callback_class, "onProgress", "(Ljava/lang/String;)V");
-        ffmpegx_on_output_method = (*env)->GetMethodID(env, callback_class, "onOutput", "(Ljava/lang/String;)V");
-        ffmpegx_on_error_method = (*env)->GetMethodID(env, callback_class, "onError", "(Ljava/lang/String;)V");
+        cb = malloc(sizeof(*cb));
+        if (!cb) {
+            pthread_mutex_unlock(&callback_mutex);
+            return 0;
+        }
+        java_callback_init(env, cb, callback);
+    }
+    pthread_mutex_unlock(&callback_mutex);
+    
+    FFmpegxSession *session = ffmpegx_session_create(cb, java_session_callback_release);
+    if (!session) {
+        LOGE("Could not allocate session");
+        java_session_callback_release(cb);
+        return 0;
+    }
+    
+    install_java_sink();
+    return ffmpegx_session_id(session);
+}
+
+// Copies a Java argument array into a heap argv with "ffmpeg" as argv[0];
+// release with free_argv()
+static char **copy_argv(JNIEnv *env, jobjectArray args, int *argc_out) {
+    int count = (*env)->GetArrayLength(env, args);
+    char **argv = calloc(count + 2, sizeof(*argv));
+    int argc = 0;
+    
+    if (!argv) {
+        return NULL;
+    }
+    argv[argc++] = strdup("ffmpeg");
+    for (int i = 0; i < count; i++) {
+        jstring jstr = (jstring)(*env)->GetObjectArrayElement(env, args, i);
+        if (!jstr) {
+            continue;
+        }
+        const char *str = (*env)->GetStringUTFChars(env, jstr, NULL);
+        if (str) {
+            argv[argc++] = strdup(str);
+            (*env)->ReleaseStringUTFChars(env, jstr, str);
+        }
+        (*env)->DeleteLocalRef(env, jstr);
     }
-}
\ No newline at end of file
+    
+    *argc_out = argc;
+    return argv;
+}
+
+static void free_argv(char **argv, int argc) {
+    if (argv) {
+        for (int i = 0; i < argc; i++) {
+            free(argv[i]);
+        }
+        free(argv);
+    }
+}
+
+// Runs a command on the calling thread, reporting to the session's callback
+JNIEXPORT jint JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeExecuteSession(JNIEnv *env, jobject thiz,
+                                                         jlong session_id, jobjectArray args) {
+    FFmpegxSession *session = ffmpegx_session_find(session_id);
+    if (!session) {
+        LOGE("Unknown session %lld", (long long)session_id);
+        return -1;
+    }
+    
+    int argc = 0;
+    int result = -1;
+    char **argv = copy_argv(env, args, &argc);
+    
+    if (argv) {
+        result = ffmpeg_main_session(session, argc, argv);
+        LOGI("Session %lld completed with result: %d", (long long)session_id, result);
+    }
+    
+    free_argv(argv, argc);
+    ffmpegx_session_unref(session);
+    return result;
+}
+
+// Scheduler completion hook: runs on the worker thread after the session's output
+// has been flushed, and reports the exit code to the session's onComplete()
+static void java_job_done(FFmpegxSession *session, int result, void *opaque) {
+    (void)opaque;
+    JNIEnv *env = NULL;
+    
+    if (!ffmpegx_java_vm ||
+        (*ffmpegx_java_vm)->AttachCurrentThread(ffmpegx_java_vm, &env, NULL) != JNI_OK) {
+        return;
+    }
+    
+    // Neither callback is called under callback_mutex, so onComplete() may freely
+    // start or release other sessions
+    const JavaCallback *cb = ffmpegx_session_callback(session);
+    JavaCallback global;
+    memset(&global, 0, sizeof(global));
+    if (!cb || !cb->object) {
+        global_callback_ref(env, &global);
+        cb = &global;
+    }
+    if (cb->object && cb->on_complete) {
+        (*env)->CallVoidMethod(env, cb->object, cb->on_complete, (jint)result);
+        if ((*env)->ExceptionCheck(env)) {
+            (*env)->ExceptionDescribe(env);
+            (*env)->ExceptionClear(env);
+        }
+    }
+    java_callback_clear(env, &global);
+    
+    (*ffmpegx_java_vm)->DetachCurrentThread(ffmpegx_java_vm);
+}
+
+// Queues a command on the native scheduler; completion is reported via onComplete()
+JNIEXPORT jint JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeSubmitSession(JNIEnv *env, jobject thiz,
+                                                        jlong session_id, jobjectArray args, jint priority) {
+    FFmpegxSession *session = ffmpegx_session_find(session_id);
+    if (!session) {
+        LOGE("Unknown session %lld", (long long)session_id);
+        return -1;
+    }
+    
+    int argc = 0;
+    int ret = -1;
+    char **argv = copy_argv(env, args, &argc);
+    
+    if (argv) {
+        ret = ffmpegx_scheduler_submit(session, argc, argv, priority, java_job_done, NULL);
+        if (ret < 0) {
+            LOGE("Could not queue session %lld: %d", (long long)session_id, ret);
+            free_argv(argv, argc);
+        }
+    }
+    
+    ffmpegx_session_unref(session);
+    return ret < 0 ? -1 : 0;
+}
+
+// Sizes the worker pool (0 = auto); only effective before the first job is queued
+JNIEXPORT jint JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeStartScheduler(JNIEnv *env, jobject thiz, jint workers) {
+    (*env)->GetJavaVM(env, &ffmpegx_java_vm);
+    return ffmpegx_scheduler_start(workers);
+}
+
+// [workers, threadBudget, queued, running, submitted, completed, totalWaitNs, maxWaitNs]
+JNIEXPORT jlongArray JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeGetSchedulerStats(JNIEnv *env, jobject thiz) {
+    FFmpegxSchedulerStats stats;
+    ffmpegx_scheduler_stats(&stats);
+    
+    jlong values[8] = {
+        stats.workers, stats.thread_budget, stats.queued, stats.running,
+        stats.submitted, stats.completed, stats.total_wait_ns, stats.max_wait_ns,
+    };
+    jlongArray result = (*env)->NewLongArray(env, 8);
+    if (result) {
+        (*env)->SetLongArrayRegion(env, result, 0, 8, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeCancelSession(JNIEnv *env, jobject thiz, jlong session_id) {
+    FFmpegxSession *session = ffmpegx_session_find(session_id);
+    if (!session) {
+        return JNI_FALSE;
+    }
+    ffmpegx_session_cancel(session);
+    ffmpegx_session_unref(session);
+    return JNI_TRUE;
+}
+
+// The session's progress buffer must not be read after this call
+JNIEXPORT void JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeReleaseSession(JNIEnv *env, jobject thiz, jlong session_id) {
+    ffmpegx_session_release(session_id);
+}
+
+// Direct view of a session's progress block, valid until nativeReleaseSession
+JNIEXPORT jobject JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeGetSessionProgressBuffer(JNIEnv *env, jobject thiz, jlong session_id) {
+    FFmpegxSession *session = ffmpegx_session_find(session_id);
+    if (!session) {
+        return NULL;
+    }
+    jobject buffer = (*env)->NewDirectByteBuffer(env, ffmpegx_session_progress(session),
+                                                 FFMPEGX_PROGRESS_SHARED_SIZE);
+    ffmpegx_session_unref(session);
+    return buffer;
+}
+
+// Stage timing of the session's current or last command as {totalNs, count, maxNs}
+// per stage; session 0 reads the counters of commands run without a session
+JNIEXPORT jlongArray JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeGetStageStats(JNIEnv *env, jobject thiz, jlong session_id) {
+    FFmpegxSession *session = NULL;
+    if (session_id != 0) {
+        session = ffmpegx_session_find(session_id);
+        if (!session) {
+            return NULL;
+        }
+    }
+    
+    int64_t counters[FFMPEGX_STAGE_COUNT * 3];
+    ffmpegx_stats_read(ffmpegx_session_stats(session), counters);
+    if (session) {
+        ffmpegx_session_unref(session);
+    }
+    
+    jlong values[FFMPEGX_STAGE_COUNT * 3];
+    for (int i = 0; i < FFMPEGX_STAGE_COUNT * 3; i++) {
+        values[i] = counters[i];
+    }
+    jlongArray result = (*env)->NewLongArray(env, FFMPEGX_STAGE_COUNT * 3);
+    if (result) {
+        (*env)->SetLongArrayRegion(env, result, 0, FFMPEGX_STAGE_COUNT * 3, values);
+    }
+    return result;
+}
+
+// [inputHits, inputMisses, codecHits, codecMisses] of the warm context cache
+JNIEXPORT jlongArray JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeGetContextCacheStats(JNIEnv *env, jobject thiz) {
+    FFmpegxCacheStats stats;
+    ffmpegx_cache_stats(&stats);
+    
+    jlong values[4] = {stats.input_hits, stats.input_misses, stats.codec_hits, stats.codec_misses};
+    jlongArray result = (*env)->NewLongArray(env, 4);
+    if (result) {
+        (*env)->SetLongArrayRegion(env, result, 0, 4, values);
+    }
+    return result;
+}
+
+// Closes every idle cached context, e.g. from onTrimMemory()
+JNIEXPORT void JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeClearContextCache(JNIEnv *env, jobject thiz) {
+    ffmpegx_cache_clear();
+}
+
+// Media description as JSON (see ffmpegx_probe_to_json), null when the file cannot be probed
+JNIEXPORT jstring JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeProbe(JNIEnv *env, jobject thiz, jstring path, jboolean fast) {
+    if (!path) {
+        return NULL;
+    }
+    const char *path_str = (*env)->GetStringUTFChars(env, path, NULL);
+    if (!path_str) {
+        return NULL;
+    }
+    
+    FFmpegxMediaInfo info;
+    int ret = ffmpegx_probe(path_str, fast ? FFMPEGX_PROBE_FAST : 0, &info);
+    if (ret < 0) {
+        LOGE("Could not probe %s: %d", path_str, ret);
+    }
+    (*env)->ReleaseStringUTFChars(env, path, path_str);
+    if (ret < 0) {
+        return NULL;
+    }
+    
+    char *json = ffmpegx_probe_to_json(&info);
+    if (!json) {
+        return NULL;
+    }
+    jstring result = (*env)->NewStringUTF(env, json);
+    free(json);
+    return result;
+}
+
+// Directory for the on-disk probe cache, null to disable it
+JNIEXPORT jint JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeSetProbeCacheDir(JNIEnv *env, jobject thiz, jstring dir) {
+    if (!dir) {
+        return ffmpegx_probe_set_cache_dir(NULL);
+    }
+    const char *dir_str = (*env)->GetStringUTFChars(env, dir, NULL);
+    if (!dir_str) {
+        return -1;
+    }
+    int ret = ffmpegx_probe_set_cache_dir(dir_str);
+    (*env)->ReleaseStringUTFChars(env, dir, dir_str);
+    return ret;
+}
+
+// Directory for keyframe index files, null to keep them next to the media
+JNIEXPORT jint JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeSetKeyframeIndexDir(JNIEnv *env, jobject thiz, jstring dir) {
+#ifdef HAVE_FFMPEG_STATIC
+    if (!dir) {
+        return ffmpegx_keyframe_index_set_dir(NULL);
+    }
+    const char *dir_str = (*env)->GetStringUTFChars(env, dir, NULL);
+    if (!dir_str) {
+        return -1;
+    }
+    int ret = ffmpegx_keyframe_index_set_dir(dir_str);
+    (*env)->ReleaseStringUTFChars(env, dir, dir_str);
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+#ifdef HAVE_FFMPEG_STATIC
+
+typedef struct ThumbnailListener {
+    jobject object;
+    jmethodID on_thumbnail;
+} ThumbnailListener;
+
+// Threads attached by attach_worker_thread(), detached when they exit
+static pthread_key_t worker_env_key;
+static pthread_once_t worker_env_once = PTHREAD_ONCE_INIT;
+
+static void detach_worker_thread(void *vm) {
+    (*(JavaVM *)vm)->DetachCurrentThread((JavaVM *)vm);
+}
+
+static void create_worker_env_key(void) {
+    pthread_key_create(&worker_env_key, detach_worker_thread);
+}
+
+// JNIEnv of the calling thread. A native worker is attached on its first call and
+// stays attached until it exits, so per-item callbacks don't attach and detach each time.
+static JNIEnv *attach_worker_thread(void) {
+    JNIEnv *env = NULL;
+    
+    jint status = (*ffmpegx_java_vm)->GetEnv(ffmpegx_java_vm, (void **)&env, JNI_VERSION_1_6);
+    if (status == JNI_OK) {
+        return env;
+    }
+    if (status != JNI_EDETACHED ||
+        (*ffmpegx_java_vm)->AttachCurrentThread(ffmpegx_java_vm, &env, NULL) != JNI_OK) {
+        return NULL;
+    }
+    pthread_once(&worker_env_once, create_worker_env_key);
+    pthread_setspecific(worker_env_key, ffmpegx_java_vm);
+    return env;
+}
+
+// FFmpegxThumbnailReadyFn: runs on the thumbnail workers, attached once per worker
+static void java_thumbnail_ready(void *opaque, int index, int64_t pts_us, const char *path, int result) {
+    const ThumbnailListener *listener = opaque;
+    JNIEnv *env = attach_worker_thread();
+    if (!env) {
+        return;
+    }
+    
+    jstring jpath = (*env)->NewStringUTF(env, path);
+    if (jpath) {
+        (*env)->CallVoidMethod(env, listener->object, listener->on_thumbnail,
+                               (jint)index, (jlong)pts_us, jpath, (jint)result);
+        (*env)->DeleteLocalRef(env, jpath);
+    }
+    if ((*env)->ExceptionCheck(env)) {
+        (*env)->ExceptionDescribe(env);
+        (*env)->ExceptionClear(env);
+    }
+}
+
+#endif
+
+// Keyframe thumbnails of path at timesUs to outputPattern (numbered from 1);
+// format is an FFmpegxThumbnailFormat. listener (may be null) hears about each
+// thumbnail as soon as it is written. Returns 0 or an AVERROR code.
+JNIEXPORT jint JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeExtractThumbnails(JNIEnv *env, jobject thiz, jstring path,
+                                                            jlongArray times_us, jstring output_pattern,
+                                                            jint width, jint height, jint format, jint quality,
+                                                            jobject listener) {
+#ifdef HAVE_FFMPEG_STATIC
+    if (!path || !times_us || !output_pattern) {
+        return AVERROR(EINVAL);
+    }
+    
+    ThumbnailListener java_listener = { NULL, NULL };
+    if (listener) {
+        (*env)->GetJavaVM(env, &ffmpegx_java_vm);
+        jclass listener_class = (*env)->GetObjectClass(env, listener);
+        java_listener.on_thumbnail = (*env)->GetMethodID(env, listener_class, "onThumbnail",
+                                                         "(IJLjava/lang/String;I)V");
+        (*env)->DeleteLocalRef(env, listener_class);
+        if (!java_listener.on_thumbnail) {
+            // Report the bad listener through the return code, not a NoSuchMethodError
+            (*env)->ExceptionClear(env);
+            LOGE("Thumbnail listener has no onThumbnail(int, long, String, int)");
+            return AVERROR(EINVAL);
+        }
+        // Workers call it from their own threads
+        java_listener.object = (*env)->NewGlobalRef(env, listener);
+    }
+    
+    int count = (*env)->GetArrayLength(env, times_us);
+    int64_t *times = malloc((count > 0 ? count : 1) * sizeof(*times));
+    const char *path_str = (*env)->GetStringUTFChars(env, path, NULL);
+    const char *pattern_str = (*env)->GetStringUTFChars(env, output_pattern, NULL);
+    int ret = AVERROR(ENOMEM);
+    
+    if (times && path_str && pattern_str) {
+        (*env)->GetLongArrayRegion(env, times_us, 0, count, (jlong *)times);
+        ret = ffmpegx_thumbnails_extract(path_str, times, count, pattern_str, width, height,
+                                         (FFmpegxThumbnailFormat)format, quality,
+                                         ffmpegx_resolve_thread_budget(0),
+                                         java_listener.object ? java_thumbnail_ready : NULL,
+                                         &java_listener);
+    }
+    
+    if (path_str) {
+        (*env)->ReleaseStringUTFChars(env, path, path_str);
+    }
+    if (pattern_str) {
+        (*env)->ReleaseStringUTFChars(env, output_pattern, pattern_str);
+    }
+    if (java_listener.object) {
+        (*env)->DeleteGlobalRef(env, java_listener.object);
+    }
+    free(times);
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+// {width, height, stride, size} of a buffer for thumbnails of path in a raw format
+// (FFMPEGX_THUMBNAIL_RGBA or _NV21), null when the file has no video
+JNIEXPORT jintArray JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeGetThumbnailLayout(JNIEnv *env, jobject thiz, jstring path,
+                                                             jint width, jint height, jint format) {
+#ifdef HAVE_FFMPEG_STATIC
+    FFmpegxThumbnailLayout layout;
+    if (!path) {
+        return NULL;
+    }
+    const char *path_str = (*env)->GetStringUTFChars(env, path, NULL);
+    if (!path_str) {
+        return NULL;
+    }
+    int ret = ffmpegx_thumbnail_layout(path_str, width, height, (FFmpegxThumbnailFormat)format, &layout);
+    (*env)->ReleaseStringUTFChars(env, path, path_str);
+    if (ret < 0 || layout.size > INT32_MAX) {
+        return NULL;
+    }
+    
+    jint values[4] = { layout.width, layout.height, layout.stride, (jint)layout.size };
+    jintArray result = (*env)->NewIntArray(env, 4);
+    if (result) {
+        (*env)->SetIntArrayRegion(env, result, 0, 4, values);
+    }
+    return result;
+#else
+    return NULL;
+#endif
+}
+
+#ifdef HAVE_FFMPEG_STATIC
+
+// Opens path, grabs the keyframe nearest to time_us into pixels and closes it again;
+// the context cache keeps the demuxer and decoder warm between calls
+static jlong grab_into(JNIEnv *env, jstring path, jlong time_us, uint8_t *pixels, int64_t size,
+                       int width, int height, int stride, FFmpegxThumbnailFormat format) {
+    FFmpegxThumbnailer t;
+    int64_t pts_us = 0;
+    
+    const char *path_str = (*env)->GetStringUTFChars(env, path, NULL);
+    if (!path_str) {
+        return AVERROR(ENOMEM);
+    }
+    int ret = ffmpegx_thumbnailer_open(&t, path_str, ffmpegx_resolve_thread_budget(0));
+    (*env)->ReleaseStringUTFChars(env, path, path_str);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = ffmpegx_thumbnailer_grab_into(&t, time_us, pixels, size, width, height, stride, format, &pts_us);
+    ffmpegx_thumbnailer_close(&t);
+    return ret < 0 ? ret : pts_us;
+}
+
+#endif
+
+// Keyframe nearest to timeUs scaled straight into a direct ByteBuffer, width x height
+// in format with rows stride bytes apart (0 = packed), as from nativeGetThumbnailLayout().
+// Returns the keyframe's time in microseconds, or a negative AVERROR code.
+JNIEXPORT jlong JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeGrabFrameToBuffer(JNIEnv *env, jobject thiz, jstring path,
+                                                            jlong time_us, jobject buffer, jint width,
+                                                            jint height, jint stride, jint format) {
+#ifdef HAVE_FFMPEG_STATIC
+    if (!path || !buffer) {
+        return AVERROR(EINVAL);
+    }
+    uint8_t *pixels = (*env)->GetDirectBufferAddress(env, buffer);
+    jlong capacity = (*env)->GetDirectBufferCapacity(env, buffer);
+    if (!pixels || capacity < 0) {
+        LOGE("Thumbnail buffer is not a direct buffer");
+        return AVERROR(EINVAL);
+    }
+    return grab_into(env, path, time_us, pixels, capacity, width, height, stride,
+                     (FFmpegxThumbnailFormat)format);
+#else
+    return -1;
+#endif
+}
+
+// Keyframe nearest to timeUs scaled straight into the pixels of an ARGB_8888 Bitmap,
+// at the bitmap's size and row stride. Returns the keyframe's time in microseconds,
+// or a negative AVERROR code.
+JNIEXPORT jlong JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeGrabFrameToBitmap(JNIEnv *env, jobject thiz, jstring path,
+                                                            jlong time_us, jobject bitmap) {
+#ifdef HAVE_FFMPEG_STATIC
+    AndroidBitmapInfo info;
+    void *pixels = NULL;
+    
+    if (!path || !bitmap || AndroidBitmap_getInfo(env, bitmap, &info) != ANDROID_BITMAP_RESULT_SUCCESS) {
+        return AVERROR(EINVAL);
+    }
+    // ARGB_8888 is stored as R, G, B, A bytes, which is AV_PIX_FMT_RGBA
+    if (info.format != ANDROID_BITMAP_FORMAT_RGBA_8888) {
+        LOGE("Thumbnail bitmaps must be ARGB_8888");
+        return AVERROR(EINVAL);
+    }
+    if (AndroidBitmap_lockPixels(env, bitmap, &pixels) != ANDROID_BITMAP_RESULT_SUCCESS) {
+        return AVERROR(EINVAL);
+    }
+    jlong ret = grab_into(env, path, time_us, pixels, (int64_t)info.stride * info.height,
+                          (int)info.width, (int)info.height, (int)info.stride, FFMPEGX_THUMBNAIL_RGBA);
+    AndroidBitmap_unlockPixels(env, bitmap);
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+// Sprite sheet of keyframe thumbnails of path at timesUs, with an optional WebVTT
+// map; format is FFMPEGX_THUMBNAIL_JPEG or _PNG. Returns 0 or an AVERROR code.
+JNIEXPORT jint JNICALL
+Java_com_mzgs_ffmpegx_FFmpegNative_nativeCreateSpriteSheet(JNIEnv *env, jobject thiz, jstring path,
+                                                            jlongArray times_us, jint columns,
+                                                            jint tile_width, jint tile_height, jint format,
+                                                            jint quality, jstring image_path, jstring vtt_path) {
+#ifdef HAVE_FFMPEG_STATIC
+    if (!path || !times_us || !image_path) {
+        return AVERROR(EINVAL);
+    }
+    int count = (*env)->GetArrayLength(env, times_us);
+    int64_t *times = malloc((count > 0 ? count : 1) * sizeof(*times));
+    const char *path_str = (*env)->GetStringUTFChars(env, path, NULL);
+    const char *image_str = (*env)->GetStringUTFChars(env, image_path, NULL);
+    const char *vtt_str = vtt_path ? (*env)->GetStringUTFChars(env, vtt_path, NULL) : NULL;
+    int ret = AVERROR(ENOMEM);
+    
+    if (times && path_str && image_str && (!vtt_path || vtt_str)) {
+        (*env)->GetLongArrayRegion(env, times_us, 0, count, (jlong *)times);
+        ret = ffmpegx_sprite_sheet(path_str, times, count, columns, tile_width, tile_height,
+                                   (FFmpegxThumbnailFormat)format, quality, image_str, vtt_str,
+                                   ffmpegx_resolve_thread_budget(0));
+    }
+    
+    if (path_str) {
+        (*env)->ReleaseStringUTFChars(env, path, path_str);
+    }
+    if (image_str) {
+        (*env)->ReleaseStringUTFChars(env, image_path, image_str);
+    }
+    if (vtt_str) {
+        (*env)->ReleaseStringUTFChars(env, vtt_path, vtt_str);
+    }
+    free(times);
+    return ret;
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,98 @@
+/**
+ * Shared codec helpers for the native pipelines
+ * Opens decoders/encoders with frame and slice threading sized from the job's thread budget
+ */
+
+#include <android/log.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_codec.h"
+#include "ffmpeg_scheduler.h"
+#include "libavutil/error.h"
+
+#define LOG_TAG "FFmpegCodec"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+int ffmpegx_cpu_count(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+int ffmpegx_resolve_thread_budget(int requested) {
+    int budget = requested > 0 ? requested : ffmpegx_cpu_count();
+    // Jobs run by the scheduler share the cores with the other workers
+    int limit = ffmpegx_scheduler_thread_budget();
+    if (limit > 0 && budget > limit) budget = limit;
+    if (budget > FFMPEGX_MAX_CODEC_THREADS) budget = FFMPEGX_MAX_CODEC_THREADS;
+    if (budget < 1) budget = 1;
+    return budget;
+}
+
+int ffmpegx_parse_thread_option(int argc, char **argv) {
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-threads") == 0) {
+            int threads = atoi(argv[i + 1]);
+            return threads > 0 ? threads : 0;
+        }
+    }
+    return 0;
+}
+
+void ffmpegx_split_thread_budget(int budget, int *decoder_threads, int *encoder_threads) {
+    // Encoding is the expensive half of a transcode, so it gets the larger share
+    int dec = budget / 3;
+    if (dec < 1) dec = 1;
+    int enc = budget - dec;
+    if (enc < 1) enc = 1;
+
+    if (decoder_threads) *decoder_threads = dec;
+    if (encoder_threads) *encoder_threads = enc;
+}
+
+int ffmpegx_codec_open(AVCodecContext *ctx, const AVCodec *codec, AVDictionary **options, int threads) {
+    if (!ctx || !codec) {
+        return AVERROR(EINVAL);
+    }
+
+    // An explicit "threads" codec option from the caller wins over the budget
+    if (!(options && av_dict_get(*options, "threads", NULL, 0))) {
+        if (threads < 1) threads = 1;
+        if (threads > FFMPEGX_MAX_CODEC_THREADS) threads = FFMPEGX_MAX_CODEC_THREADS;
+
+        int thread_type = 0;
+        if (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) {
+            thread_type |= FF_THREAD_FRAME;
+        }
+        if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) {
+            thread_type |= FF_THREAD_SLICE;
+        }
+
+        // Wrappers such as libx264 run their own thread pool sized from thread_count
+        if (thread_type || (codec->capabilities & AV_CODEC_CAP_OTHER_THREADS)) {
+            ctx->thread_count = threads;
+            ctx->thread_type = thread_type;
+        } else {
+            ctx->thread_count = 1;
+        }
+    }
+
+    int ret = avcodec_open2(ctx, codec, options);
+    if (ret < 0) {
+        return ret;
+    }
+
+    LOGD("Opened %s %s with %d thread(s), type=%s%s", codec->name,
+         av_codec_is_encoder(codec) ? "encoder" : "decoder",
+         ctx->thread_count,
+         (ctx->active_thread_type & FF_THREAD_FRAME) ? "frame" : "",
+         (ctx->active_thread_type & FF_THREAD_SLICE) ? "slice" : "");
+    return 0;
+}
+
+#endif // HAVE_FFMPEG_STATIC
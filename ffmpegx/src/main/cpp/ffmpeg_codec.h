@@ -0,0 +1,38 @@
+/**
+ * Shared codec helpers for the native pipelines
+ * Centralises how decoders and encoders are opened so that every entry point
+ * configures libavcodec threading the same way from a per-job thread budget
+ */
+
+#ifndef FFMPEGX_CODEC_H
+#define FFMPEGX_CODEC_H
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavcodec/avcodec.h"
+#include "libavutil/dict.h"
+
+// Upper bound for a single codec context; libavcodec warns above this for frame threads
+#define FFMPEGX_MAX_CODEC_THREADS 16
+
+// Number of online CPU cores (at least 1)
+int ffmpegx_cpu_count(void);
+
+// Turn a requested thread count (0 = auto) into a usable per-job budget, capped
+// by the scheduler's share when called on a scheduler worker
+int ffmpegx_resolve_thread_budget(int requested);
+
+// Returns the value of "-threads N" from the command line, or 0 when absent
+int ffmpegx_parse_thread_option(int argc, char **argv);
+
+// Split a job budget between the decoder and the encoder of one transcode so
+// that both together never use more threads than the job was given
+void ffmpegx_split_thread_budget(int budget, int *decoder_threads, int *encoder_threads);
+
+// avcodec_open2() replacement that enables frame and/or slice threading
+// (whatever the codec supports) with the given number of threads
+int ffmpegx_codec_open(AVCodecContext *ctx, const AVCodec *codec, AVDictionary **options, int threads);
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_CODEC_H
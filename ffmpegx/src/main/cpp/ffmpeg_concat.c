@@ -0,0 +1,893 @@
+/**
+ * Native concat
+ * One input at a time is either stream-copied with its timestamps shifted onto the
+ * output timeline, or decoded and re-encoded with the first input's parameters
+ */
+
+#include <android/log.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_cache.h"
+#include "ffmpeg_codec.h"
+#include "ffmpeg_concat.h"
+#include "ffmpeg_pool.h"
+#include "ffmpeg_progress.h"
+#include "ffmpeg_session.h"
+#include "ffmpeg_splice.h"
+#include "ffmpeg_trace.h"
+#include "libavcodec/avcodec.h"
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavfilter/buffersrc.h"
+#include "libavformat/avformat.h"
+#include "libavutil/audio_fifo.h"
+#include "libavutil/avstring.h"
+#include "libavutil/avutil.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/samplefmt.h"
+#include "libswresample/swresample.h"
+
+#define LOG_TAG "FFmpegConcat"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+enum { CONCAT_VIDEO, CONCAT_AUDIO, CONCAT_STREAMS };
+
+typedef struct ConcatOutput {
+    AVFormatContext *ctx;
+    AVCodecParameters *params[CONCAT_STREAMS];  // the first input's, NULL for a missing stream
+    AVStream *streams[CONCAT_STREAMS];
+    FFmpegxSplice splice;                       // of the video stream
+    int64_t last_dts[CONCAT_STREAMS];           // output time base
+    int64_t end_us;                             // end of the latest packet written
+    int dec_threads;
+    int enc_threads;
+} ConcatOutput;
+
+typedef struct ConcatInput {
+    AVFormatContext *ctx;
+    int index[CONCAT_STREAMS];                  // stream feeding each output stream, -1 for none
+    int64_t shift_us;                           // added to every timestamp of the input
+} ConcatInput;
+
+typedef struct Reencoder {
+    AVCodecContext *dec[CONCAT_STREAMS];
+    AVCodecContext *enc[CONCAT_STREAMS];
+    AVFilterGraph *graph;                       // scales and pads video to the output size
+    AVFilterContext *src;
+    AVFilterContext *sink;
+    SwrContext *swr;
+    AVAudioFifo *fifo;
+    AVFrame *frame;                             // decoded
+    AVFrame *filtered;
+    AVFrame *audio;                             // one encoder frame of samples
+    AVPacket *pkt;
+    int64_t audio_pts;                          // of the first sample in the fifo, 1/sample_rate
+    int64_t video_end;                          // of the decoded video, 1/sample_rate
+} Reencoder;
+
+static void free_list(char **files, int count) {
+    for (int i = 0; i < count; i++) {
+        av_free(files[i]);
+    }
+    av_free(files);
+}
+
+int ffmpegx_concat_read_list(const char *list_path, char ***files, int *count) {
+    const char *slash = strrchr(list_path, '/');
+    char **list = NULL;
+    char line[4096];
+    int n = 0;
+    int ret = 0;
+
+    *files = NULL;
+    *count = 0;
+    FILE *f = fopen(list_path, "r");
+    if (!f) {
+        LOGE("Cannot open concat list %s", list_path);
+        return AVERROR(errno);
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        const char *p = line + strspn(line, " \t\r\n");
+        size_t len = strcspn(p, " \t\r\n");
+        if (len == 0 || *p == '#' ||
+            (len == 8 && strncmp(p, "ffconcat", 8) == 0) ||
+            (len == 8 && strncmp(p, "duration", 8) == 0)) {
+            continue;
+        }
+        if (len != 4 || strncmp(p, "file", 4) != 0) {
+            LOGE("Unsupported concat directive: %.*s", (int)len, p);
+            ret = AVERROR_PATCHWELCOME;
+            break;
+        }
+        p += len;
+        p += strspn(p, " \t");
+
+        // Quoting and escapes as in ffmpeg's concat demuxer
+        char *path = av_get_token(&p, " \t\r\n");
+        if (path && !*path) {
+            av_freep(&path);
+            ret = AVERROR_INVALIDDATA;
+            break;
+        }
+        if (path && path[0] != '/' && !strstr(path, "://") && slash) {
+            char *relative = path;
+            path = av_asprintf("%.*s/%s", (int)(slash - list_path), list_path, relative);
+            av_free(relative);
+        }
+        char **grown = path ? av_realloc_array(list, n + 1, sizeof(*list)) : NULL;
+        if (!grown) {
+            av_free(path);
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        list = grown;
+        list[n++] = path;
+    }
+    fclose(f);
+
+    if (ret >= 0 && n == 0) {
+        LOGE("No files in concat list %s", list_path);
+        ret = AVERROR_INVALIDDATA;
+    }
+    if (ret < 0) {
+        free_list(list, n);
+        return ret;
+    }
+    *files = list;
+    *count = n;
+    return 0;
+}
+
+void ffmpegx_concat_free_list(char **files, int count) {
+    free_list(files, count);
+}
+
+// Parameters a decoder could tell apart: anything else is the same stream to a player
+static int streams_match(const AVCodecParameters *a, const AVCodecParameters *b) {
+    if (a->codec_id != b->codec_id || a->format != b->format ||
+        a->extradata_size != b->extradata_size ||
+        (a->extradata_size > 0 && memcmp(a->extradata, b->extradata, a->extradata_size) != 0)) {
+        return 0;
+    }
+    if (a->codec_type == AVMEDIA_TYPE_VIDEO) {
+        return a->width == b->width && a->height == b->height &&
+               av_cmp_q(a->sample_aspect_ratio, b->sample_aspect_ratio) == 0;
+    }
+    return a->sample_rate == b->sample_rate && av_channel_layout_compare(&a->ch_layout, &b->ch_layout) == 0;
+}
+
+static int open_concat_input(ConcatInput *in, const char *path) {
+    int ret = ffmpegx_cache_open_input(&in->ctx, path);
+    if (ret < 0) {
+        LOGE("Cannot open input file: %s", path);
+        return ret;
+    }
+    in->index[CONCAT_VIDEO] = FFMAX(av_find_best_stream(in->ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0), -1);
+    in->index[CONCAT_AUDIO] = FFMAX(av_find_best_stream(in->ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0), -1);
+    // Only the joined streams are read
+    for (unsigned i = 0; i < in->ctx->nb_streams; i++) {
+        if ((int)i != in->index[CONCAT_VIDEO] && (int)i != in->index[CONCAT_AUDIO]) {
+            in->ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    return 0;
+}
+
+static int input_matches(const ConcatOutput *out, const ConcatInput *in) {
+    for (int s = 0; s < CONCAT_STREAMS; s++) {
+        if (out->params[s] && (in->index[s] < 0 ||
+                               !streams_match(out->params[s], in->ctx->streams[in->index[s]]->codecpar))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Decides whether path can be copied, and if not, whether it can be re-encoded
+static int plan_input(const ConcatOutput *out, const char *path, uint8_t *copy) {
+    ConcatInput in = { 0 };
+    int ret = open_concat_input(&in, path);
+    if (ret < 0) {
+        return ret;
+    }
+    *copy = input_matches(out, &in);
+    for (int s = 0; s < CONCAT_STREAMS && !*copy && ret >= 0; s++) {
+        if (!out->params[s]) {
+            continue;
+        }
+        if (in.index[s] >= 0 && !avcodec_find_decoder(in.ctx->streams[in.index[s]]->codecpar->codec_id)) {
+            ret = AVERROR_DECODER_NOT_FOUND;
+        } else if (in.index[s] >= 0 || s == CONCAT_AUDIO) {
+            ret = ffmpegx_splice_check_encoder(out->params[s]);
+        }
+    }
+    if (ret < 0) {
+        LOGE("%s cannot be re-encoded to match the first input", path);
+    }
+    ffmpegx_cache_close_input(&in.ctx);
+    return ret;
+}
+
+static int open_output(ConcatOutput *out, const char *output_file, const ConcatInput *first) {
+    int ret = avformat_alloc_output_context2(&out->ctx, NULL, NULL, output_file);
+    if (ret < 0 || !out->ctx) {
+        LOGE("Could not create output context for %s", output_file);
+        return ret < 0 ? ret : AVERROR_UNKNOWN;
+    }
+
+    for (int s = 0; s < CONCAT_STREAMS; s++) {
+        if (!out->params[s]) {
+            continue;
+        }
+        AVStream *stream = avformat_new_stream(out->ctx, NULL);
+        if (!stream) {
+            return AVERROR(ENOMEM);
+        }
+        ret = avcodec_parameters_copy(stream->codecpar, out->params[s]);
+        if (ret < 0) {
+            return ret;
+        }
+        stream->codecpar->codec_tag = 0;
+        stream->time_base = first->ctx->streams[first->index[s]]->time_base;
+        out->streams[s] = stream;
+    }
+
+    if (!(out->ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = ffmpegx_open_output(out->ctx, output_file);
+        if (ret < 0) {
+            LOGE("Could not open output file '%s'", output_file);
+            return ret;
+        }
+    }
+    ret = avformat_write_header(out->ctx, NULL);
+    if (ret < 0) {
+        LOGE("Error writing header of %s", output_file);
+    }
+    return ret;
+}
+
+static int output_slot(const ConcatInput *in, int stream_index) {
+    for (int s = 0; s < CONCAT_STREAMS; s++) {
+        if (in->index[s] == stream_index) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+// Shifts pkt (in time_base) onto the output timeline and writes it. dts is kept
+// increasing across joins, where the last packets of one input and the first of the
+// next may round to the same tick.
+static int write_packet(ConcatOutput *out, const ConcatInput *in, AVPacket *pkt, int s,
+                        AVRational time_base) {
+    AVStream *stream = out->streams[s];
+    int64_t shift = av_rescale_q(in->shift_us, AV_TIME_BASE_Q, time_base);
+    if (pkt->pts != AV_NOPTS_VALUE) {
+        pkt->pts += shift;
+    }
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        pkt->dts += shift;
+    }
+    av_packet_rescale_ts(pkt, time_base, stream->time_base);
+
+    int64_t last = out->last_dts[s];
+    if (last != AV_NOPTS_VALUE && (pkt->dts == AV_NOPTS_VALUE || pkt->dts <= last)) {
+        pkt->dts = last + 1;
+    }
+    if (pkt->pts != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE && pkt->pts < pkt->dts) {
+        pkt->pts = pkt->dts;
+    }
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        out->last_dts[s] = pkt->dts;
+    }
+    int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    if (ts != AV_NOPTS_VALUE) {
+        int64_t end = av_rescale_q(ts + FFMAX(pkt->duration, 0), stream->time_base, AV_TIME_BASE_Q);
+        out->end_us = FFMAX(out->end_us, end);
+    }
+
+    pkt->stream_index = stream->index;
+    pkt->pos = -1;
+    return av_interleaved_write_frame(out->ctx, pkt);
+}
+
+// How far the first video dts of in precedes start_us: the reorder delay of a stream
+// with B-frames. Rewinds the input afterwards.
+static int64_t video_lead_us(ConcatInput *in, int64_t start_us) {
+    int video_index = in->index[CONCAT_VIDEO];
+    AVPacket *pkt = ffmpegx_packet_get();
+    int64_t lead = 0;
+
+    if (!pkt) {
+        return 0;
+    }
+    // Video normally turns up within the first few packets
+    for (int i = 0; i < 64 && av_read_frame(in->ctx, pkt) >= 0; i++) {
+        int found = pkt->stream_index == video_index;
+        if (found && pkt->dts != AV_NOPTS_VALUE) {
+            AVRational time_base = in->ctx->streams[video_index]->time_base;
+            lead = FFMAX(start_us - av_rescale_q(pkt->dts, time_base, AV_TIME_BASE_Q), 0);
+        }
+        av_packet_unref(pkt);
+        if (found) {
+            break;
+        }
+    }
+    ffmpegx_packet_put(&pkt);
+    av_seek_frame(in->ctx, -1, start_us, AVSEEK_FLAG_BACKWARD);
+    return lead;
+}
+
+// Places in right after everything written so far. A copied input whose video starts
+// with a negative dts is moved late enough for that dts to follow the last one written.
+static void place_input(ConcatOutput *out, ConcatInput *in, int copy) {
+    int64_t start_us = in->ctx->start_time != AV_NOPTS_VALUE ? in->ctx->start_time : 0;
+    int64_t offset_us = out->end_us;
+
+    AVStream *video = out->streams[CONCAT_VIDEO];
+    if (copy && video && in->index[CONCAT_VIDEO] >= 0 && out->last_dts[CONCAT_VIDEO] != AV_NOPTS_VALUE) {
+        int64_t last_us = av_rescale_q(out->last_dts[CONCAT_VIDEO], video->time_base, AV_TIME_BASE_Q);
+        offset_us = FFMAX(offset_us, last_us + video_lead_us(in, start_us) + 1);
+    }
+    in->shift_us = offset_us - start_us;
+}
+
+static int copy_input(ConcatOutput *out, ConcatInput *in) {
+    AVPacket *pkt = ffmpegx_packet_get();
+    int ret;
+
+    if (!pkt) {
+        return AVERROR(ENOMEM);
+    }
+    place_input(out, in, 1);
+
+    while ((ret = av_read_frame(in->ctx, pkt)) >= 0) {
+        if (ffmpegx_cancelled()) {
+            av_packet_unref(pkt);
+            ret = AVERROR(ECANCELED);
+            break;
+        }
+        int s = output_slot(in, pkt->stream_index);
+        if (s < 0 || !out->streams[s]) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (s == CONCAT_VIDEO) {
+            ret = ffmpegx_splice_copied_packet(&out->splice, pkt);
+            if (ret < 0) {
+                av_packet_unref(pkt);
+                break;
+            }
+        }
+        ret = write_packet(out, in, pkt, s, in->ctx->streams[pkt->stream_index]->time_base);
+        if (ret < 0) {
+            LOGE("Error muxing packet");
+            break;
+        }
+    }
+    ffmpegx_packet_put(&pkt);
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
+static int open_decoder(const AVStream *stream, int threads, AVCodecContext **dec_ctx) {
+    const AVCodec *decoder = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!decoder) {
+        return AVERROR_DECODER_NOT_FOUND;
+    }
+    AVCodecContext *dec = avcodec_alloc_context3(decoder);
+    if (!dec) {
+        return AVERROR(ENOMEM);
+    }
+    int ret = avcodec_parameters_to_context(dec, stream->codecpar);
+    if (ret >= 0) {
+        dec->pkt_timebase = stream->time_base;
+        ret = ffmpegx_cache_open_codec(&dec, decoder, NULL, threads);
+    }
+    if (ret < 0) {
+        ffmpegx_cache_close_codec(&dec);
+        return ret;
+    }
+    *dec_ctx = dec;
+    return 0;
+}
+
+static int open_reencoder(const ConcatOutput *out, const ConcatInput *in, Reencoder *re) {
+    int ret;
+
+    re->frame = ffmpegx_frame_get();
+    re->filtered = ffmpegx_frame_get();
+    re->audio = ffmpegx_frame_get();
+    re->pkt = ffmpegx_packet_get();
+    if (!re->frame || !re->filtered || !re->audio || !re->pkt) {
+        return AVERROR(ENOMEM);
+    }
+
+    if (out->streams[CONCAT_VIDEO] && in->index[CONCAT_VIDEO] >= 0) {
+        AVStream *stream = in->ctx->streams[in->index[CONCAT_VIDEO]];
+        ret = open_decoder(stream, out->dec_threads, &re->dec[CONCAT_VIDEO]);
+        if (ret < 0) {
+            return ret;
+        }
+        // No global header: the output's extradata is the first input's, so parameter
+        // sets go in-band
+        ret = ffmpegx_splice_open_encoder(out->params[CONCAT_VIDEO], stream->time_base,
+                                          av_guess_frame_rate(in->ctx, stream, NULL), 0,
+                                          out->enc_threads, &re->enc[CONCAT_VIDEO]);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    if (out->streams[CONCAT_AUDIO]) {
+        const AVCodecParameters *par = out->params[CONCAT_AUDIO];
+        if (in->index[CONCAT_AUDIO] >= 0) {
+            ret = open_decoder(in->ctx->streams[in->index[CONCAT_AUDIO]], 1, &re->dec[CONCAT_AUDIO]);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        ret = ffmpegx_splice_open_encoder(par, (AVRational){ 1, par->sample_rate }, (AVRational){ 0, 1 },
+                                          out->ctx->oformat->flags & AVFMT_GLOBALHEADER, 1,
+                                          &re->enc[CONCAT_AUDIO]);
+        if (ret < 0) {
+            return ret;
+        }
+
+        AVCodecContext *enc = re->enc[CONCAT_AUDIO];
+        re->fifo = av_audio_fifo_alloc(enc->sample_fmt, enc->ch_layout.nb_channels, 1);
+        if (!re->fifo) {
+            return AVERROR(ENOMEM);
+        }
+        re->audio->format = enc->sample_fmt;
+        re->audio->sample_rate = enc->sample_rate;
+        re->audio->nb_samples = enc->frame_size > 0 ? enc->frame_size : 1024;
+        ret = av_channel_layout_copy(&re->audio->ch_layout, &enc->ch_layout);
+        if (ret >= 0) {
+            ret = av_frame_get_buffer(re->audio, 0);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        // Silence starts with the input; decoded audio at its first frame
+        int64_t start_us = in->ctx->start_time != AV_NOPTS_VALUE ? in->ctx->start_time : 0;
+        re->audio_pts = re->dec[CONCAT_AUDIO] ? AV_NOPTS_VALUE :
+                        av_rescale_q(start_us, AV_TIME_BASE_Q, enc->time_base);
+        re->video_end = re->audio_pts;
+    }
+    return 0;
+}
+
+static void close_reencoder(Reencoder *re) {
+    for (int s = 0; s < CONCAT_STREAMS; s++) {
+        ffmpegx_cache_close_codec(&re->dec[s]);
+        ffmpegx_cache_close_codec(&re->enc[s]);
+    }
+    avfilter_graph_free(&re->graph);
+    swr_free(&re->swr);
+    if (re->fifo) {
+        av_audio_fifo_free(re->fifo);
+        re->fifo = NULL;
+    }
+    ffmpegx_frame_put(&re->frame);
+    ffmpegx_frame_put(&re->filtered);
+    ffmpegx_frame_put(&re->audio);
+    ffmpegx_packet_put(&re->pkt);
+}
+
+// Sends frame (NULL to flush) to the encoder for stream s and writes its packets
+static int encode_write(ConcatOutput *out, const ConcatInput *in, Reencoder *re, int s,
+                        const AVFrame *frame) {
+    AVCodecContext *enc = re->enc[s];
+    int ret = avcodec_send_frame(enc, frame);
+    if (ret < 0) {
+        return ret;
+    }
+    while ((ret = avcodec_receive_packet(enc, re->pkt)) >= 0) {
+        if (s == CONCAT_VIDEO) {
+            ret = ffmpegx_splice_encoded_packet(&out->splice, re->pkt);
+            if (ret < 0) {
+                av_packet_unref(re->pkt);
+                return ret;
+            }
+        }
+        ret = write_packet(out, in, re->pkt, s, enc->time_base);
+        if (ret < 0) {
+            LOGE("Error muxing packet");
+            return ret;
+        }
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// Fits the input's frames into the output's frame size, aspect ratio and pixel format.
+// Built on the first decoded frame, whose format may differ from the stream's.
+static int init_scaler(const ConcatOutput *out, const ConcatInput *in, Reencoder *re, const AVFrame *frame) {
+    const AVCodecParameters *par = out->params[CONCAT_VIDEO];
+    AVRational time_base = in->ctx->streams[in->index[CONCAT_VIDEO]]->time_base;
+    AVRational sar = par->sample_aspect_ratio.num > 0 ? par->sample_aspect_ratio : (AVRational){ 1, 1 };
+    AVFilterInOut *inputs = avfilter_inout_alloc();
+    AVFilterInOut *outputs = avfilter_inout_alloc();
+    char args[512];
+    int ret;
+
+    re->graph = avfilter_graph_alloc();
+    if (!re->graph || !inputs || !outputs) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    snprintf(args, sizeof(args),
+             "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+             frame->width, frame->height, frame->format, time_base.num, time_base.den,
+             frame->sample_aspect_ratio.num, frame->sample_aspect_ratio.den);
+    ret = avfilter_graph_create_filter(&re->src, avfilter_get_by_name("buffer"), "in", args, NULL, re->graph);
+    if (ret < 0) {
+        LOGE("Cannot create buffer source");
+        goto end;
+    }
+    ret = avfilter_graph_create_filter(&re->sink, avfilter_get_by_name("buffersink"), "out", NULL, NULL,
+                                       re->graph);
+    if (ret < 0) {
+        LOGE("Cannot create buffer sink");
+        goto end;
+    }
+
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = re->src;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = re->sink;
+    snprintf(args, sizeof(args),
+             "scale=%d:%d:force_original_aspect_ratio=decrease:force_divisible_by=2,"
+             "pad=%d:%d:(ow-iw)/2:(oh-ih)/2,setsar=%d/%d,format=%s",
+             par->width, par->height, par->width, par->height, sar.num, sar.den,
+             av_get_pix_fmt_name(par->format));
+    ret = avfilter_graph_parse_ptr(re->graph, args, &inputs, &outputs, NULL);
+    if (ret >= 0) {
+        ret = avfilter_graph_config(re->graph, NULL);
+    }
+    if (ret < 0) {
+        LOGE("Cannot configure scaler: %s", args);
+    }
+
+end:
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    return ret;
+}
+
+// Runs a decoded frame (NULL to flush) through the scaler into the encoder
+static int filter_video(ConcatOutput *out, const ConcatInput *in, Reencoder *re, AVFrame *frame) {
+    int ret;
+
+    if (!re->graph) {
+        if (!frame) {
+            return 0;
+        }
+        ret = init_scaler(out, in, re, frame);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    ret = av_buffersrc_add_frame_flags(re->src, frame, AV_BUFFERSRC_FLAG_KEEP_REF);
+    if (ret < 0) {
+        return ret;
+    }
+    while ((ret = av_buffersink_get_frame(re->sink, re->filtered)) >= 0) {
+        re->filtered->pict_type = AV_PICTURE_TYPE_NONE;
+        ret = encode_write(out, in, re, CONCAT_VIDEO, re->filtered);
+        av_frame_unref(re->filtered);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// Encodes every whole encoder frame in the fifo; flushing also encodes the rest,
+// padded with silence
+static int drain_audio(ConcatOutput *out, const ConcatInput *in, Reencoder *re, int flush) {
+    AVCodecContext *enc = re->enc[CONCAT_AUDIO];
+    AVFrame *frame = re->audio;
+    int frame_size = frame->nb_samples;
+
+    while (av_audio_fifo_size(re->fifo) >= frame_size || (flush && av_audio_fifo_size(re->fifo) > 0)) {
+        // The encoder may still hold a reference to the previous frame
+        int ret = av_frame_make_writable(frame);
+        if (ret < 0) {
+            return ret;
+        }
+        int n = av_audio_fifo_read(re->fifo, (void **)frame->data, frame_size);
+        if (n < 0) {
+            return n;
+        }
+        if (n < frame_size) {
+            av_samples_set_silence(frame->data, n, frame_size - n, enc->ch_layout.nb_channels, enc->sample_fmt);
+        }
+        frame->pts = re->audio_pts;
+        re->audio_pts += frame_size;
+        ret = encode_write(out, in, re, CONCAT_AUDIO, frame);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+// Audio for an input without any, up to until (1/sample_rate)
+static int fill_silence(ConcatOutput *out, const ConcatInput *in, Reencoder *re, int64_t until) {
+    AVCodecContext *enc = re->enc[CONCAT_AUDIO];
+    AVFrame *frame = re->audio;
+
+    while (re->audio_pts + av_audio_fifo_size(re->fifo) < until) {
+        int n = FFMIN(frame->nb_samples, until - re->audio_pts - av_audio_fifo_size(re->fifo));
+        int ret = av_frame_make_writable(frame);
+        if (ret < 0) {
+            return ret;
+        }
+        av_samples_set_silence(frame->data, 0, n, enc->ch_layout.nb_channels, enc->sample_fmt);
+        if (av_audio_fifo_write(re->fifo, (void **)frame->data, n) < n) {
+            return AVERROR(ENOMEM);
+        }
+        ret = drain_audio(out, in, re, 0);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+// Converts a decoded frame (NULL to flush the resampler) into the fifo
+static int resample_audio(ConcatOutput *out, const ConcatInput *in, Reencoder *re, const AVFrame *frame) {
+    AVCodecContext *enc = re->enc[CONCAT_AUDIO];
+    int ret;
+
+    if (!re->swr) {
+        if (!frame) {
+            return 0;
+        }
+        ret = swr_alloc_set_opts2(&re->swr, &enc->ch_layout, enc->sample_fmt, enc->sample_rate,
+                                  &frame->ch_layout, frame->format, frame->sample_rate, 0, NULL);
+        if (ret >= 0) {
+            ret = swr_init(re->swr);
+        }
+        if (ret < 0) {
+            LOGE("Cannot create resampler");
+            return ret;
+        }
+    }
+    if (re->audio_pts == AV_NOPTS_VALUE) {
+        AVRational time_base = in->ctx->streams[in->index[CONCAT_AUDIO]]->time_base;
+        int64_t start_us = in->ctx->start_time != AV_NOPTS_VALUE ? in->ctx->start_time : 0;
+        re->audio_pts = frame->pts != AV_NOPTS_VALUE ? av_rescale_q(frame->pts, time_base, enc->time_base) :
+                        av_rescale_q(start_us, AV_TIME_BASE_Q, enc->time_base);
+    }
+
+    int max_samples = swr_get_out_samples(re->swr, frame ? frame->nb_samples : 0);
+    if (max_samples <= 0) {
+        return 0;
+    }
+    uint8_t **samples = NULL;
+    ret = av_samples_alloc_array_and_samples(&samples, NULL, enc->ch_layout.nb_channels, max_samples,
+                                             enc->sample_fmt, 0);
+    if (ret < 0) {
+        return ret;
+    }
+    int n = swr_convert(re->swr, samples, max_samples,
+                        frame ? (const uint8_t **)frame->extended_data : NULL, frame ? frame->nb_samples : 0);
+    ret = n;
+    if (n > 0 && av_audio_fifo_write(re->fifo, (void **)samples, n) < n) {
+        ret = AVERROR(ENOMEM);
+    }
+    av_freep(&samples[0]);
+    av_freep(&samples);
+    return ret < 0 ? ret : drain_audio(out, in, re, 0);
+}
+
+static int process_frame(ConcatOutput *out, const ConcatInput *in, Reencoder *re, int s, AVFrame *frame) {
+    if (s == CONCAT_AUDIO) {
+        return resample_audio(out, in, re, frame);
+    }
+
+    int ret = filter_video(out, in, re, frame);
+    if (ret < 0 || !re->enc[CONCAT_AUDIO] || frame->pts == AV_NOPTS_VALUE) {
+        return ret;
+    }
+    AVRational time_base = in->ctx->streams[in->index[CONCAT_VIDEO]]->time_base;
+    int64_t end = av_rescale_q(frame->pts + FFMAX(frame->duration, 0), time_base,
+                               re->enc[CONCAT_AUDIO]->time_base);
+    re->video_end = FFMAX(re->video_end, end);
+    // Keep the silence level with the video, or the muxer would queue all of it
+    return re->dec[CONCAT_AUDIO] ? 0 : fill_silence(out, in, re, re->video_end);
+}
+
+// Sends pkt (NULL to flush) to the decoder for stream s and processes its frames
+static int decode_packet(ConcatOutput *out, const ConcatInput *in, Reencoder *re, int s,
+                         const AVPacket *pkt) {
+    int ret = avcodec_send_packet(re->dec[s], pkt);
+    if (ret < 0 && ret != AVERROR_INVALIDDATA) {
+        return ret;
+    }
+    while ((ret = avcodec_receive_frame(re->dec[s], re->frame)) >= 0) {
+        re->frame->pts = re->frame->best_effort_timestamp;
+        ret = process_frame(out, in, re, s, re->frame);
+        av_frame_unref(re->frame);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+static int reencode_input(ConcatOutput *out, ConcatInput *in) {
+    Reencoder re = { .audio_pts = AV_NOPTS_VALUE };
+    AVPacket *pkt = ffmpegx_packet_get();
+    int ret;
+
+    if (!pkt) {
+        return AVERROR(ENOMEM);
+    }
+    ret = open_reencoder(out, in, &re);
+    if (ret < 0) {
+        goto end;
+    }
+    place_input(out, in, 0);
+
+    while ((ret = av_read_frame(in->ctx, pkt)) >= 0) {
+        if (ffmpegx_cancelled()) {
+            av_packet_unref(pkt);
+            ret = AVERROR(ECANCELED);
+            goto end;
+        }
+        int s = output_slot(in, pkt->stream_index);
+        ret = s >= 0 && re.dec[s] ? decode_packet(out, in, &re, s, pkt) : 0;
+        av_packet_unref(pkt);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+    if (ret != AVERROR_EOF) {
+        goto end;
+    }
+
+    // Flush decoders, then the scaler, resampler and encoders behind them
+    ret = 0;
+    for (int s = 0; s < CONCAT_STREAMS && ret >= 0; s++) {
+        if (re.dec[s]) {
+            ret = decode_packet(out, in, &re, s, NULL);
+        }
+    }
+    if (ret >= 0 && re.enc[CONCAT_VIDEO]) {
+        ret = filter_video(out, in, &re, NULL);
+        if (ret >= 0) {
+            ret = encode_write(out, in, &re, CONCAT_VIDEO, NULL);
+        }
+    }
+    if (ret >= 0 && re.enc[CONCAT_AUDIO] && re.audio_pts != AV_NOPTS_VALUE) {
+        ret = re.dec[CONCAT_AUDIO] ? resample_audio(out, in, &re, NULL) :
+                                     fill_silence(out, in, &re, re.video_end);
+        if (ret >= 0) {
+            ret = drain_audio(out, in, &re, 1);
+        }
+        if (ret >= 0) {
+            ret = encode_write(out, in, &re, CONCAT_AUDIO, NULL);
+        }
+    }
+
+end:
+    close_reencoder(&re);
+    ffmpegx_packet_put(&pkt);
+    return ret;
+}
+
+int ffmpegx_concat(const char *const *inputs, int count, const char *output_file, int thread_budget) {
+    ConcatOutput out = { .last_dts = { AV_NOPTS_VALUE, AV_NOPTS_VALUE } };
+    ConcatInput in = { 0 };
+    uint8_t *copy = NULL;
+    int copied = 0;
+    int ret;
+
+    if (count < 1) {
+        return AVERROR(EINVAL);
+    }
+    ffmpegx_split_thread_budget(thread_budget, &out.dec_threads, &out.enc_threads);
+
+    // The first input decides the output's streams and is always copied
+    ret = open_concat_input(&in, inputs[0]);
+    if (ret < 0) {
+        goto end;
+    }
+    for (int s = 0; s < CONCAT_STREAMS; s++) {
+        if (in.index[s] < 0) {
+            continue;
+        }
+        out.params[s] = avcodec_parameters_alloc();
+        if (!out.params[s]) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        ret = avcodec_parameters_copy(out.params[s], in.ctx->streams[in.index[s]]->codecpar);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+    if (!out.params[CONCAT_VIDEO] && !out.params[CONCAT_AUDIO]) {
+        LOGE("No audio or video in %s", inputs[0]);
+        ret = AVERROR_STREAM_NOT_FOUND;
+        goto end;
+    }
+    if (out.params[CONCAT_VIDEO]) {
+        ret = ffmpegx_splice_init(&out.splice, out.params[CONCAT_VIDEO]);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+
+    // Everything that would need a re-encode is checked before the output exists
+    copy = av_malloc(count);
+    if (!copy) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    copy[0] = 1;
+    for (int i = 1; i < count; i++) {
+        ret = plan_input(&out, inputs[i], &copy[i]);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+
+    ret = open_output(&out, output_file, &in);
+    if (ret < 0) {
+        goto end;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (i > 0) {
+            ret = open_concat_input(&in, inputs[i]);
+            if (ret < 0) {
+                goto end;
+            }
+        }
+        int64_t start = ffmpegx_now_ns();
+        ret = copy[i] ? copy_input(&out, &in) : reencode_input(&out, &in);
+        ffmpegx_trace_event(copy[i] ? "concat-copy" : "concat-reencode", start, ffmpegx_now_ns());
+        ffmpegx_cache_close_input(&in.ctx);
+        if (ret < 0) {
+            LOGE("Error joining %s", inputs[i]);
+            goto end;
+        }
+        copied += copy[i];
+    }
+
+    ret = av_write_trailer(out.ctx);
+    if (ret >= 0) {
+        LOGI("Joined %d files into %s: %d copied, %d re-encoded", count, output_file, copied,
+             count - copied);
+    }
+
+end:
+    ffmpegx_cache_close_input(&in.ctx);
+    if (out.ctx) {
+        if (!(out.ctx->oformat->flags & AVFMT_NOFILE)) {
+            ffmpegx_close_output(out.ctx);
+        }
+        avformat_free_context(out.ctx);
+    }
+    for (int s = 0; s < CONCAT_STREAMS; s++) {
+        avcodec_parameters_free(&out.params[s]);
+    }
+    ffmpegx_splice_uninit(&out.splice);
+    av_free(copy);
+    return ret;
+}
+
+#endif // HAVE_FFMPEG_STATIC
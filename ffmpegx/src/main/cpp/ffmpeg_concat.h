@@ -0,0 +1,40 @@
+/**
+ * Native concat
+ * Joins files end to end at stream-copy speed: inputs whose streams match the
+ * first input's are copied packet by packet onto one timeline, and only the
+ * inputs that differ are re-encoded to match
+ */
+
+#ifndef FFMPEGX_CONCAT_H
+#define FFMPEGX_CONCAT_H
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reads the files of an ffconcat list ("file 'path'" lines, as written for ffmpeg's
+// concat demuxer); relative paths are resolved against the list's directory.
+// "ffconcat version" and "duration" lines are ignored, other directives (inpoint,
+// outpoint, ...) fail with AVERROR_PATCHWELCOME. Free with ffmpegx_concat_free_list().
+int ffmpegx_concat_read_list(const char *list_path, char ***files, int *count);
+
+void ffmpegx_concat_free_list(char **files, int count);
+
+// Joins inputs into output_file, which gets the first input's best video and audio
+// streams. A later input whose corresponding streams have the same codec parameters
+// is stream-copied; any other is decoded, scaled/padded and resampled to the first
+// input's format and re-encoded (ffmpeg_splice.h). An input without audio adds
+// silence, one without video leaves a gap in the video. Returns 0 or an AVERROR code;
+// AVERROR_DECODER_NOT_FOUND, AVERROR_ENCODER_NOT_FOUND and AVERROR_PATCHWELCOME mean
+// an input cannot be made to match, and are returned before output_file is created.
+int ffmpegx_concat(const char *const *inputs, int count, const char *output_file, int thread_budget);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_CONCAT_H
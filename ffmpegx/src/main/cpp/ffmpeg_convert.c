@@ -0,0 +1,138 @@
+/**
+ * Cached pixel format / size conversion
+ * Replaces per-frame sws_getContext()/av_frame_get_buffer() in the transcode loops
+ */
+
+#include <android/log.h>
+#include <string.h>
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_convert.h"
+#include "ffmpeg_pool.h"
+#include "ffmpeg_session.h"
+#include "ffmpeg_trace.h"
+#include "libavutil/error.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/pixdesc.h"
+#include "libswscale/swscale.h"
+
+#define LOG_TAG "FFmpegConvert"
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+// Same alignment av_frame_get_buffer() uses on SIMD-capable targets
+#define CONVERT_ALIGN 32
+
+void ffmpegx_converter_init(FFmpegxConverter *conv, int flags) {
+    memset(conv, 0, sizeof(*conv));
+    conv->flags = flags;
+    conv->pool_format = AV_PIX_FMT_NONE;
+}
+
+void ffmpegx_converter_uninit(FFmpegxConverter *conv) {
+    sws_freeContext(conv->sws_ctx);
+    conv->sws_ctx = NULL;
+    // Frames still held elsewhere keep the pool alive until they are released
+    av_buffer_pool_uninit(&conv->pool);
+}
+
+static int ensure_pool(FFmpegxConverter *conv, int width, int height, enum AVPixelFormat format) {
+    if (conv->pool && conv->pool_width == width && conv->pool_height == height &&
+        conv->pool_format == format) {
+        return 0;
+    }
+
+    int size = av_image_get_buffer_size(format, width, height, CONVERT_ALIGN);
+    if (size < 0) {
+        return size;
+    }
+
+    av_buffer_pool_uninit(&conv->pool);
+    conv->pool = av_buffer_pool_init(size, NULL);
+    if (!conv->pool) {
+        return AVERROR(ENOMEM);
+    }
+    conv->pool_width = width;
+    conv->pool_height = height;
+    conv->pool_format = format;
+    conv->pool_buffer_size = size;
+
+    LOGD("Conversion pool: %dx%d %s, %d bytes per frame", width, height,
+         av_get_pix_fmt_name(format), size);
+    return 0;
+}
+
+int ffmpegx_converter_convert_into(FFmpegxConverter *conv, const AVFrame *src,
+                                   uint8_t *const dst_data[4], const int dst_linesize[4],
+                                   int dst_width, int dst_height, enum AVPixelFormat dst_format) {
+    // Only rebuilt when the source geometry or format changes mid-stream
+    conv->sws_ctx = sws_getCachedContext(conv->sws_ctx,
+                                         src->width, src->height, src->format,
+                                         dst_width, dst_height, dst_format,
+                                         conv->flags, NULL, NULL, NULL);
+    if (!conv->sws_ctx) {
+        LOGE("Could not create scaling context");
+        return AVERROR(EINVAL);
+    }
+
+    int64_t start = ffmpegx_now_ns();
+    sws_scale(conv->sws_ctx, (const uint8_t * const *)src->data, src->linesize,
+              0, src->height, dst_data, dst_linesize);
+    ffmpegx_stats_add(ffmpegx_session_stats(ffmpegx_session_current()), FFMPEGX_STAGE_SCALE,
+                      ffmpegx_trace_span(FFMPEGX_STAGE_SCALE, start));
+    return 0;
+}
+
+int ffmpegx_converter_convert(FFmpegxConverter *conv, const AVFrame *src,
+                              int dst_width, int dst_height, enum AVPixelFormat dst_format,
+                              AVFrame **dst) {
+    AVFrame *frame = NULL;
+    int ret;
+
+    *dst = NULL;
+
+    ret = ensure_pool(conv, dst_width, dst_height, dst_format);
+    if (ret < 0) {
+        return ret;
+    }
+
+    frame = ffmpegx_frame_get();
+    if (!frame) {
+        return AVERROR(ENOMEM);
+    }
+
+    frame->buf[0] = av_buffer_pool_get(conv->pool);
+    if (!frame->buf[0]) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    ret = av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data,
+                               dst_format, dst_width, dst_height, CONVERT_ALIGN);
+    if (ret < 0) {
+        goto fail;
+    }
+    frame->format = dst_format;
+    frame->width = dst_width;
+    frame->height = dst_height;
+
+    ret = av_frame_copy_props(frame, src);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    ret = ffmpegx_converter_convert_into(conv, src, frame->data, frame->linesize,
+                                         dst_width, dst_height, dst_format);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    *dst = frame;
+    return 0;
+
+fail:
+    ffmpegx_frame_put(&frame);
+    return ret;
+}
+
+#endif // HAVE_FFMPEG_STATIC
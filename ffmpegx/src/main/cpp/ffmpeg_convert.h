@@ -0,0 +1,48 @@
+/**
+ * Cached pixel format / size conversion
+ * Keeps one SwsContext per job, rebuilt only when the source geometry or format
+ * changes, and hands out converted frames from a buffer pool
+ */
+
+#ifndef FFMPEGX_CONVERT_H
+#define FFMPEGX_CONVERT_H
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavutil/buffer.h"
+#include "libavutil/frame.h"
+#include "libavutil/pixfmt.h"
+
+typedef struct FFmpegxConverter {
+    struct SwsContext *sws_ctx;
+    int flags;
+
+    // Geometry the pool buffers were sized for
+    AVBufferPool *pool;
+    int pool_width;
+    int pool_height;
+    enum AVPixelFormat pool_format;
+    int pool_buffer_size;
+} FFmpegxConverter;
+
+// flags are the swscale algorithm flags (SWS_BILINEAR, ...)
+void ffmpegx_converter_init(FFmpegxConverter *conv, int flags);
+void ffmpegx_converter_uninit(FFmpegxConverter *conv);
+
+// Converts src into a pooled frame (ffmpeg_pool.h) backed by a pooled buffer; props
+// such as pts are copied from src. The frame may be passed on (e.g. to an encoder)
+// and its buffer returns to the pool once the last reference is dropped; hand the
+// frame itself back with ffmpegx_frame_put().
+int ffmpegx_converter_convert(FFmpegxConverter *conv, const AVFrame *src,
+                              int dst_width, int dst_height, enum AVPixelFormat dst_format,
+                              AVFrame **dst);
+
+// Scales src straight into caller-owned planes, e.g. a region of a larger image
+// or a buffer shared with Java; nothing is allocated
+int ffmpegx_converter_convert_into(FFmpegxConverter *conv, const AVFrame *src,
+                                   uint8_t *const dst_data[4], const int dst_linesize[4],
+                                   int dst_width, int dst_height, enum AVPixelFormat dst_format);
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_CONVERT_H
@@ -0,0 +1,197 @@
+/**
+ * File descriptor I/O
+ * AVIOContext callbacks over a descriptor the context owns (a duplicate of the
+ * caller's). Pipes and sockets are read and written in sequence and are not seekable.
+ */
+
+#include <android/log.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ffmpeg_fdio.h"
+
+int ffmpegx_fd_url(const char *url) {
+    size_t prefix = strlen(FFMPEGX_FD_URL_PREFIX);
+    if (!url || strncmp(url, FFMPEGX_FD_URL_PREFIX, prefix) != 0 || !isdigit((unsigned char)url[prefix])) {
+        return -1;
+    }
+
+    char *end;
+    errno = 0;
+    long fd = strtol(url + prefix, &end, 10);
+    if (errno || fd > INT_MAX || (*end && *end != '.')) {
+        return -1;
+    }
+    return (int)fd;
+}
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_session.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+
+#define LOG_TAG "FFmpegFdIO"
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+// Same as avio_open()'s default for local files
+#define FDIO_BUFFER_SIZE (64 * 1024)
+
+// write_packet takes a const buffer from libavformat 61 on
+#if !defined(FF_API_AVIO_WRITE_NONCONST) || FF_API_AVIO_WRITE_NONCONST
+typedef uint8_t FdIOWriteBuffer;
+#else
+typedef const uint8_t FdIOWriteBuffer;
+#endif
+
+typedef struct FdIO {
+    int fd;
+    int seekable;
+    int64_t pos;        // offset of the next pread()/pwrite(), from the start of the file
+} FdIO;
+
+static int fdio_read(void *opaque, uint8_t *buf, int size) {
+    FdIO *io = opaque;
+    ssize_t n;
+
+    // Blocking reads from a provider's pipe are not covered by the interrupt callback
+    if (ffmpegx_cancelled()) {
+        return AVERROR_EXIT;
+    }
+    do {
+        n = io->seekable ? pread(io->fd, buf, size, io->pos) : read(io->fd, buf, size);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        return AVERROR(errno);
+    }
+    if (n == 0) {
+        return AVERROR_EOF;
+    }
+    io->pos += n;
+    return (int)n;
+}
+
+static int fdio_write(void *opaque, FdIOWriteBuffer *buf, int size) {
+    FdIO *io = opaque;
+    int done = 0;
+
+    if (ffmpegx_cancelled()) {
+        return AVERROR_EXIT;
+    }
+    while (done < size) {
+        ssize_t n = io->seekable ? pwrite(io->fd, buf + done, size - done, io->pos)
+                                 : write(io->fd, buf + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return AVERROR(errno);
+        }
+        done += n;
+        io->pos += n;
+    }
+    return size;
+}
+
+static int64_t fdio_seek(void *opaque, int64_t offset, int whence) {
+    FdIO *io = opaque;
+    struct stat st;
+    int64_t pos;
+
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE || whence == SEEK_END) {
+        if (fstat(io->fd, &st) != 0) {
+            return AVERROR(errno);
+        }
+        if (whence == AVSEEK_SIZE) {
+            return st.st_size;
+        }
+        pos = st.st_size + offset;
+    } else if (whence == SEEK_CUR) {
+        pos = io->pos + offset;
+    } else if (whence == SEEK_SET) {
+        pos = offset;
+    } else {
+        return AVERROR(EINVAL);
+    }
+
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+    io->pos = pos;
+    return pos;
+}
+
+int ffmpegx_fdio_open(AVIOContext **pb, int fd, int flags) {
+    int write_flag = (flags & AVIO_FLAG_WRITE) != 0;
+    uint8_t *buffer = NULL;
+    struct stat st;
+    int ret;
+
+    *pb = NULL;
+    FdIO *io = av_mallocz(sizeof(*io));
+    buffer = av_malloc(FDIO_BUFFER_SIZE);
+    if (!io || !buffer) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    // Our own descriptor, so the caller may close its ParcelFileDescriptor at any time
+    io->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (io->fd < 0) {
+        ret = AVERROR(errno);
+        LOGE("Cannot duplicate descriptor %d: %s", fd, strerror(errno));
+        goto fail;
+    }
+    io->seekable = fstat(io->fd, &st) == 0 && S_ISREG(st.st_mode) && lseek(io->fd, 0, SEEK_CUR) >= 0;
+
+    *pb = avio_alloc_context(buffer, FDIO_BUFFER_SIZE, write_flag, io,
+                             write_flag ? NULL : fdio_read, write_flag ? fdio_write : NULL,
+                             io->seekable ? fdio_seek : NULL);
+    if (!*pb) {
+        close(io->fd);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    av_free(buffer);
+    av_free(io);
+    return ret;
+}
+
+int ffmpegx_fdio_is(const AVIOContext *pb) {
+    return pb && (pb->read_packet == fdio_read || pb->write_packet == fdio_write);
+}
+
+int ffmpegx_fdio_close(AVIOContext **pb) {
+    AVIOContext *s = pb ? *pb : NULL;
+    if (!s) {
+        return 0;
+    }
+
+    FdIO *io = s->opaque;
+    if (s->write_flag) {
+        avio_flush(s);
+    }
+    int ret = s->error;
+
+    // avio may have swapped the buffer for one of its own size
+    av_freep(&s->buffer);
+    avio_context_free(pb);
+    if (close(io->fd) != 0 && ret >= 0) {
+        ret = AVERROR(errno);
+    }
+    av_free(io);
+    return ret < 0 ? ret : 0;
+}
+
+#endif // HAVE_FFMPEG_STATIC
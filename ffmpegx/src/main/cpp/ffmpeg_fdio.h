@@ -0,0 +1,45 @@
+/**
+ * File descriptor I/O
+ * "fd:<n>" URLs read and write a descriptor handed over from Java, such as a
+ * ParcelFileDescriptor of a content:// URI, through a custom AVIOContext, so
+ * nothing is copied to a temporary file first. Seekable descriptors are accessed
+ * with pread()/pwrite() at each context's own offset, which lets several contexts
+ * (the thumbnail workers, say) share one descriptor.
+ */
+
+#ifndef FFMPEGX_FDIO_H
+#define FFMPEGX_FDIO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// "fd:42", optionally followed by an extension naming the format for muxers that
+// are picked by file name: "fd:42.mp4"
+#define FFMPEGX_FD_URL_PREFIX "fd:"
+
+// The descriptor of an "fd:<n>" URL, -1 for any other URL
+int ffmpegx_fd_url(const char *url);
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavformat/avio.h"
+
+// Custom AVIOContext on a duplicate of fd, which the caller still owns and may
+// close right away. flags is AVIO_FLAG_READ or AVIO_FLAG_WRITE.
+int ffmpegx_fdio_open(AVIOContext **pb, int fd, int flags);
+
+// Whether pb comes from ffmpegx_fdio_open()
+int ffmpegx_fdio_is(const AVIOContext *pb);
+
+// Flushes and frees pb and closes its descriptor. Accepts NULL, sets *pb to NULL.
+// Returns 0 or the first write error.
+int ffmpegx_fdio_close(AVIOContext **pb);
+
+#endif // HAVE_FFMPEG_STATIC
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FFMPEGX_FDIO_H
@@ -0,0 +1,458 @@
+/**
+ * Keyframe index
+ * Sidecar layout: an IndexHeader keyed by the media file's size and mtime, then
+ * per keyframe the zigzag LEB128 deltas of pts and byte offset. A typical index
+ * is 3-5 bytes per keyframe. Files are written to a temporary name and renamed.
+ */
+
+#include <android/log.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavformat/avformat.h"
+#include "libavutil/crc.h"
+
+#include "ffmpeg_fdio.h"
+#include "ffmpeg_index.h"
+#include "ffmpeg_pool.h"
+#include "ffmpeg_session.h"
+
+#define LOG_TAG "FFmpegIndex"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+#define INDEX_MAGIC 0x494b5846      // "FXKI"
+#define INDEX_VERSION 1
+#define INDEX_SUFFIX ".ffxidx"
+// Two varints of at most 10 bytes each per keyframe
+#define MAX_ENTRY_BYTES 20
+
+typedef struct IndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    int64_t file_size;
+    int64_t file_mtime_ns;
+    int32_t stream_index;
+    int32_t time_base_num;
+    int32_t time_base_den;
+    int32_t count;
+    int64_t end_pts;
+    uint32_t payload_size;
+    uint32_t payload_crc;
+} IndexHeader;
+
+static pthread_mutex_t dir_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char *index_dir;
+
+int ffmpegx_keyframe_index_set_dir(const char *dir) {
+    char *copy = NULL;
+
+    if (dir) {
+        if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+            int err = errno;
+            LOGW("Could not create index directory %s: %s", dir, strerror(err));
+            return AVERROR(err);
+        }
+        if (!(copy = strdup(dir))) {
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    pthread_mutex_lock(&dir_mutex);
+    free(index_dir);
+    index_dir = copy;
+    pthread_mutex_unlock(&dir_mutex);
+    return 0;
+}
+
+static int sidecar_path(const char *path, char *out, size_t out_size) {
+    int len;
+
+    pthread_mutex_lock(&dir_mutex);
+    if (index_dir) {
+        // FNV-1a of the media path
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+            hash = (hash ^ *p) * 0x100000001b3ULL;
+        }
+        len = snprintf(out, out_size, "%s/%016" PRIx64 INDEX_SUFFIX, index_dir, hash);
+    } else {
+        len = snprintf(out, out_size, "%s" INDEX_SUFFIX, path);
+    }
+    pthread_mutex_unlock(&dir_mutex);
+    return len > 0 && (size_t)len < out_size;
+}
+
+void ffmpegx_keyframe_index_free(FFmpegxKeyframeIndex *index) {
+    av_freep(&index->pts);
+    av_freep(&index->pos);
+    index->count = 0;
+}
+
+int ffmpegx_keyframe_index_copy(FFmpegxKeyframeIndex *dst, const FFmpegxKeyframeIndex *src) {
+    *dst = *src;
+    dst->pts = NULL;
+    dst->pos = NULL;
+    if (src->count > 0) {
+        dst->pts = av_memdup(src->pts, (size_t)src->count * sizeof(*src->pts));
+        dst->pos = av_memdup(src->pos, (size_t)src->count * sizeof(*src->pos));
+        if (!dst->pts || !dst->pos) {
+            ffmpegx_keyframe_index_free(dst);
+            return AVERROR(ENOMEM);
+        }
+    }
+    return 0;
+}
+
+static int index_append(FFmpegxKeyframeIndex *index, int *capacity, int64_t pts, int64_t pos) {
+    if (index->count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 64;
+        int64_t *new_pts = av_realloc_array(index->pts, new_capacity, sizeof(*new_pts));
+        if (!new_pts) {
+            return AVERROR(ENOMEM);
+        }
+        index->pts = new_pts;
+        int64_t *new_pos = av_realloc_array(index->pos, new_capacity, sizeof(*new_pos));
+        if (!new_pos) {
+            return AVERROR(ENOMEM);
+        }
+        index->pos = new_pos;
+        *capacity = new_capacity;
+    }
+    index->pts[index->count] = pts;
+    index->pos[index->count] = pos;
+    index->count++;
+    return 0;
+}
+
+int ffmpegx_keyframe_index_build(const char *path, FFmpegxKeyframeIndex *index) {
+    AVFormatContext *input_ctx = NULL;
+    AVPacket *pkt = NULL;
+    int capacity = 0;
+    int ret;
+
+    memset(index, 0, sizeof(*index));
+    index->end_pts = AV_NOPTS_VALUE;
+
+    ret = ffmpegx_open_input(&input_ctx, path, NULL, NULL);
+    if (ret < 0) {
+        LOGE("Cannot open input file: %s", path);
+        return ret;
+    }
+
+    // Container headers are enough to find the video stream, no need to probe by decoding
+    int video_index = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (video_index < 0) {
+        LOGE("No video stream found");
+        ret = video_index;
+        goto end;
+    }
+    for (int i = 0; i < input_ctx->nb_streams; i++) {
+        if (i != video_index) {
+            input_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    index->stream_index = video_index;
+    index->time_base = input_ctx->streams[video_index]->time_base;
+
+    pkt = ffmpegx_packet_get();
+    if (!pkt) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    while (!ffmpegx_cancelled() && (ret = av_read_frame(input_ctx, pkt)) >= 0) {
+        if (pkt->stream_index == video_index && pkt->pts != AV_NOPTS_VALUE) {
+            int64_t end = pkt->pts + (pkt->duration > 0 ? pkt->duration : 0);
+            if (index->end_pts == AV_NOPTS_VALUE || end > index->end_pts) {
+                index->end_pts = end;
+            }
+
+            if ((pkt->flags & AV_PKT_FLAG_KEY) &&
+                (index->count == 0 || pkt->pts > index->pts[index->count - 1])) {
+                ret = index_append(index, &capacity, pkt->pts, pkt->pos);
+                if (ret < 0) {
+                    av_packet_unref(pkt);
+                    goto end;
+                }
+            }
+        }
+        av_packet_unref(pkt);
+    }
+    if (ffmpegx_cancelled()) {
+        ret = AVERROR(ECANCELED);
+        goto end;
+    }
+    ret = ret == AVERROR_EOF ? 0 : ret;
+
+    LOGD("Found %d keyframes in %s", index->count, path);
+
+end:
+    if (ret < 0) {
+        ffmpegx_keyframe_index_free(index);
+    }
+    ffmpegx_packet_put(&pkt);
+    ffmpegx_close_input(&input_ctx);
+    return ret;
+}
+
+int ffmpegx_keyframe_index_from_demuxer(AVFormatContext *ctx, int stream_index,
+                                        FFmpegxKeyframeIndex *index) {
+    AVStream *stream = ctx->streams[stream_index];
+    int entries = avformat_index_get_entries_count(stream);
+    int capacity = 0;
+
+    memset(index, 0, sizeof(*index));
+    index->stream_index = stream_index;
+    index->time_base = stream->time_base;
+    index->end_pts = AV_NOPTS_VALUE;
+
+    for (int i = 0; i < entries; i++) {
+        const AVIndexEntry *entry = avformat_index_get_entry(stream, i);
+        if (!(entry->flags & AVINDEX_KEYFRAME) ||
+            (index->count > 0 && entry->timestamp <= index->pts[index->count - 1])) {
+            continue;
+        }
+        int ret = index_append(index, &capacity, entry->timestamp, entry->pos);
+        if (ret < 0) {
+            ffmpegx_keyframe_index_free(index);
+            return ret;
+        }
+    }
+    return index->count > 0 ? 0 : AVERROR(ENOENT);
+}
+
+static uint8_t *put_varint(uint8_t *p, int64_t value) {
+    // Zigzag keeps small negative deltas (unknown offsets) short
+    uint64_t v = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, int64_t *value) {
+    uint64_t v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        v |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static int64_t mtime_ns(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+static int read_sidecar(const char *file, const struct stat *st, FFmpegxKeyframeIndex *index) {
+    IndexHeader header;
+    uint8_t *payload = NULL;
+    int ret = AVERROR_INVALIDDATA;
+
+    FILE *in = fopen(file, "rb");
+    if (!in) {
+        return AVERROR(errno);
+    }
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        header.magic != INDEX_MAGIC || header.version != INDEX_VERSION ||
+        header.file_size != st->st_size || header.file_mtime_ns != mtime_ns(st) ||
+        header.count < 0 || header.time_base_num <= 0 || header.time_base_den <= 0 ||
+        header.payload_size > (uint32_t)header.count * MAX_ENTRY_BYTES) {
+        goto end;
+    }
+
+    payload = av_malloc(header.payload_size ? header.payload_size : 1);
+    if (!payload) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if (fread(payload, 1, header.payload_size, in) != header.payload_size ||
+        av_crc(av_crc_get_table(AV_CRC_32_IEEE), 0, payload, header.payload_size) != header.payload_crc) {
+        goto end;
+    }
+
+    memset(index, 0, sizeof(*index));
+    index->stream_index = header.stream_index;
+    index->time_base = (AVRational){header.time_base_num, header.time_base_den};
+    index->end_pts = header.end_pts;
+    if (header.count > 0) {
+        index->pts = av_malloc_array(header.count, sizeof(*index->pts));
+        index->pos = av_malloc_array(header.count, sizeof(*index->pos));
+        if (!index->pts || !index->pos) {
+            ffmpegx_keyframe_index_free(index);
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+
+    const uint8_t *p = payload;
+    const uint8_t *payload_end = payload + header.payload_size;
+    int64_t pts = 0, pos = 0;
+    for (int i = 0; i < header.count; i++) {
+        int64_t pts_delta, pos_delta;
+        if (!(p = get_varint(p, payload_end, &pts_delta)) ||
+            !(p = get_varint(p, payload_end, &pos_delta)) ||
+            (i > 0 && pts_delta <= 0)) {
+            ffmpegx_keyframe_index_free(index);
+            goto end;
+        }
+        pts += pts_delta;
+        pos += pos_delta;
+        index->pts[i] = pts;
+        index->pos[i] = pos;
+    }
+    index->count = header.count;
+    ret = 0;
+
+end:
+    av_free(payload);
+    fclose(in);
+    return ret;
+}
+
+static int write_sidecar(const char *file, const struct stat *st, const FFmpegxKeyframeIndex *index) {
+    char tmp[4096];
+    uint8_t *payload;
+    uint8_t *p;
+    int ret = 0;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", file) >= (int)sizeof(tmp)) {
+        return AVERROR(ENAMETOOLONG);
+    }
+    payload = av_malloc((size_t)index->count * MAX_ENTRY_BYTES + 1);
+    if (!payload) {
+        return AVERROR(ENOMEM);
+    }
+
+    p = payload;
+    for (int i = 0; i < index->count; i++) {
+        p = put_varint(p, index->pts[i] - (i ? index->pts[i - 1] : 0));
+        p = put_varint(p, index->pos[i] - (i ? index->pos[i - 1] : 0));
+    }
+
+    IndexHeader header = {
+        .magic = INDEX_MAGIC,
+        .version = INDEX_VERSION,
+        .file_size = st->st_size,
+        .file_mtime_ns = mtime_ns(st),
+        .stream_index = index->stream_index,
+        .time_base_num = index->time_base.num,
+        .time_base_den = index->time_base.den,
+        .count = index->count,
+        .end_pts = index->end_pts,
+        .payload_size = (uint32_t)(p - payload),
+    };
+    header.payload_crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), 0, payload, header.payload_size);
+
+    int fd = mkstemp(tmp);
+    FILE *out = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!out) {
+        ret = AVERROR(errno);
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        av_free(payload);
+        return ret;
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+             fwrite(payload, 1, header.payload_size, out) == header.payload_size;
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(tmp, file) != 0) {
+        ret = AVERROR(EIO);
+        unlink(tmp);
+    }
+    av_free(payload);
+    return ret;
+}
+
+int ffmpegx_keyframe_index_load(const char *path, FFmpegxKeyframeIndex *index) {
+    char file[4096];
+    struct stat st;
+    int ret;
+
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || !sidecar_path(path, file, sizeof(file))) {
+        return ffmpegx_keyframe_index_build(path, index);
+    }
+
+    if (read_sidecar(file, &st, index) >= 0) {
+        LOGD("Loaded %d keyframes of %s from %s", index->count, path, file);
+        return 0;
+    }
+
+    ret = ffmpegx_keyframe_index_build(path, index);
+    if (ret < 0) {
+        return ret;
+    }
+    // The index is still usable when it cannot be persisted (read-only media directory)
+    if (write_sidecar(file, &st, index) < 0) {
+        LOGW("Could not write keyframe index %s", file);
+    }
+    return 0;
+}
+
+int ffmpegx_keyframe_index_get(AVFormatContext *ctx, const char *path, int stream_index,
+                               FFmpegxKeyframeIndex *index) {
+    if (ffmpegx_keyframe_index_from_demuxer(ctx, stream_index, index) >= 0) {
+        return 0;
+    }
+    // A descriptor has no sidecar, so its scan would be repeated by every job
+    if (ffmpegx_fd_url(path) >= 0) {
+        memset(index, 0, sizeof(*index));
+        return AVERROR(ENOENT);
+    }
+
+    int ret = ffmpegx_keyframe_index_load(path, index);
+    if (ret >= 0 && index->stream_index != stream_index) {
+        ffmpegx_keyframe_index_free(index);
+        ret = AVERROR(ENOENT);
+    }
+    return ret;
+}
+
+int ffmpegx_keyframe_index_find(const FFmpegxKeyframeIndex *index, int64_t pts) {
+    if (index->count == 0) {
+        return -1;
+    }
+    int lo = 0, hi = index->count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (index->pts[mid] <= pts) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+int ffmpegx_keyframe_index_find_next(const FFmpegxKeyframeIndex *index, int64_t pts) {
+    int lo = 0, hi = index->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (index->pts[mid] < pts) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+#endif // HAVE_FFMPEG_STATIC
@@ -0,0 +1,71 @@
+/**
+ * Keyframe index
+ * Keyframe timestamps and byte offsets of a file's video stream, built by a
+ * demux-only pass and persisted in a compact binary sidecar, so trims, thumbnails
+ * and segment planning on the same file skip the scan and look keyframes up by
+ * binary search
+ */
+
+#ifndef FFMPEGX_INDEX_H
+#define FFMPEGX_INDEX_H
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavutil/rational.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FFmpegxKeyframeIndex {
+    int stream_index;       // the video stream the index describes
+    AVRational time_base;
+    int64_t *pts;           // keyframe pts in time_base, strictly ascending
+    int64_t *pos;           // byte offset of each keyframe packet, -1 when unknown
+    int count;
+    int64_t end_pts;        // pts just past the last video frame
+} FFmpegxKeyframeIndex;
+
+// Directory for index files, created if needed. NULL (the default) keeps each
+// index next to its media file as "<path>.ffxidx" where that is writable.
+int ffmpegx_keyframe_index_set_dir(const char *dir);
+
+// Reads the index of path from its sidecar, or scans the file and writes the
+// sidecar when there is none or the file changed (size, mtime)
+int ffmpegx_keyframe_index_load(const char *path, FFmpegxKeyframeIndex *index);
+
+// Demux-only scan of the first video stream; nothing is decoded or persisted
+int ffmpegx_keyframe_index_build(const char *path, FFmpegxKeyframeIndex *index);
+
+// Keyframes the demuxer already knows from the container's seek index (MP4 sample
+// tables, Matroska cues) after opening it: no I/O, nothing persisted. Timestamps
+// are the demuxer's seek timestamps, dts for some containers. AVERROR(ENOENT) when
+// the container has no index.
+int ffmpegx_keyframe_index_from_demuxer(struct AVFormatContext *ctx, int stream_index,
+                                        FFmpegxKeyframeIndex *index);
+
+// Keyframes of stream_index in an input already opened from path: the container's
+// seek index when it has one, else the persisted scan of ffmpegx_keyframe_index_load().
+// Descriptor ("fd:") inputs are never scanned; AVERROR(ENOENT) when nothing is known.
+int ffmpegx_keyframe_index_get(struct AVFormatContext *ctx, const char *path, int stream_index,
+                               FFmpegxKeyframeIndex *index);
+
+void ffmpegx_keyframe_index_free(FFmpegxKeyframeIndex *index);
+
+// Deep copy of src into dst, which is overwritten
+int ffmpegx_keyframe_index_copy(FFmpegxKeyframeIndex *dst, const FFmpegxKeyframeIndex *src);
+
+// Position of the last keyframe at or before pts (the first keyframe when pts
+// precedes it), -1 when the index is empty. O(log n).
+int ffmpegx_keyframe_index_find(const FFmpegxKeyframeIndex *index, int64_t pts);
+
+// Position of the first keyframe at or after pts, count when there is none. O(log n).
+int ffmpegx_keyframe_index_find_next(const FFmpegxKeyframeIndex *index, int64_t pts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_INDEX_H
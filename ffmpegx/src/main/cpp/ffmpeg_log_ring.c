@@ -0,0 +1,294 @@
+/**
+ * Native log/progress ring buffer
+ * Bounded multi-producer ring (codec worker threads log concurrently) drained by
+ * one thread, so logging never takes a lock or a JNI call on the encoding path
+ */
+
+#include <android/log.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ffmpeg_log_ring.h"
+#include "ffmpeg_session.h"
+
+#ifdef HAVE_FFMPEG_STATIC
+#include "libavutil/log.h"
+#endif
+
+#define LOG_TAG "FFmpeg"
+
+#define RING_MASK (FFMPEGX_LOG_RING_SIZE - 1)
+
+// While the ring is less than half full the drainer waits this long after a
+// wake-up, so bursts of lines reach Java as one batch instead of one call each
+#define BATCH_INTERVAL_NS (5 * 1000 * 1000)
+
+typedef struct LogSlot {
+    atomic_size_t seq;
+    FFmpegxLogEntry entry;
+} LogSlot;
+
+static LogSlot slots[FFMPEGX_LOG_RING_SIZE];
+static _Alignas(64) atomic_size_t enqueue_pos;
+static _Alignas(64) size_t dequeue_pos;            // drainer thread only
+static atomic_size_t delivered_pos;
+
+static atomic_int wake_pending;
+static sem_t wake_sem;
+static atomic_uint_fast64_t dropped_count;
+
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+static pthread_t drainer_thread;
+static atomic_int running;
+
+static pthread_mutex_t sink_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FFmpegxLogSink current_sink;
+static int has_sink;
+
+// Only touched by the drainer
+static FFmpegxLogEntry batch[FFMPEGX_LOG_BATCH_SIZE];
+
+static void wake_drainer(void) {
+    // One post per drainer wake-up, not per line
+    if (!atomic_exchange(&wake_pending, 1)) {
+        sem_post(&wake_sem);
+    }
+}
+
+int ffmpegx_log_ring_vprintf(int kind, int priority, const char *fmt, va_list args) {
+    // Before the drainer runs there is nobody to empty the ring, write through
+    if (!atomic_load_explicit(&running, memory_order_relaxed)) {
+        if (kind == FFMPEGX_LOG_OUTPUT) {
+            __android_log_vprint(priority, LOG_TAG, fmt, args);
+        }
+        return 0;
+    }
+
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    LogSlot *slot;
+
+    for (;;) {
+        slot = &slots[pos & RING_MASK];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Full: dropping a line is better than stalling a codec thread
+            atomic_fetch_add_explicit(&dropped_count, 1, memory_order_relaxed);
+            return -EAGAIN;
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    FFmpegxLogEntry *entry = &slot->entry;
+    entry->kind = kind;
+    entry->priority = priority;
+    entry->session_id = ffmpegx_session_current_id();
+    int len = vsnprintf(entry->line, sizeof(entry->line), fmt, args);
+    if (len < 0) {
+        len = 0;
+        entry->line[0] = '\0';
+    } else if (len >= (int)sizeof(entry->line)) {
+        len = sizeof(entry->line) - 1;
+    }
+    // Remove trailing newline
+    if (len > 0 && entry->line[len - 1] == '\n') {
+        entry->line[len - 1] = '\0';
+    }
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    wake_drainer();
+    return 0;
+}
+
+int ffmpegx_log_ring_printf(int kind, int priority, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int ret = ffmpegx_log_ring_vprintf(kind, priority, fmt, args);
+    va_end(args);
+    return ret;
+}
+
+static void deliver_batch(int count) {
+    for (int i = 0; i < count; i++) {
+        if (batch[i].kind == FFMPEGX_LOG_OUTPUT && batch[i].line[0]) {
+            __android_log_write(batch[i].priority, LOG_TAG, batch[i].line);
+        }
+    }
+
+    pthread_mutex_lock(&sink_mutex);
+    if (has_sink && current_sink.deliver) {
+        current_sink.deliver(current_sink.opaque, batch, count);
+    }
+    pthread_mutex_unlock(&sink_mutex);
+}
+
+// Moves everything that is published into batches; returns the number of entries
+static int drain(void) {
+    int total = 0;
+    int count = 0;
+
+    for (;;) {
+        LogSlot *slot = &slots[dequeue_pos & RING_MASK];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != dequeue_pos + 1) {
+            break;
+        }
+
+        batch[count++] = slot->entry;
+        atomic_store_explicit(&slot->seq, dequeue_pos + FFMPEGX_LOG_RING_SIZE, memory_order_release);
+        dequeue_pos++;
+
+        if (count == FFMPEGX_LOG_BATCH_SIZE) {
+            deliver_batch(count);
+            atomic_store(&delivered_pos, dequeue_pos);
+            total += count;
+            count = 0;
+        }
+    }
+
+    if (count > 0) {
+        deliver_batch(count);
+        total += count;
+    }
+    atomic_store(&delivered_pos, dequeue_pos);
+    return total;
+}
+
+static void *drainer_main(void *arg) {
+    (void)arg;
+    uint64_t reported_drops = 0;
+
+    pthread_setname_np(pthread_self(), "ffx-log");
+
+    while (atomic_load(&running)) {
+        while (sem_wait(&wake_sem) < 0 && errno == EINTR) {
+        }
+
+        size_t pending = atomic_load(&enqueue_pos) - dequeue_pos;
+        if (atomic_load(&running) && pending < FFMPEGX_LOG_RING_SIZE / 2) {
+            struct timespec interval = { 0, BATCH_INTERVAL_NS };
+            nanosleep(&interval, NULL);
+        }
+
+        atomic_store(&wake_pending, 0);
+        drain();
+
+        uint64_t drops = atomic_load(&dropped_count);
+        if (drops != reported_drops) {
+            __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Log ring full, %llu line(s) dropped",
+                                (unsigned long long)(drops - reported_drops));
+            reported_drops = drops;
+        }
+    }
+
+    drain();
+
+    pthread_mutex_lock(&sink_mutex);
+    if (has_sink && current_sink.detach) {
+        current_sink.detach(current_sink.opaque);
+    }
+    pthread_mutex_unlock(&sink_mutex);
+    return NULL;
+}
+
+static int start_result;
+
+static void start_drainer(void) {
+    for (size_t i = 0; i < FFMPEGX_LOG_RING_SIZE; i++) {
+        atomic_init(&slots[i].seq, i);
+    }
+    atomic_init(&enqueue_pos, 0);
+    atomic_init(&delivered_pos, 0);
+    atomic_init(&wake_pending, 0);
+    atomic_init(&dropped_count, 0);
+    dequeue_pos = 0;
+
+    if (sem_init(&wake_sem, 0, 0) < 0) {
+        start_result = -errno;
+        return;
+    }
+
+    atomic_store(&running, 1);
+    int ret = pthread_create(&drainer_thread, NULL, drainer_main, NULL);
+    if (ret != 0) {
+        atomic_store(&running, 0);
+        start_result = -ret;
+    }
+}
+
+int ffmpegx_log_ring_start(void) {
+    pthread_once(&start_once, start_drainer);
+    return start_result;
+}
+
+void ffmpegx_log_ring_stop(void) {
+    if (!atomic_exchange(&running, 0)) {
+        return;
+    }
+    sem_post(&wake_sem);
+    pthread_join(drainer_thread, NULL);
+}
+
+void ffmpegx_log_ring_set_sink(const FFmpegxLogSink *sink) {
+    pthread_mutex_lock(&sink_mutex);
+    if (sink) {
+        current_sink = *sink;
+        has_sink = 1;
+    } else {
+        memset(&current_sink, 0, sizeof(current_sink));
+        has_sink = 0;
+    }
+    pthread_mutex_unlock(&sink_mutex);
+}
+
+void ffmpegx_log_ring_flush(int timeout_ms) {
+    if (!atomic_load(&running)) {
+        return;
+    }
+
+    size_t target = atomic_load(&enqueue_pos);
+    int waited_ms = 0;
+
+    sem_post(&wake_sem);
+    while ((intptr_t)(atomic_load(&delivered_pos) - target) < 0 && waited_ms < timeout_ms) {
+        usleep(1000);
+        waited_ms++;
+    }
+}
+
+uint64_t ffmpegx_log_ring_dropped(void) {
+    return atomic_load(&dropped_count);
+}
+
+#ifdef HAVE_FFMPEG_STATIC
+
+static int android_priority(int level) {
+    if (level <= AV_LOG_ERROR) return ANDROID_LOG_ERROR;
+    if (level <= AV_LOG_WARNING) return ANDROID_LOG_WARN;
+    if (level <= AV_LOG_INFO) return ANDROID_LOG_INFO;
+    return ANDROID_LOG_DEBUG;
+}
+
+void ffmpegx_av_log_callback(void *ptr, int level, const char *fmt, va_list vargs) {
+    (void)ptr;
+    // av_log() hands every message to a custom callback, filtering is up to us
+    if (level > av_log_get_level()) {
+        return;
+    }
+    ffmpegx_log_ring_vprintf(FFMPEGX_LOG_OUTPUT, android_priority(level), fmt, vargs);
+}
+
+#endif // HAVE_FFMPEG_STATIC
@@ -0,0 +1,75 @@
+/**
+ * Native log/progress ring buffer
+ * Log producers (FFmpeg's av_log callback on codec threads, progress reports)
+ * format straight into a fixed-size lock-free ring and never block; a single
+ * drainer thread writes to logcat and hands batches to the registered sink (Java).
+ * Entries are tagged with the writer's session so the sink can route them
+ */
+
+#ifndef FFMPEGX_LOG_RING_H
+#define FFMPEGX_LOG_RING_H
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Ring capacity in entries (power of two) and maximum stored line length
+#define FFMPEGX_LOG_RING_SIZE 1024
+#define FFMPEGX_LOG_LINE_SIZE 512
+
+// Upper bound on entries handed to the sink in one call
+#define FFMPEGX_LOG_BATCH_SIZE 64
+
+typedef enum FFmpegxLogKind {
+    FFMPEGX_LOG_OUTPUT = 0,     // Regular output line (onOutput)
+    FFMPEGX_LOG_PROGRESS,       // Progress report (onProgress), not written to logcat
+} FFmpegxLogKind;
+
+typedef struct FFmpegxLogEntry {
+    int kind;
+    int priority;               // ANDROID_LOG_* priority
+    int64_t session_id;         // Session of the writing thread, 0 for none
+    char line[FFMPEGX_LOG_LINE_SIZE];
+} FFmpegxLogEntry;
+
+// Receives entries on the drainer thread, in the order they were written
+typedef struct FFmpegxLogSink {
+    void (*deliver)(void *opaque, const FFmpegxLogEntry *entries, int count);
+    // Called on the drainer thread right before it exits
+    void (*detach)(void *opaque);
+    void *opaque;
+} FFmpegxLogSink;
+
+// Starts the drainer thread once; later calls are no-ops
+int ffmpegx_log_ring_start(void);
+
+// Drains what is left and joins the drainer thread
+void ffmpegx_log_ring_stop(void);
+
+// Replaces the sink (NULL = logcat only). Safe to call at any time.
+void ffmpegx_log_ring_set_sink(const FFmpegxLogSink *sink);
+
+// Non-blocking writes. Return 0, or -EAGAIN when the ring is full and the entry was dropped.
+int ffmpegx_log_ring_vprintf(int kind, int priority, const char *fmt, va_list args);
+int ffmpegx_log_ring_printf(int kind, int priority, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Waits (up to timeout_ms) until everything written so far has reached the sink
+void ffmpegx_log_ring_flush(int timeout_ms);
+
+// Number of entries dropped because the ring was full
+uint64_t ffmpegx_log_ring_dropped(void);
+
+#ifdef HAVE_FFMPEG_STATIC
+// av_log_set_callback() target; lines above av_log_get_level() are discarded before formatting
+void ffmpegx_av_log_callback(void *ptr, int level, const char *fmt, va_list vargs);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FFMPEGX_LOG_RING_H
@@ -3,7 +3,6 @@
  * This uses the actual FFmpeg's functionality from the libraries
  */
 
-#include <jni.h>
 #include <android/log.h>
 #include <string.h>
 #include <stdlib.h>
@@ -11,11 +10,16 @@
 #include <stdint.h>
 #include <limits.h>
 #include <errno.h>
+#include <unistd.h>
 
 #ifdef HAVE_FFMPEG_STATIC
 
 // Forward declaration of the full transcoder from ffmpeg_transcoder.c
-extern int compress_video_full(const char *input_file, const char *output_file, int quality);
+extern int compress_video_full(const char *input_file, const char *output_file, int quality,
+                               int thread_budget, int segments);
+extern int transcode_video_full(const char *input_file, const char *output_file, const char *video_codec,
+                                int width, int height, int frame_rate_num, int frame_rate_den, int bitrate,
+                                int thread_budget, int segments);
 
 #include "libavcodec/avcodec.h"
 #include "libavformat/avformat.h"
@@ -35,6 +39,22 @@ extern int compress_video_full(const char *input_file, const char *output_file,
 #include "libavutil/dict.h"
 #include "libavutil/avstring.h"
 #include "libavutil/audio_fifo.h"
+#include "libavutil/parseutils.h"
+
+#include "ffmpeg_cache.h"
+#include "ffmpeg_codec.h"
+#include "ffmpeg_concat.h"
+#include "ffmpeg_convert.h"
+#include "ffmpeg_index.h"
+#include "ffmpeg_log_ring.h"
+#include "ffmpeg_pipeline.h"
+#include "ffmpeg_pool.h"
+#include "ffmpeg_probe.h"
+#include "ffmpeg_progress.h"
+#include "ffmpeg_session.h"
+#include "ffmpeg_smartcut.h"
+#include "ffmpeg_trace.h"
+#include "ffmpeg_trim.h"
 
 #define LOG_TAG "FFmpegMain"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
@@ -45,18 +65,6 @@ extern int compress_video_full(const char *input_file, const char *output_file,
 // Helper macro for error strings
 #define av_err2str(errnum) av_make_error_string((char[AV_ERROR_MAX_STRING_SIZE]){0}, AV_ERROR_MAX_STRING_SIZE, errnum)
 
-// External references to JNI callback variables from ffmpeg_cmd.c
-// Renamed to avoid conflict with FFmpeg's built-in jni.c
-extern JavaVM *ffmpegx_java_vm;
-extern jobject ffmpegx_java_callback;
-extern jmethodID ffmpegx_on_progress_method;
-extern jmethodID ffmpegx_on_output_method;
-extern jmethodID ffmpegx_on_error_method;
-
-// Thread safety mutex for global variables
-#include <pthread.h>
-static pthread_mutex_t callback_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 // Resource limits
 #define MAX_VIDEO_DIMENSION 8192
 #define MAX_BITRATE 100000000  // 100 Mbps
@@ -296,60 +304,6 @@ static void adjust_dimensions_for_codec(int *width, int *height, enum AVPixelFor
     if (*height > MAX_VIDEO_DIMENSION) *height = MAX_VIDEO_DIMENSION;
 }
 
-// Custom log callback
-static void ffmpeg_log_callback(void *ptr, int level, const char *fmt, va_list vargs) {
-    char line[1024];
-    vsnprintf(line, sizeof(line), fmt, vargs);
-    
-    // Remove trailing newline
-    size_t len = strlen(line);
-    if (len > 0 && line[len - 1] == '\n') {
-        line[len - 1] = '\0';
-    }
-    
-    // Log to Android logcat
-    switch (level) {
-        case AV_LOG_ERROR:
-            LOGE("%s", line);
-            break;
-        case AV_LOG_WARNING:
-            LOGW("%s", line);
-            break;
-        case AV_LOG_INFO:
-            LOGI("%s", line);
-            break;
-        default:
-            LOGD("%s", line);
-            break;
-    }
-    
-    // Send to Java callback if available (with thread safety)
-    pthread_mutex_lock(&callback_mutex);
-    if (ffmpegx_java_vm && ffmpegx_java_callback && ffmpegx_on_output_method) {
-        JNIEnv *env = NULL;
-        int attached = 0;
-        
-        if ((*ffmpegx_java_vm)->GetEnv(ffmpegx_java_vm, (void**)&env, JNI_VERSION_1_6) != JNI_OK) {
-            if ((*ffmpegx_java_vm)->AttachCurrentThread(ffmpegx_java_vm, &env, NULL) == JNI_OK) {
-                attached = 1;
-            }
-        }
-        
-        if (env) {
-            jstring jstr = (*env)->NewStringUTF(env, line);
-            if (jstr) {
-                (*env)->CallVoidMethod(env, ffmpegx_java_callback, ffmpegx_on_output_method, jstr);
-                (*env)->DeleteLocalRef(env, jstr);
-            }
-            
-            if (attached) {
-                (*ffmpegx_java_vm)->DetachCurrentThread(ffmpegx_java_vm);
-            }
-        }
-    }
-    pthread_mutex_unlock(&callback_mutex);
-}
-
 // Trim video function
 static int trim_video(const char *input_file, const char *output_file, double start_time, double duration) {
     AVFormatContext *input_ctx = NULL;
@@ -362,8 +316,8 @@ static int trim_video(const char *input_file, const char *output_file, double st
     LOGI("Trimming video: %s -> %s (start=%.1f, duration=%.1f)", 
          input_file, output_file, start_time, duration);
     
-    // Open input file
-    ret = avformat_open_input(&input_ctx, input_file, NULL, NULL);
+    // Open and probe input file (reused when the same file was probed recently)
+    ret = ffmpegx_cache_open_input(&input_ctx, input_file);
     if (ret < 0) {
         char err_buf[AV_ERROR_MAX_STRING_SIZE];
         av_strerror(ret, err_buf, sizeof(err_buf));
@@ -371,18 +325,11 @@ static int trim_video(const char *input_file, const char *output_file, double st
         return ret;
     }
     
-    ret = avformat_find_stream_info(input_ctx, NULL);
-    if (ret < 0) {
-        LOGE("Cannot find stream information");
-        avformat_close_input(&input_ctx);
-        return ret;
-    }
-    
     // Allocate output context
     avformat_alloc_output_context2(&output_ctx, NULL, NULL, output_file);
     if (!output_ctx) {
         LOGE("Could not create output context");
-        avformat_close_input(&input_ctx);
+        ffmpegx_cache_close_input(&input_ctx);
         return AVERROR_UNKNOWN;
     }
     
@@ -415,7 +362,7 @@ static int trim_video(const char *input_file, const char *output_file, double st
     
     // Open output file
     if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&output_ctx->pb, output_file, AVIO_FLAG_WRITE);
+        ret = ffmpegx_open_output(output_ctx, output_file);
         if (ret < 0) {
             LOGE("Could not open output file '%s'", output_file);
             goto end;
@@ -429,12 +376,35 @@ static int trim_video(const char *input_file, const char *output_file, double st
         goto end;
     }
     
-    // Seek to start time if specified
+    // Seek to start time if specified: straight to the last keyframe at or before it
+    // when the container's seek index (or a persisted scan) knows it, else wherever the
+    // demuxer lands
+    int video_index = -1;
+    int64_t video_start_pts = AV_NOPTS_VALUE;
     if (start_time > 0) {
-        int64_t timestamp = start_time * AV_TIME_BASE;
-        ret = avformat_seek_file(input_ctx, -1, INT64_MIN, timestamp, timestamp, 0);
+        FFmpegxKeyframeIndex keyframes;
+        int best_video = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        if (best_video >= 0 && ffmpegx_keyframe_index_get(input_ctx, input_file, best_video, &keyframes) >= 0) {
+            int64_t target = av_rescale_q((int64_t)(start_time * AV_TIME_BASE), AV_TIME_BASE_Q,
+                                          keyframes.time_base);
+            int k = ffmpegx_keyframe_index_find(&keyframes, target);
+            if (k >= 0) {
+                video_index = best_video;
+                video_start_pts = keyframes.pts[k];
+            }
+            ffmpegx_keyframe_index_free(&keyframes);
+        }
+        
+        if (video_index >= 0) {
+            ret = avformat_seek_file(input_ctx, video_index, INT64_MIN, video_start_pts,
+                                     video_start_pts, 0);
+        } else {
+            int64_t timestamp = start_time * AV_TIME_BASE;
+            ret = avformat_seek_file(input_ctx, -1, INT64_MIN, timestamp, timestamp, 0);
+        }
         if (ret < 0) {
             LOGW("Could not seek to position %.1f", start_time);
+            video_index = -1;
         }
     }
     
@@ -455,7 +425,7 @@ static int trim_video(const char *input_file, const char *output_file, double st
         start_dts[i] = -1;
     }
     
-    while (1) {
+    while (!ffmpegx_cancelled()) {
         ret = av_read_frame(input_ctx, &pkt);
         if (ret < 0) {
             break;
@@ -470,6 +440,13 @@ static int trim_video(const char *input_file, const char *output_file, double st
         AVStream *in_stream = input_ctx->streams[stream_index];
         AVStream *out_stream = output_ctx->streams[stream_mapping[stream_index]];
         
+        // Video before the indexed keyframe (demuxers may land a little early) cannot be decoded
+        if (stream_index == video_index && start_pts[stream_index] == -1 &&
+            (!(pkt.flags & AV_PKT_FLAG_KEY) || pkt.pts == AV_NOPTS_VALUE || pkt.pts < video_start_pts)) {
+            av_packet_unref(&pkt);
+            continue;
+        }
+        
         // Check if we've reached the end time
         if (duration > 0) {
             double current_time = pkt.pts * av_q2d(in_stream->time_base);
@@ -525,11 +502,17 @@ static int trim_video(const char *input_file, const char *output_file, double st
         av_packet_unref(&pkt);
     }
     
-    // Write trailer
-    av_write_trailer(output_ctx);
-    
-    LOGI("Trim completed successfully");
-    ret = 0;
+    if (ffmpegx_cancelled()) {
+        // The trailer is skipped and the partial file removed once it is closed
+        LOGI("Trim cancelled");
+        ret = AVERROR(ECANCELED);
+    } else {
+        // Write trailer
+        av_write_trailer(output_ctx);
+        
+        LOGI("Trim completed successfully");
+        ret = 0;
+    }
     
     // Free allocated arrays
     av_free(start_pts);
@@ -539,40 +522,62 @@ end:
     av_freep(&stream_mapping);
     
     if (output_ctx && !(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-        avio_closep(&output_ctx->pb);
+        int opened = output_ctx->pb != NULL;
+        ffmpegx_close_output(output_ctx);
+        // Descriptors and protocol URLs belong to the caller, only plain paths are removed
+        if (opened && ret == AVERROR(ECANCELED) && strncmp(output_file, "fd:", 3) != 0 &&
+            !strstr(output_file, "://")) {
+            unlink(output_file);
+        }
     }
     avformat_free_context(output_ctx);
-    avformat_close_input(&input_ctx);
+    ffmpegx_cache_close_input(&input_ctx);
     
     return ret;
 }
 
-// Simple media info extraction
+// Simple media info extraction: a fast, cached probe printed in av_dump_format()'s
+// layout, which callers parse from the command output
 static int get_media_info(const char *filename) {
-    AVFormatContext *fmt_ctx = NULL;
+    FFmpegxMediaInfo info;
     int ret;
     
-    ret = avformat_open_input(&fmt_ctx, filename, NULL, NULL);
+    ret = ffmpegx_probe(filename, FFMPEGX_PROBE_FAST, &info);
     if (ret < 0) {
         LOGE("Could not open input file '%s'", filename);
         return ret;
     }
     
-    ret = avformat_find_stream_info(fmt_ctx, NULL);
-    if (ret < 0) {
-        LOGE("Could not find stream information");
-        avformat_close_input(&fmt_ctx);
-        return ret;
+    int64_t secs = info.duration_us / AV_TIME_BASE;
+    int64_t centis = info.duration_us % AV_TIME_BASE / 10000;
+    av_log(NULL, AV_LOG_INFO, "Input #0, %s, from '%s':\n", info.format, filename);
+    av_log(NULL, AV_LOG_INFO, "  Duration: %02d:%02d:%02d.%02d, start: %.6f, bitrate: %lld kb/s\n",
+           (int)(secs / 3600), (int)(secs / 60 % 60), (int)(secs % 60), (int)centis,
+           info.start_us / (double)AV_TIME_BASE, (long long)(info.bit_rate / 1000));
+    
+    for (int i = 0; i < info.nb_streams; i++) {
+        const FFmpegxStreamInfo *s = &info.streams[i];
+        if (s->type == AVMEDIA_TYPE_VIDEO) {
+            av_log(NULL, AV_LOG_INFO, "  Stream #0:%d: Video: %s, %dx%d, %lld kb/s, %.2f fps, rotation %d\n",
+                   s->index, s->codec, s->width, s->height, (long long)(s->bit_rate / 1000),
+                   s->fps_den > 0 ? (double)s->fps_num / s->fps_den : 0.0, s->rotation);
+        } else if (s->type == AVMEDIA_TYPE_AUDIO) {
+            av_log(NULL, AV_LOG_INFO, "  Stream #0:%d: Audio: %s, %d Hz, %s, %lld kb/s\n",
+                   s->index, s->codec, s->sample_rate,
+                   s->channels == 1 ? "mono" : s->channels == 2 ? "stereo" : "multichannel",
+                   (long long)(s->bit_rate / 1000));
+        } else {
+            av_log(NULL, AV_LOG_INFO, "  Stream #0:%d: %s: %s\n",
+                   s->index, av_get_media_type_string(s->type) ? av_get_media_type_string(s->type) : "Unknown",
+                   s->codec);
+        }
     }
     
-    av_dump_format(fmt_ctx, 0, filename, 0);
-    avformat_close_input(&fmt_ctx);
-    
     return 0;
 }
 
 // Simple audio extraction (MP4 to MP3)
-static int extract_audio_to_mp3(const char *input_file, const char *output_file) {
+static int extract_audio_to_mp3(const char *input_file, const char *output_file, int thread_budget) {
     AVFormatContext *input_ctx = NULL;
     AVFormatContext *output_ctx = NULL;
     AVCodecContext *decoder_ctx = NULL;
@@ -593,18 +598,12 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
     LOGI("Extracting audio from %s to %s", input_file, output_file);
     
     // Open input file
-    ret = avformat_open_input(&input_ctx, input_file, NULL, NULL);
+    ret = ffmpegx_cache_open_input(&input_ctx, input_file);
     if (ret < 0) {
         LOGE("Could not open input file");
         goto cleanup;
     }
     
-    ret = avformat_find_stream_info(input_ctx, NULL);
-    if (ret < 0) {
-        LOGE("Could not find stream info");
-        goto cleanup;
-    }
-    
     // Find audio stream
     for (int i = 0; i < input_ctx->nb_streams; i++) {
         if (input_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
@@ -641,7 +640,10 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
         goto cleanup;
     }
     
-    ret = avcodec_open2(decoder_ctx, decoder, NULL);
+    int dec_threads, enc_threads;
+    ffmpegx_split_thread_budget(thread_budget, &dec_threads, &enc_threads);
+    
+    ret = ffmpegx_cache_open_codec(&decoder_ctx, decoder, NULL, dec_threads);
     if (ret < 0) {
         LOGE("Could not open decoder");
         goto cleanup;
@@ -679,7 +681,7 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
     av_channel_layout_default(&encoder_ctx->ch_layout, 2);  // Stereo
     encoder_ctx->bit_rate = 192000;
     
-    ret = avcodec_open2(encoder_ctx, encoder, NULL);
+    ret = ffmpegx_cache_open_codec(&encoder_ctx, encoder, NULL, enc_threads);
     if (ret < 0) {
         LOGE("Could not open encoder");
         goto cleanup;
@@ -701,7 +703,7 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
     
     // Open output file
     if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&output_ctx->pb, output_file, AVIO_FLAG_WRITE);
+        ret = ffmpegx_open_output(output_ctx, output_file);
         if (ret < 0) {
             LOGE("Could not open output file");
             goto cleanup;
@@ -742,11 +744,11 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
     }
     
     // Process packets
-    packet = av_packet_alloc();
-    frame = av_frame_alloc();
+    packet = ffmpegx_packet_get();
+    frame = ffmpegx_frame_get();
     
     // Allocate a frame for encoder input with the correct frame size
-    encoder_frame = av_frame_alloc();
+    encoder_frame = ffmpegx_frame_get();
     if (!encoder_frame) {
         LOGE("Could not allocate encoder frame");
         ret = -1;
@@ -760,7 +762,7 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
     ret = av_frame_get_buffer(encoder_frame, 0);
     if (ret < 0) {
         LOGE("Could not allocate encoder frame buffer");
-        av_frame_free(&encoder_frame);
+        ffmpegx_frame_put(&encoder_frame);
         ret = -1;
         goto cleanup;
     }
@@ -771,12 +773,12 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
                                              encoder_ctx->frame_size * 10);
     if (!fifo) {
         LOGE("Could not allocate FIFO");
-        av_frame_free(&encoder_frame);
+        ffmpegx_frame_put(&encoder_frame);
         ret = -1;
         goto cleanup;
     }
     
-    while (av_read_frame(input_ctx, packet) >= 0) {
+    while (!ffmpegx_cancelled() && av_read_frame(input_ctx, packet) >= 0) {
         if (packet->stream_index == audio_stream_index) {
             // Decode
             ret = avcodec_send_packet(decoder_ctx, packet);
@@ -801,7 +803,7 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
                 AVFrame *resampled_frame = NULL;
                 
                 if (swr_ctx) {
-                    resampled_frame = av_frame_alloc();
+                    resampled_frame = ffmpegx_frame_get();
                     if (!resampled_frame) {
                         LOGE("Could not allocate resampled frame");
                         break;
@@ -816,14 +818,14 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
                     ret = av_frame_get_buffer(resampled_frame, 0);
                     if (ret < 0) {
                         LOGE("Could not allocate resampled frame buffer");
-                        av_frame_free(&resampled_frame);
+                        ffmpegx_frame_put(&resampled_frame);
                         break;
                     }
                     
                     ret = swr_convert_frame(swr_ctx, resampled_frame, frame);
                     if (ret < 0) {
                         LOGE("Error resampling audio");
-                        av_frame_free(&resampled_frame);
+                        ffmpegx_frame_put(&resampled_frame);
                         break;
                     }
                     
@@ -857,7 +859,7 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
                         break;
                     }
                     
-                    AVPacket *enc_packet = av_packet_alloc();
+                    AVPacket *enc_packet = ffmpegx_packet_get();
                     while (ret >= 0) {
                         ret = avcodec_receive_packet(encoder_ctx, enc_packet);
                         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
@@ -879,10 +881,10 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
                         
                         av_packet_unref(enc_packet);
                     }
-                    av_packet_free(&enc_packet);
+                    ffmpegx_packet_put(&enc_packet);
                 }
                 
-                if (resampled_frame) av_frame_free(&resampled_frame);
+                if (resampled_frame) ffmpegx_frame_put(&resampled_frame);
             }
         }
         av_packet_unref(packet);
@@ -921,7 +923,7 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
                 // Send this last partial frame
                 ret = avcodec_send_frame(encoder_ctx, encoder_frame);
                 if (ret >= 0) {
-                    AVPacket *enc_packet = av_packet_alloc();
+                    AVPacket *enc_packet = ffmpegx_packet_get();
                     if (enc_packet) {
                         while (avcodec_receive_packet(encoder_ctx, enc_packet) >= 0) {
                             enc_packet->stream_index = out_stream->index;
@@ -929,18 +931,23 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
                             av_interleaved_write_frame(output_ctx, enc_packet);
                             av_packet_unref(enc_packet);
                         }
-                        av_packet_free(&enc_packet);
+                        ffmpegx_packet_put(&enc_packet);
                     }
                 }
             }
         }
     }
     
+    if (ffmpegx_cancelled()) {
+        ret = AVERROR(ECANCELED);
+        goto cleanup;
+    }
+    
     // Flush encoder
     if (encoder_ctx) {
         ret = avcodec_send_frame(encoder_ctx, NULL);
         if (ret >= 0) {
-            AVPacket *enc_packet = av_packet_alloc();
+            AVPacket *enc_packet = ffmpegx_packet_get();
             if (enc_packet) {
                 while (1) {
                     ret = avcodec_receive_packet(encoder_ctx, enc_packet);
@@ -966,7 +973,7 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
                     
                     av_packet_unref(enc_packet);
                 }
-                av_packet_free(&enc_packet);
+                ffmpegx_packet_put(&enc_packet);
             }
         }
     }
@@ -982,17 +989,17 @@ static int extract_audio_to_mp3(const char *input_file, const char *output_file)
 cleanup:
     // Free frames first
     if (encoder_frame) {
-        av_frame_free(&encoder_frame);
+        ffmpegx_frame_put(&encoder_frame);
         encoder_frame = NULL;
     }
     if (frame) {
-        av_frame_free(&frame);
+        ffmpegx_frame_put(&frame);
         frame = NULL;
     }
     
     // Free packet
     if (packet) {
-        av_packet_free(&packet);
+        ffmpegx_packet_put(&packet);
         packet = NULL;
     }
     
@@ -1010,26 +1017,26 @@ cleanup:
     
     // Free codec contexts AFTER everything else
     if (encoder_ctx) {
-        avcodec_free_context(&encoder_ctx);
+        ffmpegx_cache_close_codec(&encoder_ctx);
         encoder_ctx = NULL;
     }
     if (decoder_ctx) {
-        avcodec_free_context(&decoder_ctx);
+        ffmpegx_cache_close_codec(&decoder_ctx);
         decoder_ctx = NULL;
     }
     if (output_ctx) {
         if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&output_ctx->pb);
+            ffmpegx_close_output(output_ctx);
         }
         avformat_free_context(output_ctx);
     }
-    if (input_ctx) avformat_close_input(&input_ctx);
+    if (input_ctx) ffmpegx_cache_close_input(&input_ctx);
     
     return ret;
 }
 
 // Video compression with transcoding
-static int compress_video(const char *input_file, const char *output_file, const char *options) {
+static int compress_video(const char *input_file, const char *output_file, const char *options, int thread_budget) {
     AVFormatContext *input_ctx = NULL;
     AVFormatContext *output_ctx = NULL;
     AVCodecContext *video_dec_ctx = NULL;
@@ -1049,18 +1056,12 @@ static int compress_video(const char *input_file, const char *output_file, const
     LOGI("Compressing video from %s to %s", input_file, output_file);
     
     // Open input
-    ret = avformat_open_input(&input_ctx, input_file, NULL, NULL);
+    ret = ffmpegx_cache_open_input(&input_ctx, input_file);
     if (ret < 0) {
         LOGE("Could not open input file");
         return ret;
     }
     
-    ret = avformat_find_stream_info(input_ctx, NULL);
-    if (ret < 0) {
-        LOGE("Could not find stream info");
-        goto cleanup;
-    }
-    
     // Find video and audio streams
     for (int i = 0; i < input_ctx->nb_streams; i++) {
         if (input_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && video_stream_idx < 0) {
@@ -1122,7 +1123,7 @@ static int compress_video(const char *input_file, const char *output_file, const
         video_enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
     }
     
-    ret = avcodec_open2(video_enc_ctx, video_encoder, NULL);
+    ret = ffmpegx_cache_open_codec(&video_enc_ctx, video_encoder, NULL, thread_budget);
     if (ret < 0) {
         LOGE("Could not open video encoder");
         goto cleanup;
@@ -1152,7 +1153,7 @@ static int compress_video(const char *input_file, const char *output_file, const
                     audio_enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
                 }
                 
-                avcodec_open2(audio_enc_ctx, audio_encoder, NULL);
+                ffmpegx_cache_open_codec(&audio_enc_ctx, audio_encoder, NULL, 1);
                 avcodec_parameters_from_context(audio_stream->codecpar, audio_enc_ctx);
             }
         }
@@ -1160,7 +1161,7 @@ static int compress_video(const char *input_file, const char *output_file, const
     
     // Open output file
     if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&output_ctx->pb, output_file, AVIO_FLAG_WRITE);
+        ret = ffmpegx_open_output(output_ctx, output_file);
         if (ret < 0) {
             LOGE("Could not open output file");
             goto cleanup;
@@ -1178,8 +1179,8 @@ static int compress_video(const char *input_file, const char *output_file, const
     
     // For now, just do simple remux as full transcoding is complex
     // This is a placeholder - full implementation would decode and re-encode frames
-    packet = av_packet_alloc();
-    while (av_read_frame(input_ctx, packet) >= 0) {
+    packet = ffmpegx_packet_get();
+    while (!ffmpegx_cancelled() && av_read_frame(input_ctx, packet) >= 0) {
         if (packet->stream_index == video_stream_idx || 
             (audio_stream && packet->stream_index == audio_stream_idx)) {
             
@@ -1203,18 +1204,23 @@ static int compress_video(const char *input_file, const char *output_file, const
         av_packet_unref(packet);
     }
     
+    if (ffmpegx_cancelled()) {
+        ret = AVERROR(ECANCELED);
+        goto cleanup;
+    }
+    
     av_write_trailer(output_ctx);
     LOGI("Video compression completed");
     ret = 0;
     
 cleanup:
-    if (packet) av_packet_free(&packet);
-    if (video_enc_ctx) avcodec_free_context(&video_enc_ctx);
-    if (audio_enc_ctx) avcodec_free_context(&audio_enc_ctx);
-    if (input_ctx) avformat_close_input(&input_ctx);
+    if (packet) ffmpegx_packet_put(&packet);
+    if (video_enc_ctx) ffmpegx_cache_close_codec(&video_enc_ctx);
+    if (audio_enc_ctx) ffmpegx_cache_close_codec(&audio_enc_ctx);
+    if (input_ctx) ffmpegx_cache_close_input(&input_ctx);
     if (output_ctx) {
         if (!(output_ctx->oformat->flags & AVFMT_NOFILE))
-            avio_closep(&output_ctx->pb);
+            ffmpegx_close_output(output_ctx);
         avformat_free_context(output_ctx);
     }
     
@@ -1222,17 +1228,17 @@ cleanup:
 }
 
 // Simple remux function (kept for compatibility)
-static int simple_remux(const char *input_file, const char *output_file) {
+static int simple_remux(const char *input_file, const char *output_file, int thread_budget) {
     // Just redirect to compress_video for now
-    return compress_video(input_file, output_file, NULL);
+    return compress_video(input_file, output_file, NULL, thread_budget);
 }
 
 // Forward declarations
 static int ffmpeg_main_simple(int argc, char **argv);
-static int process_with_complex_filter(int argc, char **argv);
+static int process_with_complex_filter(int argc, char **argv, int thread_budget);
 
 // Process video with complex filter graph supporting multiple inputs/outputs
-static int process_with_complex_filter(int argc, char **argv) {
+static int process_with_complex_filter(int argc, char **argv, int thread_budget) {
     LOGI("Processing with complex filter graph");
     
     AVFormatContext **input_contexts = NULL;
@@ -1245,6 +1251,7 @@ static int process_with_complex_filter(int argc, char **argv) {
     AVPacket *packet = NULL;
     AVFrame *frame = NULL;
     AVFrame *filt_frame = NULL;
+    AVPacket *enc_pkt = NULL;
     
     int nb_inputs = 0;
     int nb_outputs = 0;
@@ -1312,20 +1319,19 @@ static int process_with_complex_filter(int argc, char **argv) {
         goto cleanup;
     }
     
+    // Decoders share one third of the budget, the single encoder gets the rest
+    int dec_threads, enc_threads;
+    ffmpegx_split_thread_budget(thread_budget, &dec_threads, &enc_threads);
+    dec_threads = dec_threads / nb_inputs > 0 ? dec_threads / nb_inputs : 1;
+    
     // Open all input files and set up decoders
     for (int i = 0; i < nb_inputs; i++) {
-        ret = avformat_open_input(&input_contexts[i], input_files[i], NULL, NULL);
+        ret = ffmpegx_cache_open_input(&input_contexts[i], input_files[i]);
         if (ret < 0) {
             LOGE("Cannot open input file %s", input_files[i]);
             goto cleanup;
         }
         
-        ret = avformat_find_stream_info(input_contexts[i], NULL);
-        if (ret < 0) {
-            LOGE("Cannot find stream info for %s", input_files[i]);
-            goto cleanup;
-        }
-        
         // Find video stream
         stream_indices[i] = -1;
         for (int j = 0; j < input_contexts[i]->nb_streams; j++) {
@@ -1360,7 +1366,7 @@ static int process_with_complex_filter(int argc, char **argv) {
             goto cleanup;
         }
         
-        ret = avcodec_open2(dec_ctxs[i], decoder, NULL);
+        ret = ffmpegx_cache_open_codec(&dec_ctxs[i], decoder, NULL, dec_threads);
         if (ret < 0) {
             LOGE("Cannot open decoder for input %d", i);
             goto cleanup;
@@ -1485,16 +1491,16 @@ static int process_with_complex_filter(int argc, char **argv) {
         enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
     }
     
-    ret = avcodec_open2(enc_ctx, encoder, NULL);
+    ret = ffmpegx_cache_open_codec(&enc_ctx, encoder, NULL, enc_threads);
     if (ret < 0) {
         LOGE("Cannot open encoder");
-        avcodec_free_context(&enc_ctx);
+        ffmpegx_cache_close_codec(&enc_ctx);
         goto cleanup;
     }
     
     ret = avcodec_parameters_from_context(out_stream->codecpar, enc_ctx);
     if (ret < 0) {
-        avcodec_free_context(&enc_ctx);
+        ffmpegx_cache_close_codec(&enc_ctx);
         goto cleanup;
     }
     
@@ -1502,10 +1508,10 @@ static int process_with_complex_filter(int argc, char **argv) {
     
     // Open output file
     if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&output_ctx->pb, output_file, AVIO_FLAG_WRITE);
+        ret = ffmpegx_open_output(output_ctx, output_file);
         if (ret < 0) {
             LOGE("Could not open output file");
-            avcodec_free_context(&enc_ctx);
+            ffmpegx_cache_close_codec(&enc_ctx);
             goto cleanup;
         }
     }
@@ -1513,24 +1519,27 @@ static int process_with_complex_filter(int argc, char **argv) {
     ret = avformat_write_header(output_ctx, NULL);
     if (ret < 0) {
         LOGE("Error writing header");
-        avcodec_free_context(&enc_ctx);
+        ffmpegx_cache_close_codec(&enc_ctx);
         goto cleanup;
     }
     
     // Process frames
-    packet = av_packet_alloc();
-    frame = av_frame_alloc();
-    filt_frame = av_frame_alloc();
+    packet = ffmpegx_packet_get();
+    frame = ffmpegx_frame_get();
+    filt_frame = ffmpegx_frame_get();
+    enc_pkt = ffmpegx_packet_get();
     
-    if (!packet || !frame || !filt_frame) {
+    if (!packet || !frame || !filt_frame || !enc_pkt) {
         ret = AVERROR(ENOMEM);
-        avcodec_free_context(&enc_ctx);
+        ffmpegx_cache_close_codec(&enc_ctx);
         goto cleanup;
     }
     
     // Simple processing loop (can be improved for better sync)
     int finished_inputs = 0;
-    while (finished_inputs < nb_inputs) {
+    // Cancellation makes av_read_frame() fail with AVERROR_EXIT, which never counts
+    // as a finished input, so the flag has to end this loop
+    while (finished_inputs < nb_inputs && !ffmpegx_cancelled()) {
         // Read from each input
         for (int i = 0; i < nb_inputs; i++) {
             if (!input_contexts[i]) continue;
@@ -1541,7 +1550,7 @@ static int process_with_complex_filter(int argc, char **argv) {
                     // Flush decoder
                     avcodec_send_packet(dec_ctxs[i], NULL);
                     finished_inputs++;
-                    avformat_close_input(&input_contexts[i]);
+                    ffmpegx_cache_close_input(&input_contexts[i]);
                     input_contexts[i] = NULL;
                 }
                 continue;
@@ -1590,58 +1599,59 @@ static int process_with_complex_filter(int argc, char **argv) {
             }
             
             while (ret >= 0) {
-                AVPacket enc_pkt = {0};
-                av_init_packet(&enc_pkt);
-                
-                ret = avcodec_receive_packet(enc_ctx, &enc_pkt);
+                ret = avcodec_receive_packet(enc_ctx, enc_pkt);
                 if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                     break;
                 } else if (ret < 0) {
                     break;
                 }
                 
-                av_packet_rescale_ts(&enc_pkt, enc_ctx->time_base, out_stream->time_base);
-                enc_pkt.stream_index = out_stream->index;
+                av_packet_rescale_ts(enc_pkt, enc_ctx->time_base, out_stream->time_base);
+                enc_pkt->stream_index = out_stream->index;
                 
-                ret = av_interleaved_write_frame(output_ctx, &enc_pkt);
-                av_packet_unref(&enc_pkt);
+                ret = av_interleaved_write_frame(output_ctx, enc_pkt);
+                av_packet_unref(enc_pkt);
             }
             
             av_frame_unref(filt_frame);
         }
     }
     
+    if (ffmpegx_cancelled()) {
+        ffmpegx_cache_close_codec(&enc_ctx);
+        ret = AVERROR(ECANCELED);
+        goto cleanup;
+    }
+    
     // Flush encoder
     avcodec_send_frame(enc_ctx, NULL);
     while (1) {
-        AVPacket enc_pkt = {0};
-        av_init_packet(&enc_pkt);
-        
-        ret = avcodec_receive_packet(enc_ctx, &enc_pkt);
+        ret = avcodec_receive_packet(enc_ctx, enc_pkt);
         if (ret == AVERROR_EOF) {
             break;
         } else if (ret < 0) {
             break;
         }
         
-        av_packet_rescale_ts(&enc_pkt, enc_ctx->time_base, out_stream->time_base);
-        enc_pkt.stream_index = out_stream->index;
+        av_packet_rescale_ts(enc_pkt, enc_ctx->time_base, out_stream->time_base);
+        enc_pkt->stream_index = out_stream->index;
         
-        av_interleaved_write_frame(output_ctx, &enc_pkt);
-        av_packet_unref(&enc_pkt);
+        av_interleaved_write_frame(output_ctx, enc_pkt);
+        av_packet_unref(enc_pkt);
     }
     
     av_write_trailer(output_ctx);
-    avcodec_free_context(&enc_ctx);
+    ffmpegx_cache_close_codec(&enc_ctx);
     
     LOGI("Complex filter processing completed");
     ret = 0;
     
 cleanup:
     // Clean up - handle partial allocations safely
-    if (filt_frame) av_frame_free(&filt_frame);
-    if (frame) av_frame_free(&frame);
-    if (packet) av_packet_free(&packet);
+    if (filt_frame) ffmpegx_frame_put(&filt_frame);
+    if (frame) ffmpegx_frame_put(&frame);
+    if (packet) ffmpegx_packet_put(&packet);
+    ffmpegx_packet_put(&enc_pkt);
     
     if (filter_graph) {
         avfilter_graph_free(&filter_graph);
@@ -1650,7 +1660,7 @@ cleanup:
     if (dec_ctxs && nb_inputs > 0) {
         for (int i = 0; i < nb_inputs; i++) {
             if (dec_ctxs[i]) {
-                avcodec_free_context(&dec_ctxs[i]);
+                ffmpegx_cache_close_codec(&dec_ctxs[i]);
             }
         }
         av_free(dec_ctxs);
@@ -1659,7 +1669,7 @@ cleanup:
     if (input_contexts && nb_inputs > 0) {
         for (int i = 0; i < nb_inputs; i++) {
             if (input_contexts[i]) {
-                avformat_close_input(&input_contexts[i]);
+                ffmpegx_cache_close_input(&input_contexts[i]);
             }
         }
         av_free(input_contexts);
@@ -1667,7 +1677,7 @@ cleanup:
     
     if (output_ctx) {
         if (output_ctx->pb && !(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&output_ctx->pb);
+            ffmpegx_close_output(output_ctx);
         }
         avformat_free_context(output_ctx);
     }
@@ -1680,41 +1690,37 @@ cleanup:
 }
 
 // Scale video using libswscale
-static int scale_video(const char *input_file, const char *output_file, int target_width, int target_height) {
+static int scale_video(const char *input_file, const char *output_file, int target_width, int target_height,
+                       int thread_budget) {
     AVFormatContext *input_ctx = NULL, *output_ctx = NULL;
     AVCodecContext *dec_ctx = NULL, *enc_ctx = NULL;
     AVStream *input_stream = NULL, *output_stream = NULL;
     const AVCodec *decoder = NULL, *encoder = NULL;
     struct SwsContext *sws_ctx = NULL;
-    AVPacket *packet = NULL;
+    AVPacket *packet = NULL, *enc_pkt = NULL;
     AVFrame *frame = NULL, *scaled_frame = NULL;
     int video_stream_index = -1;
     int ret;
     
     LOGI("Scaling video %s to %dx%d", input_file, target_width, target_height);
     
-    // Allocate packet and frames
-    packet = av_packet_alloc();
-    frame = av_frame_alloc();
-    scaled_frame = av_frame_alloc();
-    if (!packet || !frame || !scaled_frame) {
+    // Packets and frames are reused for the whole job
+    packet = ffmpegx_packet_get();
+    enc_pkt = ffmpegx_packet_get();
+    frame = ffmpegx_frame_get();
+    scaled_frame = ffmpegx_frame_get();
+    if (!packet || !enc_pkt || !frame || !scaled_frame) {
         ret = AVERROR(ENOMEM);
         goto end;
     }
     
     // Open input file
-    ret = avformat_open_input(&input_ctx, input_file, NULL, NULL);
+    ret = ffmpegx_cache_open_input(&input_ctx, input_file);
     if (ret < 0) {
         LOGE("Cannot open input file");
         goto end;
     }
     
-    ret = avformat_find_stream_info(input_ctx, NULL);
-    if (ret < 0) {
-        LOGE("Cannot find stream information");
-        goto end;
-    }
-    
     // Find video stream
     for (int i = 0; i < input_ctx->nb_streams; i++) {
         if (input_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
@@ -1749,7 +1755,10 @@ static int scale_video(const char *input_file, const char *output_file, int targ
         goto end;
     }
     
-    ret = avcodec_open2(dec_ctx, decoder, NULL);
+    int dec_threads, enc_threads;
+    ffmpegx_split_thread_budget(thread_budget, &dec_threads, &enc_threads);
+    
+    ret = ffmpegx_cache_open_codec(&dec_ctx, decoder, NULL, dec_threads);
     if (ret < 0) {
         LOGE("Failed to open decoder");
         goto end;
@@ -1821,7 +1830,7 @@ static int scale_video(const char *input_file, const char *output_file, int targ
     av_dict_set(&opts, "preset", "fast", 0);
     av_dict_set(&opts, "crf", "23", 0);
     
-    ret = avcodec_open2(enc_ctx, encoder, &opts);
+    ret = ffmpegx_cache_open_codec(&enc_ctx, encoder, &opts, enc_threads);
     av_dict_free(&opts);
     if (ret < 0) {
         char errbuf[AV_ERROR_MAX_STRING_SIZE];
@@ -1866,7 +1875,7 @@ static int scale_video(const char *input_file, const char *output_file, int targ
     
     // Open output file
     if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&output_ctx->pb, output_file, AVIO_FLAG_WRITE);
+        ret = ffmpegx_open_output(output_ctx, output_file);
         if (ret < 0) {
             LOGE("Could not open output file");
             goto end;
@@ -1882,8 +1891,16 @@ static int scale_video(const char *input_file, const char *output_file, int targ
     
     // Process frames
     int64_t frame_count = 0;
+    FFmpegxStats *stats = ffmpegx_session_stats(ffmpegx_session_current());
     while (1) {
+        if (ffmpegx_cancelled()) {
+            ret = AVERROR(ECANCELED);
+            goto end;
+        }
+        
+        int64_t start = ffmpegx_now_ns();
         ret = av_read_frame(input_ctx, packet);
+        ffmpegx_stats_add(stats, FFMPEGX_STAGE_DEMUX, ffmpegx_trace_span(FFMPEGX_STAGE_DEMUX, start));
         if (ret < 0) {
             if (ret == AVERROR_EOF) {
                 // Flush decoder
@@ -1894,16 +1911,23 @@ static int scale_video(const char *input_file, const char *output_file, int targ
         }
         
         if (packet->stream_index == video_stream_index || ret == AVERROR_EOF) {
+            // Decode time of this packet, excluding the scale/encode/mux work in between
+            int64_t decode_ns = 0;
             if (ret != AVERROR_EOF) {
+                start = ffmpegx_now_ns();
                 ret = avcodec_send_packet(dec_ctx, packet);
+                decode_ns += ffmpegx_trace_span(FFMPEGX_STAGE_DECODE, start);
                 if (ret < 0) {
+                    ffmpegx_stats_add(stats, FFMPEGX_STAGE_DECODE, decode_ns);
                     av_packet_unref(packet);
                     continue;
                 }
             }
             
             while (ret >= 0) {
+                start = ffmpegx_now_ns();
                 ret = avcodec_receive_frame(dec_ctx, frame);
+                decode_ns += ffmpegx_trace_span(FFMPEGX_STAGE_DECODE, start);
                 if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                     break;
                 } else if (ret < 0) {
@@ -1916,10 +1940,12 @@ static int scale_video(const char *input_file, const char *output_file, int targ
                     goto end;
                 }
                 
+                start = ffmpegx_now_ns();
                 sws_scale(sws_ctx,
                          (const uint8_t * const *)frame->data, frame->linesize,
                          0, dec_ctx->height,
                          scaled_frame->data, scaled_frame->linesize);
+                ffmpegx_stats_add(stats, FFMPEGX_STAGE_SCALE, ffmpegx_trace_span(FFMPEGX_STAGE_SCALE, start));
                 
                 // Copy timestamp
                 scaled_frame->pts = frame->pts;
@@ -1927,18 +1953,20 @@ static int scale_video(const char *input_file, const char *output_file, int targ
                 scaled_frame->duration = frame->duration;
                 
                 // Encode scaled frame
+                start = ffmpegx_now_ns();
                 ret = avcodec_send_frame(enc_ctx, scaled_frame);
+                int64_t encode_ns = ffmpegx_trace_span(FFMPEGX_STAGE_ENCODE, start);
                 if (ret < 0) {
                     LOGE("Error sending frame to encoder");
+                    ffmpegx_stats_add(stats, FFMPEGX_STAGE_ENCODE, encode_ns);
                     av_frame_unref(frame);
                     continue;
                 }
                 
                 while (ret >= 0) {
-                    AVPacket enc_pkt = {0};
-                    av_init_packet(&enc_pkt);
-                    
-                    ret = avcodec_receive_packet(enc_ctx, &enc_pkt);
+                    start = ffmpegx_now_ns();
+                    ret = avcodec_receive_packet(enc_ctx, enc_pkt);
+                    encode_ns += ffmpegx_trace_span(FFMPEGX_STAGE_ENCODE, start);
                     if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
                         break;
                     } else if (ret < 0) {
@@ -1946,20 +1974,24 @@ static int scale_video(const char *input_file, const char *output_file, int targ
                     }
                     
                     // Rescale timestamps
-                    av_packet_rescale_ts(&enc_pkt, enc_ctx->time_base, output_stream->time_base);
-                    enc_pkt.stream_index = output_stream->index;
+                    av_packet_rescale_ts(enc_pkt, enc_ctx->time_base, output_stream->time_base);
+                    enc_pkt->stream_index = output_stream->index;
                     
-                    ret = av_interleaved_write_frame(output_ctx, &enc_pkt);
-                    av_packet_unref(&enc_pkt);
+                    start = ffmpegx_now_ns();
+                    ret = av_interleaved_write_frame(output_ctx, enc_pkt);
+                    ffmpegx_stats_add(stats, FFMPEGX_STAGE_MUX, ffmpegx_trace_span(FFMPEGX_STAGE_MUX, start));
+                    av_packet_unref(enc_pkt);
                     if (ret < 0) {
                         LOGE("Error writing frame");
                         goto end;
                     }
                 }
+                ffmpegx_stats_add(stats, FFMPEGX_STAGE_ENCODE, encode_ns);
                 
                 av_frame_unref(frame);
                 frame_count++;
             }
+            ffmpegx_stats_add(stats, FFMPEGX_STAGE_DECODE, decode_ns);
         }
         
         av_packet_unref(packet);
@@ -1972,21 +2004,18 @@ static int scale_video(const char *input_file, const char *output_file, int targ
     // Flush encoder
     avcodec_send_frame(enc_ctx, NULL);
     while (1) {
-        AVPacket enc_pkt = {0};
-        av_init_packet(&enc_pkt);
-        
-        ret = avcodec_receive_packet(enc_ctx, &enc_pkt);
+        ret = avcodec_receive_packet(enc_ctx, enc_pkt);
         if (ret == AVERROR_EOF) {
             break;
         } else if (ret < 0) {
             goto end;
         }
         
-        av_packet_rescale_ts(&enc_pkt, enc_ctx->time_base, output_stream->time_base);
-        enc_pkt.stream_index = output_stream->index;
+        av_packet_rescale_ts(enc_pkt, enc_ctx->time_base, output_stream->time_base);
+        enc_pkt->stream_index = output_stream->index;
         
-        ret = av_interleaved_write_frame(output_ctx, &enc_pkt);
-        av_packet_unref(&enc_pkt);
+        ret = av_interleaved_write_frame(output_ctx, enc_pkt);
+        av_packet_unref(enc_pkt);
         if (ret < 0) {
             goto end;
         }
@@ -2004,39 +2033,106 @@ end:
         sws_freeContext(sws_ctx);
     }
     if (enc_ctx) {
-        avcodec_free_context(&enc_ctx);
+        ffmpegx_cache_close_codec(&enc_ctx);
     }
     if (dec_ctx) {
-        avcodec_free_context(&dec_ctx);
+        ffmpegx_cache_close_codec(&dec_ctx);
     }
     if (output_ctx) {
         if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&output_ctx->pb);
+            ffmpegx_close_output(output_ctx);
         }
         avformat_free_context(output_ctx);
     }
     if (input_ctx) {
-        avformat_close_input(&input_ctx);
+        ffmpegx_cache_close_input(&input_ctx);
     }
-    av_frame_free(&scaled_frame);
-    av_frame_free(&frame);
-    av_packet_free(&packet);
+    ffmpegx_frame_put(&scaled_frame);
+    ffmpegx_frame_put(&frame);
+    ffmpegx_packet_put(&packet);
+    ffmpegx_packet_put(&enc_pkt);
     
     return ret;
 }
 
+// Per-job state shared with the filter stage of process_video_with_filters
+typedef struct FilterStageContext {
+    AVFilterContext *buffersrc_ctx;
+    AVFilterContext *buffersink_ctx;
+    AVFrame *filtered_frame;
+    AVCodecContext *enc_ctx;
+    FFmpegxConverter converter;
+} FilterStageContext;
+
+// Pipeline filter stage: push decoded frames through the filter graph
+static int filter_graph_stage(FFmpegxPipeline *pipeline, AVFrame *frame, void *opaque) {
+    FilterStageContext *stage = opaque;
+    
+    // A NULL frame marks the end of the stream and flushes the graph
+    int ret = av_buffersrc_add_frame_flags(stage->buffersrc_ctx, frame, 0);
+    if (ret < 0) {
+        LOGE("Error feeding filter graph: %s", av_err2str(ret));
+        return 0;
+    }
+    
+    // Pull filtered frames; the filter graph already handles PTS correctly
+    while (1) {
+        ret = av_buffersink_get_frame(stage->buffersink_ctx, stage->filtered_frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            break;
+        } else if (ret < 0) {
+            LOGE("Error getting filtered frame: %s", av_err2str(ret));
+            break;
+        }
+        
+        ret = ffmpegx_pipeline_emit_frame(pipeline, stage->filtered_frame);
+        if (ret < 0) {
+            av_frame_unref(stage->filtered_frame);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+// Pipeline filter stage without a graph: only convert to the encoder's pixel format
+static int format_convert_stage(FFmpegxPipeline *pipeline, AVFrame *frame, void *opaque) {
+    FilterStageContext *stage = opaque;
+    AVCodecContext *enc_ctx = stage->enc_ctx;
+    
+    if (!frame) {
+        return 0;
+    }
+    if (frame->format == enc_ctx->pix_fmt) {
+        return ffmpegx_pipeline_emit_frame(pipeline, frame);
+    }
+    
+    // Need format conversion; the scaler and output buffers are reused across frames
+    AVFrame *converted_frame = NULL;
+    int ret = ffmpegx_converter_convert(&stage->converter, frame,
+                                        enc_ctx->width, enc_ctx->height, enc_ctx->pix_fmt,
+                                        &converted_frame);
+    if (ret < 0) {
+        LOGE("Pixel format conversion failed: %s", av_err2str(ret));
+    }
+    
+    // Fall back to the decoded frame if conversion was not possible
+    ret = ffmpegx_pipeline_emit_frame(pipeline, converted_frame ? converted_frame : frame);
+    ffmpegx_frame_put(&converted_frame);
+    return ret;
+}
+
 // Main FFmpeg command handler
 // Process video with complex filters
 static int process_video_with_filters(const char *input_file, const char *output_file, 
-                                     const char *filter_str, int is_complex_filter, int argc, char **argv) {
+                                     const char *filter_str, int is_complex_filter, int argc, char **argv,
+                                     int thread_budget) {
     AVFormatContext *input_ctx = NULL, *output_ctx = NULL;
     AVCodecContext *dec_ctx = NULL, *enc_ctx = NULL;
     AVFilterContext *buffersink_ctx = NULL, *buffersrc_ctx = NULL;
     AVFilterGraph *filter_graph = NULL;
     AVStream *input_stream = NULL, *output_stream = NULL;
     const AVCodec *decoder = NULL, *encoder = NULL;
-    AVPacket *packet = NULL;
-    AVFrame *frame = NULL, *filtered_frame = NULL;
+    AVFrame *filtered_frame = NULL;
     int video_stream_index = -1;
     int ret;
     
@@ -2067,28 +2163,20 @@ static int process_video_with_filters(const char *input_file, const char *output
     
     LOGI("Processing video with filters: %s", filter_str ? filter_str : "none");
     
-    // Allocate packet and frames
-    packet = av_packet_alloc();
-    frame = av_frame_alloc();
-    filtered_frame = av_frame_alloc();
-    if (!packet || !frame || !filtered_frame) {
+    // Scratch frame for pulling from the filter graph
+    filtered_frame = ffmpegx_frame_get();
+    if (!filtered_frame) {
         ret = AVERROR(ENOMEM);
         goto end;
     }
     
     // Open input file
-    ret = avformat_open_input(&input_ctx, input_file, NULL, NULL);
+    ret = ffmpegx_cache_open_input(&input_ctx, input_file);
     if (ret < 0) {
         LOGE("Cannot open input file: %s", input_file);
         goto end;
     }
     
-    ret = avformat_find_stream_info(input_ctx, NULL);
-    if (ret < 0) {
-        LOGE("Cannot find stream information");
-        goto end;
-    }
-    
     // Find video stream
     for (int i = 0; i < input_ctx->nb_streams; i++) {
         if (input_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
@@ -2124,7 +2212,10 @@ static int process_video_with_filters(const char *input_file, const char *output
         goto end;
     }
     
-    ret = avcodec_open2(dec_ctx, decoder, NULL);
+    int dec_threads, enc_threads;
+    ffmpegx_split_thread_budget(thread_budget, &dec_threads, &enc_threads);
+    
+    ret = ffmpegx_cache_open_codec(&dec_ctx, decoder, NULL, dec_threads);
     if (ret < 0) {
         LOGE("Failed to open decoder");
         goto end;
@@ -2266,7 +2357,7 @@ static int process_video_with_filters(const char *input_file, const char *output
         }
     }
     
-    ret = avcodec_open2(enc_ctx, encoder, &opts);
+    ret = ffmpegx_cache_open_codec(&enc_ctx, encoder, &opts, enc_threads);
     av_dict_free(&opts);
     if (ret < 0) {
         char errbuf[AV_ERROR_MAX_STRING_SIZE];
@@ -2453,7 +2544,7 @@ static int process_video_with_filters(const char *input_file, const char *output
     
     // Open output file
     if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&output_ctx->pb, output_file, AVIO_FLAG_WRITE);
+        ret = ffmpegx_open_output(output_ctx, output_file);
         if (ret < 0) {
             LOGE("Could not open output file '%s'", output_file);
             goto end;
@@ -2467,224 +2558,36 @@ static int process_video_with_filters(const char *input_file, const char *output
         goto end;
     }
     
-    // Process frames
-    while (1) {
-        ret = av_read_frame(input_ctx, packet);
-        if (ret < 0) {
-            if (ret == AVERROR_EOF) {
-                // Flush decoder
-                avcodec_send_packet(dec_ctx, NULL);
-            } else {
-                break;
-            }
-        }
-        
-        if (packet->stream_index == video_stream_index || ret == AVERROR_EOF) {
-            if (ret != AVERROR_EOF) {
-                ret = avcodec_send_packet(dec_ctx, packet);
-                if (ret < 0) {
-                    LOGE("Error sending packet to decoder");
-                    av_packet_unref(packet);
-                    continue;
-                }
-            }
-            
-            while (ret >= 0) {
-                ret = avcodec_receive_frame(dec_ctx, frame);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                    break;
-                } else if (ret < 0) {
-                    LOGE("Error receiving frame from decoder");
-                    goto end;
-                }
-                
-                // Apply filter if available
-                if (filter_graph && filter_str && strlen(filter_str) > 0) {
-                    // Push frame to filter graph (without KEEP_REF flag to avoid memory issues)
-                    ret = av_buffersrc_add_frame_flags(buffersrc_ctx, frame, 0);
-                    if (ret < 0) {
-                        LOGE("Error feeding filter graph: %s", av_err2str(ret));
-                        av_frame_unref(frame);
-                        continue;
-                    }
-                    
-                    // Pull filtered frame
-                    while (1) {
-                        ret = av_buffersink_get_frame(buffersink_ctx, filtered_frame);
-                        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                            break;
-                        } else if (ret < 0) {
-                            LOGE("Error getting filtered frame: %s", av_err2str(ret));
-                            break;
-                        }
-                        
-                        // Ensure frame is writable before sending to encoder
-                        ret = av_frame_make_writable(filtered_frame);
-                        if (ret < 0) {
-                            LOGE("Could not make frame writable");
-                            av_frame_unref(filtered_frame);
-                            continue;
-                        }
-                        
-                        // The filter graph already handles PTS correctly, don't rescale again
-                        // Just ensure the frame has proper type
-                        filtered_frame->pict_type = AV_PICTURE_TYPE_NONE;
-                        
-                        // Encode filtered frame
-                        ret = avcodec_send_frame(enc_ctx, filtered_frame);
-                        if (ret < 0) {
-                            LOGE("Error sending frame to encoder: %s", av_err2str(ret));
-                            av_frame_unref(filtered_frame);
-                            continue;
-                        }
-                        
-                        while (ret >= 0) {
-                            AVPacket enc_pkt = {0};
-                            av_init_packet(&enc_pkt);
-                            
-                            ret = avcodec_receive_packet(enc_ctx, &enc_pkt);
-                            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                                break;
-                            } else if (ret < 0) {
-                                LOGE("Error receiving packet from encoder");
-                                goto end;
-                            }
-                            
-                            // Rescale timestamps
-                            av_packet_rescale_ts(&enc_pkt, enc_ctx->time_base, output_stream->time_base);
-                            enc_pkt.stream_index = output_stream->index;
-                            
-                            ret = av_interleaved_write_frame(output_ctx, &enc_pkt);
-                            av_packet_unref(&enc_pkt);
-                            if (ret < 0) {
-                                LOGE("Error writing frame");
-                                goto end;
-                            }
-                        }
-                        
-                        av_frame_unref(filtered_frame);
-                    }
-                } else {
-                    // No filter or simple passthrough, encode directly
-                    // Ensure frame is in correct format for encoder
-                    AVFrame *enc_frame = frame;
-                    
-                    // Check if we need pixel format conversion
-                    if (frame->format != enc_ctx->pix_fmt) {
-                        // Need format conversion, create a simple scaler
-                        struct SwsContext *sws_conv = sws_getContext(
-                            frame->width, frame->height, frame->format,
-                            enc_ctx->width, enc_ctx->height, enc_ctx->pix_fmt,
-                            SWS_BILINEAR, NULL, NULL, NULL);
-                        
-                        if (sws_conv) {
-                            AVFrame *converted_frame = av_frame_alloc();
-                            if (converted_frame) {
-                                converted_frame->format = enc_ctx->pix_fmt;
-                                converted_frame->width = enc_ctx->width;
-                                converted_frame->height = enc_ctx->height;
-                                
-                                if (av_frame_get_buffer(converted_frame, 0) >= 0) {
-                                    sws_scale(sws_conv,
-                                             (const uint8_t * const *)frame->data, frame->linesize,
-                                             0, frame->height,
-                                             converted_frame->data, converted_frame->linesize);
-                                    
-                                    // Copy timestamps
-                                    converted_frame->pts = frame->pts;
-                                    converted_frame->pkt_dts = frame->pkt_dts;
-                                    converted_frame->duration = frame->duration;
-                                    
-                                    enc_frame = converted_frame;
-                                }
-                            }
-                            sws_freeContext(sws_conv);
-                        }
-                    }
-                    
-                    enc_frame->pict_type = AV_PICTURE_TYPE_NONE;
-                    
-                    ret = avcodec_send_frame(enc_ctx, enc_frame);
-                    if (ret < 0) {
-                        LOGE("Error sending frame to encoder");
-                        if (enc_frame != frame) {
-                            av_frame_free(&enc_frame);
-                        }
-                        av_frame_unref(frame);
-                        continue;
-                    }
-                    
-                    while (ret >= 0) {
-                        AVPacket enc_pkt = {0};
-                        av_init_packet(&enc_pkt);
-                        
-                        ret = avcodec_receive_packet(enc_ctx, &enc_pkt);
-                        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                            break;
-                        } else if (ret < 0) {
-                            LOGE("Error receiving packet from encoder");
-                            if (enc_frame != frame) {
-                                av_frame_free(&enc_frame);
-                            }
-                            goto end;
-                        }
-                        
-                        // Rescale timestamps
-                        av_packet_rescale_ts(&enc_pkt, enc_ctx->time_base, output_stream->time_base);
-                        enc_pkt.stream_index = output_stream->index;
-                        
-                        ret = av_interleaved_write_frame(output_ctx, &enc_pkt);
-                        av_packet_unref(&enc_pkt);
-                        if (ret < 0) {
-                            LOGE("Error writing frame");
-                            if (enc_frame != frame) {
-                                av_frame_free(&enc_frame);
-                            }
-                            goto end;
-                        }
-                    }
-                    
-                    // Clean up converted frame if it was allocated
-                    if (enc_frame != frame) {
-                        av_frame_free(&enc_frame);
-                    }
-                }
-                
-                av_frame_unref(frame);
-            }
-        }
-        
-        av_packet_unref(packet);
-        
-        if (ret == AVERROR_EOF) {
-            break;
-        }
-    }
+    // Decode, filter, encode and mux run as concurrent pipeline stages
+    FilterStageContext stage = {
+        .buffersrc_ctx = buffersrc_ctx,
+        .buffersink_ctx = buffersink_ctx,
+        .filtered_frame = filtered_frame,
+        .enc_ctx = enc_ctx,
+    };
+    ffmpegx_converter_init(&stage.converter, SWS_BILINEAR);
+    
+    FFmpegxPipelineConfig pipeline_config = {
+        .input_ctx = input_ctx,
+        .video_stream_index = video_stream_index,
+        .dec_ctx = dec_ctx,
+        .enc_ctx = enc_ctx,
+        .output_ctx = output_ctx,
+        .output_stream = output_stream,
+        .filter = (filter_graph && filter_str && strlen(filter_str) > 0) ?
+                  filter_graph_stage : format_convert_stage,
+        .opaque = &stage,
+        .progress = ffmpegx_session_progress(ffmpegx_session_current()),
+    };
+    int64_t frames_encoded = 0;
     
-    // Flush encoder
-    avcodec_send_frame(enc_ctx, NULL);
-    while (1) {
-        AVPacket enc_pkt = {0};
-        av_init_packet(&enc_pkt);
-        
-        ret = avcodec_receive_packet(enc_ctx, &enc_pkt);
-        if (ret == AVERROR_EOF) {
-            break;
-        } else if (ret < 0) {
-            LOGE("Error flushing encoder");
-            goto end;
-        }
-        
-        av_packet_rescale_ts(&enc_pkt, enc_ctx->time_base, output_stream->time_base);
-        enc_pkt.stream_index = output_stream->index;
-        
-        ret = av_interleaved_write_frame(output_ctx, &enc_pkt);
-        av_packet_unref(&enc_pkt);
-        if (ret < 0) {
-            LOGE("Error writing final frame");
-            goto end;
-        }
+    ret = ffmpegx_pipeline_run(&pipeline_config, &frames_encoded);
+    ffmpegx_converter_uninit(&stage.converter);
+    if (ret < 0) {
+        LOGE("Pipeline failed: %s", av_err2str(ret));
+        goto end;
     }
+    LOGI("Encoded %lld frames", (long long)frames_encoded);
     
     // Write trailer
     av_write_trailer(output_ctx);
@@ -2701,33 +2604,146 @@ end:
         avfilter_graph_free(&filter_graph);
     }
     if (enc_ctx) {
-        avcodec_free_context(&enc_ctx);
+        ffmpegx_cache_close_codec(&enc_ctx);
     }
     if (dec_ctx) {
-        avcodec_free_context(&dec_ctx);
+        ffmpegx_cache_close_codec(&dec_ctx);
     }
     if (output_ctx) {
         if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&output_ctx->pb);
+            ffmpegx_close_output(output_ctx);
         }
         avformat_free_context(output_ctx);
     }
     if (input_ctx) {
-        avformat_close_input(&input_ctx);
+        ffmpegx_cache_close_input(&input_ctx);
     }
-    av_frame_free(&filtered_frame);
-    av_frame_free(&frame);
-    av_packet_free(&packet);
+    ffmpegx_frame_put(&filtered_frame);
     
     return ret;
 }
 
+// "-i in -ss A -t B out1.mp4 -ss C -t D out2.mp4": like ffmpeg's per-output options,
+// each output is cut by the -ss/-t/-to given since the previous one. Returns the
+// number of outputs (ranges filled when not NULL), 0 when one of them has no range.
+static int parse_output_ranges(int argc, char **argv, const int *option_params, FFmpegxTrimRange *ranges) {
+    int count = 0;
+    int seen_input = 0;
+    double start = -1;
+    double duration = -1;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            seen_input = 1;
+            i++;
+        } else if (strcmp(argv[i], "-ss") == 0 && i + 1 < argc) {
+            start = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            duration = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-to") == 0 && i + 1 < argc) {
+            duration = atof(argv[++i]) - (start >= 0 ? start : 0);
+        } else if (argv[i][0] != '-' && seen_input && !option_params[i]) {
+            if (start < 0 && duration <= 0) {
+                return 0;
+            }
+            if (ranges) {
+                ranges[count].start = start >= 0 ? start : 0;
+                ranges[count].duration = duration;
+                ranges[count].output = argv[i];
+            }
+            count++;
+            start = -1;
+            duration = -1;
+        }
+    }
+    return count;
+}
+
+// What transcode_video_full() is asked for by a "-segments" command line
+typedef struct SegmentedCommand {
+    const char *video_codec;
+    int width, height;          // <= 0 follows the source
+    AVRational frame_rate;      // 0/0 when not given
+    int bitrate;                // 0 when not given
+} SegmentedCommand;
+
+// Fills cmd from a single-input, single-output command that only uses options the
+// segmented transcoder honours: -c:v (not copy), -b:v, -s, -r, a plain "-vf scale=W:H",
+// "-c:a copy" (audio is always copied), -segments, -threads and -y. Returns 0 for
+// anything else, which then takes the generic path with its full option support.
+static int parse_segmented_command(int argc, char **argv, SegmentedCommand *cmd) {
+    int inputs = 0, outputs = 0;
+    
+    memset(cmd, 0, sizeof(*cmd));
+    for (int i = 1; i < argc; i++) {
+        const char *opt = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        
+        if (opt[0] != '-') {
+            outputs++;
+            continue;
+        }
+        if (strcmp(opt, "-y") == 0) {
+            continue;
+        }
+        if (!value) {
+            return 0;
+        }
+        i++;
+        
+        if (strcmp(opt, "-i") == 0) {
+            inputs++;
+        } else if (strcmp(opt, "-segments") == 0 || strcmp(opt, "-threads") == 0) {
+            // Already applied by the caller
+        } else if (strcmp(opt, "-c:v") == 0 || strcmp(opt, "-codec:v") == 0 || strcmp(opt, "-vcodec") == 0) {
+            if (strcmp(value, "copy") == 0) {
+                return 0;
+            }
+            cmd->video_codec = value;
+        } else if (strcmp(opt, "-b:v") == 0) {
+            char *unit;
+            double bitrate = strtod(value, &unit);
+            if (*unit == 'k' || *unit == 'K') {
+                bitrate *= 1000;
+                unit++;
+            } else if (*unit == 'M' || *unit == 'm') {
+                bitrate *= 1000000;
+                unit++;
+            }
+            if (*unit || bitrate <= 0 || bitrate > INT_MAX) {
+                return 0;
+            }
+            cmd->bitrate = (int)bitrate;
+        } else if (strcmp(opt, "-s") == 0) {
+            if (av_parse_video_size(&cmd->width, &cmd->height, value) < 0) {
+                return 0;
+            }
+        } else if (strcmp(opt, "-r") == 0) {
+            if (av_parse_video_rate(&cmd->frame_rate, value) < 0) {
+                return 0;
+            }
+        } else if (strcmp(opt, "-vf") == 0 || strcmp(opt, "-filter:v") == 0) {
+            int end = 0;
+            if (sscanf(value, "scale=%d:%d%n", &cmd->width, &cmd->height, &end) != 2 || value[end]) {
+                return 0;
+            }
+        } else if (strcmp(opt, "-c:a") == 0 || strcmp(opt, "-codec:a") == 0 || strcmp(opt, "-acodec") == 0) {
+            if (strcmp(value, "copy") != 0) {
+                return 0;
+            }
+        } else {
+            return 0;
+        }
+    }
+    return inputs == 1 && outputs == 1 && cmd->video_codec;
+}
+
 // Full FFmpeg command implementation that supports all features
-int ffmpeg_main(int argc, char **argv) {
+static int ffmpeg_main_full(int argc, char **argv) {
     LOGI("FFmpeg full implementation called with %d arguments", argc);
     
     // Initialize FFmpeg
-    av_log_set_callback(ffmpeg_log_callback);
+    av_log_set_callback(ffmpegx_av_log_callback);
     av_log_set_level(AV_LOG_INFO);
     
     // Log all arguments
@@ -2737,6 +2753,7 @@ int ffmpeg_main(int argc, char **argv) {
     
     // Parse command line to find input and output files
     const char *input_file = NULL;
+    const char *input_format = NULL;
     const char *output_file = NULL;
     const char *video_filter = NULL;
     const char *audio_filter = NULL;
@@ -2746,6 +2763,9 @@ int ffmpeg_main(int argc, char **argv) {
     double start_time = -1;
     double duration = -1;
     int is_complex = 0;
+    int requested_threads = 0;
+    int smart_cut = 0;
+    int segments = 1;
     
     // First pass: identify all options that take parameters
     int *option_params = av_malloc_array(argc, sizeof(int));
@@ -2758,6 +2778,7 @@ int ffmpeg_main(int argc, char **argv) {
                 strcmp(argv[i], "-vf") == 0 || strcmp(argv[i], "-filter:v") == 0 ||
                 strcmp(argv[i], "-af") == 0 || strcmp(argv[i], "-filter:a") == 0 ||
                 strcmp(argv[i], "-filter_complex") == 0 || strcmp(argv[i], "-lavfi") == 0 ||
+                strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "-codec") == 0 ||
                 strcmp(argv[i], "-c:v") == 0 || strcmp(argv[i], "-codec:v") == 0 ||
                 strcmp(argv[i], "-c:a") == 0 || strcmp(argv[i], "-codec:a") == 0 ||
                 strcmp(argv[i], "-ss") == 0 || strcmp(argv[i], "-t") == 0 ||
@@ -2772,7 +2793,15 @@ int ffmpeg_main(int argc, char **argv) {
                 strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "-keyint_min") == 0 ||
                 strcmp(argv[i], "-sc_threshold") == 0 || strcmp(argv[i], "-bufsize") == 0 ||
                 strcmp(argv[i], "-maxrate") == 0 || strcmp(argv[i], "-minrate") == 0 ||
-                strcmp(argv[i], "-threads") == 0 || strcmp(argv[i], "-f") == 0) {
+                strcmp(argv[i], "-threads") == 0 || strcmp(argv[i], "-f") == 0 ||
+                strcmp(argv[i], "-segments") == 0 ||
+                strcmp(argv[i], "-ar") == 0 || strcmp(argv[i], "-ac") == 0 ||
+                strcmp(argv[i], "-ab") == 0 || strcmp(argv[i], "-c:s") == 0 ||
+                strcmp(argv[i], "-vcodec") == 0 || strcmp(argv[i], "-acodec") == 0 ||
+                strcmp(argv[i], "-vtag") == 0 || strcmp(argv[i], "-atag") == 0 ||
+                strcmp(argv[i], "-tag:v") == 0 || strcmp(argv[i], "-tag:a") == 0 ||
+                strcmp(argv[i], "-frames:v") == 0 || strcmp(argv[i], "-vframes") == 0 ||
+                strcmp(argv[i], "-safe") == 0) {
                 option_params[i + 1] = 1; // Mark next arg as parameter
             }
         }
@@ -2832,21 +2861,75 @@ int ffmpeg_main(int argc, char **argv) {
                 duration = end_time - start_time;
             }
             i++;
+        } else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            // 0 (or anything unparsable) means one thread per core, like ffmpeg's default
+            requested_threads = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            // Before -i it names the input's format, after it the output's
+            if (!input_file) {
+                input_format = argv[i + 1];
+            }
+            i++;
+        } else if (strcmp(argv[i], "-segments") == 0 && i + 1 < argc) {
+            // Transcode up to N keyframe-aligned parts in parallel (0 = auto)
+            segments = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-smartcut") == 0) {
+            // Frame-accurate trim: re-encode the partial GOPs at the cut points, copy the rest
+            smart_cut = 1;
         } else if (argv[i][0] != '-' && !output_file && input_file && !option_params[i]) {
             // Non-option argument after input file that's not a parameter value
             output_file = argv[i];
         }
     }
     
+    // Several outputs, each cut by its own -ss/-t: clips from one pass over the input
+    FFmpegxTrimRange *clips = NULL;
+    int clip_count = parse_output_ranges(argc, argv, option_params, NULL);
+    if (clip_count > 1 && (clips = av_malloc_array(clip_count, sizeof(*clips)))) {
+        parse_output_ranges(argc, argv, option_params, clips);
+    }
+    
     // Free the temporary array
     av_free(option_params);
     
+    int thread_budget = ffmpegx_resolve_thread_budget(requested_threads);
+    LOGI("Thread budget for this job: %d", thread_budget);
+    
+    if (clip_count > 1) {
+        LOGI("Cutting %d clips from %s", clip_count, input_file);
+        int ret = clips ? ffmpegx_trim_ranges(input_file, clips, clip_count) : AVERROR(ENOMEM);
+        av_free(clips);
+        return ret;
+    }
+    
     // Validate input
     if (!input_file) {
         LOGE("No input file specified");
         return 1;
     }
     
+    // "-f concat -i list.txt": join the listed files natively, copying whatever matches
+    if (input_format && strcmp(input_format, "concat") == 0 && output_file &&
+        !video_filter && !audio_filter && !complex_filter &&
+        (!video_codec || strcmp(video_codec, "copy") == 0) &&
+        (!audio_codec || strcmp(audio_codec, "copy") == 0)) {
+        char **files = NULL;
+        int file_count = 0;
+        int ret = ffmpegx_concat_read_list(input_file, &files, &file_count);
+        if (ret >= 0) {
+            LOGI("Joining %d files into %s", file_count, output_file);
+            ret = ffmpegx_concat((const char *const *)files, file_count, output_file, thread_budget);
+            ffmpegx_concat_free_list(files, file_count);
+            if (ret != AVERROR_ENCODER_NOT_FOUND && ret != AVERROR_DECODER_NOT_FOUND &&
+                ret != AVERROR_PATCHWELCOME) {
+                return ret;
+            }
+        }
+        LOGW("Native concat not possible for %s, falling back to the generic path", input_file);
+    }
+    
     // Check for audio extraction first (before other operations)
     if (output_file && (strstr(output_file, ".mp3") || strstr(output_file, ".aac") || 
                         strstr(output_file, ".m4a") || strstr(output_file, ".wav"))) {
@@ -2862,7 +2945,7 @@ int ffmpeg_main(int argc, char **argv) {
         // Also extract audio if output is audio format
         if (extract_audio || strstr(output_file, ".mp3")) {
             LOGI("Audio extraction requested to %s", output_file);
-            return extract_audio_to_mp3(input_file, output_file);
+            return extract_audio_to_mp3(input_file, output_file, thread_budget);
         }
     }
     
@@ -2872,12 +2955,41 @@ int ffmpeg_main(int argc, char **argv) {
         if (output_file) {
             LOGI("Trimming video: start=%.1f, duration=%.1f", 
                  start_time >= 0 ? start_time : 0, duration);
+            if (smart_cut) {
+                int ret = ffmpegx_smart_cut(input_file, output_file,
+                                            start_time >= 0 ? start_time : 0,
+                                            duration > 0 ? duration : -1, thread_budget);
+                if (ret != AVERROR_ENCODER_NOT_FOUND && ret != AVERROR_DECODER_NOT_FOUND &&
+                    ret != AVERROR_PATCHWELCOME) {
+                    return ret;
+                }
+                LOGW("Smart cut not possible for this video, cutting at keyframes");
+            }
             return trim_video(input_file, output_file, 
                             start_time >= 0 ? start_time : 0,
                             duration > 0 ? duration : -1);
         }
     }
     
+    // "-segments N" re-encodes keyframe-aligned parts in parallel, for the commands whose
+    // every option the segmented transcoder honours
+    SegmentedCommand segmented;
+    if (output_file && segments != 1 && parse_segmented_command(argc, argv, &segmented)) {
+        LOGI("Segmented transcode: %s %dx%d, %d bps, segments %d", segmented.video_codec,
+             segmented.width, segmented.height, segmented.bitrate, segments);
+        int ret = transcode_video_full(input_file, output_file, segmented.video_codec,
+                                       segmented.width, segmented.height,
+                                       segmented.frame_rate.num, segmented.frame_rate.den,
+                                       segmented.bitrate, thread_budget, segments);
+        if (ret != AVERROR_ENCODER_NOT_FOUND) {
+            return ret;
+        }
+        LOGW("Encoder %s not available for segments, falling back to the generic path",
+             segmented.video_codec);
+    } else if (output_file && segments != 1) {
+        LOGI("Options not supported by the segmented transcoder, transcoding in one pass");
+    }
+    
     if (video_filter || audio_filter || complex_filter) {
         // Filter operation
         if (output_file) {
@@ -2896,7 +3008,7 @@ int ffmpeg_main(int argc, char **argv) {
                 
                 if (input_count > 1) {
                     LOGI("Multiple inputs detected, using complex filter handler");
-                    return process_with_complex_filter(argc, argv);
+                    return process_with_complex_filter(argc, argv, thread_budget);
                 }
             }
             
@@ -2911,15 +3023,17 @@ int ffmpeg_main(int argc, char **argv) {
                 // Check for -1 in dimensions (maintain aspect ratio)
                 if (target_width == -1 || target_height == -1) {
                     LOGI("Using filter graph for aspect ratio preserving scale");
-                    return process_video_with_filters(input_file, output_file, video_filter, 0, argc, argv);
+                    return process_video_with_filters(input_file, output_file, video_filter, 0, argc, argv,
+                                                      thread_budget);
                 }
                 // Use dedicated scale function for simple scaling
-                return scale_video(input_file, output_file, target_width, target_height);
+                return scale_video(input_file, output_file, target_width, target_height, thread_budget);
             }
             
             // For other filters or complex filters, use the full implementation
             if (filter_to_use) {
-                return process_video_with_filters(input_file, output_file, filter_to_use, is_complex, argc, argv);
+                return process_video_with_filters(input_file, output_file, filter_to_use, is_complex, argc, argv,
+                                                  thread_budget);
             }
         }
     }
@@ -2941,24 +3055,81 @@ int ffmpeg_main(int argc, char **argv) {
         if (has_compression_opts) {
             LOGI("Compression options detected, using filter processor for transcoding");
             // Use the filter processor without filters for proper transcoding
-            return process_video_with_filters(input_file, output_file, NULL, 0, argc, argv);
+            return process_video_with_filters(input_file, output_file, NULL, 0, argc, argv, thread_budget);
         }
         
         // Basic copy without re-encoding if no options specified
         LOGI("No specific operation requested, attempting basic transcode");
-        return process_video_with_filters(input_file, output_file, NULL, 0, argc, argv);
+        return process_video_with_filters(input_file, output_file, NULL, 0, argc, argv, thread_budget);
     }
     
     // For other cases, try the simple implementation
     return ffmpeg_main_simple(argc, argv);
 }
 
+// One line per stage that did any work, e.g.
+// "  decode: 1843.2 ms busy, 900 units, avg 2.048 ms, max 9.310 ms"
+static void log_stage_report(const FFmpegxStats *stats) {
+    int64_t counters[FFMPEGX_STAGE_COUNT * 3];
+    ffmpegx_stats_read(stats, counters);
+    
+    LOGI("Stage timing:");
+    for (int i = 0; i < FFMPEGX_STAGE_COUNT; i++) {
+        int64_t total_ns = counters[i * 3];
+        int64_t count = counters[i * 3 + 1];
+        int64_t max_ns = counters[i * 3 + 2];
+        if (count == 0) {
+            continue;
+        }
+        LOGI("  %s: %.1f ms busy, %lld units, avg %.3f ms, max %.3f ms",
+             ffmpegx_stage_name(i), total_ns / 1e6, (long long)count,
+             total_ns / 1e6 / count, max_ns / 1e6);
+    }
+}
+
+// Runs a command on behalf of a session (NULL = process-wide callback and progress).
+// Everything the command logs or reports from this thread, and from the threads it
+// starts, is attributed to the session.
+int ffmpeg_main_session(FFmpegxSession *session, int argc, char **argv) {
+    FFmpegxSession *previous = ffmpegx_session_set_current(session);
+    FFmpegxProgress *progress = ffmpegx_session_progress(session);
+    FFmpegxStats *stats = ffmpegx_session_stats(session);
+    
+    // Log lines are queued and delivered to logcat/Java by the ring's drainer thread
+    ffmpegx_log_ring_start();
+    ffmpegx_progress_start(progress, 0);
+    ffmpegx_stats_reset(stats);
+    
+    int64_t start = ffmpegx_now_ns();
+    int ret = ffmpeg_main_full(argc, argv);
+    ffmpegx_trace_event("command", start, ffmpegx_now_ns());
+    // A cancelled command fails wherever it was interrupted, usually with AVERROR_EXIT
+    // from the interrupt callback; report one code for all of them
+    if (ret != 0 && ffmpegx_session_is_cancelled(session)) {
+        ret = AVERROR(ECANCELED);
+    }
+    // Positive exit codes are failures too, even though they are not AVERROR values
+    ffmpegx_progress_finish(progress, ret > 0 ? AVERROR_UNKNOWN : ret);
+    // The counters stay readable (nativeGetStageStats) until the session's next command
+    log_stage_report(stats);
+    
+    // Make sure Java has seen all output before the command returns
+    ffmpegx_log_ring_flush(1000);
+    
+    ffmpegx_session_set_current(previous);
+    return ret;
+}
+
+int ffmpeg_main(int argc, char **argv) {
+    return ffmpeg_main_session(NULL, argc, argv);
+}
+
 // Simplified FFmpeg implementation for basic operations
 int ffmpeg_main_simple(int argc, char **argv) {
     LOGI("FFmpeg simple implementation called with %d arguments", argc);
     
     // Initialize FFmpeg
-    av_log_set_callback(ffmpeg_log_callback);
+    av_log_set_callback(ffmpegx_av_log_callback);
     av_log_set_level(AV_LOG_INFO);
     
     // Simple command parser
@@ -2967,6 +3138,8 @@ int ffmpeg_main_simple(int argc, char **argv) {
         return 1;
     }
     
+    int thread_budget = ffmpegx_resolve_thread_budget(ffmpegx_parse_thread_option(argc, argv));
+    
     // Handle different commands
     if (argc >= 3 && strcmp(argv[1], "-i") == 0) {
         const char *input_file = argv[2];
@@ -3008,7 +3181,7 @@ int ffmpeg_main_simple(int argc, char **argv) {
                     if (strcmp(codec, "libmp3lame") == 0 || 
                         strcmp(codec, "mp3") == 0 ||
                         strstr(output_file, ".mp3")) {
-                        return extract_audio_to_mp3(input_file, output_file);
+                        return extract_audio_to_mp3(input_file, output_file, thread_budget);
                     }
                     // For other codecs, fall through to simple copy
                     break;
@@ -3016,7 +3189,7 @@ int ffmpeg_main_simple(int argc, char **argv) {
             }
             
             // Simple audio extraction (codec copy)
-            return extract_audio_to_mp3(input_file, output_file);
+            return extract_audio_to_mp3(input_file, output_file, thread_budget);
         }
         
         // Check for video compression (-c:v flag)
@@ -3039,12 +3212,21 @@ int ffmpeg_main_simple(int argc, char **argv) {
                     }
                 }
                 
-                LOGI("Using full transcoder with quality level: %d", quality);
-                return compress_video_full(input_file, output_file, quality);
+                // "-segments N" transcodes up to N keyframe-aligned parts in parallel (0 = auto)
+                int segments = 1;
+                for (int j = 3; j < argc - 1; j++) {
+                    if (strcmp(argv[j], "-segments") == 0) {
+                        segments = atoi(argv[j + 1]);
+                        break;
+                    }
+                }
+                
+                LOGI("Using full transcoder with quality level: %d, segments: %d", quality, segments);
+                return compress_video_full(input_file, output_file, quality, thread_budget, segments);
                 
                 // For other codecs, fall back to remux
                 LOGW("Codec %s not fully supported, attempting remux", video_codec);
-                return simple_remux(input_file, output_file);
+                return simple_remux(input_file, output_file, thread_budget);
             }
         }
         
@@ -3073,7 +3255,7 @@ int ffmpeg_main_simple(int argc, char **argv) {
         // Default: try compression if output file specified
         if (output_file) {
             LOGI("Attempting video compression to: %s", output_file);
-            return compress_video(input_file, output_file, NULL);
+            return compress_video(input_file, output_file, NULL, thread_budget);
         }
         
         // Default: just show info
@@ -13,6 +13,9 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <cstring>
+#include <cstdlib>
+
+#include "ffmpeg_scheduler.h"
 
 #define LOG_TAG "FFmpegNativeJNI"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
@@ -35,87 +38,9 @@ extern "C" {
     void Java_com_mzgs_ffmpegx_FFmpegNative_nativeSetCallback(JNIEnv *env, jobject thiz, jobject callback);
 }
 
-// Callback interface for progress updates
+// Output and progress are routed per session by ffmpeg_cmd.c; jobs started here
+// report to the process-wide callback (nativeSetCallback)
 static JavaVM* g_jvm = nullptr;
-static jobject g_callback = nullptr;
-static jmethodID g_onProgress = nullptr;
-static jmethodID g_onOutput = nullptr;
-static jmethodID g_onError = nullptr;
-static jmethodID g_onComplete = nullptr;
-
-// Thread-safe callback handling
-void callJavaCallback(JNIEnv* env, const char* method, const char* message) {
-    if (g_callback && env) {
-        jmethodID methodId = nullptr;
-        
-        if (strcmp(method, "onProgress") == 0) {
-            methodId = g_onProgress;
-        } else if (strcmp(method, "onOutput") == 0) {
-            methodId = g_onOutput;
-        } else if (strcmp(method, "onError") == 0) {
-            methodId = g_onError;
-        }
-        
-        if (methodId) {
-            jstring jmsg = env->NewStringUTF(message);
-            env->CallVoidMethod(g_callback, methodId, jmsg);
-            env->DeleteLocalRef(jmsg);
-        }
-    }
-}
-
-// Structure to pass data to the execution thread
-struct FFmpegExecutionData {
-    std::vector<std::string> args;
-    int result;
-};
-
-// Thread function for FFmpeg execution
-void* executeFFmpegThread(void* data) {
-    FFmpegExecutionData* execData = (FFmpegExecutionData*)data;
-    JNIEnv* env = nullptr;
-    
-    // Attach thread to JVM
-    if (g_jvm) {
-        g_jvm->AttachCurrentThread(&env, nullptr);
-    }
-    
-    // Convert arguments to char**
-    int argc = execData->args.size();
-    char** argv = new char*[argc + 1];
-    
-    for (int i = 0; i < argc; i++) {
-        argv[i] = const_cast<char*>(execData->args[i].c_str());
-        LOGD("argv[%d]: %s", i, argv[i]);
-    }
-    argv[argc] = nullptr;
-    
-    LOGI("Executing FFmpeg with %d arguments", argc);
-    
-    // Call FFmpeg main function
-    try {
-        execData->result = ffmpeg_main(argc, argv);
-        LOGI("FFmpeg execution completed with result: %d", execData->result);
-    } catch (...) {
-        LOGE("FFmpeg execution failed with exception");
-        execData->result = -1;
-    }
-    
-    // Clean up
-    delete[] argv;
-    
-    // Notify completion
-    if (env && g_callback && g_onComplete) {
-        env->CallVoidMethod(g_callback, g_onComplete, execData->result);
-    }
-    
-    // Detach thread
-    if (g_jvm) {
-        g_jvm->DetachCurrentThread();
-    }
-    
-    return nullptr;
-}
 
 extern "C" JNIEXPORT jint JNICALL
 Java_com_mzgs_ffmpegx_FFmpegNative_nativeInit(JNIEnv* env, jobject thiz) {
@@ -146,13 +71,17 @@ Java_com_mzgs_ffmpegx_FFmpegNative_nativeExecute(
     std::string binaryPathStr(binPath);
     env->ReleaseStringUTFChars(binaryPath, binPath);
     
-    // Prepare execution data - will be freed by the thread
-    FFmpegExecutionData* execData = new FFmpegExecutionData();
+    // argv is handed to the scheduler, which frees it after the job ran
+    char** argv = static_cast<char**>(calloc(argc + 2, sizeof(char*)));
+    if (!argv) {
+        return -1;
+    }
+    int jobArgc = 0;
     
     // Add binary path as first argument
-    execData->args.push_back(binaryPathStr);
+    argv[jobArgc++] = strdup(binaryPathStr.c_str());
     
-    // Convert Java string array to C++ vector
+    // Convert Java string array to C strings
     for (int i = 0; i < argc; i++) {
         jstring jstr = (jstring)env->GetObjectArrayElement(args, i);
         if (!jstr) {
@@ -161,23 +90,25 @@ Java_com_mzgs_ffmpegx_FFmpegNative_nativeExecute(
         }
         const char* str = env->GetStringUTFChars(jstr, nullptr);
         if (str) {
-            execData->args.push_back(std::string(str));
+            argv[jobArgc++] = strdup(str);
             env->ReleaseStringUTFChars(jstr, str);
         }
         env->DeleteLocalRef(jstr);
     }
     
-    // Execute in a separate thread to avoid blocking
-    pthread_t thread;
-    int threadResult = pthread_create(&thread, nullptr, executeFFmpegThread, execData);
-    if (threadResult != 0) {
-        LOGE("Failed to create thread: %d", threadResult);
-        delete execData;  // Clean up if thread creation failed
+    // Queue on the shared worker pool instead of a thread per call, so bursts of
+    // jobs cannot oversubscribe the cores
+    int ret = ffmpegx_scheduler_submit(nullptr, jobArgc, argv, FFMPEGX_PRIORITY_NORMAL, nullptr, nullptr);
+    if (ret < 0) {
+        LOGE("Failed to queue FFmpeg job: %d", ret);
+        for (int i = 0; i < jobArgc; i++) {
+            free(argv[i]);
+        }
+        free(argv);
         return -1;
     }
-    pthread_detach(thread);
     
-    return 0; // Return immediately, thread will clean up execData
+    return 0; // Return immediately, the scheduler owns argv now
 }
 
 extern "C" JNIEXPORT jint JNICALL
@@ -226,16 +157,8 @@ extern "C" JNIEXPORT void JNICALL
 Java_com_mzgs_ffmpegx_FFmpegNative_nativeCleanup(JNIEnv* env, jobject thiz) {
     LOGI("Cleaning up FFmpeg native resources");
     
-    // Release global references
-    if (g_callback) {
-        env->DeleteGlobalRef(g_callback);
-        g_callback = nullptr;
-    }
-    
-    g_onProgress = nullptr;
-    g_onOutput = nullptr;
-    g_onError = nullptr;
-    g_onComplete = nullptr;
+    // Drop the process-wide callback; sessions release their own
+    Java_com_mzgs_ffmpegx_FFmpegNative_nativeSetCallback(env, thiz, nullptr);
 }
 
 extern "C" JNIEXPORT jstring JNICALL
@@ -0,0 +1,624 @@
+/**
+ * Staged transcoding pipeline
+ * demux (caller thread) -> decode -> filter -> encode -> mux, each stage on its own
+ * thread and connected by bounded lock-free queues of refcounted packets/frames
+ */
+
+#include <android/log.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ffmpeg_pipeline.h"
+#include "ffmpeg_pool.h"
+#include "ffmpeg_session.h"
+#include "ffmpeg_trace.h"
+
+#define LOG_TAG "FFmpegPipeline"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+// ---------------------------------------------------------------------------
+// Bounded MPMC queue (Vyukov), with semaphores to park on full/empty
+// ---------------------------------------------------------------------------
+
+int ffmpegx_queue_init(FFmpegxQueue *q, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+
+    memset(q, 0, sizeof(*q));
+    q->cells = calloc(size, sizeof(*q->cells));
+    if (!q->cells) {
+        return -ENOMEM;
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&q->cells[i].seq, i);
+    }
+    q->mask = size - 1;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    atomic_init(&q->aborted, 0);
+
+    if (sem_init(&q->free_slots, 0, (unsigned int)size) != 0) {
+        free(q->cells);
+        q->cells = NULL;
+        return -errno;
+    }
+    if (sem_init(&q->used_slots, 0, 0) != 0) {
+        sem_destroy(&q->free_slots);
+        free(q->cells);
+        q->cells = NULL;
+        return -errno;
+    }
+    return 0;
+}
+
+static int queue_try_enqueue(FFmpegxQueue *q, void *data) {
+    FFmpegxQueueCell *cell;
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->data = data;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    return 1;
+}
+
+static int queue_try_dequeue(FFmpegxQueue *q, void **data) {
+    FFmpegxQueueCell *cell;
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    *data = cell->data;
+    atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+    return 1;
+}
+
+// Waits for a semaphore permit; on abort the permit is handed on so every waiter wakes
+static int queue_wait(FFmpegxQueue *q, sem_t *sem) {
+    while (sem_wait(sem) != 0) {
+        if (errno != EINTR) {
+            return -errno;
+        }
+    }
+    if (atomic_load_explicit(&q->aborted, memory_order_acquire)) {
+        sem_post(sem);
+        return -ECANCELED;
+    }
+    return 0;
+}
+
+int ffmpegx_queue_push(FFmpegxQueue *q, void *item) {
+    int ret = queue_wait(q, &q->free_slots);
+    if (ret < 0) {
+        return ret;
+    }
+    // A permit guarantees a free cell, but the consumer owning the next cell may
+    // still be finishing its dequeue
+    while (!queue_try_enqueue(q, item)) {
+        sched_yield();
+    }
+    sem_post(&q->used_slots);
+    return 0;
+}
+
+int ffmpegx_queue_pop(FFmpegxQueue *q, void **item) {
+    int ret = queue_wait(q, &q->used_slots);
+    if (ret < 0) {
+        return ret;
+    }
+    while (!queue_try_dequeue(q, item)) {
+        sched_yield();
+    }
+    sem_post(&q->free_slots);
+    return 0;
+}
+
+void ffmpegx_queue_abort(FFmpegxQueue *q) {
+    atomic_store_explicit(&q->aborted, 1, memory_order_release);
+    sem_post(&q->free_slots);
+    sem_post(&q->used_slots);
+}
+
+void ffmpegx_queue_destroy(FFmpegxQueue *q, void (*free_item)(void *item)) {
+    if (!q->cells) {
+        return;
+    }
+    void *item;
+    while (queue_try_dequeue(q, &item)) {
+        if (item && free_item) {
+            free_item(item);
+        }
+    }
+    sem_destroy(&q->free_slots);
+    sem_destroy(&q->used_slots);
+    free(q->cells);
+    q->cells = NULL;
+}
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavutil/error.h"
+
+#define DEFAULT_PACKET_QUEUE_SIZE 64
+// Decoded 1080p frames are ~3 MB each, keep the frame queues short
+#define DEFAULT_FRAME_QUEUE_SIZE 4
+
+// Helper macro for error strings
+#define av_err2str(errnum) av_make_error_string((char[AV_ERROR_MAX_STRING_SIZE]){0}, AV_ERROR_MAX_STRING_SIZE, errnum)
+
+struct FFmpegxPipeline {
+    const FFmpegxPipelineConfig *config;
+    // Session of the thread that runs the pipeline, adopted by every stage thread
+    FFmpegxSession *session;
+
+    FFmpegxQueue packet_queue;   // demux -> decode
+    FFmpegxQueue decoded_queue;  // decode -> filter
+    FFmpegxQueue filtered_queue; // filter -> encode
+    FFmpegxQueue mux_queue;      // encode + copied streams -> mux
+
+    atomic_int error;
+    atomic_llong frames_encoded;
+
+    // Time each stage spent working (not waiting on a queue), for progress
+    atomic_llong stage_ns[FFMPEGX_STAGE_COUNT];
+    // The session's counters, which also see every packet/frame as a unit of work
+    FFmpegxStats *stats;
+    // Time the filter callback spent blocked in emit_frame; filter thread only
+    int64_t filter_wait_ns;
+};
+
+// Books one unit of work (a packet or frame) that kept a stage busy for ns
+static inline void stage_record(FFmpegxPipeline *p, FFmpegxStage stage, int64_t ns) {
+    atomic_fetch_add_explicit(&p->stage_ns[stage], ns, memory_order_relaxed);
+    ffmpegx_stats_add(p->stats, stage, ns);
+}
+
+static void free_packet_item(void *item) {
+    AVPacket *pkt = item;
+    ffmpegx_packet_put(&pkt);
+}
+
+static void free_frame_item(void *item) {
+    AVFrame *frame = item;
+    ffmpegx_frame_put(&frame);
+}
+
+void ffmpegx_pipeline_fail(FFmpegxPipeline *p, int error) {
+    int expected = 0;
+    if (error >= 0) {
+        error = AVERROR_UNKNOWN;
+    }
+    if (atomic_compare_exchange_strong(&p->error, &expected, error)) {
+        LOGE("Pipeline stopped: %s", av_err2str(error));
+    }
+    ffmpegx_queue_abort(&p->packet_queue);
+    ffmpegx_queue_abort(&p->decoded_queue);
+    ffmpegx_queue_abort(&p->filtered_queue);
+    ffmpegx_queue_abort(&p->mux_queue);
+}
+
+int ffmpegx_pipeline_emit_frame(FFmpegxPipeline *p, AVFrame *frame) {
+    AVFrame *queued = ffmpegx_frame_get();
+    if (!queued) {
+        return AVERROR(ENOMEM);
+    }
+    av_frame_move_ref(queued, frame);
+
+    int64_t wait_start = ffmpegx_now_ns();
+    int ret = ffmpegx_queue_push(&p->filtered_queue, queued);
+    int64_t wait_end = ffmpegx_now_ns();
+    p->filter_wait_ns += wait_end - wait_start;
+    // Encoder backpressure, shown nested inside the filter span
+    ffmpegx_trace_event("wait", wait_start, wait_end);
+    if (ret < 0) {
+        ffmpegx_frame_put(&queued);
+    }
+    return ret;
+}
+
+static void *decode_thread(void *arg) {
+    FFmpegxPipeline *p = arg;
+    AVCodecContext *dec_ctx = p->config->dec_ctx;
+    AVFrame *frame = ffmpegx_frame_get();
+    AVPacket *pkt = NULL;
+    int ret;
+
+    pthread_setname_np(pthread_self(), "ffx-decode");
+    ffmpegx_session_set_current(p->session);
+
+    if (!frame) {
+        ffmpegx_pipeline_fail(p, AVERROR(ENOMEM));
+        return NULL;
+    }
+
+    while (ffmpegx_queue_pop(&p->packet_queue, (void **)&pkt) == 0) {
+        int eof = pkt == NULL;
+
+        // A NULL packet puts the decoder into draining mode
+        int64_t start = ffmpegx_now_ns();
+        ret = avcodec_send_packet(dec_ctx, pkt);
+        ffmpegx_packet_put(&pkt);
+        int64_t busy = ffmpegx_trace_span(FFMPEGX_STAGE_DECODE, start);
+        if (ret < 0 && ret != AVERROR_EOF) {
+            LOGE("Error sending packet to decoder: %s", av_err2str(ret));
+            if (!eof) {
+                stage_record(p, FFMPEGX_STAGE_DECODE, busy);
+                continue;
+            }
+        }
+
+        while (1) {
+            start = ffmpegx_now_ns();
+            ret = avcodec_receive_frame(dec_ctx, frame);
+            busy += ffmpegx_trace_span(FFMPEGX_STAGE_DECODE, start);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            } else if (ret < 0) {
+                LOGE("Error receiving frame from decoder");
+                ffmpegx_pipeline_fail(p, ret);
+                goto done;
+            }
+
+            AVFrame *decoded = ffmpegx_frame_get();
+            if (!decoded) {
+                ffmpegx_pipeline_fail(p, AVERROR(ENOMEM));
+                goto done;
+            }
+            av_frame_move_ref(decoded, frame);
+
+            if (ffmpegx_queue_push(&p->decoded_queue, decoded) < 0) {
+                ffmpegx_frame_put(&decoded);
+                goto done;
+            }
+        }
+        stage_record(p, FFMPEGX_STAGE_DECODE, busy);
+
+        if (eof) {
+            ffmpegx_queue_push(&p->decoded_queue, NULL);
+            break;
+        }
+    }
+
+done:
+    ffmpegx_frame_put(&frame);
+    return NULL;
+}
+
+static void *filter_thread(void *arg) {
+    FFmpegxPipeline *p = arg;
+    const FFmpegxPipelineConfig *config = p->config;
+    AVFrame *frame = NULL;
+    int ret;
+
+    pthread_setname_np(pthread_self(), "ffx-filter");
+    ffmpegx_session_set_current(p->session);
+
+    while (ffmpegx_queue_pop(&p->decoded_queue, (void **)&frame) == 0) {
+        if (config->filter) {
+            int64_t start = ffmpegx_now_ns();
+            int64_t scale_before = ffmpegx_stats_thread_ns(FFMPEGX_STAGE_SCALE);
+            p->filter_wait_ns = 0;
+            ret = config->filter(p, frame, config->opaque);
+
+            // Conversions inside the callback were already booked to SCALE
+            int64_t scale_ns = ffmpegx_stats_thread_ns(FFMPEGX_STAGE_SCALE) - scale_before;
+            atomic_fetch_add_explicit(&p->stage_ns[FFMPEGX_STAGE_SCALE], scale_ns, memory_order_relaxed);
+            // The trace shows the whole callback, with its conversions nested inside
+            int64_t filter_ns = ffmpegx_trace_span(FFMPEGX_STAGE_FILTER, start);
+            stage_record(p, FFMPEGX_STAGE_FILTER, filter_ns - p->filter_wait_ns - scale_ns);
+        } else {
+            ret = frame ? ffmpegx_pipeline_emit_frame(p, frame) : 0;
+        }
+
+        if (!frame) {
+            if (ret >= 0) {
+                ffmpegx_queue_push(&p->filtered_queue, NULL);
+            } else {
+                ffmpegx_pipeline_fail(p, ret);
+            }
+            break;
+        }
+
+        ffmpegx_frame_put(&frame);
+        if (ret < 0) {
+            ffmpegx_pipeline_fail(p, ret);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void *encode_thread(void *arg) {
+    FFmpegxPipeline *p = arg;
+    const FFmpegxPipelineConfig *config = p->config;
+    AVCodecContext *enc_ctx = config->enc_ctx;
+    AVFrame *frame = NULL;
+    int ret;
+
+    pthread_setname_np(pthread_self(), "ffx-encode");
+    ffmpegx_session_set_current(p->session);
+
+    while (ffmpegx_queue_pop(&p->filtered_queue, (void **)&frame) == 0) {
+        int eof = frame == NULL;
+
+        if (frame) {
+            frame->pict_type = AV_PICTURE_TYPE_NONE;
+        }
+        int64_t start = ffmpegx_now_ns();
+        ret = avcodec_send_frame(enc_ctx, frame);
+        ffmpegx_frame_put(&frame);
+        int64_t busy = ffmpegx_trace_span(FFMPEGX_STAGE_ENCODE, start);
+        if (ret < 0) {
+            if (!eof) {
+                LOGE("Error sending frame to encoder: %s", av_err2str(ret));
+                stage_record(p, FFMPEGX_STAGE_ENCODE, busy);
+                continue;
+            }
+        } else if (!eof) {
+            atomic_fetch_add(&p->frames_encoded, 1);
+        }
+
+        while (1) {
+            AVPacket *pkt = ffmpegx_packet_get();
+            if (!pkt) {
+                ffmpegx_pipeline_fail(p, AVERROR(ENOMEM));
+                return NULL;
+            }
+
+            start = ffmpegx_now_ns();
+            ret = avcodec_receive_packet(enc_ctx, pkt);
+            busy += ffmpegx_trace_span(FFMPEGX_STAGE_ENCODE, start);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                ffmpegx_packet_put(&pkt);
+                break;
+            } else if (ret < 0) {
+                LOGE("Error receiving packet from encoder");
+                ffmpegx_packet_put(&pkt);
+                ffmpegx_pipeline_fail(p, ret);
+                return NULL;
+            }
+
+            av_packet_rescale_ts(pkt, enc_ctx->time_base, config->output_stream->time_base);
+            pkt->stream_index = config->output_stream->index;
+
+            if (ffmpegx_queue_push(&p->mux_queue, pkt) < 0) {
+                ffmpegx_packet_put(&pkt);
+                return NULL;
+            }
+        }
+        stage_record(p, FFMPEGX_STAGE_ENCODE, busy);
+
+        if (eof) {
+            ffmpegx_queue_push(&p->mux_queue, NULL);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void publish_progress(FFmpegxPipeline *p, int64_t pts_us) {
+    AVFormatContext *output_ctx = p->config->output_ctx;
+    int64_t stage_ns[FFMPEGX_STAGE_COUNT];
+
+    for (int i = 0; i < FFMPEGX_STAGE_COUNT; i++) {
+        stage_ns[i] = atomic_load_explicit(&p->stage_ns[i], memory_order_relaxed);
+    }
+    ffmpegx_progress_update(p->config->progress, atomic_load(&p->frames_encoded), pts_us,
+                            output_ctx->pb ? avio_tell(output_ctx->pb) : 0, stage_ns);
+}
+
+static void *mux_thread(void *arg) {
+    FFmpegxPipeline *p = arg;
+    const FFmpegxPipelineConfig *config = p->config;
+    AVFormatContext *output_ctx = config->output_ctx;
+    AVPacket *pkt = NULL;
+    int producers_done = 0;
+    int ret;
+
+    pthread_setname_np(pthread_self(), "ffx-mux");
+    ffmpegx_session_set_current(p->session);
+
+    // Demuxer (copied streams) and encoder both end their output with a NULL
+    while (producers_done < 2 && ffmpegx_queue_pop(&p->mux_queue, (void **)&pkt) == 0) {
+        if (!pkt) {
+            producers_done++;
+            continue;
+        }
+
+        // Position in the output, taken before the muxer consumes the packet
+        int64_t pts_us = AV_NOPTS_VALUE;
+        if (config->progress && pkt->stream_index == config->output_stream->index &&
+            pkt->pts != AV_NOPTS_VALUE) {
+            pts_us = av_rescale_q(pkt->pts, config->output_stream->time_base, AV_TIME_BASE_Q);
+        }
+
+        int64_t start = ffmpegx_now_ns();
+        ret = av_interleaved_write_frame(output_ctx, pkt);
+        ffmpegx_packet_put(&pkt);
+        stage_record(p, FFMPEGX_STAGE_MUX, ffmpegx_trace_span(FFMPEGX_STAGE_MUX, start));
+        if (ret < 0) {
+            LOGE("Error writing frame: %s", av_err2str(ret));
+            ffmpegx_pipeline_fail(p, ret);
+            break;
+        }
+
+        if (pts_us != AV_NOPTS_VALUE) {
+            publish_progress(p, pts_us);
+        }
+    }
+
+    return NULL;
+}
+
+static void demux_loop(FFmpegxPipeline *p) {
+    const FFmpegxPipelineConfig *config = p->config;
+    AVFormatContext *input_ctx = config->input_ctx;
+    int ret;
+
+    while (!atomic_load(&p->error)) {
+        AVPacket *pkt = ffmpegx_packet_get();
+        if (!pkt) {
+            ffmpegx_pipeline_fail(p, AVERROR(ENOMEM));
+            return;
+        }
+
+        int64_t start = ffmpegx_now_ns();
+        ret = av_read_frame(input_ctx, pkt);
+        stage_record(p, FFMPEGX_STAGE_DEMUX, ffmpegx_trace_span(FFMPEGX_STAGE_DEMUX, start));
+
+        // Checked once per packet, and after a read that the interrupt callback
+        // cut short; aborting the queues stops every stage without draining
+        if (ffmpegx_cancelled()) {
+            ffmpegx_packet_put(&pkt);
+            ffmpegx_pipeline_fail(p, AVERROR(ECANCELED));
+            return;
+        }
+        if (ret < 0) {
+            ffmpegx_packet_put(&pkt);
+            if (ret != AVERROR_EOF) {
+                // A read error is not the end of the input; the job must not succeed
+                LOGE("Error reading input: %s", av_err2str(ret));
+                ffmpegx_pipeline_fail(p, ret);
+                return;
+            }
+            break;
+        }
+
+        int index = pkt->stream_index;
+        FFmpegxQueue *target = NULL;
+
+        if (index == config->video_stream_index) {
+            // Packets up to and including stop_pts still go to the decoder, so
+            // reordered frames that display before the boundary are not lost
+            if (config->has_stop_pts && pkt->pts != AV_NOPTS_VALUE && pkt->pts > config->stop_pts) {
+                ffmpegx_packet_put(&pkt);
+                break;
+            }
+            target = &p->packet_queue;
+        } else if (config->stream_mapping && index < (int)input_ctx->nb_streams &&
+                   config->stream_mapping[index] >= 0) {
+            AVStream *in_stream = input_ctx->streams[index];
+            AVStream *out_stream = config->output_ctx->streams[config->stream_mapping[index]];
+            av_packet_rescale_ts(pkt, in_stream->time_base, out_stream->time_base);
+            pkt->stream_index = out_stream->index;
+            pkt->pos = -1;
+            target = &p->mux_queue;
+        }
+
+        if (!target) {
+            ffmpegx_packet_put(&pkt);
+            continue;
+        }
+        if (ffmpegx_queue_push(target, pkt) < 0) {
+            ffmpegx_packet_put(&pkt);
+            return;
+        }
+    }
+
+    ffmpegx_queue_push(&p->packet_queue, NULL);
+    ffmpegx_queue_push(&p->mux_queue, NULL);
+}
+
+int ffmpegx_pipeline_run(const FFmpegxPipelineConfig *config, int64_t *frames_encoded) {
+    FFmpegxPipeline p;
+    pthread_t threads[4];
+    void *(*stages[4])(void *) = { decode_thread, filter_thread, encode_thread, mux_thread };
+    int started = 0;
+    int ret;
+
+    memset(&p, 0, sizeof(p));
+    p.config = config;
+    p.session = ffmpegx_session_current();
+    p.stats = ffmpegx_session_stats(p.session);
+    atomic_init(&p.error, 0);
+    atomic_init(&p.frames_encoded, 0);
+    for (int i = 0; i < FFMPEGX_STAGE_COUNT; i++) {
+        atomic_init(&p.stage_ns[i], 0);
+    }
+
+    if (config->progress) {
+        int64_t duration = config->input_ctx->duration;
+        ffmpegx_progress_start(config->progress, duration != AV_NOPTS_VALUE ? duration : 0);
+    }
+
+    int packet_queue_size = config->packet_queue_size > 0 ? config->packet_queue_size : DEFAULT_PACKET_QUEUE_SIZE;
+    int frame_queue_size = config->frame_queue_size > 0 ? config->frame_queue_size : DEFAULT_FRAME_QUEUE_SIZE;
+
+    if ((ret = ffmpegx_queue_init(&p.packet_queue, packet_queue_size)) < 0 ||
+        (ret = ffmpegx_queue_init(&p.decoded_queue, frame_queue_size)) < 0 ||
+        (ret = ffmpegx_queue_init(&p.filtered_queue, frame_queue_size)) < 0 ||
+        (ret = ffmpegx_queue_init(&p.mux_queue, packet_queue_size)) < 0) {
+        LOGE("Could not allocate pipeline queues");
+        goto cleanup;
+    }
+
+    for (started = 0; started < 4; started++) {
+        ret = pthread_create(&threads[started], NULL, stages[started], &p);
+        if (ret != 0) {
+            LOGE("Failed to create pipeline thread: %d", ret);
+            ffmpegx_pipeline_fail(&p, AVERROR(ret));
+            break;
+        }
+    }
+
+    if (started == 4) {
+        demux_loop(&p);
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    ret = atomic_load(&p.error);
+    if (config->progress) {
+        publish_progress(&p, 0);
+    }
+    if (frames_encoded) {
+        *frames_encoded = atomic_load(&p.frames_encoded);
+    }
+    LOGD("Pipeline finished: %lld frames encoded", (long long)atomic_load(&p.frames_encoded));
+
+cleanup:
+    ffmpegx_queue_destroy(&p.packet_queue, free_packet_item);
+    ffmpegx_queue_destroy(&p.decoded_queue, free_frame_item);
+    ffmpegx_queue_destroy(&p.filtered_queue, free_frame_item);
+    ffmpegx_queue_destroy(&p.mux_queue, free_packet_item);
+    return ret;
+}
+
+#endif // HAVE_FFMPEG_STATIC
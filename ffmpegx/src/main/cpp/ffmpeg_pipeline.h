@@ -0,0 +1,105 @@
+/**
+ * Staged transcoding pipeline
+ * Runs demux -> decode -> filter -> encode -> mux on separate threads connected by
+ * bounded lock-free queues, so that disk I/O, decoding and encoding overlap
+ */
+
+#ifndef FFMPEGX_PIPELINE_H
+#define FFMPEGX_PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+// Bounded multi-producer/multi-consumer queue of pointers.
+// Push/pop are lock-free; semaphores only park a thread while the queue is full/empty.
+// A NULL item is a valid payload and is used by the pipeline as the end-of-stream marker.
+typedef struct FFmpegxQueueCell {
+    atomic_size_t seq;
+    void *data;
+} FFmpegxQueueCell;
+
+typedef struct FFmpegxQueue {
+    FFmpegxQueueCell *cells;
+    size_t mask;
+    _Alignas(64) atomic_size_t enqueue_pos;
+    _Alignas(64) atomic_size_t dequeue_pos;
+    sem_t free_slots;
+    sem_t used_slots;
+    atomic_int aborted;
+} FFmpegxQueue;
+
+// Capacity is rounded up to a power of two
+int ffmpegx_queue_init(FFmpegxQueue *q, size_t capacity);
+
+// Frees the queue; free_item (if set) is called for every non-NULL item still queued
+void ffmpegx_queue_destroy(FFmpegxQueue *q, void (*free_item)(void *item));
+
+// Blocking push/pop. Return 0 on success or -ECANCELED (== AVERROR(ECANCELED))
+// once the queue was aborted.
+int ffmpegx_queue_push(FFmpegxQueue *q, void *item);
+int ffmpegx_queue_pop(FFmpegxQueue *q, void **item);
+
+// Wakes every thread blocked on the queue; later push/pop calls fail immediately
+void ffmpegx_queue_abort(FFmpegxQueue *q);
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+
+#include "ffmpeg_progress.h"
+
+typedef struct FFmpegxPipeline FFmpegxPipeline;
+
+// Filter stage callback. Called with each decoded frame (NULL once the decoder is
+// drained, to flush any internal state) and hands every frame that is ready for the
+// encoder to ffmpegx_pipeline_emit_frame(). The pipeline frees the input frame when
+// the callback returns; a negative return value stops the pipeline. Runs on its own thread.
+typedef int (*FFmpegxFilterFn)(FFmpegxPipeline *pipeline, AVFrame *frame, void *opaque);
+
+typedef struct FFmpegxPipelineConfig {
+    AVFormatContext *input_ctx;
+    int video_stream_index;
+    AVCodecContext *dec_ctx;
+
+    AVCodecContext *enc_ctx;
+    AVFormatContext *output_ctx;
+    AVStream *output_stream;
+
+    // Input stream index -> output stream index for packets that are muxed
+    // as-is (e.g. copied audio); -1 drops the stream. May be NULL.
+    const int *stream_mapping;
+
+    // Optional; without it decoded frames go straight to the encoder
+    FFmpegxFilterFn filter;
+    void *opaque;
+
+    // Stop demuxing at the first video packet whose pts is past stop_pts (video
+    // stream time base), e.g. to transcode a single GOP-aligned segment
+    int has_stop_pts;
+    int64_t stop_pts;
+
+    // Updated from the mux thread after every written packet. May be NULL.
+    FFmpegxProgress *progress;
+
+    // Queue depths, 0 selects the defaults
+    int packet_queue_size;
+    int frame_queue_size;
+} FFmpegxPipelineConfig;
+
+// Runs the pipeline to completion (header must already be written, trailer is
+// left to the caller). Returns 0 or the first error raised by any stage.
+int ffmpegx_pipeline_run(const FFmpegxPipelineConfig *config, int64_t *frames_encoded);
+
+// Queue a frame for the encoder from inside the filter callback. Takes over the
+// frame's reference (the caller's AVFrame is left blank and can be reused).
+int ffmpegx_pipeline_emit_frame(FFmpegxPipeline *pipeline, AVFrame *frame);
+
+// Stop the pipeline with an error from inside a callback
+void ffmpegx_pipeline_fail(FFmpegxPipeline *pipeline, int error);
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_PIPELINE_H
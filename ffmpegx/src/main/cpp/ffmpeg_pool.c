@@ -0,0 +1,135 @@
+/**
+ * Shared AVFrame/AVPacket pools
+ * Fixed-size stacks of unreferenced structs behind one mutex each. Frames are
+ * released on a different thread than the one that got them (decode -> filter
+ * -> encode), so the pools are process-wide rather than per thread.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_pool.h"
+
+_Static_assert(FFMPEGX_PACKET_POOL_SIZE >= FFMPEGX_FRAME_POOL_SIZE,
+               "ffmpegx_pool_trim() drains both pools through one array");
+
+typedef struct Pool {
+    pthread_mutex_t mutex;
+    int count;
+    int capacity;
+    void **items;
+    atomic_llong gets;
+    atomic_llong allocs;
+} Pool;
+
+static void *frame_items[FFMPEGX_FRAME_POOL_SIZE];
+static void *packet_items[FFMPEGX_PACKET_POOL_SIZE];
+
+static Pool frame_pool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .capacity = FFMPEGX_FRAME_POOL_SIZE,
+    .items = frame_items,
+};
+static Pool packet_pool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .capacity = FFMPEGX_PACKET_POOL_SIZE,
+    .items = packet_items,
+};
+
+static void *pool_take(Pool *pool) {
+    void *item = NULL;
+
+    atomic_fetch_add_explicit(&pool->gets, 1, memory_order_relaxed);
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->count > 0) {
+        item = pool->items[--pool->count];
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (!item) {
+        atomic_fetch_add_explicit(&pool->allocs, 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+// Returns 0 when the pool is full and the caller has to free the item
+static int pool_give(Pool *pool, void *item) {
+    int kept = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->count < pool->capacity) {
+        pool->items[pool->count++] = item;
+        kept = 1;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return kept;
+}
+
+AVFrame *ffmpegx_frame_get(void) {
+    AVFrame *frame = pool_take(&frame_pool);
+    return frame ? frame : av_frame_alloc();
+}
+
+AVPacket *ffmpegx_packet_get(void) {
+    AVPacket *packet = pool_take(&packet_pool);
+    return packet ? packet : av_packet_alloc();
+}
+
+void ffmpegx_frame_put(AVFrame **frame) {
+    if (!*frame) return;
+
+    // Resets every field to its av_frame_alloc() default
+    av_frame_unref(*frame);
+    if (!pool_give(&frame_pool, *frame)) {
+        av_frame_free(frame);
+    }
+    *frame = NULL;
+}
+
+void ffmpegx_packet_put(AVPacket **packet) {
+    if (!*packet) return;
+
+    av_packet_unref(*packet);
+    if (!pool_give(&packet_pool, *packet)) {
+        av_packet_free(packet);
+    }
+    *packet = NULL;
+}
+
+void ffmpegx_pool_stats(FFmpegxPoolStats *stats) {
+    stats->frame_gets = atomic_load_explicit(&frame_pool.gets, memory_order_relaxed);
+    stats->frame_allocs = atomic_load_explicit(&frame_pool.allocs, memory_order_relaxed);
+    stats->packet_gets = atomic_load_explicit(&packet_pool.gets, memory_order_relaxed);
+    stats->packet_allocs = atomic_load_explicit(&packet_pool.allocs, memory_order_relaxed);
+}
+
+// Empties the pool into items, which must hold capacity entries
+static int pool_drain(Pool *pool, void **items) {
+    pthread_mutex_lock(&pool->mutex);
+    int count = pool->count;
+    for (int i = 0; i < count; i++) {
+        items[i] = pool->items[i];
+    }
+    pool->count = 0;
+    pthread_mutex_unlock(&pool->mutex);
+    return count;
+}
+
+void ffmpegx_pool_trim(void) {
+    void *items[FFMPEGX_PACKET_POOL_SIZE];
+
+    int count = pool_drain(&frame_pool, items);
+    for (int i = 0; i < count; i++) {
+        AVFrame *frame = items[i];
+        av_frame_free(&frame);
+    }
+    count = pool_drain(&packet_pool, items);
+    for (int i = 0; i < count; i++) {
+        AVPacket *packet = items[i];
+        av_packet_free(&packet);
+    }
+}
+
+#endif // HAVE_FFMPEG_STATIC
@@ -0,0 +1,56 @@
+/**
+ * Shared AVFrame/AVPacket pools
+ * Recycles the frame and packet structs that the hot loops allocate per packet,
+ * per decoded frame and per job, for every native entry point, so steady-state
+ * processing stops going to the heap for them. Pixel data is pooled separately
+ * through AVBufferPool (ffmpeg_convert.h).
+ */
+
+#ifndef FFMPEGX_POOL_H
+#define FFMPEGX_POOL_H
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include <stdint.h>
+
+#include "libavcodec/packet.h"
+#include "libavutil/frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Structs kept per pool; anything returned beyond that is freed
+#define FFMPEGX_FRAME_POOL_SIZE 64
+#define FFMPEGX_PACKET_POOL_SIZE 256
+
+typedef struct FFmpegxPoolStats {
+    int64_t frame_gets;
+    int64_t frame_allocs;       // gets the pool could not serve
+    int64_t packet_gets;
+    int64_t packet_allocs;
+} FFmpegxPoolStats;
+
+// Blank frame/packet, as from av_frame_alloc()/av_packet_alloc(); NULL on ENOMEM.
+// Safe from any thread.
+AVFrame *ffmpegx_frame_get(void);
+AVPacket *ffmpegx_packet_get(void);
+
+// Unreferences the frame/packet and keeps it for the next get; sets the pointer
+// to NULL and accepts NULL. Anything from av_frame_alloc()/av_packet_alloc() may
+// be put, and a pooled frame/packet may still be released with av_frame_free().
+void ffmpegx_frame_put(AVFrame **frame);
+void ffmpegx_packet_put(AVPacket **packet);
+
+void ffmpegx_pool_stats(FFmpegxPoolStats *stats);
+
+// Frees every pooled struct, e.g. on memory pressure
+void ffmpegx_pool_trim(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_POOL_H
@@ -0,0 +1,569 @@
+/**
+ * Media probe
+ * One mutex guards the in-memory LRU, another the cache directory. Disk entries are
+ * one file per path (hashed name) holding the key and the FFmpegxMediaInfo as is,
+ * written to a temporary file and renamed into place; their mtime is the LRU clock.
+ */
+
+#include <android/log.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ffmpeg_probe.h"
+
+#define LOG_TAG "FFmpegProbe"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+static atomic_llong memory_hits;
+static atomic_llong disk_hits;
+static atomic_llong fast_probes;
+static atomic_llong full_probes;
+
+void ffmpegx_probe_stats(FFmpegxProbeStats *stats) {
+    stats->memory_hits = atomic_load(&memory_hits);
+    stats->disk_hits = atomic_load(&disk_hits);
+    stats->fast_probes = atomic_load(&fast_probes);
+    stats->full_probes = atomic_load(&full_probes);
+}
+
+static const char *media_type_name(int type) {
+    // AVMediaType values
+    switch (type) {
+        case 0: return "video";
+        case 1: return "audio";
+        case 2: return "data";
+        case 3: return "subtitle";
+        case 4: return "attachment";
+        default: return "unknown";
+    }
+}
+
+char *ffmpegx_probe_to_json(const FFmpegxMediaInfo *info) {
+    char *json = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&json, &size);
+    if (!out) {
+        return NULL;
+    }
+
+    // Format and codec names are demuxer/codec identifiers, no escaping needed
+    fprintf(out, "{\"format\":\"%s\",\"durationUs\":%" PRId64 ",\"startUs\":%" PRId64
+                 ",\"bitRate\":%" PRId64 ",\"fullProbe\":%s,\"streams\":[",
+            info->format, info->duration_us, info->start_us, info->bit_rate,
+            info->full_probe ? "true" : "false");
+    for (int i = 0; i < info->nb_streams; i++) {
+        const FFmpegxStreamInfo *s = &info->streams[i];
+        fprintf(out, "%s{\"index\":%d,\"type\":\"%s\",\"codec\":\"%s\",\"bitRate\":%" PRId64
+                     ",\"durationUs\":%" PRId64,
+                i ? "," : "", s->index, media_type_name(s->type), s->codec, s->bit_rate,
+                s->duration_us);
+        if (s->width > 0) {
+            fprintf(out, ",\"width\":%d,\"height\":%d,\"rotation\":%d,\"fpsNum\":%d,\"fpsDen\":%d",
+                    s->width, s->height, s->rotation, s->fps_num, s->fps_den);
+        }
+        if (s->sample_rate > 0) {
+            fprintf(out, ",\"sampleRate\":%d,\"channels\":%d", s->sample_rate, s->channels);
+        }
+        fputc('}', out);
+    }
+    fputs("]}", out);
+
+    if (fclose(out) != 0) {
+        free(json);
+        return NULL;
+    }
+    return json;
+}
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libavutil/avstring.h"
+#include "libavutil/display.h"
+
+#include "ffmpeg_fdio.h"
+#include "ffmpeg_progress.h"
+#include "ffmpeg_session.h"
+
+#define DISK_MAGIC 0x42505846   // "FXPB"
+
+typedef struct ProbeKey {
+    int64_t size;
+    int64_t mtime_ns;
+} ProbeKey;
+
+typedef struct MemoryEntry {
+    char *path;
+    ProbeKey key;
+    int64_t last_used_ns;
+    FFmpegxMediaInfo info;
+} MemoryEntry;
+
+// Leads every disk entry, followed by path_len bytes of path and the info
+typedef struct DiskHeader {
+    uint32_t magic;
+    uint32_t info_size;         // layout check: entries of another build are misses
+    ProbeKey key;
+    uint32_t path_len;
+    uint32_t reserved;
+} DiskHeader;
+
+static pthread_mutex_t memory_mutex = PTHREAD_MUTEX_INITIALIZER;
+static MemoryEntry *memory_entries[FFMPEGX_PROBE_MEMORY_ENTRIES];
+
+static pthread_mutex_t disk_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char *cache_dir;
+
+// A cached result answers the request when it is at least as thorough
+static int result_usable(const FFmpegxMediaInfo *info, int flags) {
+    return info->full_probe || (flags & FFMPEGX_PROBE_FAST);
+}
+
+static int memory_lookup(const char *path, const ProbeKey *key, int flags, FFmpegxMediaInfo *info) {
+    int found = 0;
+
+    pthread_mutex_lock(&memory_mutex);
+    for (int i = 0; i < FFMPEGX_PROBE_MEMORY_ENTRIES; i++) {
+        MemoryEntry *entry = memory_entries[i];
+        if (entry && strcmp(entry->path, path) == 0 &&
+            entry->key.size == key->size && entry->key.mtime_ns == key->mtime_ns &&
+            result_usable(&entry->info, flags)) {
+            entry->last_used_ns = ffmpegx_now_ns();
+            *info = entry->info;
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&memory_mutex);
+    return found;
+}
+
+static void memory_store(const char *path, const ProbeKey *key, const FFmpegxMediaInfo *info) {
+    MemoryEntry *entry = calloc(1, sizeof(*entry));
+    if (!entry || !(entry->path = strdup(path))) {
+        free(entry);
+        return;
+    }
+    entry->key = *key;
+    entry->info = *info;
+    entry->last_used_ns = ffmpegx_now_ns();
+
+    pthread_mutex_lock(&memory_mutex);
+    // Replaces the entry for the same path, else takes a free slot, else the oldest
+    int slot = -1;
+    for (int i = 0; i < FFMPEGX_PROBE_MEMORY_ENTRIES && slot < 0; i++) {
+        if (memory_entries[i] && strcmp(memory_entries[i]->path, path) == 0) {
+            slot = i;
+        }
+    }
+    for (int i = 0; i < FFMPEGX_PROBE_MEMORY_ENTRIES && slot < 0; i++) {
+        if (!memory_entries[i]) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        slot = 0;
+        for (int i = 1; i < FFMPEGX_PROBE_MEMORY_ENTRIES; i++) {
+            if (memory_entries[i]->last_used_ns < memory_entries[slot]->last_used_ns) {
+                slot = i;
+            }
+        }
+    }
+    MemoryEntry *old = memory_entries[slot];
+    memory_entries[slot] = entry;
+    pthread_mutex_unlock(&memory_mutex);
+
+    if (old) {
+        free(old->path);
+        free(old);
+    }
+}
+
+void ffmpegx_probe_cache_clear(void) {
+    MemoryEntry *entries[FFMPEGX_PROBE_MEMORY_ENTRIES];
+
+    pthread_mutex_lock(&memory_mutex);
+    memcpy(entries, memory_entries, sizeof(entries));
+    memset(memory_entries, 0, sizeof(memory_entries));
+    pthread_mutex_unlock(&memory_mutex);
+
+    for (int i = 0; i < FFMPEGX_PROBE_MEMORY_ENTRIES; i++) {
+        if (entries[i]) {
+            free(entries[i]->path);
+            free(entries[i]);
+        }
+    }
+}
+
+int ffmpegx_probe_set_cache_dir(const char *dir) {
+    char *copy = NULL;
+
+    if (dir) {
+        if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+            int err = errno;
+            LOGW("Could not create probe cache %s: %s", dir, strerror(err));
+            return AVERROR(err);
+        }
+        if (!(copy = strdup(dir))) {
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    pthread_mutex_lock(&disk_mutex);
+    free(cache_dir);
+    cache_dir = copy;
+    pthread_mutex_unlock(&disk_mutex);
+    return 0;
+}
+
+// <dir>/<FNV-1a of the path>.probe, under disk_mutex
+static int disk_entry_path(const char *path, char *out, size_t out_size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        hash = (hash ^ *p) * 0x100000001b3ULL;
+    }
+    int len = snprintf(out, out_size, "%s/%016" PRIx64 ".probe", cache_dir, hash);
+    return len > 0 && (size_t)len < out_size;
+}
+
+static int disk_lookup(const char *path, const ProbeKey *key, int flags, FFmpegxMediaInfo *info) {
+    char file[4096];
+    int found = 0;
+
+    pthread_mutex_lock(&disk_mutex);
+    if (!cache_dir || !disk_entry_path(path, file, sizeof(file))) {
+        pthread_mutex_unlock(&disk_mutex);
+        return 0;
+    }
+
+    FILE *in = fopen(file, "rb");
+    if (in) {
+        DiskHeader header;
+        size_t path_len = strlen(path);
+        char *stored_path = malloc(path_len + 1);
+        if (stored_path &&
+            fread(&header, sizeof(header), 1, in) == 1 &&
+            header.magic == DISK_MAGIC && header.info_size == sizeof(*info) &&
+            header.key.size == key->size && header.key.mtime_ns == key->mtime_ns &&
+            header.path_len == path_len &&
+            fread(stored_path, 1, path_len, in) == path_len &&
+            memcmp(stored_path, path, path_len) == 0 &&
+            fread(info, sizeof(*info), 1, in) == 1 &&
+            info->nb_streams >= 0 && info->nb_streams <= FFMPEGX_PROBE_MAX_STREAMS &&
+            result_usable(info, flags)) {
+            found = 1;
+        }
+        free(stored_path);
+        fclose(in);
+        if (found) {
+            // Bumps the entry's mtime, the eviction order
+            utimensat(AT_FDCWD, file, NULL, 0);
+        }
+    }
+    pthread_mutex_unlock(&disk_mutex);
+    return found;
+}
+
+typedef struct DiskFile {
+    int64_t mtime_ns;
+    char name[32];
+} DiskFile;
+
+static int compare_disk_files(const void *a, const void *b) {
+    const DiskFile *fa = a;
+    const DiskFile *fb = b;
+    return fa->mtime_ns < fb->mtime_ns ? -1 : fa->mtime_ns > fb->mtime_ns;
+}
+
+// Removes the least recently used entries beyond FFMPEGX_PROBE_DISK_ENTRIES, under disk_mutex
+static void disk_evict(void) {
+    DIR *dir = opendir(cache_dir);
+    DiskFile *files = NULL;
+    int count = 0, capacity = 0;
+    struct dirent *ent;
+
+    if (!dir) return;
+    while ((ent = readdir(dir))) {
+        size_t len = strlen(ent->d_name);
+        struct stat st;
+        if (len < 7 || len >= sizeof(files->name) || strcmp(ent->d_name + len - 6, ".probe") != 0 ||
+            fstatat(dirfd(dir), ent->d_name, &st, 0) != 0) {
+            continue;
+        }
+        if (count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : FFMPEGX_PROBE_DISK_ENTRIES + 16;
+            DiskFile *grown = realloc(files, new_capacity * sizeof(*files));
+            if (!grown) break;
+            files = grown;
+            capacity = new_capacity;
+        }
+        files[count].mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        memcpy(files[count].name, ent->d_name, len + 1);
+        count++;
+    }
+
+    if (count > FFMPEGX_PROBE_DISK_ENTRIES) {
+        qsort(files, count, sizeof(*files), compare_disk_files);
+        for (int i = 0; i < count - FFMPEGX_PROBE_DISK_ENTRIES; i++) {
+            unlinkat(dirfd(dir), files[i].name, 0);
+        }
+    }
+    free(files);
+    closedir(dir);
+}
+
+static void disk_store(const char *path, const ProbeKey *key, const FFmpegxMediaInfo *info) {
+    char file[4096];
+    char tmp[4096];
+
+    pthread_mutex_lock(&disk_mutex);
+    if (!cache_dir || !disk_entry_path(path, file, sizeof(file)) ||
+        snprintf(tmp, sizeof(tmp), "%s/.probe-XXXXXX", cache_dir) >= (int)sizeof(tmp)) {
+        pthread_mutex_unlock(&disk_mutex);
+        return;
+    }
+
+    int fd = mkstemp(tmp);
+    FILE *out = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!out) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        pthread_mutex_unlock(&disk_mutex);
+        return;
+    }
+
+    DiskHeader header = {
+        .magic = DISK_MAGIC,
+        .info_size = sizeof(*info),
+        .key = *key,
+        .path_len = (uint32_t)strlen(path),
+    };
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+             fwrite(path, 1, header.path_len, out) == header.path_len &&
+             fwrite(info, sizeof(*info), 1, out) == 1;
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(tmp, file) != 0) {
+        LOGW("Could not write probe cache entry for %s", path);
+        unlink(tmp);
+    } else {
+        disk_evict();
+    }
+    pthread_mutex_unlock(&disk_mutex);
+}
+
+// Whether the demuxer's header alone describes every stream and the duration
+static int header_complete(const AVFormatContext *ctx) {
+    int has_duration = ctx->duration != AV_NOPTS_VALUE;
+
+    if ((ctx->ctx_flags & AVFMTCTX_NOHEADER) || ctx->nb_streams == 0) {
+        return 0;
+    }
+    for (unsigned i = 0; i < ctx->nb_streams; i++) {
+        const AVStream *st = ctx->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+        if (par->codec_id == AV_CODEC_ID_NONE) {
+            return 0;
+        }
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO && (par->width <= 0 || par->height <= 0)) {
+            return 0;
+        }
+        if (par->codec_type == AVMEDIA_TYPE_AUDIO &&
+            (par->sample_rate <= 0 || par->ch_layout.nb_channels <= 0)) {
+            return 0;
+        }
+        if (st->duration != AV_NOPTS_VALUE) {
+            has_duration = 1;
+        }
+    }
+    return has_duration;
+}
+
+static int stream_rotation(const AVStream *st) {
+    const int32_t *matrix = NULL;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(60, 30, 100)
+    const AVPacketSideData *sd = av_packet_side_data_get(st->codecpar->coded_side_data,
+                                                         st->codecpar->nb_coded_side_data,
+                                                         AV_PKT_DATA_DISPLAYMATRIX);
+    if (sd && sd->size >= 9 * sizeof(int32_t)) {
+        matrix = (const int32_t *)sd->data;
+    }
+#else
+    size_t size = 0;
+    matrix = (const int32_t *)av_stream_get_side_data(st, AV_PKT_DATA_DISPLAYMATRIX, &size);
+    if (size < 9 * sizeof(int32_t)) {
+        matrix = NULL;
+    }
+#endif
+    if (!matrix) {
+        return 0;
+    }
+    // av_display_rotation_get() is counterclockwise, like ffmpeg's autorotate
+    double theta = -av_display_rotation_get(matrix);
+    if (theta != theta) {
+        return 0;
+    }
+    int degrees = (int)lrint(theta) % 360;
+    return degrees < 0 ? degrees + 360 : degrees;
+}
+
+static void fill_info(const AVFormatContext *ctx, int64_t file_size, int full_probe,
+                      FFmpegxMediaInfo *info) {
+    memset(info, 0, sizeof(*info));
+    av_strlcpy(info->format, ctx->iformat->name, sizeof(info->format));
+    info->full_probe = full_probe;
+    info->start_us = ctx->start_time != AV_NOPTS_VALUE ? ctx->start_time : 0;
+    info->duration_us = ctx->duration != AV_NOPTS_VALUE ? ctx->duration : 0;
+    info->bit_rate = ctx->bit_rate;
+
+    for (unsigned i = 0; i < ctx->nb_streams; i++) {
+        const AVStream *st = ctx->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+        int64_t duration_us = st->duration != AV_NOPTS_VALUE ?
+                              av_rescale_q(st->duration, st->time_base, AV_TIME_BASE_Q) : 0;
+        // Header-only probes leave the container duration to the streams
+        if (duration_us > info->duration_us && ctx->duration == AV_NOPTS_VALUE) {
+            info->duration_us = duration_us;
+        }
+        if (info->nb_streams == FFMPEGX_PROBE_MAX_STREAMS) {
+            continue;
+        }
+
+        FFmpegxStreamInfo *s = &info->streams[info->nb_streams++];
+        s->index = (int)i;
+        s->type = par->codec_type;
+        av_strlcpy(s->codec, avcodec_get_name(par->codec_id), sizeof(s->codec));
+        s->bit_rate = par->bit_rate;
+        s->duration_us = duration_us;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+            AVRational fps = st->avg_frame_rate.num > 0 ? st->avg_frame_rate : st->r_frame_rate;
+            s->width = par->width;
+            s->height = par->height;
+            s->rotation = stream_rotation(st);
+            s->fps_num = fps.num;
+            s->fps_den = fps.den;
+        } else if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
+            s->sample_rate = par->sample_rate;
+            s->channels = par->ch_layout.nb_channels;
+        }
+    }
+
+    if (info->bit_rate <= 0 && info->duration_us > 0 && file_size > 0) {
+        info->bit_rate = av_rescale(file_size, 8 * AV_TIME_BASE, info->duration_us);
+    }
+}
+
+// AVERROR(EAGAIN) when a fast probe could not describe every stream
+static int probe_file(const char *path, int fast, int64_t file_size, FFmpegxMediaInfo *info) {
+    AVFormatContext *ctx = NULL;
+    AVDictionary *opts = NULL;
+    int ret;
+
+    if (fast) {
+        av_dict_set_int(&opts, "probesize", FFMPEGX_PROBE_FAST_SIZE, 0);
+        av_dict_set_int(&opts, "analyzeduration", FFMPEGX_PROBE_FAST_DURATION_US, 0);
+    }
+    ret = ffmpegx_open_input(&ctx, path, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (!fast || !header_complete(ctx)) {
+        ret = avformat_find_stream_info(ctx, NULL);
+        if (ret < 0) {
+            goto end;
+        }
+        if (fast && !header_complete(ctx)) {
+            ret = AVERROR(EAGAIN);
+            goto end;
+        }
+    }
+
+    fill_info(ctx, file_size, !fast, info);
+    ret = 0;
+
+end:
+    ffmpegx_close_input(&ctx);
+    return ret;
+}
+
+int ffmpegx_probe(const char *path, int flags, FFmpegxMediaInfo *info) {
+    struct stat st;
+    ProbeKey key = {0};
+    int cacheable;
+    int ret;
+
+    int fd = ffmpegx_fd_url(path);
+    if (fd >= 0 ? fstat(fd, &st) != 0 : stat(path, &st) != 0) {
+        return AVERROR(errno);
+    }
+    // A descriptor number says nothing about which file is behind it
+    cacheable = fd < 0 && S_ISREG(st.st_mode);
+    key.size = st.st_size;
+    key.mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+    if (cacheable && !(flags & FFMPEGX_PROBE_NO_CACHE)) {
+        if (memory_lookup(path, &key, flags, info)) {
+            atomic_fetch_add(&memory_hits, 1);
+            return 0;
+        }
+        if (disk_lookup(path, &key, flags, info)) {
+            atomic_fetch_add(&disk_hits, 1);
+            memory_store(path, &key, info);
+            return 0;
+        }
+    }
+
+    ret = AVERROR(EAGAIN);
+    if (flags & FFMPEGX_PROBE_FAST) {
+        ret = probe_file(path, 1, key.size, info);
+        if (ret >= 0) {
+            atomic_fetch_add(&fast_probes, 1);
+        }
+    }
+    if (ret == AVERROR(EAGAIN)) {
+        LOGD("Full probe of %s", path);
+        ret = probe_file(path, 0, key.size, info);
+        if (ret >= 0) {
+            atomic_fetch_add(&full_probes, 1);
+        }
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (cacheable) {
+        memory_store(path, &key, info);
+        disk_store(path, &key, info);
+    }
+    return 0;
+}
+
+#else
+
+int ffmpegx_probe(const char *path, int flags, FFmpegxMediaInfo *info) {
+    return -ENOSYS;
+}
+
+int ffmpegx_probe_set_cache_dir(const char *dir) {
+    return -ENOSYS;
+}
+
+void ffmpegx_probe_cache_clear(void) {
+}
+
+#endif // HAVE_FFMPEG_STATIC
@@ -0,0 +1,86 @@
+/**
+ * Media probe
+ * Compact description of a file's container and streams. Fast mode trusts the
+ * container header when it already describes every stream (MP4/MOV, MKV, ...) and
+ * reads at most FFMPEGX_PROBE_FAST_SIZE bytes otherwise. Results are cached in
+ * memory and in an on-disk LRU keyed by path, size and mtime.
+ */
+
+#ifndef FFMPEGX_PROBE_H
+#define FFMPEGX_PROBE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FFMPEGX_PROBE_MAX_STREAMS 16
+
+// Results kept in memory / on disk; the least recently used ones are dropped beyond that
+#define FFMPEGX_PROBE_MEMORY_ENTRIES 64
+#define FFMPEGX_PROBE_DISK_ENTRIES 512
+
+// probesize and analyzeduration of a fast probe whose header is not enough on its own
+#define FFMPEGX_PROBE_FAST_SIZE (256 * 1024)
+#define FFMPEGX_PROBE_FAST_DURATION_US 500000
+
+// ffmpegx_probe() flags
+#define FFMPEGX_PROBE_FAST     0x1  // reduced probesize, falls back to a full probe
+#define FFMPEGX_PROBE_NO_CACHE 0x2  // ignore cached results (the new one is still stored)
+
+typedef struct FFmpegxStreamInfo {
+    int index;
+    int type;                   // AVMediaType
+    char codec[32];             // avcodec_get_name()
+    int64_t bit_rate;           // 0 when unknown
+    int64_t duration_us;        // 0 when unknown
+    // Video
+    int width;
+    int height;
+    int rotation;               // clockwise degrees to rotate by for display, [0, 360)
+    int fps_num;
+    int fps_den;
+    // Audio
+    int sample_rate;
+    int channels;
+} FFmpegxStreamInfo;
+
+typedef struct FFmpegxMediaInfo {
+    char format[32];            // demuxer name
+    int64_t duration_us;
+    int64_t start_us;
+    int64_t bit_rate;
+    int full_probe;             // probed with the default probesize/analyzeduration
+    int nb_streams;             // streams described, at most FFMPEGX_PROBE_MAX_STREAMS
+    FFmpegxStreamInfo streams[FFMPEGX_PROBE_MAX_STREAMS];
+} FFmpegxMediaInfo;
+
+typedef struct FFmpegxProbeStats {
+    int64_t memory_hits;
+    int64_t disk_hits;
+    int64_t fast_probes;        // answered from the header or a reduced probe
+    int64_t full_probes;
+} FFmpegxProbeStats;
+
+// Describes path, from the caches when the file is unchanged. A fast request is
+// also served by a cached full result, never the other way round.
+// Returns 0 or an AVERROR code.
+int ffmpegx_probe(const char *path, int flags, FFmpegxMediaInfo *info);
+
+// Directory of the on-disk cache, created if needed; NULL disables it (the default)
+int ffmpegx_probe_set_cache_dir(const char *dir);
+
+// Forgets the in-memory results; the disk cache is left alone
+void ffmpegx_probe_cache_clear(void);
+
+void ffmpegx_probe_stats(FFmpegxProbeStats *stats);
+
+// {"format":..., "durationUs":..., "streams":[...]}; free() the result. NULL on ENOMEM.
+char *ffmpegx_probe_to_json(const FFmpegxMediaInfo *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FFMPEGX_PROBE_H
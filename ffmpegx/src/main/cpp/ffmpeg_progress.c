@@ -0,0 +1,188 @@
+/**
+ * Binary progress block and stage timing
+ * Seqlock-protected writer side of the progress struct shared with Java, and the
+ * lock-free per-stage counters
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include "ffmpeg_progress.h"
+
+_Static_assert(offsetof(FFmpegxProgress, stage_ns) == 72, "progress layout changed");
+_Static_assert(FFMPEGX_STAGE_COUNT == 6, "progress layout changed");
+_Static_assert(offsetof(FFmpegxProgress, start_ns) == FFMPEGX_PROGRESS_SHARED_SIZE,
+               "progress layout changed");
+
+static FFmpegxProgress default_progress = { .version = FFMPEGX_PROGRESS_VERSION };
+static FFmpegxStats default_stats;
+
+static const char *const stage_names[FFMPEGX_STAGE_COUNT] = {
+    "demux", "decode", "scale", "filter", "encode", "mux",
+};
+
+// Per-thread running totals for ffmpegx_stats_thread_ns()
+static _Thread_local int64_t thread_stage_ns[FFMPEGX_STAGE_COUNT];
+
+FFmpegxProgress *ffmpegx_progress_default(void) {
+    return &default_progress;
+}
+
+int64_t ffmpegx_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Attempts of ffmpegx_progress_read() before it gives up on a busy block
+#define READ_RETRIES 1000
+
+static void write_begin(FFmpegxProgress *progress) {
+    _Atomic int32_t *writer = (_Atomic int32_t *)&progress->writer;
+    _Atomic uint32_t *seq = (_Atomic uint32_t *)&progress->seq;
+
+    // Updates are a few stores long, not worth sleeping for
+    while (atomic_exchange_explicit(writer, 1, memory_order_acquire)) {
+        sched_yield();
+    }
+    atomic_fetch_add_explicit(seq, 1, memory_order_relaxed);
+    // Field stores below must not become visible before the odd sequence number
+    atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(FFmpegxProgress *progress) {
+    atomic_fetch_add_explicit((_Atomic uint32_t *)&progress->seq, 1, memory_order_release);
+    atomic_store_explicit((_Atomic int32_t *)&progress->writer, 0, memory_order_release);
+}
+
+void ffmpegx_progress_start(FFmpegxProgress *progress, int64_t duration_us) {
+    if (!progress) return;
+
+    write_begin(progress);
+    progress->version = FFMPEGX_PROGRESS_VERSION;
+    progress->state = FFMPEGX_PROGRESS_RUNNING;
+    progress->error = 0;
+    progress->frames = 0;
+    progress->pts_us = 0;
+    progress->duration_us = duration_us > 0 ? duration_us : 0;
+    progress->bytes_written = 0;
+    progress->fps = 0;
+    progress->speed = 0;
+    progress->elapsed_ns = 0;
+    memset(progress->stage_ns, 0, sizeof(progress->stage_ns));
+    progress->start_ns = ffmpegx_now_ns();
+    write_end(progress);
+}
+
+void ffmpegx_progress_update(FFmpegxProgress *progress, int64_t frames, int64_t pts_us,
+                             int64_t bytes_written, const int64_t *stage_ns) {
+    if (!progress) return;
+
+    int64_t elapsed = ffmpegx_now_ns() - progress->start_ns;
+    double seconds = elapsed / 1e9;
+
+    write_begin(progress);
+    progress->frames = frames;
+    if (pts_us > progress->pts_us) {
+        progress->pts_us = pts_us;
+    }
+    progress->bytes_written = bytes_written;
+    progress->elapsed_ns = elapsed;
+    if (seconds > 0) {
+        progress->fps = frames / seconds;
+        progress->speed = (progress->pts_us / 1e6) / seconds;
+    }
+    if (stage_ns) {
+        memcpy(progress->stage_ns, stage_ns, sizeof(progress->stage_ns));
+    }
+    write_end(progress);
+}
+
+void ffmpegx_progress_finish(FFmpegxProgress *progress, int error) {
+    if (!progress) return;
+
+    write_begin(progress);
+    if (error == -ECANCELED) {
+        progress->state = FFMPEGX_PROGRESS_CANCELLED;
+    } else {
+        progress->state = error < 0 ? FFMPEGX_PROGRESS_FAILED : FFMPEGX_PROGRESS_FINISHED;
+    }
+    progress->error = error < 0 ? error : 0;
+    progress->elapsed_ns = ffmpegx_now_ns() - progress->start_ns;
+    write_end(progress);
+}
+
+int ffmpegx_progress_read(const FFmpegxProgress *progress, FFmpegxProgress *out) {
+    _Atomic uint32_t *seq = (_Atomic uint32_t *)&progress->seq;
+
+    for (int i = 0; i < READ_RETRIES; i++) {
+        uint32_t before = atomic_load_explicit(seq, memory_order_acquire);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(out, progress, FFMPEGX_PROGRESS_SHARED_SIZE);
+        // The field loads above must complete before seq is checked again
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(seq, memory_order_relaxed) == before) {
+            out->start_ns = 0;
+            out->writer = 0;
+            return 0;
+        }
+    }
+    return -EAGAIN;
+}
+
+const char *ffmpegx_stage_name(FFmpegxStage stage) {
+    return stage >= 0 && stage < FFMPEGX_STAGE_COUNT ? stage_names[stage] : "unknown";
+}
+
+FFmpegxStats *ffmpegx_stats_default(void) {
+    return &default_stats;
+}
+
+void ffmpegx_stats_reset(FFmpegxStats *stats) {
+    if (!stats) return;
+
+    for (int i = 0; i < FFMPEGX_STAGE_COUNT; i++) {
+        FFmpegxStageStats *stage = &stats->stages[i];
+        atomic_store_explicit((_Atomic int64_t *)&stage->total_ns, 0, memory_order_relaxed);
+        atomic_store_explicit((_Atomic int64_t *)&stage->count, 0, memory_order_relaxed);
+        atomic_store_explicit((_Atomic int64_t *)&stage->max_ns, 0, memory_order_relaxed);
+    }
+}
+
+void ffmpegx_stats_add(FFmpegxStats *stats, FFmpegxStage stage, int64_t ns) {
+    if (stage < 0 || stage >= FFMPEGX_STAGE_COUNT) return;
+
+    thread_stage_ns[stage] += ns;
+    if (!stats) return;
+
+    FFmpegxStageStats *counters = &stats->stages[stage];
+    atomic_fetch_add_explicit((_Atomic int64_t *)&counters->total_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit((_Atomic int64_t *)&counters->count, 1, memory_order_relaxed);
+
+    _Atomic int64_t *max_ns = (_Atomic int64_t *)&counters->max_ns;
+    int64_t current = atomic_load_explicit(max_ns, memory_order_relaxed);
+    while (ns > current &&
+           !atomic_compare_exchange_weak_explicit(max_ns, &current, ns,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+int64_t ffmpegx_stats_thread_ns(FFmpegxStage stage) {
+    return stage >= 0 && stage < FFMPEGX_STAGE_COUNT ? thread_stage_ns[stage] : 0;
+}
+
+void ffmpegx_stats_read(const FFmpegxStats *stats, int64_t *out) {
+    for (int i = 0; i < FFMPEGX_STAGE_COUNT; i++) {
+        FFmpegxStageStats *stage = (FFmpegxStageStats *)&stats->stages[i];
+        out[i * 3] = atomic_load_explicit((_Atomic int64_t *)&stage->total_ns, memory_order_relaxed);
+        out[i * 3 + 1] = atomic_load_explicit((_Atomic int64_t *)&stage->count, memory_order_relaxed);
+        out[i * 3 + 2] = atomic_load_explicit((_Atomic int64_t *)&stage->max_ns, memory_order_relaxed);
+    }
+}
@@ -0,0 +1,117 @@
+/**
+ * Binary progress block and stage timing
+ * A fixed-layout struct that the pipeline updates in place and Java reads through
+ * a direct ByteBuffer, replacing "progress:%.1f" strings and log-line regexes, plus
+ * per-stage counters (busy time, units of work, slowest unit) for a whole command
+ */
+
+#ifndef FFMPEGX_PROGRESS_H
+#define FFMPEGX_PROGRESS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bumped whenever the layout below changes; mirrored in FFmpegNativeProgress.kt
+#define FFMPEGX_PROGRESS_VERSION 2
+
+typedef enum FFmpegxStage {
+    FFMPEGX_STAGE_DEMUX = 0,
+    FFMPEGX_STAGE_DECODE,
+    FFMPEGX_STAGE_SCALE,        // sws_scale() conversions, wherever they run
+    FFMPEGX_STAGE_FILTER,       // filter callbacks/graphs, excluding SCALE
+    FFMPEGX_STAGE_ENCODE,
+    FFMPEGX_STAGE_MUX,
+    FFMPEGX_STAGE_COUNT
+} FFmpegxStage;
+
+typedef enum FFmpegxProgressState {
+    FFMPEGX_PROGRESS_IDLE = 0,
+    FFMPEGX_PROGRESS_RUNNING,
+    FFMPEGX_PROGRESS_FINISHED,
+    FFMPEGX_PROGRESS_FAILED,
+    FFMPEGX_PROGRESS_CANCELLED,
+} FFmpegxProgressState;
+
+// Shared with Kotlin by offset, native byte order. seq is a seqlock counter: it is
+// odd while an update is in progress, readers retry until they see the same even
+// value before and after copying the fields. Writers take turns through a lock, as
+// commands without a session all write the default block.
+typedef struct FFmpegxProgress {
+    uint32_t version;                       // 0
+    uint32_t seq;                           // 4
+    int32_t state;                          // 8   FFmpegxProgressState
+    int32_t error;                          // 12  AVERROR when FAILED
+    int64_t frames;                         // 16  frames encoded
+    int64_t pts_us;                         // 24  output position
+    int64_t duration_us;                    // 32  input duration, 0 when unknown
+    int64_t bytes_written;                  // 40
+    double fps;                             // 48
+    double speed;                           // 56  output position / wall time
+    int64_t elapsed_ns;                     // 64
+    int64_t stage_ns[FFMPEGX_STAGE_COUNT];  // 72  busy time per pipeline stage
+
+    // Writer-only bookkeeping, not part of the shared layout contract
+    int64_t start_ns;
+    int32_t writer;                         // spin lock held from write_begin() to write_end()
+} FFmpegxProgress;
+
+// Per-stage counters of one command, summed over all of its threads and pipelines.
+// Updated with atomic operations; read them through ffmpegx_stats_read().
+typedef struct FFmpegxStageStats {
+    int64_t total_ns;                       // busy time
+    int64_t count;                          // units of work: packets, frames, conversions
+    int64_t max_ns;                         // slowest single unit
+} FFmpegxStageStats;
+
+typedef struct FFmpegxStats {
+    FFmpegxStageStats stages[FFMPEGX_STAGE_COUNT];
+} FFmpegxStats;
+
+// Bytes of FFmpegxProgress that Java may read
+#define FFMPEGX_PROGRESS_SHARED_SIZE (72 + 8 * FFMPEGX_STAGE_COUNT)
+
+// Process-wide block used by commands that are not bound to a session
+FFmpegxProgress *ffmpegx_progress_default(void);
+
+// Monotonic clock in nanoseconds
+int64_t ffmpegx_now_ns(void);
+
+// Writer side; safe from any number of threads, one update is applied at a time
+void ffmpegx_progress_start(FFmpegxProgress *progress, int64_t duration_us);
+void ffmpegx_progress_update(FFmpegxProgress *progress, int64_t frames, int64_t pts_us,
+                             int64_t bytes_written, const int64_t *stage_ns);
+void ffmpegx_progress_finish(FFmpegxProgress *progress, int error);
+
+// Reader side: a consistent copy of the shared fields, taken while a writer may be
+// running on another thread. AVERROR(EAGAIN) when writers kept the block busy for
+// every retry.
+int ffmpegx_progress_read(const FFmpegxProgress *progress, FFmpegxProgress *out);
+
+// "demux", "decode", ...
+const char *ffmpegx_stage_name(FFmpegxStage stage);
+
+// Process-wide counters used by commands that are not bound to a session
+FFmpegxStats *ffmpegx_stats_default(void);
+
+void ffmpegx_stats_reset(FFmpegxStats *stats);
+
+// Records one unit of work that kept a stage busy for ns; safe from any thread.
+// NULL stats only feeds the calling thread's running total (see below).
+void ffmpegx_stats_add(FFmpegxStats *stats, FFmpegxStage stage, int64_t ns);
+
+// Busy time the calling thread has recorded for a stage so far, across all stats.
+// Lets an enclosing measurement (a filter callback that converts frames) exclude
+// the time already booked to a nested stage.
+int64_t ffmpegx_stats_thread_ns(FFmpegxStage stage);
+
+// Copies the counters as {total_ns, count, max_ns} triples, FFMPEGX_STAGE_COUNT of them
+void ffmpegx_stats_read(const FFmpegxStats *stats, int64_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FFMPEGX_PROGRESS_H
@@ -0,0 +1,259 @@
+/**
+ * Native job scheduler
+ * Binary heap of pending jobs (priority, then submission order) guarded by one
+ * mutex; workers park on a condition variable while the queue is empty
+ */
+
+#include <android/log.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ffmpeg_scheduler.h"
+
+#define LOG_TAG "FFmpegScheduler"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+#define MAX_WORKERS 8
+
+// Implemented in ffmpeg_main.c (or the stub in ffmpeg_cmd.c)
+extern int ffmpeg_main_session(FFmpegxSession *session, int argc, char **argv);
+
+typedef struct Job {
+    FFmpegxSession *session;
+    int argc;
+    char **argv;
+    int priority;
+    uint64_t seq;
+    int64_t submit_ns;
+    FFmpegxJobDoneFn done;
+    void *opaque;
+} Job;
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static Job **heap;
+static int heap_size;
+static int heap_capacity;
+static uint64_t next_seq;
+
+static pthread_mutex_t start_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int worker_count;
+static int job_thread_budget;
+
+// Guarded by queue_mutex
+static int running_jobs;
+static int64_t submitted_jobs;
+static int64_t completed_jobs;
+static int64_t total_wait_ns;
+static int64_t max_wait_ns;
+
+static _Thread_local int current_thread_budget;
+
+// a runs before b
+static int job_before(const Job *a, const Job *b) {
+    if (a->priority != b->priority) {
+        return a->priority > b->priority;
+    }
+    return a->seq < b->seq;
+}
+
+static int heap_push(Job *job) {
+    if (heap_size == heap_capacity) {
+        int capacity = heap_capacity ? heap_capacity * 2 : 16;
+        Job **grown = realloc(heap, capacity * sizeof(*heap));
+        if (!grown) {
+            return -ENOMEM;
+        }
+        heap = grown;
+        heap_capacity = capacity;
+    }
+
+    int i = heap_size++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!job_before(job, heap[parent])) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = job;
+    return 0;
+}
+
+static Job *heap_pop(void) {
+    Job *top = heap[0];
+    Job *last = heap[--heap_size];
+    int i = 0;
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= heap_size) {
+            break;
+        }
+        if (child + 1 < heap_size && job_before(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!job_before(heap[child], last)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (heap_size > 0) {
+        heap[i] = last;
+    }
+    return top;
+}
+
+static void free_job(Job *job) {
+    for (int i = 0; i < job->argc; i++) {
+        free(job->argv[i]);
+    }
+    free(job->argv);
+    ffmpegx_session_unref(job->session);
+    free(job);
+}
+
+static void *worker_main(void *arg) {
+    char name[16];
+    snprintf(name, sizeof(name), "ffx-job-%d", (int)(intptr_t)arg);
+    pthread_setname_np(pthread_self(), name);
+
+    current_thread_budget = job_thread_budget;
+
+    for (;;) {
+        pthread_mutex_lock(&queue_mutex);
+        while (heap_size == 0) {
+            pthread_cond_wait(&queue_cond, &queue_mutex);
+        }
+        Job *job = heap_pop();
+        int64_t wait_ns = ffmpegx_now_ns() - job->submit_ns;
+        running_jobs++;
+        total_wait_ns += wait_ns;
+        if (wait_ns > max_wait_ns) {
+            max_wait_ns = wait_ns;
+        }
+        pthread_mutex_unlock(&queue_mutex);
+
+        LOGD("Job for session %lld started after %lld ms in queue",
+             (long long)ffmpegx_session_id(job->session), (long long)(wait_ns / 1000000));
+
+        // Same value as AVERROR(ECANCELED)
+        int result = -ECANCELED;
+        if (!ffmpegx_session_is_cancelled(job->session)) {
+            result = ffmpeg_main_session(job->session, job->argc, job->argv);
+        }
+        if (job->done) {
+            job->done(job->session, result, job->opaque);
+        }
+
+        pthread_mutex_lock(&queue_mutex);
+        running_jobs--;
+        completed_jobs++;
+        pthread_mutex_unlock(&queue_mutex);
+
+        free_job(job);
+    }
+    return NULL;
+}
+
+int ffmpegx_scheduler_start(int workers) {
+    pthread_mutex_lock(&start_mutex);
+    if (worker_count > 0) {
+        pthread_mutex_unlock(&start_mutex);
+        return worker_count;
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+    if (workers <= 0) {
+        // Two or more codec threads per job keep frame threading worthwhile
+        workers = cores / 2;
+    }
+    if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+    if (workers < 1) workers = 1;
+
+    job_thread_budget = cores / workers > 0 ? (int)(cores / workers) : 1;
+
+    int started = 0;
+    for (int i = 0; i < workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, (void *)(intptr_t)i) != 0) {
+            LOGE("Failed to create scheduler worker %d", i);
+            break;
+        }
+        pthread_detach(thread);
+        started++;
+    }
+    worker_count = started;
+
+    LOGI("Scheduler started: %d worker(s), %d codec thread(s) per job", started, job_thread_budget);
+    pthread_mutex_unlock(&start_mutex);
+    return started;
+}
+
+int ffmpegx_scheduler_submit(FFmpegxSession *session, int argc, char **argv, int priority,
+                             FFmpegxJobDoneFn done, void *opaque) {
+    if (ffmpegx_scheduler_start(0) <= 0) {
+        return -EAGAIN;
+    }
+
+    Job *job = calloc(1, sizeof(*job));
+    if (!job) {
+        return -ENOMEM;
+    }
+    if (session) {
+        ffmpegx_session_ref(session);
+    }
+    job->session = session;
+    job->argc = argc;
+    job->argv = argv;
+    job->priority = priority;
+    job->submit_ns = ffmpegx_now_ns();
+    job->done = done;
+    job->opaque = opaque;
+
+    pthread_mutex_lock(&queue_mutex);
+    job->seq = next_seq++;
+    int ret = heap_push(job);
+    if (ret == 0) {
+        submitted_jobs++;
+        pthread_cond_signal(&queue_cond);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+
+    if (ret < 0) {
+        // Leave argv to the caller, as on every other failure
+        job->argc = 0;
+        job->argv = NULL;
+        free_job(job);
+    }
+    return ret;
+}
+
+void ffmpegx_scheduler_stats(FFmpegxSchedulerStats *stats) {
+    pthread_mutex_lock(&start_mutex);
+    stats->workers = worker_count;
+    stats->thread_budget = job_thread_budget;
+    pthread_mutex_unlock(&start_mutex);
+
+    pthread_mutex_lock(&queue_mutex);
+    stats->queued = heap_size;
+    stats->running = running_jobs;
+    stats->submitted = submitted_jobs;
+    stats->completed = completed_jobs;
+    stats->total_wait_ns = total_wait_ns;
+    stats->max_wait_ns = max_wait_ns;
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+int ffmpegx_scheduler_thread_budget(void) {
+    return current_thread_budget;
+}
@@ -0,0 +1,59 @@
+/**
+ * Native job scheduler
+ * A fixed pool of worker threads runs queued commands by priority. Every worker
+ * gets an equal share of the CPU cores as its codec thread budget, so the codec
+ * threads of all running jobs together never exceed the core count.
+ */
+
+#ifndef FFMPEGX_SCHEDULER_H
+#define FFMPEGX_SCHEDULER_H
+
+#include <stdint.h>
+
+#include "ffmpeg_session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum FFmpegxJobPriority {
+    FFMPEGX_PRIORITY_LOW = 0,
+    FFMPEGX_PRIORITY_NORMAL,
+    FFMPEGX_PRIORITY_HIGH,
+} FFmpegxJobPriority;
+
+// Called on the worker thread once a job has finished (or was dropped because its
+// session was cancelled while it was still queued)
+typedef void (*FFmpegxJobDoneFn)(FFmpegxSession *session, int result, void *opaque);
+
+typedef struct FFmpegxSchedulerStats {
+    int workers;
+    int thread_budget;          // codec threads per running job
+    int queued;                 // queue depth
+    int running;
+    int64_t submitted;
+    int64_t completed;
+    int64_t total_wait_ns;      // time jobs spent queued, summed over started jobs
+    int64_t max_wait_ns;
+} FFmpegxSchedulerStats;
+
+// Starts the worker pool (0 = pick from the core count). Only the first call
+// decides the pool size; returns the number of workers.
+int ffmpegx_scheduler_start(int workers);
+
+// Queues ffmpeg_main_session(session, argc, argv), starting the pool if needed.
+// On success takes ownership of argv (array and strings, released with free())
+// and a reference to the session, which may be NULL. Returns 0 or a negative errno.
+int ffmpegx_scheduler_submit(FFmpegxSession *session, int argc, char **argv, int priority,
+                             FFmpegxJobDoneFn done, void *opaque);
+
+void ffmpegx_scheduler_stats(FFmpegxSchedulerStats *stats);
+
+// Codec thread budget of the job running on the calling thread, 0 off the pool
+int ffmpegx_scheduler_thread_budget(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FFMPEGX_SCHEDULER_H
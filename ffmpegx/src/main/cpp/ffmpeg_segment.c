@@ -0,0 +1,301 @@
+/**
+ * GOP-aligned segmentation helpers
+ * Segment planning and stream-copy stitching used by the segment-parallel transcoder
+ */
+
+#include <android/log.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_pool.h"
+#include "ffmpeg_segment.h"
+#include "ffmpeg_session.h"
+#include "libavutil/avutil.h"
+#include "libavutil/mathematics.h"
+
+#define LOG_TAG "FFmpegSegment"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+int ffmpegx_plan_segments(const FFmpegxKeyframeIndex *list, int max_segments, int min_seconds,
+                          FFmpegxSegment **segments) {
+    *segments = NULL;
+    if (list->count < 1 || list->end_pts == AV_NOPTS_VALUE) {
+        return AVERROR(EINVAL);
+    }
+
+    int64_t first = list->pts[0];
+    int64_t total = list->end_pts - first;
+    int64_t min_length = av_rescale_q(min_seconds, (AVRational){1, 1}, list->time_base);
+
+    int n = max_segments;
+    if (min_length > 0 && total / min_length < n) n = (int)(total / min_length);
+    if (n > list->count) n = list->count;
+    if (n < 1) n = 1;
+
+    FFmpegxSegment *out = av_malloc_array(n, sizeof(*out));
+    if (!out) {
+        return AVERROR(ENOMEM);
+    }
+
+    int count = 0;
+    int current = 0;
+    out[0].start_pts = AV_NOPTS_VALUE;
+
+    for (int i = 1; i < n; i++) {
+        int64_t target = first + av_rescale(total, i, n);
+
+        // First keyframe at or after the ideal split point, or the one just before it if closer
+        int next = current + 1;
+        while (next < list->count && list->pts[next] < target) {
+            next++;
+        }
+        if (next > current + 1 &&
+            (next == list->count || target - list->pts[next - 1] < list->pts[next] - target)) {
+            next--;
+        }
+        if (next >= list->count) {
+            break;
+        }
+
+        out[count].end_pts = list->pts[next];
+        count++;
+        out[count].start_pts = list->pts[next];
+        current = next;
+    }
+    out[count].end_pts = AV_NOPTS_VALUE;
+    count++;
+
+    *segments = out;
+    return count;
+}
+
+typedef struct ConcatVideoSource {
+    const char *const *files;
+    int count;
+    int current;
+    AVFormatContext *ctx;
+    int stream_index;
+} ConcatVideoSource;
+
+static int open_segment(ConcatVideoSource *src, int index) {
+    ffmpegx_close_input(&src->ctx);
+
+    int ret = ffmpegx_open_input(&src->ctx, src->files[index], NULL, NULL);
+    if (ret < 0) {
+        LOGE("Cannot open segment %s", src->files[index]);
+        return ret;
+    }
+    ret = av_find_best_stream(src->ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (ret < 0) {
+        LOGE("No video stream in segment %s", src->files[index]);
+        return ret;
+    }
+    src->stream_index = ret;
+    src->current = index;
+    return 0;
+}
+
+// Next video packet across all segments in output time base, AVERROR_EOF after the last one
+static int read_segment_packet(ConcatVideoSource *src, AVPacket *pkt, AVStream *out_stream) {
+    while (1) {
+        int ret = av_read_frame(src->ctx, pkt);
+        if (ret == AVERROR_EOF) {
+            if (src->current + 1 >= src->count) {
+                return AVERROR_EOF;
+            }
+            ret = open_segment(src, src->current + 1);
+            if (ret < 0) {
+                return ret;
+            }
+            continue;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        if (pkt->stream_index != src->stream_index) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        AVStream *in_stream = src->ctx->streams[src->stream_index];
+        av_packet_rescale_ts(pkt, in_stream->time_base, out_stream->time_base);
+        pkt->stream_index = out_stream->index;
+        pkt->pos = -1;
+        return 0;
+    }
+}
+
+static int read_audio_packet(AVFormatContext *ctx, int stream_index, AVPacket *pkt, AVStream *out_stream) {
+    while (1) {
+        int ret = av_read_frame(ctx, pkt);
+        if (ret < 0) {
+            return ret;
+        }
+        if (pkt->stream_index != stream_index) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        av_packet_rescale_ts(pkt, ctx->streams[stream_index]->time_base, out_stream->time_base);
+        pkt->stream_index = out_stream->index;
+        pkt->pos = -1;
+        return 0;
+    }
+}
+
+int ffmpegx_concat_segments(const char *const *segment_files, int count,
+                            const char *audio_source, const char *output_file) {
+    ConcatVideoSource video = { segment_files, count, 0, NULL, -1 };
+    AVFormatContext *audio_ctx = NULL, *output_ctx = NULL;
+    AVStream *out_video = NULL, *out_audio = NULL;
+    AVPacket *video_pkt = NULL, *audio_pkt = NULL;
+    int audio_index = -1;
+    int have_video = 0, have_audio = 0;
+    int ret;
+
+    if (count < 1) {
+        return AVERROR(EINVAL);
+    }
+
+    video_pkt = ffmpegx_packet_get();
+    audio_pkt = ffmpegx_packet_get();
+    if (!video_pkt || !audio_pkt) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    ret = open_segment(&video, 0);
+    if (ret < 0) {
+        goto end;
+    }
+
+    ret = avformat_alloc_output_context2(&output_ctx, NULL, NULL, output_file);
+    if (ret < 0 || !output_ctx) {
+        LOGE("Could not create output context");
+        ret = ret < 0 ? ret : AVERROR_UNKNOWN;
+        goto end;
+    }
+
+    // All segments come from identically configured encoders, so the first one's
+    // parameters describe the whole stream
+    out_video = avformat_new_stream(output_ctx, NULL);
+    if (!out_video) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    ret = avcodec_parameters_copy(out_video->codecpar, video.ctx->streams[video.stream_index]->codecpar);
+    if (ret < 0) {
+        goto end;
+    }
+    out_video->codecpar->codec_tag = 0;
+    out_video->time_base = video.ctx->streams[video.stream_index]->time_base;
+
+    if (audio_source) {
+        ret = ffmpegx_open_input(&audio_ctx, audio_source, NULL, NULL);
+        if (ret < 0) {
+            LOGE("Cannot open audio source: %s", audio_source);
+            goto end;
+        }
+        audio_index = av_find_best_stream(audio_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+        if (audio_index >= 0) {
+            for (int i = 0; i < audio_ctx->nb_streams; i++) {
+                if (i != audio_index) {
+                    audio_ctx->streams[i]->discard = AVDISCARD_ALL;
+                }
+            }
+            out_audio = avformat_new_stream(output_ctx, NULL);
+            if (!out_audio) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+            ret = avcodec_parameters_copy(out_audio->codecpar, audio_ctx->streams[audio_index]->codecpar);
+            if (ret < 0) {
+                goto end;
+            }
+            out_audio->codecpar->codec_tag = 0;
+            out_audio->time_base = audio_ctx->streams[audio_index]->time_base;
+        } else {
+            ffmpegx_close_input(&audio_ctx);
+        }
+    }
+
+    if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = ffmpegx_open_output(output_ctx, output_file);
+        if (ret < 0) {
+            LOGE("Could not open output file '%s'", output_file);
+            goto end;
+        }
+    }
+
+    ret = avformat_write_header(output_ctx, NULL);
+    if (ret < 0) {
+        LOGE("Error writing header");
+        goto end;
+    }
+
+    // Merge the two sources in dts order so the muxer never has to buffer a whole stream
+    ret = read_segment_packet(&video, video_pkt, out_video);
+    if (ret < 0 && ret != AVERROR_EOF) goto end;
+    have_video = ret >= 0;
+
+    if (out_audio) {
+        ret = read_audio_packet(audio_ctx, audio_index, audio_pkt, out_audio);
+        if (ret < 0 && ret != AVERROR_EOF) goto end;
+        have_audio = ret >= 0;
+    }
+
+    while (have_video || have_audio) {
+        if (ffmpegx_cancelled()) {
+            ret = AVERROR(ECANCELED);
+            goto end;
+        }
+
+        int take_video = have_video;
+        if (have_video && have_audio &&
+            video_pkt->dts != AV_NOPTS_VALUE && audio_pkt->dts != AV_NOPTS_VALUE) {
+            take_video = av_compare_ts(video_pkt->dts, out_video->time_base,
+                                       audio_pkt->dts, out_audio->time_base) <= 0;
+        }
+
+        if (take_video) {
+            ret = av_interleaved_write_frame(output_ctx, video_pkt);
+            if (ret < 0) goto write_error;
+            ret = read_segment_packet(&video, video_pkt, out_video);
+            if (ret < 0 && ret != AVERROR_EOF) goto end;
+            have_video = ret >= 0;
+        } else {
+            ret = av_interleaved_write_frame(output_ctx, audio_pkt);
+            if (ret < 0) goto write_error;
+            ret = read_audio_packet(audio_ctx, audio_index, audio_pkt, out_audio);
+            if (ret < 0 && ret != AVERROR_EOF) goto end;
+            have_audio = ret >= 0;
+        }
+    }
+
+    ret = av_write_trailer(output_ctx);
+    if (ret >= 0) {
+        LOGI("Stitched %d segments into %s", count, output_file);
+    }
+    goto end;
+
+write_error:
+    LOGE("Error writing packet: %s", av_err2str(ret));
+
+end:
+    ffmpegx_packet_put(&video_pkt);
+    ffmpegx_packet_put(&audio_pkt);
+    ffmpegx_close_input(&video.ctx);
+    ffmpegx_close_input(&audio_ctx);
+    if (output_ctx) {
+        if (!(output_ctx->oformat->flags & AVFMT_NOFILE)) {
+            ffmpegx_close_output(output_ctx);
+        }
+        avformat_free_context(output_ctx);
+    }
+    return ret;
+}
+
+#endif // HAVE_FFMPEG_STATIC
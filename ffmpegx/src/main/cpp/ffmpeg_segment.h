@@ -0,0 +1,41 @@
+/**
+ * GOP-aligned segmentation helpers
+ * Plans evenly sized segments on the keyframe boundaries of a keyframe index
+ * (ffmpeg_index.h) and stitches independently encoded segments back together by
+ * stream copy
+ */
+
+#ifndef FFMPEGX_SEGMENT_H
+#define FFMPEGX_SEGMENT_H
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavformat/avformat.h"
+
+#include "ffmpeg_index.h"
+
+// Segments shorter than this are not worth a separate encoder instance
+#define FFMPEGX_MIN_SEGMENT_SECONDS 10
+
+// A half-open [start_pts, end_pts) range of the video stream. The first segment
+// starts and the last one ends at AV_NOPTS_VALUE, i.e. at the ends of the input.
+typedef struct FFmpegxSegment {
+    int64_t start_pts;
+    int64_t end_pts;
+} FFmpegxSegment;
+
+// Splits the video into at most max_segments keyframe-aligned ranges of roughly
+// equal duration, none shorter than min_seconds. Returns the number of segments
+// (the array is av_malloc'ed) or a negative AVERROR.
+int ffmpegx_plan_segments(const FFmpegxKeyframeIndex *list, int max_segments, int min_seconds,
+                          FFmpegxSegment **segments);
+
+// Stream-copies the video of each segment file, in order, into output. Segments
+// must already share one timeline (they keep the source timestamps). The first
+// audio stream of audio_source (may be NULL) is copied alongside, interleaved by dts.
+int ffmpegx_concat_segments(const char *const *segment_files, int count,
+                            const char *audio_source, const char *output_file);
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_SEGMENT_H
@@ -0,0 +1,214 @@
+/**
+ * Native sessions
+ * Registry of live sessions keyed by id, plus the per-thread current session
+ */
+
+#include <android/log.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "ffmpeg_fdio.h"
+#include "ffmpeg_session.h"
+
+#define LOG_TAG "FFmpegSession"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+struct FFmpegxSession {
+    int64_t id;
+    atomic_int refs;
+    atomic_int cancelled;
+    FFmpegxProgress progress;
+    FFmpegxStats stats;
+
+    void *callback;
+    void (*release_callback)(void *callback);
+
+    FFmpegxSession *next;   // registry list, guarded by registry_mutex
+};
+
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FFmpegxSession *registry;
+static int64_t next_id = 1;
+
+static _Thread_local FFmpegxSession *current_session;
+
+FFmpegxSession *ffmpegx_session_create(void *callback, void (*release_callback)(void *callback)) {
+    FFmpegxSession *session = calloc(1, sizeof(*session));
+    if (!session) {
+        return NULL;
+    }
+
+    atomic_init(&session->refs, 1);
+    atomic_init(&session->cancelled, 0);
+    session->progress.version = FFMPEGX_PROGRESS_VERSION;
+    session->callback = callback;
+    session->release_callback = release_callback;
+
+    pthread_mutex_lock(&registry_mutex);
+    session->id = next_id++;
+    session->next = registry;
+    registry = session;
+    pthread_mutex_unlock(&registry_mutex);
+
+    LOGD("Session %lld created", (long long)session->id);
+    return session;
+}
+
+FFmpegxSession *ffmpegx_session_find(int64_t id) {
+    FFmpegxSession *session;
+
+    pthread_mutex_lock(&registry_mutex);
+    for (session = registry; session; session = session->next) {
+        if (session->id == id) {
+            ffmpegx_session_ref(session);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    return session;
+}
+
+void ffmpegx_session_release(int64_t id) {
+    FFmpegxSession *session = NULL;
+
+    pthread_mutex_lock(&registry_mutex);
+    for (FFmpegxSession **link = &registry; *link; link = &(*link)->next) {
+        if ((*link)->id == id) {
+            session = *link;
+            *link = session->next;
+            session->next = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_mutex);
+
+    if (session) {
+        ffmpegx_session_unref(session);
+    }
+}
+
+void ffmpegx_session_ref(FFmpegxSession *session) {
+    atomic_fetch_add_explicit(&session->refs, 1, memory_order_relaxed);
+}
+
+void ffmpegx_session_unref(FFmpegxSession *session) {
+    if (!session || atomic_fetch_sub_explicit(&session->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    LOGD("Session %lld destroyed", (long long)session->id);
+    if (session->release_callback) {
+        session->release_callback(session->callback);
+    }
+    free(session);
+}
+
+int64_t ffmpegx_session_id(const FFmpegxSession *session) {
+    return session ? session->id : 0;
+}
+
+void *ffmpegx_session_callback(const FFmpegxSession *session) {
+    return session ? session->callback : NULL;
+}
+
+FFmpegxProgress *ffmpegx_session_progress(FFmpegxSession *session) {
+    return session ? &session->progress : ffmpegx_progress_default();
+}
+
+FFmpegxStats *ffmpegx_session_stats(FFmpegxSession *session) {
+    return session ? &session->stats : ffmpegx_stats_default();
+}
+
+void ffmpegx_session_cancel(FFmpegxSession *session) {
+    if (session) {
+        atomic_store(&session->cancelled, 1);
+    }
+}
+
+int ffmpegx_session_is_cancelled(const FFmpegxSession *session) {
+    return session ? atomic_load_explicit(&session->cancelled, memory_order_relaxed) : 0;
+}
+
+FFmpegxSession *ffmpegx_session_current(void) {
+    return current_session;
+}
+
+FFmpegxSession *ffmpegx_session_set_current(FFmpegxSession *session) {
+    FFmpegxSession *previous = current_session;
+    current_session = session;
+    return previous;
+}
+
+int64_t ffmpegx_session_current_id(void) {
+    return current_session ? current_session->id : 0;
+}
+
+int ffmpegx_cancelled(void) {
+    return ffmpegx_session_is_cancelled(current_session);
+}
+
+#ifdef HAVE_FFMPEG_STATIC
+
+static int interrupt_callback(void *opaque) {
+    return ffmpegx_session_is_cancelled(opaque);
+}
+
+int ffmpegx_open_input(AVFormatContext **ctx, const char *url, const AVInputFormat *fmt,
+                       AVDictionary **options) {
+    AVIOContext *fd_pb = NULL;
+    int fd = ffmpegx_fd_url(url);
+    int ret;
+
+    *ctx = NULL;
+    if (fd >= 0) {
+        ret = ffmpegx_fdio_open(&fd_pb, fd, AVIO_FLAG_READ);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    AVFormatContext *input_ctx = avformat_alloc_context();
+    if (!input_ctx) {
+        ffmpegx_fdio_close(&fd_pb);
+        return AVERROR(ENOMEM);
+    }
+    // The job holds a session reference for as long as its contexts are open
+    input_ctx->interrupt_callback.callback = interrupt_callback;
+    input_ctx->interrupt_callback.opaque = current_session;
+    input_ctx->pb = fd_pb;
+
+    // Frees input_ctx and sets it to NULL on failure, but leaves a custom pb alone
+    ret = avformat_open_input(&input_ctx, url, fmt, options);
+    if (ret < 0) {
+        ffmpegx_fdio_close(&fd_pb);
+    }
+    *ctx = input_ctx;
+    return ret;
+}
+
+void ffmpegx_close_input(AVFormatContext **ctx) {
+    AVIOContext *fd_pb = *ctx && ffmpegx_fdio_is((*ctx)->pb) ? (*ctx)->pb : NULL;
+    avformat_close_input(ctx);
+    ffmpegx_fdio_close(&fd_pb);
+}
+
+int ffmpegx_open_output(AVFormatContext *ctx, const char *url) {
+    ctx->interrupt_callback.callback = interrupt_callback;
+    ctx->interrupt_callback.opaque = current_session;
+
+    int fd = ffmpegx_fd_url(url);
+    if (fd >= 0) {
+        return ffmpegx_fdio_open(&ctx->pb, fd, AVIO_FLAG_WRITE);
+    }
+    return avio_open2(&ctx->pb, url, AVIO_FLAG_WRITE, &ctx->interrupt_callback, NULL);
+}
+
+int ffmpegx_close_output(AVFormatContext *ctx) {
+    if (ffmpegx_fdio_is(ctx->pb)) {
+        return ffmpegx_fdio_close(&ctx->pb);
+    }
+    return avio_closep(&ctx->pb);
+}
+
+#endif // HAVE_FFMPEG_STATIC
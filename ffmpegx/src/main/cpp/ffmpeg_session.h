@@ -0,0 +1,85 @@
+/**
+ * Native sessions
+ * A session owns everything one job reports or reacts to (Java callback, progress
+ * block, stage timing, cancellation flag), so several commands can run side by
+ * side without clobbering each other's process-wide state
+ */
+
+#ifndef FFMPEGX_SESSION_H
+#define FFMPEGX_SESSION_H
+
+#include <stdint.h>
+
+#include "ffmpeg_progress.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FFmpegxSession FFmpegxSession;
+
+// Creates a registered session holding one reference. The callback is opaque to
+// the session and handed to release_callback when the last reference goes away.
+FFmpegxSession *ffmpegx_session_create(void *callback, void (*release_callback)(void *callback));
+
+// Looks a session up by id; the result carries a reference (NULL when unknown)
+FFmpegxSession *ffmpegx_session_find(int64_t id);
+
+// Removes the session from the registry and drops the creator's reference;
+// jobs still running on it keep it alive until they finish
+void ffmpegx_session_release(int64_t id);
+
+void ffmpegx_session_ref(FFmpegxSession *session);
+void ffmpegx_session_unref(FFmpegxSession *session);
+
+int64_t ffmpegx_session_id(const FFmpegxSession *session);
+void *ffmpegx_session_callback(const FFmpegxSession *session);
+
+// The session's progress block, or the process-wide one for NULL
+FFmpegxProgress *ffmpegx_session_progress(FFmpegxSession *session);
+
+// The session's stage timing counters, or the process-wide ones for NULL
+FFmpegxStats *ffmpegx_session_stats(FFmpegxSession *session);
+
+// Requests cancellation; jobs poll ffmpegx_session_is_cancelled()
+void ffmpegx_session_cancel(FFmpegxSession *session);
+int ffmpegx_session_is_cancelled(const FFmpegxSession *session);
+
+// Session the calling thread works for. Threads started on behalf of a job
+// (pipeline stages, segment workers) must adopt the starting thread's session.
+FFmpegxSession *ffmpegx_session_current(void);
+FFmpegxSession *ffmpegx_session_set_current(FFmpegxSession *session);
+
+// Id of the current session, 0 when the thread works for none
+int64_t ffmpegx_session_current_id(void);
+
+// Whether the calling thread's session has been cancelled; cheap enough for
+// every iteration of a read/decode/encode loop
+int ffmpegx_cancelled(void);
+
+#ifdef HAVE_FFMPEG_STATIC
+#include "libavformat/avformat.h"
+
+// avformat_open_input() whose blocking I/O is interrupted once the current
+// session is cancelled (libavformat then fails with AVERROR_EXIT). Also opens
+// "fd:<n>" URLs (ffmpeg_fdio.h).
+int ffmpegx_open_input(AVFormatContext **ctx, const char *url, const AVInputFormat *fmt,
+                       AVDictionary **options);
+
+// avformat_close_input() for contexts from ffmpegx_open_input(), which also
+// closes a descriptor's AVIOContext
+void ffmpegx_close_input(AVFormatContext **ctx);
+
+// avio_open() for a muxer's output with the same interrupt callback, or an
+// "fd:<n>" descriptor
+int ffmpegx_open_output(AVFormatContext *ctx, const char *url);
+
+// avio_closep() of the output opened by ffmpegx_open_output()
+int ffmpegx_close_output(AVFormatContext *ctx);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FFMPEGX_SESSION_H
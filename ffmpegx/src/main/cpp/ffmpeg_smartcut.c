@@ -0,0 +1,609 @@
+/**
+ * Smart-cut trimming
+ * Re-encodes the partial GOPs at both ends of a cut with an encoder configured like
+ * the source and stream-copies everything between them
+ */
+
+#include <android/log.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_cache.h"
+#include "ffmpeg_codec.h"
+#include "ffmpeg_index.h"
+#include "ffmpeg_pool.h"
+#include "ffmpeg_progress.h"
+#include "ffmpeg_session.h"
+#include "ffmpeg_smartcut.h"
+#include "ffmpeg_splice.h"
+#include "ffmpeg_trace.h"
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libavutil/avutil.h"
+#include "libavutil/mathematics.h"
+
+#define LOG_TAG "FFmpegSmartCut"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+typedef struct SmartCut {
+    AVFormatContext *input_ctx;
+    AVFormatContext *audio_ctx;     // second demuxer on the same file, read alongside
+    AVFormatContext *output_ctx;
+    AVStream *out_video;
+    AVStream *out_audio;
+    int video_index;
+    int audio_index;
+    AVRational time_base;           // of the input video stream, used by every video pts below
+
+    AVCodecContext *dec_ctx;
+    int enc_threads;
+    FFmpegxSplice splice;
+
+    int64_t offset;                 // cut start, subtracted from every video timestamp
+    int64_t dts_delay;              // pts - dts of the copied keyframes
+    int64_t last_dts;               // of the last video packet written
+
+    AVPacket *audio_pkt;            // next audio packet to write, when have_audio
+    int have_audio;
+    int64_t audio_start;            // cut start and end in the audio time base
+    int64_t audio_end;
+} SmartCut;
+
+// Next audio packet inside the cut, shifted onto the output timeline
+static int read_audio(SmartCut *sc) {
+    AVPacket *pkt = sc->audio_pkt;
+    while (1) {
+        int ret = av_read_frame(sc->audio_ctx, pkt);
+        if (ret < 0) {
+            sc->have_audio = 0;
+            return ret == AVERROR_EOF ? 0 : ret;
+        }
+        if (pkt->stream_index != sc->audio_index || pkt->pts == AV_NOPTS_VALUE ||
+            pkt->pts < sc->audio_start) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (pkt->pts >= sc->audio_end) {
+            av_packet_unref(pkt);
+            sc->have_audio = 0;
+            return 0;
+        }
+        pkt->pts -= sc->audio_start;
+        if (pkt->dts != AV_NOPTS_VALUE) {
+            pkt->dts -= sc->audio_start;
+        }
+        sc->have_audio = 1;
+        return 0;
+    }
+}
+
+// Writes the audio due up to video_dts (output timeline), or all of it for AV_NOPTS_VALUE
+static int write_audio_until(SmartCut *sc, int64_t video_dts) {
+    AVRational audio_tb = sc->audio_ctx ? sc->audio_ctx->streams[sc->audio_index]->time_base
+                                        : (AVRational){ 1, 1 };
+    while (sc->have_audio) {
+        AVPacket *pkt = sc->audio_pkt;
+        int64_t dts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        if (video_dts != AV_NOPTS_VALUE && av_compare_ts(dts, audio_tb, video_dts, sc->time_base) > 0) {
+            break;
+        }
+        av_packet_rescale_ts(pkt, audio_tb, sc->out_audio->time_base);
+        pkt->stream_index = sc->out_audio->index;
+        pkt->pos = -1;
+        int ret = av_interleaved_write_frame(sc->output_ctx, pkt);
+        if (ret < 0) {
+            return ret;
+        }
+        ret = read_audio(sc);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+// Shifts a video packet (input time base) onto the output timeline and writes it.
+// dts stays strictly increasing across the joins between copied and re-encoded packets.
+static int write_video_packet(SmartCut *sc, AVPacket *pkt) {
+    if (pkt->pts != AV_NOPTS_VALUE) {
+        pkt->pts -= sc->offset;
+    }
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        pkt->dts -= sc->offset;
+    }
+    if (sc->last_dts != AV_NOPTS_VALUE && (pkt->dts == AV_NOPTS_VALUE || pkt->dts <= sc->last_dts)) {
+        pkt->dts = sc->last_dts + 1;
+    }
+    if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts) {
+        pkt->pts = pkt->dts;
+    }
+
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        sc->last_dts = pkt->dts;
+        int ret = write_audio_until(sc, pkt->dts);
+        if (ret < 0) {
+            av_packet_unref(pkt);
+            return ret;
+        }
+    }
+
+    av_packet_rescale_ts(pkt, sc->time_base, sc->out_video->time_base);
+    pkt->stream_index = sc->out_video->index;
+    pkt->pos = -1;
+    return av_interleaved_write_frame(sc->output_ctx, pkt);
+}
+
+// Boundary frames are encoded like the source stream (ffmpeg_splice.h), with in-band
+// parameter sets because the output's extradata is the source's
+static int open_encoder(SmartCut *sc, AVCodecContext **enc_ctx) {
+    AVStream *in = sc->input_ctx->streams[sc->video_index];
+    return ffmpegx_splice_open_encoder(in->codecpar, sc->time_base,
+                                       av_guess_frame_rate(sc->input_ctx, in, NULL), 0,
+                                       sc->enc_threads, enc_ctx);
+}
+
+static int encode_frame(SmartCut *sc, AVCodecContext *enc, const AVFrame *frame, AVPacket *pkt) {
+    int ret = avcodec_send_frame(enc, frame);
+    if (ret < 0) {
+        return ret;
+    }
+    while ((ret = avcodec_receive_packet(enc, pkt)) >= 0) {
+        // Same pts - dts distance as the copied packets, whose dts the joins must fit between
+        pkt->dts = pkt->pts - sc->dts_delay;
+        ret = ffmpegx_splice_encoded_packet(&sc->splice, pkt);
+        if (ret < 0) {
+            av_packet_unref(pkt);
+            return ret;
+        }
+        ret = write_video_packet(sc, pkt);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// Decodes from the keyframe at key_pts and re-encodes the frames with pts in
+// [from_pts, to_pts). Decoding continues past to_pts until the decoder outputs a
+// frame at or after it: in open GOPs frames before a keyframe follow it in decode order.
+static int reencode_range(SmartCut *sc, int64_t key_pts, int64_t from_pts, int64_t to_pts) {
+    AVCodecContext *enc = NULL;
+    AVPacket *pkt = ffmpegx_packet_get();
+    AVPacket *out = ffmpegx_packet_get();
+    AVFrame *frame = ffmpegx_frame_get();
+    int started = 0, done = 0, eof = 0;
+    int ret;
+
+    if (!pkt || !out || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    ret = open_encoder(sc, &enc);
+    if (ret < 0) {
+        goto end;
+    }
+
+    avcodec_flush_buffers(sc->dec_ctx);
+    ret = avformat_seek_file(sc->input_ctx, sc->video_index, INT64_MIN, key_pts, key_pts, 0);
+    if (ret < 0) {
+        LOGE("Cannot seek to keyframe %lld", (long long)key_pts);
+        goto end;
+    }
+
+    while (!done) {
+        if (ffmpegx_cancelled()) {
+            ret = AVERROR(ECANCELED);
+            goto end;
+        }
+
+        if (!eof) {
+            ret = av_read_frame(sc->input_ctx, pkt);
+            if (ret == AVERROR_EOF) {
+                eof = 1;
+                ret = avcodec_send_packet(sc->dec_ctx, NULL);
+            } else if (ret < 0) {
+                goto end;
+            } else if (pkt->stream_index != sc->video_index ||
+                       (!started && (!(pkt->flags & AV_PKT_FLAG_KEY) || pkt->pts == AV_NOPTS_VALUE ||
+                                     pkt->pts < key_pts))) {
+                // Demuxers may land a little before the keyframe
+                av_packet_unref(pkt);
+                continue;
+            } else {
+                started = 1;
+                ret = avcodec_send_packet(sc->dec_ctx, pkt);
+                av_packet_unref(pkt);
+            }
+            if (ret < 0 && ret != AVERROR_INVALIDDATA) {
+                goto end;
+            }
+        }
+
+        while ((ret = avcodec_receive_frame(sc->dec_ctx, frame)) >= 0) {
+            int64_t pts = frame->best_effort_timestamp;
+            if (pts != AV_NOPTS_VALUE && pts >= from_pts && pts < to_pts) {
+                frame->pts = pts;
+                frame->pict_type = AV_PICTURE_TYPE_NONE;
+                ret = encode_frame(sc, enc, frame, out);
+            } else {
+                ret = 0;
+            }
+            if (pts != AV_NOPTS_VALUE && pts >= to_pts) {
+                done = 1;
+            }
+            av_frame_unref(frame);
+            if (ret < 0) {
+                goto end;
+            }
+        }
+        if (ret == AVERROR_EOF) {
+            done = 1;
+        } else if (ret != AVERROR(EAGAIN)) {
+            goto end;
+        }
+    }
+
+    ret = encode_frame(sc, enc, NULL, out);
+
+end:
+    ffmpegx_cache_close_codec(&enc);
+    ffmpegx_packet_put(&pkt);
+    ffmpegx_packet_put(&out);
+    ffmpegx_frame_put(&frame);
+    return ret;
+}
+
+// Stream-copies the video packets with pts in [from_pts, to_pts): from the keyframe
+// at from_pts up to the keyframe at to_pts (or the end of the file). Sets *open_gop
+// when the packet after that keyframe is displayed before it, and *last_pts to the
+// highest pts copied.
+static int copy_range(SmartCut *sc, int64_t from_pts, int64_t to_pts, int *open_gop, int64_t *last_pts) {
+    AVPacket *pkt = ffmpegx_packet_get();
+    int started = 0, stopping = 0;
+    int ret;
+
+    if (!pkt) {
+        return AVERROR(ENOMEM);
+    }
+
+    ret = avformat_seek_file(sc->input_ctx, sc->video_index, INT64_MIN, from_pts, from_pts, 0);
+    if (ret < 0) {
+        LOGE("Cannot seek to keyframe %lld", (long long)from_pts);
+        goto end;
+    }
+
+    while (1) {
+        if (ffmpegx_cancelled()) {
+            ret = AVERROR(ECANCELED);
+            goto end;
+        }
+        ret = av_read_frame(sc->input_ctx, pkt);
+        if (ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        }
+        if (ret < 0) {
+            goto end;
+        }
+        if (pkt->stream_index != sc->video_index) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (stopping) {
+            *open_gop = pkt->pts != AV_NOPTS_VALUE && pkt->pts < to_pts;
+            av_packet_unref(pkt);
+            break;
+        }
+
+        int key = pkt->flags & AV_PKT_FLAG_KEY;
+        if (!started && (!key || pkt->pts == AV_NOPTS_VALUE || pkt->pts < from_pts)) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (key && pkt->pts != AV_NOPTS_VALUE && pkt->pts >= to_pts) {
+            stopping = 1;
+            av_packet_unref(pkt);
+            continue;
+        }
+        // Leading frames of an open GOP at from_pts were re-encoded with the head
+        if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < from_pts) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        started = 1;
+        ret = ffmpegx_splice_copied_packet(&sc->splice, pkt);
+        if (ret < 0) {
+            av_packet_unref(pkt);
+            goto end;
+        }
+        if (pkt->pts != AV_NOPTS_VALUE && (*last_pts == AV_NOPTS_VALUE || pkt->pts > *last_pts)) {
+            *last_pts = pkt->pts;
+        }
+        ret = write_video_packet(sc, pkt);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+
+end:
+    ffmpegx_packet_put(&pkt);
+    return ret;
+}
+
+// pts - dts of the keyframe at key_pts: the reordering delay of the copied packets
+static int64_t probe_dts_delay(SmartCut *sc, int64_t key_pts) {
+    AVPacket *pkt = ffmpegx_packet_get();
+    int64_t delay = 0;
+
+    if (!pkt || avformat_seek_file(sc->input_ctx, sc->video_index, INT64_MIN, key_pts, key_pts, 0) < 0) {
+        ffmpegx_packet_put(&pkt);
+        return 0;
+    }
+    while (av_read_frame(sc->input_ctx, pkt) >= 0) {
+        int found = pkt->stream_index == sc->video_index && (pkt->flags & AV_PKT_FLAG_KEY) &&
+                    pkt->pts != AV_NOPTS_VALUE && pkt->pts >= key_pts;
+        if (found && pkt->dts != AV_NOPTS_VALUE && pkt->pts > pkt->dts) {
+            delay = pkt->pts - pkt->dts;
+        }
+        av_packet_unref(pkt);
+        if (found) {
+            break;
+        }
+    }
+    ffmpegx_packet_put(&pkt);
+    return delay;
+}
+
+static int open_decoder(SmartCut *sc, int thread_budget) {
+    AVCodecParameters *par = sc->input_ctx->streams[sc->video_index]->codecpar;
+    const AVCodec *decoder = avcodec_find_decoder(par->codec_id);
+    int dec_threads, enc_threads;
+
+    if (!decoder) {
+        return AVERROR_DECODER_NOT_FOUND;
+    }
+    int ret = ffmpegx_splice_check_encoder(par);
+    if (ret < 0) {
+        return ret;
+    }
+
+    sc->dec_ctx = avcodec_alloc_context3(decoder);
+    if (!sc->dec_ctx) {
+        return AVERROR(ENOMEM);
+    }
+    ret = avcodec_parameters_to_context(sc->dec_ctx, par);
+    if (ret < 0) {
+        return ret;
+    }
+    sc->dec_ctx->pkt_timebase = sc->time_base;
+
+    ffmpegx_split_thread_budget(thread_budget, &dec_threads, &enc_threads);
+    sc->enc_threads = enc_threads;
+    return ffmpegx_cache_open_codec(&sc->dec_ctx, decoder, NULL, dec_threads);
+}
+
+// Records one phase of the cut in the trace, returns the end time
+static int64_t trace_phase(const char *name, int64_t start_ns) {
+    int64_t now = ffmpegx_now_ns();
+    ffmpegx_trace_event(name, start_ns, now);
+    return now;
+}
+
+static int add_stream(AVFormatContext *output_ctx, const AVStream *in, AVStream **out) {
+    *out = avformat_new_stream(output_ctx, NULL);
+    if (!*out) {
+        return AVERROR(ENOMEM);
+    }
+    int ret = avcodec_parameters_copy((*out)->codecpar, in->codecpar);
+    if (ret < 0) {
+        return ret;
+    }
+    (*out)->codecpar->codec_tag = 0;
+    (*out)->time_base = in->time_base;
+    return 0;
+}
+
+int ffmpegx_smart_cut(const char *input_file, const char *output_file, double start_time,
+                      double duration, int thread_budget) {
+    SmartCut sc = { .video_index = -1, .audio_index = -1, .last_dts = AV_NOPTS_VALUE };
+    FFmpegxKeyframeIndex index = { 0 };
+    int ret;
+
+    ret = ffmpegx_keyframe_index_load(input_file, &index);
+    if (ret < 0) {
+        LOGE("No keyframe index for %s", input_file);
+        return ret;
+    }
+    if (index.count < 1 || index.end_pts == AV_NOPTS_VALUE) {
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+
+    ret = ffmpegx_cache_open_input(&sc.input_ctx, input_file);
+    if (ret < 0) {
+        LOGE("Cannot open input file: %s", input_file);
+        goto end;
+    }
+    if (index.stream_index >= sc.input_ctx->nb_streams ||
+        av_cmp_q(sc.input_ctx->streams[index.stream_index]->time_base, index.time_base) != 0) {
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+    sc.video_index = index.stream_index;
+    sc.time_base = index.time_base;
+    sc.audio_index = av_find_best_stream(sc.input_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    for (int i = 0; i < sc.input_ctx->nb_streams; i++) {
+        if (i != sc.video_index) {
+            sc.input_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    // Cut points in the video time base, the seconds counting from the start of the file
+    int64_t origin = sc.input_ctx->start_time != AV_NOPTS_VALUE ? sc.input_ctx->start_time : 0;
+    int64_t start_pts = av_rescale_q(origin + (int64_t)(start_time * AV_TIME_BASE), AV_TIME_BASE_Q,
+                                     sc.time_base);
+    int64_t end_pts = index.end_pts;
+    if (duration > 0) {
+        end_pts = FFMIN(end_pts, av_rescale_q(origin + (int64_t)((start_time + duration) * AV_TIME_BASE),
+                                              AV_TIME_BASE_Q, sc.time_base));
+    }
+    start_pts = FFMAX(start_pts, index.pts[0]);
+    if (start_pts >= end_pts) {
+        LOGE("Cut %.3f+%.3f is outside the video", start_time, duration);
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    // Re-encoded head [start_pts, k1), copied middle [k1, k2), re-encoded tail [k2, end_pts).
+    // A cut running to the end of the file copies through to it.
+    int next = ffmpegx_keyframe_index_find_next(&index, start_pts);
+    int64_t k1 = next < index.count ? FFMIN(index.pts[next], end_pts) : end_pts;
+    int64_t k2 = end_pts;
+    if (end_pts < index.end_pts) {
+        k2 = FFMAX(k1, index.pts[ffmpegx_keyframe_index_find(&index, end_pts)]);
+    }
+
+    AVStream *in_video = sc.input_ctx->streams[sc.video_index];
+    if (start_pts < k1 || k2 < end_pts) {
+        ret = open_decoder(&sc, thread_budget);
+        if (ret < 0) {
+            goto end;
+        }
+        ret = ffmpegx_splice_init(&sc.splice, in_video->codecpar);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+
+    ret = avformat_alloc_output_context2(&sc.output_ctx, NULL, NULL, output_file);
+    if (ret < 0 || !sc.output_ctx) {
+        LOGE("Could not create output context");
+        ret = ret < 0 ? ret : AVERROR_UNKNOWN;
+        goto end;
+    }
+    ret = add_stream(sc.output_ctx, in_video, &sc.out_video);
+    if (ret < 0) {
+        goto end;
+    }
+
+    if (sc.audio_index >= 0) {
+        ret = ffmpegx_cache_open_input(&sc.audio_ctx, input_file);
+        if (ret < 0) {
+            goto end;
+        }
+        for (int i = 0; i < sc.audio_ctx->nb_streams; i++) {
+            if (i != sc.audio_index) {
+                sc.audio_ctx->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+        ret = add_stream(sc.output_ctx, sc.audio_ctx->streams[sc.audio_index], &sc.out_audio);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+
+    if (!(sc.output_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = ffmpegx_open_output(sc.output_ctx, output_file);
+        if (ret < 0) {
+            LOGE("Could not open output file '%s'", output_file);
+            goto end;
+        }
+    }
+    ret = avformat_write_header(sc.output_ctx, NULL);
+    if (ret < 0) {
+        LOGE("Error writing header");
+        goto end;
+    }
+
+    sc.offset = start_pts;
+    if (sc.out_audio) {
+        AVRational audio_tb = sc.audio_ctx->streams[sc.audio_index]->time_base;
+        sc.audio_start = av_rescale_q(start_pts, sc.time_base, audio_tb);
+        sc.audio_end = av_rescale_q(end_pts, sc.time_base, audio_tb);
+        sc.audio_pkt = ffmpegx_packet_get();
+        if (!sc.audio_pkt) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        ret = avformat_seek_file(sc.audio_ctx, sc.audio_index, INT64_MIN, sc.audio_start,
+                                 sc.audio_start, 0);
+        if (ret >= 0) {
+            ret = read_audio(&sc);
+        }
+        if (ret < 0) {
+            goto end;
+        }
+    }
+    if (k1 < k2) {
+        sc.dts_delay = probe_dts_delay(&sc, k1);
+    }
+
+    int64_t t = ffmpegx_now_ns();
+    if (start_pts < k1) {
+        int key = ffmpegx_keyframe_index_find(&index, start_pts);
+        ret = reencode_range(&sc, index.pts[key], start_pts, k1);
+        if (ret < 0) {
+            goto end;
+        }
+        t = trace_phase("smartcut-head", t);
+    }
+
+    int open_gop = 0;
+    int64_t last_copied = AV_NOPTS_VALUE;
+    if (k1 < k2) {
+        ret = copy_range(&sc, k1, k2, &open_gop, &last_copied);
+        if (ret < 0) {
+            goto end;
+        }
+        t = trace_phase("smartcut-copy", t);
+    }
+
+    if (k2 < end_pts) {
+        int key = ffmpegx_keyframe_index_find(&index, k2);
+        int64_t from_pts = k2;
+        // Frames displayed before k2 but stored after it were not copied; decode them
+        // from the previous keyframe
+        if (open_gop && last_copied != AV_NOPTS_VALUE && key > 0) {
+            key--;
+            from_pts = last_copied + 1;
+        }
+        ret = reencode_range(&sc, index.pts[key], from_pts, end_pts);
+        if (ret < 0) {
+            goto end;
+        }
+        trace_phase("smartcut-tail", t);
+    }
+
+    ret = write_audio_until(&sc, AV_NOPTS_VALUE);
+    if (ret < 0) {
+        goto end;
+    }
+    ret = av_write_trailer(sc.output_ctx);
+    if (ret >= 0) {
+        LOGI("Smart cut %s: re-encoded %.3fs + %.3fs, copied %.3fs", output_file,
+             (k1 - start_pts) * av_q2d(sc.time_base), (end_pts - k2) * av_q2d(sc.time_base),
+             (k2 - k1) * av_q2d(sc.time_base));
+    }
+
+end:
+    ffmpegx_packet_put(&sc.audio_pkt);
+    ffmpegx_cache_close_codec(&sc.dec_ctx);
+    ffmpegx_splice_uninit(&sc.splice);
+    if (sc.output_ctx) {
+        if (!(sc.output_ctx->oformat->flags & AVFMT_NOFILE)) {
+            ffmpegx_close_output(sc.output_ctx);
+        }
+        avformat_free_context(sc.output_ctx);
+    }
+    ffmpegx_cache_close_input(&sc.audio_ctx);
+    ffmpegx_cache_close_input(&sc.input_ctx);
+    ffmpegx_keyframe_index_free(&index);
+    return ret;
+}
+
+#endif // HAVE_FFMPEG_STATIC
@@ -0,0 +1,32 @@
+/**
+ * Smart-cut trimming
+ * Frame-accurate trims at close to stream-copy speed: the GOPs fully inside the
+ * cut are stream-copied and only the partial GOPs at its start and end are
+ * decoded and re-encoded, with the source's codec and encoder parameters
+ */
+
+#ifndef FFMPEGX_SMARTCUT_H
+#define FFMPEGX_SMARTCUT_H
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Copies [start_time, start_time + duration) of input_file (seconds from the start
+// of the file, duration <= 0 for the rest of it) to output_file. Keyframes come
+// from the file's keyframe index (ffmpeg_index.h); the first audio stream is
+// stream-copied alongside. Returns 0 or an AVERROR code; AVERROR_ENCODER_NOT_FOUND
+// and AVERROR_PATCHWELCOME mean the video cannot be re-encoded to match and a
+// keyframe-aligned trim is the only option.
+int ffmpegx_smart_cut(const char *input_file, const char *output_file, double start_time,
+                      double duration, int thread_budget);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_SMARTCUT_H
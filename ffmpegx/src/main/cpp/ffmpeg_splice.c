@@ -0,0 +1,273 @@
+/**
+ * Splicing re-encoded and stream-copied packets
+ * Encoder setup from a stream's codec parameters, Annex B to length-prefixed
+ * conversion and in-band repetition of avcC/hvcC parameter sets
+ */
+
+#include <android/log.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_cache.h"
+#include "ffmpeg_splice.h"
+#include "libavutil/avutil.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/pixdesc.h"
+
+#define LOG_TAG "FFmpegSplice"
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+static void write_length(uint8_t *p, int length_size, uint32_t value) {
+    for (int i = length_size - 1; i >= 0; i--) {
+        p[i] = value & 0xff;
+        value >>= 8;
+    }
+}
+
+// Replaces the payload of pkt with buf, keeping its timestamps and flags
+static void set_payload(AVPacket *pkt, AVBufferRef *buf, int size) {
+    memset(buf->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    av_buffer_unref(&pkt->buf);
+    pkt->buf = buf;
+    pkt->data = buf->data;
+    pkt->size = size;
+}
+
+static const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end) {
+    for (; p + 3 <= end; p++) {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1) {
+            return p;
+        }
+    }
+    return end;
+}
+
+// Encoders without a global header emit Annex B; MP4/MKV streams carry
+// length-prefixed NAL units instead
+static int annexb_to_length_prefixed(AVPacket *pkt, int length_size) {
+    const uint8_t *end = pkt->data + pkt->size;
+    AVBufferRef *buf = NULL;
+    int size = 0;
+
+    if (pkt->size < 4 || find_start_code(pkt->data, pkt->data + 4) == pkt->data + 4) {
+        return 0;
+    }
+
+    // First pass measures, second one writes
+    for (int pass = 0; pass < 2; pass++) {
+        uint8_t *out = buf ? buf->data : NULL;
+        const uint8_t *p = find_start_code(pkt->data, end);
+        while (p < end) {
+            const uint8_t *nal = p + 3;
+            const uint8_t *next = find_start_code(nal, end);
+            const uint8_t *nal_end = next;
+            // Trailing zeros belong to the next four-byte start code
+            while (nal_end > nal && nal_end[-1] == 0) {
+                nal_end--;
+            }
+            int nal_size = nal_end - nal;
+            if (nal_size > 0) {
+                if (out) {
+                    write_length(out, length_size, nal_size);
+                    memcpy(out + length_size, nal, nal_size);
+                    out += length_size + nal_size;
+                } else {
+                    size += length_size + nal_size;
+                }
+            }
+            p = next;
+        }
+        if (!buf && !(buf = av_buffer_alloc(size + AV_INPUT_BUFFER_PADDING_SIZE))) {
+            return AVERROR(ENOMEM);
+        }
+    }
+    set_payload(pkt, buf, size);
+    return 0;
+}
+
+int ffmpegx_splice_init(FFmpegxSplice *splice, const AVCodecParameters *par) {
+    const uint8_t *p = par->extradata;
+    const uint8_t *end = p + par->extradata_size;
+    int h264 = par->codec_id == AV_CODEC_ID_H264;
+    int arrays;
+
+    memset(splice, 0, sizeof(*splice));
+    if (par->extradata_size < 7 || p[0] != 1) {
+        return 0;
+    }
+    if (h264) {
+        splice->length_size = (p[4] & 3) + 1;
+        arrays = 2;
+        p += 5;
+    } else if (par->codec_id == AV_CODEC_ID_HEVC && par->extradata_size >= 23) {
+        splice->length_size = (p[21] & 3) + 1;
+        arrays = p[22];
+        p += 23;
+    } else {
+        return 0;
+    }
+
+    // Each NAL unit grows by at most two bytes (16-bit size to a 32-bit length field)
+    splice->param_sets = av_malloc(par->extradata_size * 2);
+    if (!splice->param_sets) {
+        return AVERROR(ENOMEM);
+    }
+
+    for (int a = 0; a < arrays; a++) {
+        int count;
+        if (h264) {
+            // SPS count in the low five bits, then the PPS count as a whole byte
+            if (p >= end) break;
+            count = a == 0 ? *p & 0x1f : *p;
+            p++;
+        } else {
+            if (end - p < 3) break;
+            count = AV_RB16(p + 1);
+            p += 3;
+        }
+        for (int i = 0; i < count; i++) {
+            if (end - p < 2 || AV_RB16(p) > end - p - 2) {
+                ffmpegx_splice_uninit(splice);
+                return AVERROR_INVALIDDATA;
+            }
+            int size = AV_RB16(p);
+            uint8_t *out = splice->param_sets + splice->param_sets_size;
+            write_length(out, splice->length_size, size);
+            memcpy(out + splice->length_size, p + 2, size);
+            splice->param_sets_size += splice->length_size + size;
+            p += 2 + size;
+        }
+    }
+    return 0;
+}
+
+void ffmpegx_splice_uninit(FFmpegxSplice *splice) {
+    av_freep(&splice->param_sets);
+    splice->param_sets_size = 0;
+}
+
+const AVCodec *ffmpegx_splice_find_encoder(enum AVCodecID codec_id) {
+    // libavcodec's own H.264/HEVC "encoders" are hardware wrappers at best
+    const char *preferred = codec_id == AV_CODEC_ID_H264 ? "libx264" :
+                            codec_id == AV_CODEC_ID_HEVC ? "libx265" : NULL;
+    const AVCodec *codec = preferred ? avcodec_find_encoder_by_name(preferred) : NULL;
+    return codec ? codec : avcodec_find_encoder(codec_id);
+}
+
+int ffmpegx_splice_check_encoder(const AVCodecParameters *par) {
+    const AVCodec *codec = ffmpegx_splice_find_encoder(par->codec_id);
+    if (!codec) {
+        LOGW("No %s encoder", avcodec_get_name(par->codec_id));
+        return AVERROR_ENCODER_NOT_FOUND;
+    }
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO && codec->pix_fmts) {
+        const enum AVPixelFormat *p = codec->pix_fmts;
+        while (*p != AV_PIX_FMT_NONE && *p != par->format) {
+            p++;
+        }
+        if (*p == AV_PIX_FMT_NONE) {
+            LOGW("%s cannot encode %s", codec->name, av_get_pix_fmt_name(par->format));
+            return AVERROR_PATCHWELCOME;
+        }
+    }
+    return 0;
+}
+
+int ffmpegx_splice_open_encoder(const AVCodecParameters *par, AVRational time_base,
+                                AVRational framerate, int global_header, int threads,
+                                AVCodecContext **enc_ctx) {
+    AVDictionary *opts = NULL;
+    int ret = ffmpegx_splice_check_encoder(par);
+    if (ret < 0) {
+        return ret;
+    }
+    const AVCodec *codec = ffmpegx_splice_find_encoder(par->codec_id);
+
+    AVCodecContext *enc = avcodec_alloc_context3(codec);
+    if (!enc) {
+        return AVERROR(ENOMEM);
+    }
+    enc->time_base = time_base;
+    enc->profile = par->profile;
+    if (par->bit_rate > 0) {
+        enc->bit_rate = FFMIN(par->bit_rate, 100000000);
+    }
+
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+        enc->width = par->width;
+        enc->height = par->height;
+        enc->pix_fmt = par->format;
+        enc->sample_aspect_ratio = par->sample_aspect_ratio;
+        enc->color_range = par->color_range;
+        enc->color_primaries = par->color_primaries;
+        enc->color_trc = par->color_trc;
+        enc->colorspace = par->color_space;
+        enc->chroma_sample_location = par->chroma_location;
+        enc->framerate = framerate;
+        enc->level = par->level;
+        enc->max_b_frames = 0;
+        if (strcmp(codec->name, "libx264") == 0 || strcmp(codec->name, "libx265") == 0) {
+            av_dict_set(&opts, "preset", "fast", 0);
+            if (par->bit_rate <= 0) {
+                av_dict_set(&opts, "crf", "18", 0);
+            }
+        }
+    } else {
+        enc->sample_rate = par->sample_rate;
+        ret = av_channel_layout_copy(&enc->ch_layout, &par->ch_layout);
+        if (ret < 0) {
+            avcodec_free_context(&enc);
+            return ret;
+        }
+        enc->sample_fmt = codec->sample_fmts ? codec->sample_fmts[0] : par->format;
+        for (const enum AVSampleFormat *f = codec->sample_fmts; f && *f != AV_SAMPLE_FMT_NONE; f++) {
+            if (*f == par->format) {
+                enc->sample_fmt = *f;
+            }
+        }
+    }
+    if (global_header) {
+        enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    ret = ffmpegx_cache_open_codec(&enc, codec, &opts, threads);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        LOGE("Cannot open %s to match the %s stream", codec->name, avcodec_get_name(par->codec_id));
+        ffmpegx_cache_close_codec(&enc);
+        return ret;
+    }
+    *enc_ctx = enc;
+    return 0;
+}
+
+int ffmpegx_splice_encoded_packet(FFmpegxSplice *splice, AVPacket *pkt) {
+    splice->after_encoded = 1;
+    return splice->length_size ? annexb_to_length_prefixed(pkt, splice->length_size) : 0;
+}
+
+int ffmpegx_splice_copied_packet(FFmpegxSplice *splice, AVPacket *pkt) {
+    if (!splice->after_encoded) {
+        return 0;
+    }
+    splice->after_encoded = 0;
+    if (splice->param_sets_size == 0) {
+        return 0;
+    }
+
+    int size = splice->param_sets_size + pkt->size;
+    AVBufferRef *buf = av_buffer_alloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!buf) {
+        return AVERROR(ENOMEM);
+    }
+    memcpy(buf->data, splice->param_sets, splice->param_sets_size);
+    memcpy(buf->data + splice->param_sets_size, pkt->data, pkt->size);
+    set_payload(pkt, buf, size);
+    return 0;
+}
+
+#endif // HAVE_FFMPEG_STATIC
@@ -0,0 +1,61 @@
+/**
+ * Splicing re-encoded and stream-copied packets
+ * Opens encoders configured like an existing stream, so that their packets can
+ * continue that stream in one output, and fixes up NAL framing and H.264/HEVC
+ * parameter sets at each join between encoded and copied packets
+ */
+
+#ifndef FFMPEGX_SPLICE_H
+#define FFMPEGX_SPLICE_H
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "libavcodec/avcodec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FFmpegxSplice {
+    int length_size;            // NAL length field of the copied stream, 0 for Annex B
+    uint8_t *param_sets;        // its parameter sets as length-prefixed NAL units
+    int param_sets_size;
+    int after_encoded;          // the last packet passed through came from an encoder
+} FFmpegxSplice;
+
+// Reads the parameter sets of the copied stream from its avcC/hvcC extradata;
+// Annex B streams and other codecs carry what they need in-band
+int ffmpegx_splice_init(FFmpegxSplice *splice, const AVCodecParameters *par);
+
+void ffmpegx_splice_uninit(FFmpegxSplice *splice);
+
+// Encoder for par's codec, libx264/libx265 preferred for H.264/HEVC
+const AVCodec *ffmpegx_splice_find_encoder(enum AVCodecID codec_id);
+
+// 0 when ffmpegx_splice_open_encoder() can match par, AVERROR_ENCODER_NOT_FOUND
+// or AVERROR_PATCHWELCOME (pixel format the encoder lacks) otherwise
+int ffmpegx_splice_check_encoder(const AVCodecParameters *par);
+
+// Encoder configured like par. Video: size, pixel format, aspect ratio, colour
+// description, profile, level and bit rate, without B-frames (dts == pts, nothing
+// reorders across a join) and with in-band parameter sets. Audio: sample rate,
+// channel layout, profile and bit rate, in par's sample format when the encoder
+// supports it. time_base is the encoder's; framerate may be {0, 1}.
+int ffmpegx_splice_open_encoder(const AVCodecParameters *par, AVRational time_base,
+                                AVRational framerate, int global_header, int threads,
+                                AVCodecContext **enc);
+
+// Converts a video encoder packet to the copied stream's NAL framing
+int ffmpegx_splice_encoded_packet(FFmpegxSplice *splice, AVPacket *pkt);
+
+// Repeats the copied stream's parameter sets on its first packet after encoded
+// ones, which replaced them in the decoder
+int ffmpegx_splice_copied_packet(FFmpegxSplice *splice, AVPacket *pkt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_SPLICE_H
@@ -0,0 +1,355 @@
+/**
+ * Synthetic media generator
+ * Pulls frames from a lavfi source graph per stream, encodes them single-threaded
+ * with bit-exact flags and interleaves the packets by timestamp
+ */
+
+#include <android/log.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_synth.h"
+#include "libavcodec/avcodec.h"
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavformat/avformat.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+
+#define LOG_TAG "FFmpegSynth"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+typedef struct SynthStream {
+    AVFilterGraph *graph;
+    AVFilterContext *sink;
+    AVCodecContext *enc;
+    AVStream *stream;
+    AVFrame *frame;
+    int64_t next_pts;       // encoder time base
+    int done;
+} SynthStream;
+
+void ffmpegx_synth_default_config(FFmpegxSynthConfig *config) {
+    memset(config, 0, sizeof(*config));
+    config->width = 1280;
+    config->height = 720;
+    config->fps = 30;
+    config->gop = 30;
+    config->video_codec = "mpeg4";
+    config->video_source = "testsrc2";
+    config->channels = 2;
+    config->sample_rate = 48000;
+    config->audio_bit_rate = 128000;
+    config->audio_codec = "aac";
+    config->audio_source = "sine=frequency=440";
+    config->duration = 10;
+}
+
+static void close_stream(SynthStream *ss) {
+    avfilter_graph_free(&ss->graph);
+    avcodec_free_context(&ss->enc);
+    av_frame_free(&ss->frame);
+}
+
+static enum AVPixelFormat pick_pix_fmt(const AVCodec *codec) {
+    if (!codec->pix_fmts) {
+        return AV_PIX_FMT_YUV420P;
+    }
+    for (const enum AVPixelFormat *p = codec->pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+        if (*p == AV_PIX_FMT_YUV420P) {
+            return *p;
+        }
+    }
+    return codec->pix_fmts[0];
+}
+
+static int open_encoder(SynthStream *ss, AVFormatContext *oc, const FFmpegxSynthConfig *config,
+                        enum AVMediaType type) {
+    const char *name = type == AVMEDIA_TYPE_VIDEO ? config->video_codec : config->audio_codec;
+    const AVCodec *codec = avcodec_find_encoder_by_name(name);
+    if (!codec || codec->type != type) {
+        LOGE("Encoder %s not available", name);
+        return AVERROR_ENCODER_NOT_FOUND;
+    }
+
+    ss->enc = avcodec_alloc_context3(codec);
+    ss->stream = avformat_new_stream(oc, NULL);
+    ss->frame = av_frame_alloc();
+    if (!ss->enc || !ss->stream || !ss->frame) {
+        return AVERROR(ENOMEM);
+    }
+
+    AVCodecContext *enc = ss->enc;
+    if (type == AVMEDIA_TYPE_VIDEO) {
+        enc->width = config->width;
+        enc->height = config->height;
+        enc->pix_fmt = pick_pix_fmt(codec);
+        enc->time_base = (AVRational){ 1, config->fps };
+        enc->framerate = (AVRational){ config->fps, 1 };
+        enc->gop_size = config->gop;
+        enc->keyint_min = config->gop;
+        enc->max_b_frames = config->b_frames;
+        enc->bit_rate = config->video_bit_rate > 0 ? config->video_bit_rate :
+                        (int64_t)config->width * config->height * config->fps / 8;
+        // Keyframes only at GOP boundaries, never on scene changes. The option is
+        // private to each encoder: libx264 turns scene cuts off with 0, the mpegvideo
+        // family (mpeg4, mpeg2video, ...) with a threshold nothing reaches
+        av_opt_set_int(enc, "sc_threshold", strcmp(codec->name, "libx264") == 0 ? 0 : 1000000000,
+                       AV_OPT_SEARCH_CHILDREN);
+    } else {
+        enc->sample_fmt = codec->sample_fmts ? codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+        enc->sample_rate = config->sample_rate;
+        av_channel_layout_default(&enc->ch_layout, config->channels);
+        enc->time_base = (AVRational){ 1, config->sample_rate };
+        enc->bit_rate = config->audio_bit_rate;
+    }
+    // Same bytes on every machine: no version strings, no thread-dependent decisions
+    enc->flags |= AV_CODEC_FLAG_BITEXACT;
+    enc->thread_count = 1;
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
+        enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    int ret = avcodec_open2(enc, codec, NULL);
+    if (ret < 0) {
+        LOGE("Cannot open encoder %s", name);
+        return ret;
+    }
+    ret = avcodec_parameters_from_context(ss->stream->codecpar, enc);
+    if (ret < 0) {
+        return ret;
+    }
+    ss->stream->time_base = enc->time_base;
+    return 0;
+}
+
+// Source graph ending in a sink that already produces what the encoder takes
+static int open_source(SynthStream *ss, const FFmpegxSynthConfig *config, enum AVMediaType type) {
+    AVCodecContext *enc = ss->enc;
+    AVFilterInOut *inputs = NULL;
+    char desc[512];
+    int ret;
+
+    if (type == AVMEDIA_TYPE_VIDEO) {
+        snprintf(desc, sizeof(desc), "%s=size=%dx%d:rate=%d:duration=%f,format=%s",
+                 config->video_source, enc->width, enc->height, config->fps, config->duration,
+                 av_get_pix_fmt_name(enc->pix_fmt));
+    } else {
+        char layout[64];
+        av_channel_layout_describe(&enc->ch_layout, layout, sizeof(layout));
+        snprintf(desc, sizeof(desc),
+                 "%s:sample_rate=%d:duration=%f,aformat=sample_fmts=%s:channel_layouts=%s",
+                 config->audio_source, enc->sample_rate, config->duration,
+                 av_get_sample_fmt_name(enc->sample_fmt), layout);
+    }
+
+    ss->graph = avfilter_graph_alloc();
+    if (!ss->graph) {
+        return AVERROR(ENOMEM);
+    }
+    // Filters follow the encoder: single-threaded for deterministic output
+    ss->graph->nb_threads = 1;
+
+    const AVFilter *sink = avfilter_get_by_name(type == AVMEDIA_TYPE_VIDEO ? "buffersink" : "abuffersink");
+    ret = avfilter_graph_create_filter(&ss->sink, sink, "out", NULL, NULL, ss->graph);
+    if (ret < 0) {
+        return ret;
+    }
+
+    inputs = avfilter_inout_alloc();
+    if (!inputs) {
+        return AVERROR(ENOMEM);
+    }
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = ss->sink;
+    inputs->pad_idx = 0;
+    inputs->next = NULL;
+
+    ret = avfilter_graph_parse_ptr(ss->graph, desc, &inputs, NULL, NULL);
+    avfilter_inout_free(&inputs);
+    if (ret < 0) {
+        LOGE("Cannot parse source graph: %s", desc);
+        return ret;
+    }
+    ret = avfilter_graph_config(ss->graph, NULL);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (type == AVMEDIA_TYPE_AUDIO && enc->frame_size > 0 &&
+        !(enc->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE)) {
+        av_buffersink_set_frame_size(ss->sink, enc->frame_size);
+    }
+    return 0;
+}
+
+static int encode(AVFormatContext *oc, SynthStream *ss, AVFrame *frame, AVPacket *pkt) {
+    int ret = avcodec_send_frame(ss->enc, frame);
+    while (ret >= 0) {
+        ret = avcodec_receive_packet(ss->enc, pkt);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return 0;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        av_packet_rescale_ts(pkt, ss->enc->time_base, ss->stream->time_base);
+        pkt->stream_index = ss->stream->index;
+        ret = av_interleaved_write_frame(oc, pkt);
+    }
+    return ret;
+}
+
+// Encodes the next source frame, or flushes the encoder at the end of the source
+static int step(AVFormatContext *oc, SynthStream *ss, AVPacket *pkt) {
+    int ret = av_buffersink_get_frame(ss->sink, ss->frame);
+    if (ret == AVERROR_EOF) {
+        ss->done = 1;
+        return encode(oc, ss, NULL, pkt);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    AVFrame *frame = ss->frame;
+    frame->pts = av_rescale_q(frame->pts, av_buffersink_get_time_base(ss->sink), ss->enc->time_base);
+    frame->pict_type = AV_PICTURE_TYPE_NONE;
+    ss->next_pts = frame->pts + (ss->enc->codec_type == AVMEDIA_TYPE_VIDEO ? 1 : frame->nb_samples);
+
+    ret = encode(oc, ss, frame, pkt);
+    av_frame_unref(frame);
+    return ret;
+}
+
+// Muxes into oc, whose pb the caller has already opened
+static int write_clip(const FFmpegxSynthConfig *config, AVFormatContext *oc) {
+    SynthStream video = { 0 };
+    SynthStream audio = { 0 };
+    AVPacket *pkt = NULL;
+    int ret = 0;
+
+    video.done = config->width <= 0 || config->height <= 0;
+    audio.done = config->channels <= 0;
+    if ((video.done && audio.done) || config->duration <= 0) {
+        return AVERROR(EINVAL);
+    }
+    if (!video.done && (config->fps <= 0 || config->gop <= 0)) {
+        return AVERROR(EINVAL);
+    }
+
+    if (!video.done) {
+        ret = open_encoder(&video, oc, config, AVMEDIA_TYPE_VIDEO);
+        if (ret >= 0) {
+            ret = open_source(&video, config, AVMEDIA_TYPE_VIDEO);
+        }
+        if (ret < 0) {
+            goto end;
+        }
+    }
+    if (!audio.done) {
+        ret = open_encoder(&audio, oc, config, AVMEDIA_TYPE_AUDIO);
+        if (ret >= 0) {
+            ret = open_source(&audio, config, AVMEDIA_TYPE_AUDIO);
+        }
+        if (ret < 0) {
+            goto end;
+        }
+    }
+
+    pkt = av_packet_alloc();
+    if (!pkt) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    oc->flags |= AVFMT_FLAG_BITEXACT;
+    ret = avformat_write_header(oc, NULL);
+    if (ret < 0) {
+        goto end;
+    }
+
+    // Always feed the stream that is behind, like a capture would
+    while (!video.done || !audio.done) {
+        SynthStream *next;
+        if (video.done) {
+            next = &audio;
+        } else if (audio.done) {
+            next = &video;
+        } else {
+            next = av_compare_ts(video.next_pts, video.enc->time_base,
+                                 audio.next_pts, audio.enc->time_base) <= 0 ? &video : &audio;
+        }
+        ret = step(oc, next, pkt);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+
+    ret = av_write_trailer(oc);
+
+end:
+    av_packet_free(&pkt);
+    close_stream(&video);
+    close_stream(&audio);
+    return ret;
+}
+
+int ffmpegx_synth_write_file(const FFmpegxSynthConfig *config, const char *path) {
+    AVFormatContext *oc = NULL;
+    int ret = avformat_alloc_output_context2(&oc, NULL, config->format, path);
+    if (!oc) {
+        return ret < 0 ? ret : AVERROR_UNKNOWN;
+    }
+
+    ret = avio_open(&oc->pb, path, AVIO_FLAG_WRITE);
+    if (ret >= 0) {
+        ret = write_clip(config, oc);
+        avio_closep(&oc->pb);
+    }
+    avformat_free_context(oc);
+
+    if (ret < 0) {
+        LOGE("Could not write synthetic clip %s", path);
+        unlink(path);
+        return ret;
+    }
+    LOGI("Synthetic clip %s: %dx%d@%d, %d channel(s), %.1fs", path, config->width,
+         config->height, config->fps, config->channels, config->duration);
+    return 0;
+}
+
+int ffmpegx_synth_write_buffer(const FFmpegxSynthConfig *config, uint8_t **data, size_t *size) {
+    AVFormatContext *oc = NULL;
+    *data = NULL;
+    *size = 0;
+
+    int ret = avformat_alloc_output_context2(&oc, NULL, config->format ? config->format : "mp4", NULL);
+    if (!oc) {
+        return ret < 0 ? ret : AVERROR_UNKNOWN;
+    }
+
+    // Dynamic buffers are seekable, so muxers can still patch their headers
+    ret = avio_open_dyn_buf(&oc->pb);
+    if (ret >= 0) {
+        ret = write_clip(config, oc);
+        uint8_t *buffer = NULL;
+        int length = avio_close_dyn_buf(oc->pb, &buffer);
+        oc->pb = NULL;
+        if (ret >= 0) {
+            *data = buffer;
+            *size = length;
+        } else {
+            av_free(buffer);
+        }
+    }
+    avformat_free_context(oc);
+    return ret < 0 ? ret : 0;
+}
+
+#endif // HAVE_FFMPEG_STATIC
@@ -0,0 +1,57 @@
+/**
+ * Synthetic media generator
+ * Encodes deterministic clips from lavfi sources (testsrc2, sine) so benchmarks and
+ * checks need no fixture files; the same config gives byte-identical output
+ */
+
+#ifndef FFMPEGX_SYNTH_H
+#define FFMPEGX_SYNTH_H
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FFmpegxSynthConfig {
+    // Video; width or height 0 leaves the clip without a video stream
+    int width;
+    int height;
+    int fps;
+    int gop;                    // frames per GOP, every GOP starts with a keyframe
+    int b_frames;
+    int64_t video_bit_rate;     // 0 = from resolution and fps
+    const char *video_codec;    // encoder name
+    const char *video_source;   // lavfi source filter and options, without size/rate
+
+    // Audio; channels 0 leaves the clip without an audio stream
+    int channels;
+    int sample_rate;
+    int64_t audio_bit_rate;
+    const char *audio_codec;
+    const char *audio_source;   // without sample_rate
+
+    double duration;            // seconds
+    const char *format;         // muxer name, NULL = guessed from the file name (mp4 in memory)
+} FFmpegxSynthConfig;
+
+// 1280x720 at 30 fps with one-second GOPs, stereo 48 kHz, 10 seconds of MPEG-4 Part 2
+// and AAC: both encoders are built into libavcodec, so every build can produce it
+void ffmpegx_synth_default_config(FFmpegxSynthConfig *config);
+
+// Writes the clip to path
+int ffmpegx_synth_write_file(const FFmpegxSynthConfig *config, const char *path);
+
+// Writes the clip to memory; free *data with av_free()
+int ffmpegx_synth_write_buffer(const FFmpegxSynthConfig *config, uint8_t **data, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_SYNTH_H
@@ -0,0 +1,796 @@
+/**
+ * Keyframe thumbnails
+ * The decoder only ever sees one keyframe at a time: it is sent on its own and
+ * drained, so frame threading adds no delay, and the decoder is flushed before the
+ * next seek. Batches are shared between workers that each own a demuxer and decoder,
+ * taking the timestamps in time order.
+ */
+
+#include <android/log.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_cache.h"
+#include "ffmpeg_pool.h"
+#include "ffmpeg_probe.h"
+#include "ffmpeg_progress.h"
+#include "ffmpeg_session.h"
+#include "ffmpeg_thumbnail.h"
+#include "ffmpeg_trace.h"
+#include "libavutil/avstring.h"
+#include "libavutil/avutil.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mathematics.h"
+#include "libavutil/pixdesc.h"
+#include "libswscale/swscale.h"
+
+#define LOG_TAG "FFmpegThumbnail"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+// JPEG qscale for quality 0, close to visually lossless at thumbnail sizes
+#define DEFAULT_JPEG_QSCALE 3
+
+// Thumbnails below which another worker costs more (opening, probing) than it saves
+#define THUMBNAILS_PER_WORKER 4
+
+// Row alignment ffmpegx_thumbnail_layout() proposes, which keeps swscale on its SIMD paths
+#define THUMBNAIL_STRIDE_ALIGN 64
+
+// keyframes (may be NULL) is an index already resolved for input_file, copied
+// instead of looked up again
+static int thumbnailer_open(FFmpegxThumbnailer *t, const char *input_file, int threads,
+                            const FFmpegxKeyframeIndex *keyframes) {
+    AVDictionary *opts = NULL;
+    int ret;
+
+    memset(t, 0, sizeof(*t));
+    ffmpegx_converter_init(&t->converter, SWS_BILINEAR);
+
+    ret = ffmpegx_cache_open_input(&t->input_ctx, input_file);
+    if (ret < 0) {
+        LOGE("Cannot open input file: %s", input_file);
+        return ret;
+    }
+    t->video_index = av_find_best_stream(t->input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (t->video_index < 0) {
+        LOGE("No video stream in %s", input_file);
+        ret = t->video_index;
+        goto fail;
+    }
+    for (unsigned i = 0; i < t->input_ctx->nb_streams; i++) {
+        if ((int)i != t->video_index) {
+            t->input_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    if (keyframes && keyframes->count > 0 && keyframes->stream_index == t->video_index) {
+        ret = ffmpegx_keyframe_index_copy(&t->index, keyframes);
+        if (ret < 0) {
+            goto fail;
+        }
+    } else if (ffmpegx_keyframe_index_get(t->input_ctx, input_file, t->video_index, &t->index) < 0) {
+        // Without an index every grab seeks to whichever keyframe the demuxer picks
+        ffmpegx_keyframe_index_free(&t->index);
+    }
+
+    AVStream *stream = t->input_ctx->streams[t->video_index];
+    const AVCodec *decoder = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!decoder) {
+        ret = AVERROR_DECODER_NOT_FOUND;
+        goto fail;
+    }
+    t->dec_ctx = avcodec_alloc_context3(decoder);
+    if (!t->dec_ctx) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    ret = avcodec_parameters_to_context(t->dec_ctx, stream->codecpar);
+    if (ret < 0) {
+        goto fail;
+    }
+    t->dec_ctx->pkt_timebase = stream->time_base;
+
+    // Frame threads only help a stream of frames; slices speed up a single one
+    av_dict_set(&opts, "thread_type", "slice", 0);
+    av_dict_set(&opts, "skip_frame", "nokey", 0);
+    av_dict_set(&opts, "skip_loop_filter", "all", 0);
+    ret = ffmpegx_cache_open_codec(&t->dec_ctx, decoder, &opts, threads);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        LOGE("Cannot open %s decoder", decoder->name);
+        goto fail;
+    }
+
+    t->pkt = ffmpegx_packet_get();
+    t->frame = ffmpegx_frame_get();
+    if (!t->pkt || !t->frame) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    ffmpegx_thumbnailer_close(t);
+    return ret;
+}
+
+int ffmpegx_thumbnailer_open(FFmpegxThumbnailer *t, const char *input_file, int threads) {
+    return thumbnailer_open(t, input_file, threads, NULL);
+}
+
+void ffmpegx_thumbnailer_close(FFmpegxThumbnailer *t) {
+    ffmpegx_packet_put(&t->pkt);
+    ffmpegx_frame_put(&t->frame);
+    ffmpegx_converter_uninit(&t->converter);
+    ffmpegx_keyframe_index_free(&t->index);
+    ffmpegx_cache_close_codec(&t->dec_ctx);
+    ffmpegx_cache_close_input(&t->input_ctx);
+}
+
+// Keyframe closest to target, before or after it
+static int64_t nearest_keyframe(const FFmpegxKeyframeIndex *index, int64_t target) {
+    int before = ffmpegx_keyframe_index_find(index, target);
+    int after = ffmpegx_keyframe_index_find_next(index, target);
+    if (after < index->count && index->pts[after] - target < target - index->pts[before]) {
+        return index->pts[after];
+    }
+    return index->pts[before];
+}
+
+// Sends one keyframe and drains the decoder. AVERROR(EAGAIN) when it produced
+// nothing (a damaged or undecodable keyframe), so the caller can try the next one.
+static int decode_keyframe(FFmpegxThumbnailer *t, const AVPacket *pkt) {
+    int ret = avcodec_send_packet(t->dec_ctx, pkt);
+    if (ret >= 0 || ret == AVERROR_INVALIDDATA) {
+        ret = avcodec_send_packet(t->dec_ctx, NULL);
+    }
+    if (ret >= 0) {
+        ret = avcodec_receive_frame(t->dec_ctx, t->frame);
+    }
+    avcodec_flush_buffers(t->dec_ctx);
+    return ret == AVERROR_EOF || ret == AVERROR_INVALIDDATA ? AVERROR(EAGAIN) : ret;
+}
+
+int ffmpegx_thumbnailer_decode(FFmpegxThumbnailer *t, int64_t time_us, int64_t *pts_us) {
+    AVStream *stream = t->input_ctx->streams[t->video_index];
+    int64_t start_us = t->input_ctx->start_time != AV_NOPTS_VALUE ? t->input_ctx->start_time : 0;
+    int64_t target = av_rescale_q(start_us + FFMAX(time_us, 0), AV_TIME_BASE_Q, stream->time_base);
+    int64_t key = t->index.count > 0 ? nearest_keyframe(&t->index, target) : target;
+    int ret;
+
+    av_frame_unref(t->frame);
+    // Without an index the demuxer picks the keyframe at or before the target
+    ret = avformat_seek_file(t->input_ctx, t->video_index, INT64_MIN, key, key, 0);
+    if (ret < 0) {
+        LOGE("Cannot seek to %.3f", time_us / 1e6);
+        return ret;
+    }
+
+    while ((ret = av_read_frame(t->input_ctx, t->pkt)) >= 0) {
+        AVPacket *pkt = t->pkt;
+        // Demuxers may land a little before the keyframe
+        if (pkt->stream_index != t->video_index || !(pkt->flags & AV_PKT_FLAG_KEY) ||
+            (t->index.count > 0 && pkt->pts != AV_NOPTS_VALUE && pkt->pts < key)) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        ret = decode_keyframe(t, pkt);
+        av_packet_unref(pkt);
+        if (ret != AVERROR(EAGAIN)) {
+            break;
+        }
+        if (ffmpegx_cancelled()) {
+            return AVERROR(ECANCELED);
+        }
+    }
+    if (ret < 0) {
+        LOGE("No keyframe decoded near %.3f", time_us / 1e6);
+        return ret == AVERROR(EAGAIN) ? AVERROR_EOF : ret;
+    }
+
+    if (pts_us) {
+        int64_t pts = t->frame->best_effort_timestamp;
+        *pts_us = pts != AV_NOPTS_VALUE ? av_rescale_q(pts, stream->time_base, AV_TIME_BASE_Q) - start_us : time_us;
+    }
+    return 0;
+}
+
+static void fit_size(int src_width, int src_height, AVRational sar, int width, int height,
+                     int *out_width, int *out_height) {
+    double display_width = src_width * (sar.num > 0 && sar.den > 0 ? av_q2d(sar) : 1.0);
+
+    if (width <= 0 && height <= 0) {
+        width = (int)lrint(display_width);
+        height = src_height;
+    } else if (width <= 0) {
+        width = (int)lrint(height * display_width / src_height);
+    } else if (height <= 0) {
+        height = (int)lrint(width * src_height / display_width);
+    }
+    *out_width = FFMAX(width, 1);
+    *out_height = FFMAX(height, 1);
+}
+
+void ffmpegx_thumbnail_size(const AVFrame *frame, int width, int height, int *out_width, int *out_height) {
+    fit_size(frame->width, frame->height, frame->sample_aspect_ratio, width, height, out_width, out_height);
+}
+
+int ffmpegx_thumbnailer_grab(FFmpegxThumbnailer *t, int64_t time_us, int width, int height,
+                             enum AVPixelFormat format, AVFrame **thumb, int64_t *pts_us) {
+    int thumb_width, thumb_height;
+
+    *thumb = NULL;
+    int ret = ffmpegx_thumbnailer_decode(t, time_us, pts_us);
+    if (ret < 0) {
+        return ret;
+    }
+    ffmpegx_thumbnail_size(t->frame, width, height, &thumb_width, &thumb_height);
+    ret = ffmpegx_converter_convert(&t->converter, t->frame, thumb_width, thumb_height, format, thumb);
+    av_frame_unref(t->frame);
+    if (ret >= 0) {
+        (*thumb)->sample_aspect_ratio = (AVRational){ 1, 1 };
+    }
+    return ret;
+}
+
+enum AVPixelFormat ffmpegx_thumbnail_pix_fmt(FFmpegxThumbnailFormat format) {
+    switch (format) {
+    case FFMPEGX_THUMBNAIL_JPEG:
+        // Full range, which the JPEG encoder expects
+        return AV_PIX_FMT_YUVJ420P;
+    case FFMPEGX_THUMBNAIL_PNG:
+        return AV_PIX_FMT_RGB24;
+    case FFMPEGX_THUMBNAIL_NV21:
+        return AV_PIX_FMT_NV21;
+    default:
+        return AV_PIX_FMT_RGBA;
+    }
+}
+
+static int is_raw_format(FFmpegxThumbnailFormat format) {
+    return format == FFMPEGX_THUMBNAIL_RGBA || format == FFMPEGX_THUMBNAIL_NV21;
+}
+
+int64_t ffmpegx_thumbnail_buffer_size(int width, int height, int stride, FFmpegxThumbnailFormat format) {
+    if (width <= 0 || height <= 0 || !is_raw_format(format) ||
+        (format == FFMPEGX_THUMBNAIL_NV21 && (width & 1 || height & 1))) {
+        return AVERROR(EINVAL);
+    }
+    int min_stride = format == FFMPEGX_THUMBNAIL_RGBA ? width * 4 : width;
+    if (stride == 0) {
+        stride = min_stride;
+    } else if (stride < min_stride) {
+        return AVERROR(EINVAL);
+    }
+    // NV21: the interleaved V/U rows follow the luma rows, same stride
+    int rows = format == FFMPEGX_THUMBNAIL_NV21 ? height + height / 2 : height;
+    return (int64_t)stride * rows;
+}
+
+int ffmpegx_thumbnail_layout(const char *input_file, int width, int height, FFmpegxThumbnailFormat format,
+                             FFmpegxThumbnailLayout *layout) {
+    FFmpegxMediaInfo info;
+    const FFmpegxStreamInfo *video = NULL;
+
+    int ret = ffmpegx_probe(input_file, FFMPEGX_PROBE_FAST, &info);
+    if (ret < 0) {
+        return ret;
+    }
+    for (int i = 0; i < info.nb_streams && !video; i++) {
+        if (info.streams[i].type == AVMEDIA_TYPE_VIDEO && info.streams[i].width > 0) {
+            video = &info.streams[i];
+        }
+    }
+    if (!video) {
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+
+    fit_size(video->width, video->height, (AVRational){ 1, 1 }, width, height, &layout->width, &layout->height);
+    if (format == FFMPEGX_THUMBNAIL_NV21) {
+        layout->width = FFMAX(layout->width & ~1, 2);
+        layout->height = FFMAX(layout->height & ~1, 2);
+    }
+    int min_stride = format == FFMPEGX_THUMBNAIL_NV21 ? layout->width : layout->width * 4;
+    layout->stride = FFALIGN(min_stride, THUMBNAIL_STRIDE_ALIGN);
+    layout->size = ffmpegx_thumbnail_buffer_size(layout->width, layout->height, layout->stride, format);
+    return layout->size < 0 ? (int)layout->size : 0;
+}
+
+int ffmpegx_thumbnailer_grab_into(FFmpegxThumbnailer *t, int64_t time_us, uint8_t *pixels, int64_t size,
+                                  int width, int height, int stride, FFmpegxThumbnailFormat format,
+                                  int64_t *pts_us) {
+    uint8_t *planes[4] = { NULL };
+    int linesizes[4] = { 0 };
+
+    int64_t needed = ffmpegx_thumbnail_buffer_size(width, height, stride, format);
+    if (needed < 0 || !pixels || size < needed) {
+        LOGE("Buffer of %lld bytes cannot hold a %dx%d thumbnail with stride %d", (long long)size,
+             width, height, stride);
+        return AVERROR(EINVAL);
+    }
+    if (stride == 0) {
+        stride = format == FFMPEGX_THUMBNAIL_RGBA ? width * 4 : width;
+    }
+    planes[0] = pixels;
+    linesizes[0] = stride;
+    if (format == FFMPEGX_THUMBNAIL_NV21) {
+        planes[1] = pixels + (size_t)stride * height;
+        linesizes[1] = stride;
+    }
+
+    int ret = ffmpegx_thumbnailer_decode(t, time_us, pts_us);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = ffmpegx_converter_convert_into(&t->converter, t->frame, planes, linesizes, width, height,
+                                         ffmpegx_thumbnail_pix_fmt(format));
+    av_frame_unref(t->frame);
+    return ret;
+}
+
+// Raw pixels, rows packed without padding
+static int write_raw(const AVFrame *frame, FILE *f) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    int row_bytes[4];
+
+    int ret = av_image_fill_linesizes(row_bytes, frame->format, frame->width);
+    if (ret < 0) {
+        return ret;
+    }
+    for (int plane = 0; plane < 4 && frame->data[plane]; plane++) {
+        int rows = plane > 0 ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+        for (int y = 0; y < rows; y++) {
+            const uint8_t *row = frame->data[plane] + (size_t)y * frame->linesize[plane];
+            if (fwrite(row, 1, row_bytes[plane], f) != (size_t)row_bytes[plane]) {
+                return AVERROR(EIO);
+            }
+        }
+    }
+    return 0;
+}
+
+// Encodes frame as a single JPEG or PNG image into pkt
+static int encode_image(AVFrame *frame, FFmpegxThumbnailFormat format, int quality, AVPacket *pkt) {
+    const AVCodec *codec = avcodec_find_encoder(format == FFMPEGX_THUMBNAIL_JPEG ? AV_CODEC_ID_MJPEG
+                                                                                  : AV_CODEC_ID_PNG);
+    if (!codec) {
+        return AVERROR_ENCODER_NOT_FOUND;
+    }
+    AVCodecContext *enc = avcodec_alloc_context3(codec);
+    if (!enc) {
+        return AVERROR(ENOMEM);
+    }
+    enc->width = frame->width;
+    enc->height = frame->height;
+    enc->pix_fmt = frame->format;
+    enc->time_base = (AVRational){ 1, 25 };
+    if (format == FFMPEGX_THUMBNAIL_JPEG) {
+        // Quality 1-100 onto qscale 31-2; the encoder reads the frame's quality
+        int qscale = quality > 0 ? 31 - (FFMIN(quality, 100) - 1) * 29 / 99 : DEFAULT_JPEG_QSCALE;
+        enc->flags |= AV_CODEC_FLAG_QSCALE;
+        enc->global_quality = FF_QP2LAMBDA * qscale;
+        enc->color_range = AVCOL_RANGE_JPEG;
+        frame->quality = enc->global_quality;
+    }
+
+    int ret = ffmpegx_cache_open_codec(&enc, codec, NULL, 1);
+    if (ret >= 0) {
+        ret = avcodec_send_frame(enc, frame);
+    }
+    if (ret >= 0) {
+        ret = avcodec_send_frame(enc, NULL);
+    }
+    if (ret >= 0) {
+        ret = avcodec_receive_packet(enc, pkt);
+    }
+    ffmpegx_cache_close_codec(&enc);
+    return ret;
+}
+
+int ffmpegx_thumbnail_write(AVFrame *frame, FFmpegxThumbnailFormat format, int quality, const char *path) {
+    AVPacket *pkt = NULL;
+    int ret;
+
+    if (frame->format != ffmpegx_thumbnail_pix_fmt(format)) {
+        return AVERROR(EINVAL);
+    }
+    if (!is_raw_format(format)) {
+        pkt = ffmpegx_packet_get();
+        if (!pkt) {
+            return AVERROR(ENOMEM);
+        }
+        ret = encode_image(frame, format, quality, pkt);
+        if (ret < 0) {
+            LOGE("Cannot encode thumbnail %s", path);
+            ffmpegx_packet_put(&pkt);
+            return ret;
+        }
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        LOGE("Cannot write %s", path);
+        ffmpegx_packet_put(&pkt);
+        return AVERROR(errno);
+    }
+    if (pkt) {
+        ret = fwrite(pkt->data, 1, pkt->size, f) == (size_t)pkt->size ? 0 : AVERROR(EIO);
+    } else {
+        ret = write_raw(frame, f);
+    }
+    if (fclose(f) != 0 && ret >= 0) {
+        ret = AVERROR(EIO);
+    }
+    ffmpegx_packet_put(&pkt);
+    return ret;
+}
+
+typedef struct ThumbnailTime {
+    int64_t time_us;
+    int index;                  // position in the caller's times_us
+} ThumbnailTime;
+
+typedef struct ThumbnailJobs ThumbnailJobs;
+
+// Produces the thumbnail of times_us[index] with the worker's thumbnailer
+typedef int (*ThumbnailTask)(ThumbnailJobs *jobs, FFmpegxThumbnailer *t, int index, int64_t time_us);
+
+struct ThumbnailJobs {
+    const char *input_file;
+    ThumbnailTime *times;       // by time, so every worker only seeks forward
+    int count;
+    ThumbnailTask task;
+    int width, height;
+    int threads_per_worker;
+    const FFmpegxKeyframeIndex *index;
+    FFmpegxSession *session;
+    atomic_int next;
+    atomic_int error;
+
+    // Files
+    const char *output_pattern;
+    FFmpegxThumbnailFormat format;
+    int quality;
+    FFmpegxThumbnailReadyFn ready;
+    void *opaque;
+
+    // Sprite sheet
+    AVFrame *canvas;
+    int columns;
+};
+
+static int compare_times(const void *a, const void *b) {
+    const ThumbnailTime *x = a, *y = b;
+    if (x->time_us != y->time_us) {
+        return x->time_us < y->time_us ? -1 : 1;
+    }
+    return x->index - y->index;
+}
+
+// Takes thumbnails off jobs until none is left or one has failed
+static void run_thumbnails(ThumbnailJobs *jobs, FFmpegxThumbnailer *t) {
+    while (!atomic_load(&jobs->error)) {
+        if (ffmpegx_cancelled()) {
+            int expected = 0;
+            atomic_compare_exchange_strong(&jobs->error, &expected, AVERROR(ECANCELED));
+            break;
+        }
+
+        int next = atomic_fetch_add(&jobs->next, 1);
+        if (next >= jobs->count) {
+            break;
+        }
+
+        int64_t start = ffmpegx_now_ns();
+        int ret = jobs->task(jobs, t, jobs->times[next].index, jobs->times[next].time_us);
+        ffmpegx_trace_event("thumbnail", start, ffmpegx_now_ns());
+        if (ret < 0) {
+            int expected = 0;
+            atomic_compare_exchange_strong(&jobs->error, &expected, ret);
+        }
+    }
+}
+
+static void *thumbnail_worker(void *arg) {
+    ThumbnailJobs *jobs = arg;
+    FFmpegxThumbnailer t;
+
+    pthread_setname_np(pthread_self(), "ffx-thumb");
+    ffmpegx_session_set_current(jobs->session);
+
+    // A worker that cannot open the input leaves its share to the others
+    if (thumbnailer_open(&t, jobs->input_file, jobs->threads_per_worker, jobs->index) < 0) {
+        LOGE("Thumbnail worker could not open %s", jobs->input_file);
+        return NULL;
+    }
+    run_thumbnails(jobs, &t);
+    ffmpegx_thumbnailer_close(&t);
+    return NULL;
+}
+
+// Workers a batch of count thumbnails is worth
+static int batch_workers(int count, int thread_budget) {
+    int workers = (count + THUMBNAILS_PER_WORKER - 1) / THUMBNAILS_PER_WORKER;
+    if (workers > thread_budget) workers = thread_budget;
+    return workers < 1 ? 1 : workers;
+}
+
+// Runs jobs->task for every entry of times_us on worker_count workers, t (opened
+// on the calling thread) being the first. Returns 0 or the first error.
+static int run_batch(ThumbnailJobs *jobs, FFmpegxThumbnailer *t, const int64_t *times_us, int count,
+                     int worker_count, int thread_budget) {
+    pthread_t *workers = NULL;
+    int started = 0;
+
+    jobs->times = av_malloc_array(count, sizeof(*jobs->times));
+    if (worker_count > 1) {
+        workers = av_calloc(worker_count - 1, sizeof(*workers));
+    }
+    if (!jobs->times || (worker_count > 1 && !workers)) {
+        av_freep(&jobs->times);
+        av_free(workers);
+        return AVERROR(ENOMEM);
+    }
+    for (int i = 0; i < count; i++) {
+        jobs->times[i].time_us = times_us[i];
+        jobs->times[i].index = i;
+    }
+    qsort(jobs->times, count, sizeof(*jobs->times), compare_times);
+
+    jobs->count = count;
+    jobs->threads_per_worker = FFMAX(thread_budget / worker_count, 1);
+    // The others copy the first thumbnailer's keyframe index, so a file without
+    // one is only scanned once
+    jobs->index = &t->index;
+    jobs->session = ffmpegx_session_current();
+    atomic_init(&jobs->next, 0);
+    atomic_init(&jobs->error, 0);
+
+    if (worker_count > 1) {
+        LOGI("Extracting %d thumbnails with %d workers", count, worker_count);
+    }
+    for (started = 0; started < worker_count - 1; started++) {
+        if (pthread_create(&workers[started], NULL, thumbnail_worker, jobs) != 0) {
+            LOGE("Failed to create thumbnail worker");
+            break;
+        }
+    }
+    run_thumbnails(jobs, t);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    av_free(workers);
+    return atomic_load(&jobs->error);
+}
+
+// ThumbnailTask writing each thumbnail to its own file
+static int write_thumbnail(ThumbnailJobs *jobs, FFmpegxThumbnailer *t, int index, int64_t time_us) {
+    char path[1024];
+    int64_t pts_us = time_us;
+    AVFrame *thumb = NULL;
+
+    int ret = ffmpegx_thumbnailer_grab(t, time_us, jobs->width, jobs->height,
+                                       ffmpegx_thumbnail_pix_fmt(jobs->format), &thumb, &pts_us);
+    if (av_get_frame_filename(path, sizeof(path), jobs->output_pattern, index + 1) < 0) {
+        av_strlcpy(path, jobs->output_pattern, sizeof(path));
+    }
+    if (ret >= 0) {
+        ret = ffmpegx_thumbnail_write(thumb, jobs->format, jobs->quality, path);
+    }
+    ffmpegx_frame_put(&thumb);
+
+    if (jobs->ready) {
+        jobs->ready(jobs->opaque, index, pts_us, path, ret);
+    }
+    return ret;
+}
+
+int ffmpegx_thumbnails_extract(const char *input_file, const int64_t *times_us, int count,
+                               const char *output_pattern, int width, int height,
+                               FFmpegxThumbnailFormat format, int quality, int thread_budget,
+                               FFmpegxThumbnailReadyFn ready, void *opaque) {
+    FFmpegxThumbnailer t;
+    ThumbnailJobs jobs;
+    char path[1024];
+    int ret;
+
+    if (count < 1) {
+        return AVERROR(EINVAL);
+    }
+    if (av_get_frame_filename(path, sizeof(path), output_pattern, 1) < 0 && count > 1) {
+        LOGE("Output pattern needs a %%d for %d thumbnails: %s", count, output_pattern);
+        return AVERROR(EINVAL);
+    }
+
+    int worker_count = batch_workers(count, thread_budget);
+    ret = thumbnailer_open(&t, input_file, FFMAX(thread_budget / worker_count, 1), NULL);
+    if (ret < 0) {
+        return ret;
+    }
+
+    memset(&jobs, 0, sizeof(jobs));
+    jobs.input_file = input_file;
+    jobs.task = write_thumbnail;
+    jobs.width = width;
+    jobs.height = height;
+    jobs.output_pattern = output_pattern;
+    jobs.format = format;
+    jobs.quality = quality;
+    jobs.ready = ready;
+    jobs.opaque = opaque;
+
+    ret = run_batch(&jobs, &t, times_us, count, worker_count, thread_budget);
+    if (ret >= 0) {
+        LOGI("Wrote %d keyframe thumbnails of %s", count, input_file);
+    }
+
+    av_free(jobs.times);
+    ffmpegx_thumbnailer_close(&t);
+    return ret;
+}
+
+// ThumbnailTask scaling each thumbnail straight into its tile of the sheet; tiles
+// do not overlap, so the workers need no lock
+static int draw_tile(ThumbnailJobs *jobs, FFmpegxThumbnailer *t, int index, int64_t time_us) {
+    AVFrame *canvas = jobs->canvas;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(canvas->format);
+    uint8_t *tile[4] = { NULL };
+    int x = index % jobs->columns * jobs->width;
+    int y = index / jobs->columns * jobs->height;
+
+    int ret = ffmpegx_thumbnailer_decode(t, time_us, NULL);
+    if (ret < 0) {
+        return ret;
+    }
+    for (int plane = 0; plane < 4 && canvas->data[plane]; plane++) {
+        int chroma = plane == 1 || plane == 2;
+        int shift_x = chroma ? desc->log2_chroma_w : 0;
+        int shift_y = chroma ? desc->log2_chroma_h : 0;
+        tile[plane] = canvas->data[plane] + (y >> shift_y) * canvas->linesize[plane] +
+                      (x >> shift_x) * desc->comp[plane].step;
+    }
+    ret = ffmpegx_converter_convert_into(&t->converter, t->frame, tile, canvas->linesize,
+                                         jobs->width, jobs->height, canvas->format);
+    av_frame_unref(t->frame);
+    return ret;
+}
+
+static void format_vtt_time(char *out, size_t size, int64_t time_us) {
+    int64_t ms = FFMAX(time_us, 0) / 1000;
+    snprintf(out, size, "%02d:%02d:%02d.%03d", (int)(ms / 3600000), (int)(ms / 60000 % 60),
+             (int)(ms / 1000 % 60), (int)(ms % 1000));
+}
+
+// WebVTT thumbnail track: each tile covers the time from its timestamp to the next
+// one, the last one up to end_us
+static int write_sprite_vtt(const ThumbnailJobs *jobs, const char *image_path, int64_t end_us,
+                            const char *vtt_path) {
+    char start[32], end[32];
+    FILE *f = fopen(vtt_path, "w");
+    if (!f) {
+        LOGE("Cannot write %s", vtt_path);
+        return AVERROR(errno);
+    }
+
+    // The player resolves the image next to the VTT file
+    const char *image_name = av_basename(image_path);
+    fprintf(f, "WEBVTT\n");
+    for (int i = 0; i < jobs->count; i++) {
+        const ThumbnailTime *tile = &jobs->times[i];
+        int64_t next_us = i + 1 < jobs->count ? jobs->times[i + 1].time_us : end_us;
+        if (next_us <= tile->time_us) {
+            continue;
+        }
+        format_vtt_time(start, sizeof(start), tile->time_us);
+        format_vtt_time(end, sizeof(end), next_us);
+        fprintf(f, "\n%s --> %s\n%s#xywh=%d,%d,%d,%d\n", start, end, image_name,
+                tile->index % jobs->columns * jobs->width, tile->index / jobs->columns * jobs->height,
+                jobs->width, jobs->height);
+    }
+    int ret = ferror(f) ? AVERROR(EIO) : 0;
+    if (fclose(f) != 0 && ret >= 0) {
+        ret = AVERROR(EIO);
+    }
+    return ret;
+}
+
+int ffmpegx_sprite_sheet(const char *input_file, const int64_t *times_us, int count, int columns,
+                         int tile_width, int tile_height, FFmpegxThumbnailFormat format, int quality,
+                         const char *image_path, const char *vtt_path, int thread_budget) {
+    FFmpegxThumbnailer t;
+    ThumbnailJobs jobs;
+    AVFrame *canvas = NULL;
+    int ret;
+
+    memset(&jobs, 0, sizeof(jobs));
+    if (count < 1 || is_raw_format(format)) {
+        return AVERROR(EINVAL);
+    }
+    if (columns <= 0) {
+        columns = (int)ceil(sqrt(count));
+    }
+    columns = FFMIN(columns, count);
+    int rows = (count + columns - 1) / columns;
+
+    int worker_count = batch_workers(count, thread_budget);
+    ret = thumbnailer_open(&t, input_file, FFMAX(thread_budget / worker_count, 1), NULL);
+    if (ret < 0) {
+        return ret;
+    }
+
+    // Tiles are sized from the stream up front so the sheet can be allocated before
+    // anything is decoded; even sizes keep 4:2:0 tiles on chroma sample boundaries
+    AVStream *stream = t.input_ctx->streams[t.video_index];
+    fit_size(stream->codecpar->width, stream->codecpar->height,
+             av_guess_sample_aspect_ratio(t.input_ctx, stream, NULL), tile_width, tile_height,
+             &tile_width, &tile_height);
+    tile_width = FFMAX(tile_width & ~1, 2);
+    tile_height = FFMAX(tile_height & ~1, 2);
+
+    canvas = ffmpegx_frame_get();
+    if (!canvas) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    canvas->format = ffmpegx_thumbnail_pix_fmt(format);
+    canvas->width = columns * tile_width;
+    canvas->height = rows * tile_height;
+    ret = av_frame_get_buffer(canvas, 0);
+    if (ret < 0) {
+        goto end;
+    }
+    // Cells past the last tile stay black
+    if (count < columns * rows) {
+        ptrdiff_t linesize[4] = { 0 };
+        for (int i = 0; i < 4; i++) {
+            linesize[i] = canvas->linesize[i];
+        }
+        av_image_fill_black(canvas->data, linesize, canvas->format, AVCOL_RANGE_JPEG,
+                            canvas->width, canvas->height);
+    }
+
+    jobs.input_file = input_file;
+    jobs.task = draw_tile;
+    jobs.width = tile_width;
+    jobs.height = tile_height;
+    jobs.canvas = canvas;
+    jobs.columns = columns;
+
+    ret = run_batch(&jobs, &t, times_us, count, worker_count, thread_budget);
+    if (ret < 0) {
+        goto end;
+    }
+
+    int64_t start = ffmpegx_now_ns();
+    ret = ffmpegx_thumbnail_write(canvas, format, quality, image_path);
+    ffmpegx_trace_event("sprite_encode", start, ffmpegx_now_ns());
+    if (ret < 0 || !vtt_path) {
+        goto end;
+    }
+
+    int64_t last_us = jobs.times[count - 1].time_us;
+    int64_t end_us = t.input_ctx->duration > 0 ? t.input_ctx->duration
+                     : last_us + (count > 1 ? (last_us - jobs.times[0].time_us) / (count - 1) : AV_TIME_BASE);
+    ret = write_sprite_vtt(&jobs, image_path, FFMAX(end_us, last_us + 1000), vtt_path);
+    if (ret >= 0) {
+        LOGI("Wrote a %dx%d sprite sheet of %d tiles of %s", canvas->width, canvas->height,
+             count, input_file);
+    }
+
+end:
+    ffmpegx_frame_put(&canvas);
+    av_free(jobs.times);
+    ffmpegx_thumbnailer_close(&t);
+    return ret;
+}
+
+#endif // HAVE_FFMPEG_STATIC
@@ -0,0 +1,124 @@
+/**
+ * Keyframe thumbnails
+ * Grabs frames at the keyframes nearest to requested timestamps: one seek and one
+ * keyframe decode per thumbnail, with non-key frames and the loop filter skipped,
+ * scaled straight to the thumbnail size. Batches run on several workers at once,
+ * into separate files or into the tiles of one sprite sheet.
+ */
+
+#ifndef FFMPEGX_THUMBNAIL_H
+#define FFMPEGX_THUMBNAIL_H
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_convert.h"
+#include "ffmpeg_index.h"
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum FFmpegxThumbnailFormat {
+    FFMPEGX_THUMBNAIL_JPEG,
+    FFMPEGX_THUMBNAIL_PNG,
+    FFMPEGX_THUMBNAIL_RGBA,     // raw pixels, width * 4 bytes per row, no header
+    FFMPEGX_THUMBNAIL_NV21,     // raw Y plane then interleaved V/U plane, no header
+} FFmpegxThumbnailFormat;
+
+// Caller-owned pixel buffer for a raw format: rows stride bytes apart, the NV21
+// chroma rows right after the height luma rows
+typedef struct FFmpegxThumbnailLayout {
+    int width;
+    int height;
+    int stride;
+    int64_t size;               // bytes
+} FFmpegxThumbnailLayout;
+
+typedef struct FFmpegxThumbnailer {
+    AVFormatContext *input_ctx;
+    AVCodecContext *dec_ctx;
+    int video_index;
+    FFmpegxKeyframeIndex index;     // empty when there is none: the demuxer seeks back
+    FFmpegxConverter converter;
+    AVPacket *pkt;
+    AVFrame *frame;                 // the last decoded keyframe
+} FFmpegxThumbnailer;
+
+// Opens the best video stream of input_file. Keyframes come from the container's
+// seek index when it has one, otherwise from the persisted keyframe index.
+int ffmpegx_thumbnailer_open(FFmpegxThumbnailer *t, const char *input_file, int threads);
+
+void ffmpegx_thumbnailer_close(FFmpegxThumbnailer *t);
+
+// Decodes the keyframe nearest to time_us (from the start of the file) into
+// t->frame, at its full size. *pts_us (may be NULL) is the frame's time from the start.
+int ffmpegx_thumbnailer_decode(FFmpegxThumbnailer *t, int64_t time_us, int64_t *pts_us);
+
+// Size of a thumbnail of frame: a width or height <= 0 follows the display aspect
+// ratio, both <= 0 keep the display size
+void ffmpegx_thumbnail_size(const AVFrame *frame, int width, int height, int *out_width, int *out_height);
+
+// ffmpegx_thumbnailer_decode() scaled to width x height (as ffmpegx_thumbnail_size())
+// in format. *thumb comes from the converter's pool, return it with ffmpegx_frame_put().
+int ffmpegx_thumbnailer_grab(FFmpegxThumbnailer *t, int64_t time_us, int width, int height,
+                             enum AVPixelFormat format, AVFrame **thumb, int64_t *pts_us);
+
+// Pixel format thumbnails are grabbed in for format
+enum AVPixelFormat ffmpegx_thumbnail_pix_fmt(FFmpegxThumbnailFormat format);
+
+// Bytes a width x height raw thumbnail needs with rows stride bytes apart (0 =
+// packed); AVERROR(EINVAL) for a stride below the row size, a compressed format
+// or odd NV21 sizes
+int64_t ffmpegx_thumbnail_buffer_size(int width, int height, int stride, FFmpegxThumbnailFormat format);
+
+// Proposes a buffer for thumbnails of input_file in a raw format: the size of
+// ffmpegx_thumbnail_size() for the stream's coded size (even for NV21) and a
+// SIMD-aligned stride. Only probes the file (cached).
+int ffmpegx_thumbnail_layout(const char *input_file, int width, int height, FFmpegxThumbnailFormat format,
+                             FFmpegxThumbnailLayout *layout);
+
+// ffmpegx_thumbnailer_decode() scaled straight into caller-owned pixels (a Java
+// direct buffer, a locked Bitmap) of size bytes, width x height in a raw format
+// with rows stride bytes apart (0 = packed). Nothing is allocated or copied.
+int ffmpegx_thumbnailer_grab_into(FFmpegxThumbnailer *t, int64_t time_us, uint8_t *pixels, int64_t size,
+                                  int width, int height, int stride, FFmpegxThumbnailFormat format,
+                                  int64_t *pts_us);
+
+// Writes frame, in ffmpegx_thumbnail_pix_fmt(format), to path, raw formats without
+// row padding. quality is 1-100 for JPEG, 0 for the default.
+int ffmpegx_thumbnail_write(AVFrame *frame, FFmpegxThumbnailFormat format, int quality, const char *path);
+
+// Called as soon as thumbnail index (its position in times_us) is written to path, or
+// has failed with result < 0; pts_us is the keyframe's time. Calls come from the
+// workers, concurrently and in no particular order.
+typedef void (*FFmpegxThumbnailReadyFn)(void *opaque, int index, int64_t pts_us, const char *path,
+                                        int result);
+
+// One thumbnail per entry of times_us, written to output_pattern numbered from 1
+// ("thumb_%03d.jpg", as for ffmpeg's image2 muxer; a single thumbnail may use a
+// plain file name). Larger batches are shared by up to thread_budget workers with
+// a demuxer and decoder each. ready may be NULL. Returns 0 or the first AVERROR code.
+int ffmpegx_thumbnails_extract(const char *input_file, const int64_t *times_us, int count,
+                               const char *output_pattern, int width, int height,
+                               FFmpegxThumbnailFormat format, int quality, int thread_budget,
+                               FFmpegxThumbnailReadyFn ready, void *opaque);
+
+// One image tiling a thumbnail per entry of times_us, left to right and top to
+// bottom in columns columns (<= 0 for a square-ish grid), each tile_width x
+// tile_height (as ffmpegx_thumbnail_size(), rounded down to even). Keyframes are
+// scaled straight into their tile and the sheet is encoded once, as JPEG or PNG.
+// vtt_path (may be NULL) receives a WebVTT thumbnail track mapping each tile's time
+// span to its "#xywh=" region of the image.
+int ffmpegx_sprite_sheet(const char *input_file, const int64_t *times_us, int count, int columns,
+                         int tile_width, int tile_height, FFmpegxThumbnailFormat format, int quality,
+                         const char *image_path, const char *vtt_path, int thread_budget);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_THUMBNAIL_H
@@ -0,0 +1,229 @@
+/**
+ * Pipeline trace recorder
+ * Each thread appends to its own chunked buffer without locks or atomics on the
+ * hot path; buffers are linked into a global list when a thread records its first
+ * event and only walked by ffmpegx_trace_stop()
+ */
+
+#include <android/log.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "ffmpeg_session.h"
+#include "ffmpeg_trace.h"
+
+#define LOG_TAG "FFmpegTrace"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+#define CHUNK_EVENTS 4096
+
+typedef struct TraceEvent {
+    const char *name;
+    int64_t start_ns;
+    int64_t end_ns;
+    int64_t session_id;
+} TraceEvent;
+
+typedef struct TraceChunk {
+    struct TraceChunk *next;
+    int count;
+    TraceEvent events[CHUNK_EVENTS];
+} TraceChunk;
+
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;   // global list
+    int tid;
+    char thread_name[16];
+    TraceChunk *head;
+    TraceChunk *tail;
+    int64_t events;
+    int64_t dropped;
+} TraceBuffer;
+
+static atomic_int trace_enabled;
+static _Atomic(TraceBuffer *) trace_buffers;
+// Bumped by every start, so threads drop buffers that belong to an earlier trace
+// without touching them (they have been freed)
+static atomic_int trace_generation;
+static int64_t trace_start_ns;
+
+static _Thread_local TraceBuffer *thread_buffer;
+static _Thread_local int thread_generation;
+
+int ffmpegx_trace_start(void) {
+    int expected = 0;
+    if (atomic_load(&trace_enabled)) {
+        return -EBUSY;
+    }
+    trace_start_ns = ffmpegx_now_ns();
+    atomic_fetch_add(&trace_generation, 1);
+    if (!atomic_compare_exchange_strong(&trace_enabled, &expected, 1)) {
+        return -EBUSY;
+    }
+    LOGI("Tracing started");
+    return 0;
+}
+
+int ffmpegx_trace_enabled(void) {
+    return atomic_load_explicit(&trace_enabled, memory_order_relaxed);
+}
+
+static TraceBuffer *get_thread_buffer(void) {
+    int generation = atomic_load_explicit(&trace_generation, memory_order_relaxed);
+    if (thread_buffer && thread_generation == generation) {
+        return thread_buffer;
+    }
+
+    thread_buffer = NULL;
+    TraceBuffer *buffer = calloc(1, sizeof(*buffer));
+    if (!buffer) {
+        return NULL;
+    }
+    buffer->tid = (int)syscall(SYS_gettid);
+    // Stage threads name themselves before doing any traced work
+    prctl(PR_GET_NAME, buffer->thread_name, 0, 0, 0);
+
+    TraceBuffer *head = atomic_load(&trace_buffers);
+    do {
+        buffer->next = head;
+    } while (!atomic_compare_exchange_weak(&trace_buffers, &head, buffer));
+
+    thread_buffer = buffer;
+    thread_generation = generation;
+    return buffer;
+}
+
+void ffmpegx_trace_event(const char *name, int64_t start_ns, int64_t end_ns) {
+    if (!ffmpegx_trace_enabled()) return;
+
+    TraceBuffer *buffer = get_thread_buffer();
+    if (!buffer) return;
+
+    if (buffer->events >= FFMPEGX_TRACE_MAX_THREAD_EVENTS) {
+        buffer->dropped++;
+        return;
+    }
+
+    TraceChunk *chunk = buffer->tail;
+    if (!chunk || chunk->count == CHUNK_EVENTS) {
+        chunk = malloc(sizeof(*chunk));
+        if (!chunk) {
+            buffer->dropped++;
+            return;
+        }
+        chunk->next = NULL;
+        chunk->count = 0;
+        if (buffer->tail) {
+            buffer->tail->next = chunk;
+        } else {
+            buffer->head = chunk;
+        }
+        buffer->tail = chunk;
+    }
+
+    TraceEvent *event = &chunk->events[chunk->count++];
+    event->name = name;
+    event->start_ns = start_ns;
+    event->end_ns = end_ns;
+    event->session_id = ffmpegx_session_current_id();
+    buffer->events++;
+}
+
+int64_t ffmpegx_trace_span(FFmpegxStage stage, int64_t start_ns) {
+    int64_t end_ns = ffmpegx_now_ns();
+    ffmpegx_trace_event(ffmpegx_stage_name(stage), start_ns, end_ns);
+    return end_ns - start_ns;
+}
+
+// Thread names are the only strings not under our control
+static void write_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        fputc(c < 0x20 || c == '"' || c == '\\' ? '_' : c, out);
+    }
+    fputc('"', out);
+}
+
+// Chrome trace-event format, timestamps in microseconds. Every span is one
+// complete ("X") event, the compact form of a begin/end pair.
+static int write_trace(FILE *out, TraceBuffer *buffers, int64_t *events, int64_t *dropped) {
+    int pid = (int)getpid();
+    int first = 1;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (TraceBuffer *buffer = buffers; buffer; buffer = buffer->next) {
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                first ? "" : ",\n", pid, buffer->tid);
+        write_json_string(out, buffer->thread_name);
+        fprintf(out, "}}");
+        first = 0;
+
+        for (TraceChunk *chunk = buffer->head; chunk; chunk = chunk->next) {
+            for (int i = 0; i < chunk->count; i++) {
+                const TraceEvent *event = &chunk->events[i];
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"ffmpegx\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                             "\"pid\":%d,\"tid\":%d,\"args\":{\"session\":%" PRId64 "}}",
+                        event->name, (event->start_ns - trace_start_ns) / 1e3,
+                        (event->end_ns - event->start_ns) / 1e3, pid, buffer->tid,
+                        event->session_id);
+            }
+        }
+        *events += buffer->events;
+        *dropped += buffer->dropped;
+    }
+    fprintf(out, "\n]}\n");
+
+    return ferror(out) ? -EIO : 0;
+}
+
+int ffmpegx_trace_stop(const char *path) {
+    int expected = 1;
+    if (!atomic_compare_exchange_strong(&trace_enabled, &expected, 0)) {
+        return -EINVAL;
+    }
+    TraceBuffer *buffers = atomic_exchange(&trace_buffers, NULL);
+    int ret = 0;
+
+    if (path) {
+        FILE *out = fopen(path, "w");
+        if (!out) {
+            ret = -errno;
+            LOGE("Could not open trace file %s: %s", path, strerror(errno));
+        } else {
+            int64_t events = 0;
+            int64_t dropped = 0;
+            ret = write_trace(out, buffers, &events, &dropped);
+            if (fclose(out) != 0 && ret == 0) {
+                ret = -errno;
+            }
+            if (ret < 0) {
+                LOGE("Could not write trace file %s", path);
+            } else {
+                LOGI("Trace written to %s: %lld events, %lld dropped",
+                     path, (long long)events, (long long)dropped);
+            }
+        }
+    }
+
+    while (buffers) {
+        TraceBuffer *next = buffers->next;
+        TraceChunk *chunk = buffers->head;
+        while (chunk) {
+            TraceChunk *next_chunk = chunk->next;
+            free(chunk);
+            chunk = next_chunk;
+        }
+        free(buffers);
+        buffers = next;
+    }
+    return ret;
+}
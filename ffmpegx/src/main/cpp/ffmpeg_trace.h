@@ -0,0 +1,44 @@
+/**
+ * Pipeline trace recorder
+ * Optional recording of every demux/decode/scale/filter/encode/mux span into
+ * per-thread buffers, written out as a Chrome trace-event JSON file (chrome://tracing,
+ * ui.perfetto.dev) to look at stalls and thread utilisation of a real job
+ */
+
+#ifndef FFMPEGX_TRACE_H
+#define FFMPEGX_TRACE_H
+
+#include <stdint.h>
+
+#include "ffmpeg_progress.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Events one thread may record in a trace; later ones are dropped and counted
+#define FFMPEGX_TRACE_MAX_THREAD_EVENTS (1 << 20)
+
+// Starts recording on every thread. Returns 0, or -EBUSY while a trace is running.
+int ffmpegx_trace_start(void);
+
+// Stops recording, writes the trace to path (NULL discards it) and frees the
+// buffers. Call once the traced work has finished: a thread still recording
+// would write into a freed buffer. Returns 0 or a negative errno.
+int ffmpegx_trace_stop(const char *path);
+
+int ffmpegx_trace_enabled(void);
+
+// Records [start_ns, end_ns] (ffmpegx_now_ns() clock) as a span on the calling
+// thread; name must outlive the trace, e.g. a string literal
+void ffmpegx_trace_event(const char *name, int64_t start_ns, int64_t end_ns);
+
+// Ends a span of stage that began at start_ns and returns its length, so timing
+// sites can feed the stage counters and the trace with one clock read
+int64_t ffmpegx_trace_span(FFmpegxStage stage, int64_t start_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FFMPEGX_TRACE_H
@@ -3,7 +3,6 @@
  * This properly decodes and re-encodes video for real compression
  */
 
-#include <jni.h>
 #include <android/log.h>
 #include <string.h>
 #include <stdlib.h>
@@ -23,10 +22,35 @@
 #include "libswscale/swscale.h"
 #include "libswresample/swresample.h"
 
+#include "ffmpeg_cache.h"
+#include "ffmpeg_codec.h"
+#include "ffmpeg_convert.h"
+#include "ffmpeg_fdio.h"
+#include "ffmpeg_pipeline.h"
+#include "ffmpeg_pool.h"
+#include "ffmpeg_segment.h"
+#include "ffmpeg_session.h"
+#include "ffmpeg_trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+
 #define LOG_TAG "FFmpegTranscoder"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
+// What the video is encoded to. A width or height <= 0 follows the source (its
+// aspect ratio when only one is given), bitrate <= 0 leaves the encoder's default,
+// a frame rate of 0/0 keeps the source's.
+typedef struct TranscodeSettings {
+    const char *video_codec;    // encoder name, NULL for the first of MPEG-4, H.264, H.263+
+    int width, height;
+    int bitrate;
+    AVRational frame_rate;
+} TranscodeSettings;
+
 typedef struct TranscodeContext {
     AVFormatContext *input_ctx;
     AVFormatContext *output_ctx;
@@ -36,61 +60,112 @@ typedef struct TranscodeContext {
     AVCodecContext *audio_dec_ctx;
     AVCodecContext *audio_enc_ctx;
     
-    struct SwsContext *sws_ctx;
+    FFmpegxConverter converter;
     SwrContext *swr_ctx;
     
     int video_stream_idx;
     int audio_stream_idx;
     
-    AVFrame *decoded_frame;
-    AVFrame *scaled_frame;
-    AVPacket *packet;
-    AVPacket *enc_packet;
+    int target_width;
+    int target_height;
+    int frames_processed;
+    
+    // Encoder ticks of the frames to keep; a segment job only encodes its own range
+    AVRational in_time_base;
+    int64_t range_start;
+    int64_t range_end;
+    int64_t last_pts;
 } TranscodeContext;
 
 static void cleanup_context(TranscodeContext *ctx) {
-    if (ctx->sws_ctx) sws_freeContext(ctx->sws_ctx);
+    ffmpegx_converter_uninit(&ctx->converter);
     if (ctx->swr_ctx) swr_free(&ctx->swr_ctx);
     
-    if (ctx->video_dec_ctx) avcodec_free_context(&ctx->video_dec_ctx);
-    if (ctx->video_enc_ctx) avcodec_free_context(&ctx->video_enc_ctx);
-    if (ctx->audio_dec_ctx) avcodec_free_context(&ctx->audio_dec_ctx);
-    if (ctx->audio_enc_ctx) avcodec_free_context(&ctx->audio_enc_ctx);
-    
-    if (ctx->decoded_frame) av_frame_free(&ctx->decoded_frame);
-    if (ctx->scaled_frame) av_frame_free(&ctx->scaled_frame);
-    if (ctx->packet) av_packet_free(&ctx->packet);
-    if (ctx->enc_packet) av_packet_free(&ctx->enc_packet);
+    if (ctx->video_dec_ctx) ffmpegx_cache_close_codec(&ctx->video_dec_ctx);
+    if (ctx->video_enc_ctx) ffmpegx_cache_close_codec(&ctx->video_enc_ctx);
+    if (ctx->audio_dec_ctx) ffmpegx_cache_close_codec(&ctx->audio_dec_ctx);
+    if (ctx->audio_enc_ctx) ffmpegx_cache_close_codec(&ctx->audio_enc_ctx);
     
-    if (ctx->input_ctx) avformat_close_input(&ctx->input_ctx);
+    if (ctx->input_ctx) ffmpegx_cache_close_input(&ctx->input_ctx);
     if (ctx->output_ctx) {
         if (!(ctx->output_ctx->oformat->flags & AVFMT_NOFILE))
-            avio_closep(&ctx->output_ctx->pb);
+            ffmpegx_close_output(ctx->output_ctx);
         avformat_free_context(ctx->output_ctx);
     }
 }
 
-int transcode_video(const char *input_file, const char *output_file, 
-                   int target_width, int target_height, int target_bitrate) {
+// Pipeline filter stage: scale each decoded frame to the target size.
+// Every frame gets its own pooled buffer since the encoder may still hold the previous one.
+static int scale_stage(FFmpegxPipeline *pipeline, AVFrame *frame, void *opaque) {
+    TranscodeContext *ctx = opaque;
+    
+    if (!frame) {
+        return 0;
+    }
+    
+    // Map the source timestamp onto the encoder's time base. Segment jobs decide
+    // membership on the same ticks, so neighbouring segments never overlap.
+    int64_t ts = frame->best_effort_timestamp;
+    int64_t pts = ts != AV_NOPTS_VALUE ?
+                  av_rescale_q(ts, ctx->in_time_base, ctx->video_enc_ctx->time_base) :
+                  ctx->last_pts + 1;
+    if (pts < ctx->range_start || pts >= ctx->range_end) {
+        return 0;
+    }
+    // More than one source frame per tick, which only happens when an explicit output
+    // rate is below the source's: keep the first, as ffmpeg's -r does
+    if (ctx->frames_processed > 0 && pts <= ctx->last_pts) {
+        return 0;
+    }
+    ctx->last_pts = pts;
+    
+    // Scaler and output buffers are reused across frames
+    AVFrame *scaled_frame = NULL;
+    int ret = ffmpegx_converter_convert(&ctx->converter, frame,
+                                        ctx->target_width, ctx->target_height, AV_PIX_FMT_YUV420P,
+                                        &scaled_frame);
+    if (ret < 0) {
+        LOGE("Could not scale frame: %s", av_err2str(ret));
+        return ret;
+    }
+    scaled_frame->pts = pts;
+    
+    ret = ffmpegx_pipeline_emit_frame(pipeline, scaled_frame);
+    ffmpegx_frame_put(&scaled_frame);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    ctx->frames_processed++;
+    if (ctx->frames_processed % 30 == 0) {
+        LOGI("Processed %d frames", ctx->frames_processed);
+    }
+    return 0;
+}
+
+// Transcodes the whole input, or only the video of one GOP-aligned range when
+// range is set (used for the segments of a parallel transcode). progress may be NULL.
+static int transcode_range(const char *input_file, const char *output_file, const char *format_name,
+                           const TranscodeSettings *settings, int thread_budget,
+                           const FFmpegxSegment *range, FFmpegxProgress *progress) {
     TranscodeContext ctx = {0};
+    int target_width = settings->width;
+    int target_height = settings->height;
+    int target_bitrate = settings->bitrate;
     int ret;
     
     LOGI("Starting full video transcoding: %s -> %s", input_file, output_file);
-    LOGI("Target: %dx%d @ %d kbps", target_width, target_height, target_bitrate/1000);
+    
+    int dec_threads, enc_threads;
+    ffmpegx_split_thread_budget(thread_budget, &dec_threads, &enc_threads);
     
     // Open input file
-    ret = avformat_open_input(&ctx.input_ctx, input_file, NULL, NULL);
+    ret = ffmpegx_cache_open_input(&ctx.input_ctx, input_file);
     if (ret < 0) {
         LOGE("Could not open input file");
         goto cleanup;
     }
     
-    ret = avformat_find_stream_info(ctx.input_ctx, NULL);
-    if (ret < 0) {
-        LOGE("Could not find stream info");
-        goto cleanup;
-    }
-    
     // Find video and audio streams
     ctx.video_stream_idx = -1;
     ctx.audio_stream_idx = -1;
@@ -122,25 +197,67 @@ int transcode_video(const char *input_file, const char *output_file,
     ctx.video_dec_ctx = avcodec_alloc_context3(video_decoder);
     avcodec_parameters_to_context(ctx.video_dec_ctx, video_stream->codecpar);
     
-    ret = avcodec_open2(ctx.video_dec_ctx, video_decoder, NULL);
+    ret = ffmpegx_cache_open_codec(&ctx.video_dec_ctx, video_decoder, NULL, dec_threads);
     if (ret < 0) {
         LOGE("Could not open video decoder");
         goto cleanup;
     }
     
     // Create output context
-    avformat_alloc_output_context2(&ctx.output_ctx, NULL, "mp4", output_file);
+    avformat_alloc_output_context2(&ctx.output_ctx, NULL, format_name, output_file);
     if (!ctx.output_ctx) {
         LOGE("Could not create output context");
         ret = -1;
         goto cleanup;
     }
     
-    // Setup video encoder - try different codecs
+    // Source size where the settings leave it open, even for 4:2:0
+    int source_width = ctx.video_dec_ctx->width, source_height = ctx.video_dec_ctx->height;
+    if (target_width <= 0 && target_height <= 0) {
+        target_width = source_width;
+        target_height = source_height;
+    } else if (target_width <= 0 && source_height > 0) {
+        target_width = (int)av_rescale(target_height, source_width, source_height);
+    } else if (target_height <= 0 && source_width > 0) {
+        target_height = (int)av_rescale(target_width, source_height, source_width);
+    }
+    target_width &= ~1;
+    target_height &= ~1;
+    if (target_width <= 0 || target_height <= 0) {
+        LOGE("Invalid output size %dx%d", target_width, target_height);
+        ret = AVERROR(EINVAL);
+        goto cleanup;
+    }
+    
+    // An explicit rate makes the output constant-rate; otherwise it keeps the source's
+    AVRational frame_rate = settings->frame_rate;
+    int fixed_rate = frame_rate.num > 0 && frame_rate.den > 0;
+    if (!fixed_rate) {
+        frame_rate = av_guess_frame_rate(ctx.input_ctx, video_stream, NULL);
+    }
+    if (frame_rate.num <= 0 || frame_rate.den <= 0) {
+        frame_rate = (AVRational){30, 1};
+    }
+    
+    LOGI("Target: %dx%d @ %d kbps, %d/%d fps, %d thread(s)", target_width, target_height,
+         target_bitrate / 1000, frame_rate.num, frame_rate.den, thread_budget);
+    
+    // Setup video encoder: the requested one, else the first available of a few
     const AVCodec *video_encoder = NULL;
     
+    if (settings->video_codec) {
+        video_encoder = avcodec_find_encoder_by_name(settings->video_codec);
+        if (!video_encoder) {
+            LOGE("Video encoder %s not found", settings->video_codec);
+            ret = AVERROR_ENCODER_NOT_FOUND;
+            goto cleanup;
+        }
+    }
+    
     // First try MPEG4 which is most likely to be available
-    video_encoder = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    if (!video_encoder) {
+        video_encoder = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    }
     if (!video_encoder) {
         LOGI("MPEG4 encoder not found, trying H264");
         video_encoder = avcodec_find_encoder(AV_CODEC_ID_H264);
@@ -168,10 +285,18 @@ int transcode_video(const char *input_file, const char *output_file,
     ctx.video_enc_ctx->width = target_width;
     ctx.video_enc_ctx->height = target_height;
     ctx.video_enc_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    ctx.video_enc_ctx->bit_rate = target_bitrate;
-    ctx.video_enc_ctx->time_base = (AVRational){1, 30};
-    ctx.video_enc_ctx->framerate = (AVRational){30, 1};
-    ctx.video_enc_ctx->gop_size = 30;
+    if (target_bitrate > 0) {
+        ctx.video_enc_ctx->bit_rate = target_bitrate;
+    }
+    // The source time base keeps every frame on its own tick; MPEG-4 caps the
+    // denominator at 16 bits, so such sources fall back to one tick per frame
+    ctx.video_enc_ctx->time_base = av_inv_q(frame_rate);
+    if (!fixed_rate && video_stream->time_base.num > 0 &&
+        (video_encoder->id != AV_CODEC_ID_MPEG4 || video_stream->time_base.den <= 65535)) {
+        ctx.video_enc_ctx->time_base = video_stream->time_base;
+    }
+    ctx.video_enc_ctx->framerate = frame_rate;
+    ctx.video_enc_ctx->gop_size = FFMAX((int)(av_q2d(frame_rate) + 0.5), 1);
     ctx.video_enc_ctx->max_b_frames = 0; // Disable B-frames to avoid DTS issues
     
     // Add strict experimental flag if needed
@@ -186,7 +311,7 @@ int transcode_video(const char *input_file, const char *output_file,
     av_dict_set(&opts, "preset", "fast", 0);
     av_dict_set(&opts, "tune", "zerolatency", 0);
     
-    ret = avcodec_open2(ctx.video_enc_ctx, video_encoder, &opts);
+    ret = ffmpegx_cache_open_codec(&ctx.video_enc_ctx, video_encoder, &opts, enc_threads);
     av_dict_free(&opts);
     if (ret < 0) {
         LOGE("Could not open video encoder");
@@ -196,28 +321,18 @@ int transcode_video(const char *input_file, const char *output_file,
     avcodec_parameters_from_context(out_video_stream->codecpar, ctx.video_enc_ctx);
     out_video_stream->time_base = ctx.video_enc_ctx->time_base;
     
-    // Setup scaling context
-    ctx.sws_ctx = sws_getContext(
-        ctx.video_dec_ctx->width, ctx.video_dec_ctx->height, ctx.video_dec_ctx->pix_fmt,
-        target_width, target_height, AV_PIX_FMT_YUV420P,
-        SWS_BILINEAR, NULL, NULL, NULL
-    );
-    
-    if (!ctx.sws_ctx) {
-        LOGE("Could not create scaling context");
-        ret = -1;
-        goto cleanup;
-    }
+    // Setup scaling; the context is created from the first decoded frame
+    ffmpegx_converter_init(&ctx.converter, SWS_BILINEAR);
     
-    // Setup audio if present
-    if (ctx.audio_stream_idx >= 0) {
+    // Setup audio if present; segments are video only, audio is copied once when stitching
+    if (ctx.audio_stream_idx >= 0 && !range) {
         AVStream *audio_stream = ctx.input_ctx->streams[ctx.audio_stream_idx];
         const AVCodec *audio_decoder = avcodec_find_decoder(audio_stream->codecpar->codec_id);
         
         if (audio_decoder) {
             ctx.audio_dec_ctx = avcodec_alloc_context3(audio_decoder);
             avcodec_parameters_to_context(ctx.audio_dec_ctx, audio_stream->codecpar);
-            avcodec_open2(ctx.audio_dec_ctx, audio_decoder, NULL);
+            ffmpegx_cache_open_codec(&ctx.audio_dec_ctx, audio_decoder, NULL, 1);
             
             // Setup audio encoder (AAC)
             const AVCodec *audio_encoder = avcodec_find_encoder(AV_CODEC_ID_AAC);
@@ -233,7 +348,7 @@ int transcode_video(const char *input_file, const char *output_file,
                     ctx.audio_enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
                 }
                 
-                avcodec_open2(ctx.audio_enc_ctx, audio_encoder, NULL);
+                ffmpegx_cache_open_codec(&ctx.audio_enc_ctx, audio_encoder, NULL, 1);
                 avcodec_parameters_from_context(out_audio_stream->codecpar, ctx.audio_enc_ctx);
             }
         }
@@ -241,7 +356,7 @@ int transcode_video(const char *input_file, const char *output_file,
     
     // Open output file
     if (!(ctx.output_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&ctx.output_ctx->pb, output_file, AVIO_FLAG_WRITE);
+        ret = ffmpegx_open_output(ctx.output_ctx, output_file);
         if (ret < 0) {
             LOGE("Could not open output file");
             goto cleanup;
@@ -255,116 +370,68 @@ int transcode_video(const char *input_file, const char *output_file,
         goto cleanup;
     }
     
-    // Allocate frames and packets
-    ctx.decoded_frame = av_frame_alloc();
-    ctx.scaled_frame = av_frame_alloc();
-    ctx.scaled_frame->format = AV_PIX_FMT_YUV420P;
-    ctx.scaled_frame->width = target_width;
-    ctx.scaled_frame->height = target_height;
-    av_frame_get_buffer(ctx.scaled_frame, 32);
-    
-    ctx.packet = av_packet_alloc();
-    ctx.enc_packet = av_packet_alloc();
-    
-    // Main transcoding loop
-    int frames_processed = 0;
-    while (av_read_frame(ctx.input_ctx, ctx.packet) >= 0) {
-        if (ctx.packet->stream_index == ctx.video_stream_idx) {
-            // Decode video frame
-            ret = avcodec_send_packet(ctx.video_dec_ctx, ctx.packet);
-            if (ret < 0) {
-                LOGE("Error sending packet to decoder");
-                av_packet_unref(ctx.packet);
-                continue;
-            }
-            
-            while (ret >= 0) {
-                ret = avcodec_receive_frame(ctx.video_dec_ctx, ctx.decoded_frame);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                    break;
-                } else if (ret < 0) {
-                    LOGE("Error receiving frame from decoder");
-                    goto cleanup;
-                }
-                
-                // Scale frame
-                sws_scale(ctx.sws_ctx,
-                    (const uint8_t * const *)ctx.decoded_frame->data,
-                    ctx.decoded_frame->linesize, 0, ctx.video_dec_ctx->height,
-                    ctx.scaled_frame->data, ctx.scaled_frame->linesize
-                );
-                
-                ctx.scaled_frame->pts = ctx.decoded_frame->pts;
-                
-                // Encode frame
-                ret = avcodec_send_frame(ctx.video_enc_ctx, ctx.scaled_frame);
-                if (ret < 0) {
-                    LOGE("Error sending frame to encoder");
-                    continue;
-                }
-                
-                while (ret >= 0) {
-                    ret = avcodec_receive_packet(ctx.video_enc_ctx, ctx.enc_packet);
-                    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                        break;
-                    } else if (ret < 0) {
-                        LOGE("Error receiving packet from encoder");
-                        goto cleanup;
-                    }
-                    
-                    // Rescale timestamps
-                    av_packet_rescale_ts(ctx.enc_packet, ctx.video_enc_ctx->time_base,
-                                        out_video_stream->time_base);
-                    ctx.enc_packet->stream_index = out_video_stream->index;
-                    
-                    // Write packet
-                    ret = av_interleaved_write_frame(ctx.output_ctx, ctx.enc_packet);
-                    if (ret < 0) {
-                        LOGE("Error writing video packet");
-                    }
-                    
-                    av_packet_unref(ctx.enc_packet);
-                }
-                
-                frames_processed++;
-                if (frames_processed % 30 == 0) {
-                    LOGI("Processed %d frames", frames_processed);
-                }
-            }
-        } else if (ctx.audio_stream_idx >= 0 && ctx.packet->stream_index == ctx.audio_stream_idx) {
-            // For now, just copy audio packets
-            AVStream *in_stream = ctx.input_ctx->streams[ctx.packet->stream_index];
-            AVStream *out_stream = ctx.output_ctx->streams[1]; // Assuming audio is stream 1
-            
-            av_packet_rescale_ts(ctx.packet, in_stream->time_base, out_stream->time_base);
-            ctx.packet->stream_index = out_stream->index;
-            av_interleaved_write_frame(ctx.output_ctx, ctx.packet);
-        }
-        
-        av_packet_unref(ctx.packet);
+    // Audio packets are copied as-is into the second output stream
+    int *stream_mapping = av_malloc_array(ctx.input_ctx->nb_streams, sizeof(*stream_mapping));
+    if (!stream_mapping) {
+        ret = AVERROR(ENOMEM);
+        goto cleanup;
+    }
+    for (int i = 0; i < ctx.input_ctx->nb_streams; i++) {
+        stream_mapping[i] = -1;
+    }
+    if (ctx.audio_stream_idx >= 0 && ctx.output_ctx->nb_streams > 1) {
+        stream_mapping[ctx.audio_stream_idx] = 1;
     }
     
-    // Flush encoders
-    avcodec_send_frame(ctx.video_enc_ctx, NULL);
-    while (1) {
-        ret = avcodec_receive_packet(ctx.video_enc_ctx, ctx.enc_packet);
-        if (ret == AVERROR_EOF) break;
+    // Main transcoding pipeline
+    ctx.target_width = target_width;
+    ctx.target_height = target_height;
+    ctx.in_time_base = video_stream->time_base;
+    ctx.range_start = INT64_MIN;
+    ctx.range_end = INT64_MAX;
+    
+    if (range && range->start_pts != AV_NOPTS_VALUE) {
+        ctx.range_start = av_rescale_q(range->start_pts, ctx.in_time_base, ctx.video_enc_ctx->time_base);
+        
+        ret = av_seek_frame(ctx.input_ctx, ctx.video_stream_idx, range->start_pts, AVSEEK_FLAG_BACKWARD);
         if (ret < 0) {
-            LOGE("Error flushing encoder");
-            break;
+            LOGE("Could not seek to segment start");
+            av_free(stream_mapping);
+            goto cleanup;
         }
-        
-        av_packet_rescale_ts(ctx.enc_packet, ctx.video_enc_ctx->time_base,
-                            ctx.output_ctx->streams[0]->time_base);
-        ctx.enc_packet->stream_index = 0;
-        av_interleaved_write_frame(ctx.output_ctx, ctx.enc_packet);
-        av_packet_unref(ctx.enc_packet);
+    }
+    if (range && range->end_pts != AV_NOPTS_VALUE) {
+        ctx.range_end = av_rescale_q(range->end_pts, ctx.in_time_base, ctx.video_enc_ctx->time_base);
+    }
+    
+    FFmpegxPipelineConfig pipeline_config = {
+        .input_ctx = ctx.input_ctx,
+        .video_stream_index = ctx.video_stream_idx,
+        .dec_ctx = ctx.video_dec_ctx,
+        .enc_ctx = ctx.video_enc_ctx,
+        .output_ctx = ctx.output_ctx,
+        .output_stream = out_video_stream,
+        .stream_mapping = stream_mapping,
+        .filter = scale_stage,
+        .opaque = &ctx,
+        .progress = progress,
+        .has_stop_pts = range && range->end_pts != AV_NOPTS_VALUE,
+        .stop_pts = range ? range->end_pts : 0,
+    };
+    int64_t frames_encoded = 0;
+    
+    ret = ffmpegx_pipeline_run(&pipeline_config, &frames_encoded);
+    av_free(stream_mapping);
+    if (ret < 0) {
+        LOGE("Transcoding pipeline failed: %s", av_err2str(ret));
+        goto cleanup;
     }
     
     // Write trailer
     av_write_trailer(ctx.output_ctx);
     
-    LOGI("Transcoding completed! Processed %d frames", frames_processed);
+    LOGI("Transcoding completed! Processed %d frames, encoded %lld",
+         ctx.frames_processed, (long long)frames_encoded);
     ret = 0;
     
 cleanup:
@@ -372,35 +439,269 @@ cleanup:
     return ret;
 }
 
+static int transcode_single(const char *input_file, const char *output_file,
+                            const TranscodeSettings *settings, int thread_budget) {
+    return transcode_range(input_file, output_file, "mp4", settings, thread_budget, NULL,
+                           ffmpegx_session_progress(ffmpegx_session_current()));
+}
+
+int transcode_video(const char *input_file, const char *output_file, 
+                   int target_width, int target_height, int target_bitrate, int thread_budget) {
+    TranscodeSettings settings = { NULL, target_width, target_height, target_bitrate, {0, 0} };
+    return transcode_single(input_file, output_file, &settings, thread_budget);
+}
+
+// How often the coordinator folds the segments' progress into the session's
+#define SEGMENT_PROGRESS_INTERVAL_US 100000
+
+typedef struct SegmentJobs {
+    const char *input_file;
+    char **segment_files;
+    const FFmpegxSegment *segments;
+    int count;
+    const TranscodeSettings *settings;
+    int threads_per_job;
+    FFmpegxSession *session;
+    // One private block per segment, as segment jobs run side by side and would
+    // overwrite each other's progress; summed into the session's by the coordinator
+    FFmpegxProgress *progress;
+    AVRational time_base;   // of the segment bounds
+    int64_t first_pts;      // where the first segment starts
+    atomic_int next;
+    atomic_int error;
+    atomic_int finished;    // workers that have returned
+} SegmentJobs;
+
+static void *segment_worker(void *arg) {
+    SegmentJobs *jobs = arg;
+    
+    pthread_setname_np(pthread_self(), "ffx-segment");
+    ffmpegx_session_set_current(jobs->session);
+    
+    while (!atomic_load(&jobs->error)) {
+        if (ffmpegx_cancelled()) {
+            int expected = 0;
+            atomic_compare_exchange_strong(&jobs->error, &expected, AVERROR(ECANCELED));
+            break;
+        }
+        
+        int index = atomic_fetch_add(&jobs->next, 1);
+        if (index >= jobs->count) {
+            break;
+        }
+        
+        int64_t start = ffmpegx_now_ns();
+        int ret = transcode_range(jobs->input_file, jobs->segment_files[index], "matroska",
+                                  jobs->settings, jobs->threads_per_job, &jobs->segments[index],
+                                  &jobs->progress[index]);
+        ffmpegx_trace_event("segment", start, ffmpegx_now_ns());
+        if (ret < 0) {
+            LOGE("Segment %d failed: %s", index, av_err2str(ret));
+            int expected = 0;
+            atomic_compare_exchange_strong(&jobs->error, &expected, ret);
+        }
+    }
+    atomic_fetch_add(&jobs->finished, 1);
+    return NULL;
+}
+
+// Publishes the sum of the segments' counters as the progress of the whole input.
+// Segments keep the source timestamps, so each one's position counts from its start.
+static void publish_segment_progress(const SegmentJobs *jobs, FFmpegxProgress *total) {
+    int64_t frames = 0, done_us = 0, bytes_written = 0;
+    int64_t stage_ns[FFMPEGX_STAGE_COUNT] = {0};
+    
+    for (int i = 0; i < jobs->count; i++) {
+        FFmpegxProgress segment;
+        if (ffmpegx_progress_read(&jobs->progress[i], &segment) < 0 ||
+            segment.state == FFMPEGX_PROGRESS_IDLE) {
+            continue;
+        }
+        
+        int64_t start_pts = jobs->segments[i].start_pts != AV_NOPTS_VALUE ? jobs->segments[i].start_pts
+                                                                        : jobs->first_pts;
+        int64_t start_us = av_rescale_q(start_pts, jobs->time_base, AV_TIME_BASE_Q);
+        frames += segment.frames;
+        done_us += segment.pts_us > start_us ? segment.pts_us - start_us : 0;
+        bytes_written += segment.bytes_written;
+        for (int stage = 0; stage < FFMPEGX_STAGE_COUNT; stage++) {
+            stage_ns[stage] += segment.stage_ns[stage];
+        }
+    }
+    ffmpegx_progress_update(total, frames, done_us, bytes_written, stage_ns);
+}
+
+// Splits the input at keyframes, transcodes the segments concurrently and
+// stitches them with a stream copy. Falls back to a single transcode when the
+// input is too short to be worth splitting.
+static int transcode_video_segmented(const char *input_file, const char *output_file,
+                                     const TranscodeSettings *settings, int thread_budget,
+                                     int max_segments) {
+    FFmpegxKeyframeIndex keyframes;
+    FFmpegxSegment *segments = NULL;
+    SegmentJobs jobs;
+    FFmpegxProgress *total = NULL;
+    int64_t duration_us = 0;
+    pthread_t *workers = NULL;
+    int started = 0;
+    int count;
+    int ret;
+    
+    memset(&jobs, 0, sizeof(jobs));
+    
+    // Segment files go next to the output, which a descriptor does not have
+    if (ffmpegx_fd_url(output_file) >= 0) {
+        return transcode_single(input_file, output_file, settings, thread_budget);
+    }
+    
+    ret = ffmpegx_keyframe_index_load(input_file, &keyframes);
+    if (ret < 0) {
+        return ret;
+    }
+    
+    if (max_segments <= 0) {
+        max_segments = thread_budget;
+    }
+    count = ffmpegx_plan_segments(&keyframes, max_segments, FFMPEGX_MIN_SEGMENT_SECONDS, &segments);
+    jobs.time_base = keyframes.time_base;
+    jobs.first_pts = keyframes.count > 0 ? keyframes.pts[0] : 0;
+    if (keyframes.end_pts != AV_NOPTS_VALUE) {
+        duration_us = av_rescale_q(keyframes.end_pts - jobs.first_pts, keyframes.time_base, AV_TIME_BASE_Q);
+    }
+    ffmpegx_keyframe_index_free(&keyframes);
+    
+    if (count < 2) {
+        av_free(segments);
+        LOGI("Input too short to split, transcoding in one pass");
+        return transcode_single(input_file, output_file, settings, thread_budget);
+    }
+    
+    // Each segment runs a whole encoder, so share the budget between concurrent segments
+    int worker_count = count < thread_budget ? count : thread_budget;
+    if (worker_count < 1) worker_count = 1;
+    
+    jobs.input_file = input_file;
+    jobs.segments = segments;
+    jobs.count = count;
+    jobs.settings = settings;
+    jobs.threads_per_job = thread_budget / worker_count > 0 ? thread_budget / worker_count : 1;
+    jobs.session = ffmpegx_session_current();
+    total = ffmpegx_session_progress(jobs.session);
+    atomic_init(&jobs.next, 0);
+    atomic_init(&jobs.error, 0);
+    atomic_init(&jobs.finished, 0);
+    
+    LOGI("Transcoding %d segments with %d workers, %d thread(s) each",
+         count, worker_count, jobs.threads_per_job);
+    
+    jobs.segment_files = av_calloc(count, sizeof(*jobs.segment_files));
+    jobs.progress = av_calloc(count, sizeof(*jobs.progress));
+    workers = av_calloc(worker_count, sizeof(*workers));
+    if (!jobs.segment_files || !jobs.progress || !workers) {
+        ret = AVERROR(ENOMEM);
+        goto cleanup;
+    }
+    for (int i = 0; i < count; i++) {
+        jobs.segment_files[i] = av_asprintf("%s.seg%d.mkv", output_file, i);
+        if (!jobs.segment_files[i]) {
+            ret = AVERROR(ENOMEM);
+            goto cleanup;
+        }
+    }
+    
+    ffmpegx_progress_start(total, duration_us);
+    for (started = 0; started < worker_count; started++) {
+        if (pthread_create(&workers[started], NULL, segment_worker, &jobs) != 0) {
+            LOGE("Failed to create segment worker");
+            break;
+        }
+    }
+    // The jobs left behind by a failed thread creation are picked up by the others
+    if (started == 0) {
+        segment_worker(&jobs);
+    }
+    while (atomic_load(&jobs.finished) < started) {
+        usleep(SEGMENT_PROGRESS_INTERVAL_US);
+        publish_segment_progress(&jobs, total);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    publish_segment_progress(&jobs, total);
+    
+    ret = atomic_load(&jobs.error);
+    if (ret < 0) {
+        goto cleanup;
+    }
+    
+    ret = ffmpegx_concat_segments((const char *const *)jobs.segment_files, count,
+                                  input_file, output_file);
+    
+cleanup:
+    if (jobs.segment_files) {
+        for (int i = 0; i < count; i++) {
+            if (jobs.segment_files[i]) {
+                unlink(jobs.segment_files[i]);
+                av_free(jobs.segment_files[i]);
+            }
+        }
+        av_free(jobs.segment_files);
+    }
+    av_free(jobs.progress);
+    av_free(workers);
+    av_free(segments);
+    return ret;
+}
+
 // Export function for use in ffmpeg_main.c
-int compress_video_full(const char *input_file, const char *output_file, int quality) {
-    int width, height, bitrate;
+// segments: 1 = single pass, 0 = pick the segment count from the thread budget,
+// N = split into at most N segments transcoded in parallel
+int compress_video_full(const char *input_file, const char *output_file, int quality,
+                        int thread_budget, int segments) {
+    TranscodeSettings settings = { NULL, 0, 0, 0, {0, 0} };
     
     // Set parameters based on quality
     switch (quality) {
         case 0: // LOW
-            width = 640;
-            height = 360;
-            bitrate = 200000; // 200 kbps
+            settings.width = 640;
+            settings.height = 360;
+            settings.bitrate = 200000; // 200 kbps
             break;
         case 1: // MEDIUM
-            width = 854;
-            height = 480;
-            bitrate = 800000; // 800 kbps
+            settings.width = 854;
+            settings.height = 480;
+            settings.bitrate = 800000; // 800 kbps
             break;
         case 2: // HIGH
-            width = 1280;
-            height = 720;
-            bitrate = 2000000; // 2 Mbps
+            settings.width = 1280;
+            settings.height = 720;
+            settings.bitrate = 2000000; // 2 Mbps
             break;
         default:
-            width = 1920;
-            height = 1080;
-            bitrate = 4000000; // 4 Mbps
+            settings.width = 1920;
+            settings.height = 1080;
+            settings.bitrate = 4000000; // 4 Mbps
             break;
     }
     
-    return transcode_video(input_file, output_file, width, height, bitrate);
+    if (segments != 1) {
+        return transcode_video_segmented(input_file, output_file, &settings, thread_budget, segments);
+    }
+    return transcode_single(input_file, output_file, &settings, thread_budget);
+}
+
+// Export function for use in ffmpeg_main.c, for command lines that spell out the
+// encoding: video_codec may be NULL, width/height <= 0 keep the source size, bitrate
+// <= 0 the encoder's default, frame rate <= 0 the source rate. Audio packets are copied.
+int transcode_video_full(const char *input_file, const char *output_file, const char *video_codec,
+                         int width, int height, int frame_rate_num, int frame_rate_den, int bitrate,
+                         int thread_budget, int segments) {
+    TranscodeSettings settings = { video_codec, width, height, bitrate, {frame_rate_num, frame_rate_den} };
+    
+    if (segments != 1) {
+        return transcode_video_segmented(input_file, output_file, &settings, thread_budget, segments);
+    }
+    return transcode_single(input_file, output_file, &settings, thread_budget);
 }
 
 #endif // HAVE_FFMPEG_STATIC
\ No newline at end of file
@@ -0,0 +1,308 @@
+/**
+ * Multi-range trimming
+ * One demuxer feeds one muxer per clip; packets are shared by reference, so a
+ * packet that lands in several overlapping clips is read and stored once
+ */
+
+#include <android/log.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#include "ffmpeg_cache.h"
+#include "ffmpeg_index.h"
+#include "ffmpeg_pool.h"
+#include "ffmpeg_session.h"
+#include "ffmpeg_trim.h"
+#include "libavformat/avformat.h"
+#include "libavutil/avutil.h"
+#include "libavutil/mathematics.h"
+
+#define LOG_TAG "FFmpegTrim"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+typedef struct RangeOutput {
+    const FFmpegxTrimRange *range;
+    AVFormatContext *ctx;
+    int64_t start_us;           // keyframe the clip starts at, AV_TIME_BASE
+    int64_t end_us;             // INT64_MAX when it runs to the end of the file
+    int started;                // first video keyframe written (set from the start without video)
+    int received;               // at least one packet written
+    uint8_t *past_end;          // per input stream: a packet at or after end_us was read
+    int pending_streams;        // audio/video streams not past end_us yet
+    int finished;
+} RangeOutput;
+
+// Audio and video decide when a clip is complete; sparse streams (subtitles, data,
+// cover art) are copied but would keep every clip open until the end of the file
+static int is_tracked(const AVStream *stream) {
+    enum AVMediaType type = stream->codecpar->codec_type;
+    return (type == AVMEDIA_TYPE_VIDEO && !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)) ||
+           type == AVMEDIA_TYPE_AUDIO;
+}
+
+static int compare_start(const void *a, const void *b) {
+    const RangeOutput *ra = a, *rb = b;
+    return ra->start_us < rb->start_us ? -1 : ra->start_us > rb->start_us;
+}
+
+static int open_range_output(RangeOutput *r, AVFormatContext *input_ctx) {
+    const char *output_file = r->range->output;
+    int ret = avformat_alloc_output_context2(&r->ctx, NULL, NULL, output_file);
+    if (ret < 0 || !r->ctx) {
+        LOGE("Could not create output context for %s", output_file);
+        return ret < 0 ? ret : AVERROR_UNKNOWN;
+    }
+
+    r->past_end = av_calloc(input_ctx->nb_streams, 1);
+    if (!r->past_end) {
+        return AVERROR(ENOMEM);
+    }
+    for (int i = 0; i < input_ctx->nb_streams; i++) {
+        AVStream *in_stream = input_ctx->streams[i];
+        AVStream *out_stream = avformat_new_stream(r->ctx, NULL);
+        if (!out_stream) {
+            return AVERROR(ENOMEM);
+        }
+        ret = avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar);
+        if (ret < 0) {
+            return ret;
+        }
+        out_stream->codecpar->codec_tag = 0;
+        out_stream->time_base = in_stream->time_base;
+        r->pending_streams += is_tracked(in_stream);
+    }
+
+    if (!(r->ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = ffmpegx_open_output(r->ctx, output_file);
+        if (ret < 0) {
+            LOGE("Could not open output file '%s'", output_file);
+            return ret;
+        }
+    }
+    ret = avformat_write_header(r->ctx, NULL);
+    if (ret < 0) {
+        LOGE("Error writing header of %s", output_file);
+    }
+    return ret;
+}
+
+static void close_range_output(RangeOutput *r) {
+    if (r->ctx) {
+        if (!(r->ctx->oformat->flags & AVFMT_NOFILE)) {
+            ffmpegx_close_output(r->ctx);
+        }
+        avformat_free_context(r->ctx);
+        r->ctx = NULL;
+    }
+    av_freep(&r->past_end);
+}
+
+static int finish_range_output(RangeOutput *r) {
+    int ret = av_write_trailer(r->ctx);
+    if (ret >= 0) {
+        LOGI("Clip %.3f+%.3f written to %s", r->range->start, r->range->duration, r->range->output);
+    }
+    close_range_output(r);
+    r->finished = 1;
+    return ret;
+}
+
+// Writes a new reference to pkt, shifted so that the clip starts at 0
+static int write_range_packet(RangeOutput *r, const AVPacket *pkt, AVPacket *ref, const AVStream *in_stream) {
+    int ret = av_packet_ref(ref, pkt);
+    if (ret < 0) {
+        return ret;
+    }
+    int64_t offset = av_rescale_q(r->start_us, AV_TIME_BASE_Q, in_stream->time_base);
+    if (ref->pts != AV_NOPTS_VALUE) {
+        ref->pts -= offset;
+    }
+    if (ref->dts != AV_NOPTS_VALUE) {
+        ref->dts -= offset;
+    }
+    AVStream *out_stream = r->ctx->streams[pkt->stream_index];
+    av_packet_rescale_ts(ref, in_stream->time_base, out_stream->time_base);
+    ref->stream_index = out_stream->index;
+    ref->pos = -1;
+    r->received = 1;
+    return av_interleaved_write_frame(r->ctx, ref);
+}
+
+static int seek_to(AVFormatContext *ctx, int video_index, int64_t start_us) {
+    if (video_index < 0) {
+        return avformat_seek_file(ctx, -1, INT64_MIN, start_us, start_us, 0);
+    }
+    int64_t ts = av_rescale_q(start_us, AV_TIME_BASE_Q, ctx->streams[video_index]->time_base);
+    return avformat_seek_file(ctx, video_index, INT64_MIN, ts, ts, 0);
+}
+
+int ffmpegx_trim_ranges(const char *input_file, const FFmpegxTrimRange *ranges, int count) {
+    AVFormatContext *input_ctx = NULL;
+    RangeOutput *outputs = NULL;
+    FFmpegxKeyframeIndex index = { 0 };
+    AVPacket *pkt = NULL, *ref = NULL;
+    int remaining = count;
+    int active = 0;             // clips that received packets and are not finished
+    int64_t seek_target = AV_NOPTS_VALUE;
+    int ret;
+
+    if (count < 1) {
+        return AVERROR(EINVAL);
+    }
+
+    ret = ffmpegx_cache_open_input(&input_ctx, input_file);
+    if (ret < 0) {
+        LOGE("Cannot open input file: %s", input_file);
+        return ret;
+    }
+
+    pkt = ffmpegx_packet_get();
+    ref = ffmpegx_packet_get();
+    outputs = av_calloc(count, sizeof(*outputs));
+    if (!pkt || !ref || !outputs) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    // Only the container's seek index, which costs no I/O: without it each clip
+    // simply starts at its first video keyframe (see the started gate below)
+    int video_index = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (video_index >= 0) {
+        ffmpegx_keyframe_index_from_demuxer(input_ctx, video_index, &index);
+    }
+
+    // Clip starts move back to the keyframe at or before them, like a single trim
+    int64_t origin = input_ctx->start_time != AV_NOPTS_VALUE ? input_ctx->start_time : 0;
+    for (int i = 0; i < count; i++) {
+        RangeOutput *r = &outputs[i];
+        r->range = &ranges[i];
+        r->start_us = origin + (int64_t)(FFMAX(ranges[i].start, 0) * AV_TIME_BASE);
+        r->end_us = ranges[i].duration > 0 ? r->start_us + (int64_t)(ranges[i].duration * AV_TIME_BASE)
+                                           : INT64_MAX;
+        if (index.count > 0) {
+            int k = ffmpegx_keyframe_index_find(&index, av_rescale_q(r->start_us, AV_TIME_BASE_Q,
+                                                                     index.time_base));
+            r->start_us = av_rescale_q(index.pts[k], index.time_base, AV_TIME_BASE_Q);
+        }
+        r->started = video_index < 0;
+        ret = open_range_output(r, input_ctx);
+        if (ret < 0) {
+            goto end;
+        }
+    }
+    qsort(outputs, count, sizeof(*outputs), compare_start);
+
+    if (outputs[0].start_us > origin && seek_to(input_ctx, video_index, outputs[0].start_us) < 0) {
+        LOGE("Could not seek to %.3f", outputs[0].range->start);
+    }
+
+    while (remaining > 0) {
+        if (ffmpegx_cancelled()) {
+            ret = AVERROR(ECANCELED);
+            goto end;
+        }
+        ret = av_read_frame(input_ctx, pkt);
+        if (ret == AVERROR_EOF) {
+            break;
+        }
+        if (ret < 0) {
+            goto end;
+        }
+
+        int stream_index = pkt->stream_index;
+        AVStream *in_stream = input_ctx->streams[stream_index];
+        int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if (ts == AV_NOPTS_VALUE) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        int64_t pts_us = av_rescale_q(ts, in_stream->time_base, AV_TIME_BASE_Q);
+        int64_t dts_us = pkt->dts != AV_NOPTS_VALUE ?
+                         av_rescale_q(pkt->dts, in_stream->time_base, AV_TIME_BASE_Q) : pts_us;
+        int tracked = is_tracked(in_stream);
+
+        for (int i = 0; i < count; i++) {
+            RangeOutput *r = &outputs[i];
+            if (r->finished) {
+                continue;
+            }
+            if (dts_us >= r->end_us) {
+                // dts only grows within a stream: nothing more of it belongs to this clip
+                if (tracked && !r->past_end[stream_index]) {
+                    r->past_end[stream_index] = 1;
+                    if (--r->pending_streams == 0) {
+                        active -= r->received;
+                        remaining--;
+                        ret = finish_range_output(r);
+                        if (ret < 0) {
+                            goto end;
+                        }
+                    }
+                }
+                continue;
+            }
+            if (pts_us < r->start_us || pts_us >= r->end_us) {
+                continue;
+            }
+            // Video that precedes the first keyframe cannot be decoded
+            if (stream_index == video_index && !r->started) {
+                if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+                    continue;
+                }
+                r->started = 1;
+            }
+            active += !r->received;
+            ret = write_range_packet(r, pkt, ref, in_stream);
+            if (ret < 0) {
+                LOGE("Error muxing packet for %s", r->range->output);
+                goto end;
+            }
+        }
+        av_packet_unref(pkt);
+
+        // Between clips: skip ahead to the next one rather than reading the gap
+        if (active == 0 && remaining > 0) {
+            RangeOutput *next = outputs;
+            while (next->finished) {
+                next++;
+            }
+            // Once per clip, in case the demuxer lands well before the target
+            if (next->start_us - pts_us > FFMPEGX_TRIM_SEEK_GAP_US && next->start_us != seek_target) {
+                seek_target = next->start_us;
+                if (seek_to(input_ctx, video_index, next->start_us) < 0) {
+                    LOGE("Could not seek to %.3f", next->range->start);
+                }
+            }
+        }
+    }
+
+    // End of the input completes every clip still open
+    ret = 0;
+    for (int i = 0; i < count && ret >= 0; i++) {
+        if (!outputs[i].finished) {
+            ret = finish_range_output(&outputs[i]);
+        }
+    }
+    if (ret >= 0) {
+        LOGI("Cut %d clips from %s in one pass", count, input_file);
+    }
+
+end:
+    if (outputs) {
+        // Cancelled or failed: the unfinished clips are left without a trailer
+        for (int i = 0; i < count; i++) {
+            close_range_output(&outputs[i]);
+        }
+        av_free(outputs);
+    }
+    ffmpegx_packet_put(&pkt);
+    ffmpegx_packet_put(&ref);
+    ffmpegx_keyframe_index_free(&index);
+    ffmpegx_cache_close_input(&input_ctx);
+    return ret;
+}
+
+#endif // HAVE_FFMPEG_STATIC
@@ -0,0 +1,38 @@
+/**
+ * Multi-range trimming
+ * Cuts several clips out of one input in a single forward pass: every packet read
+ * is routed to each open output whose range contains it
+ */
+
+#ifndef FFMPEGX_TRIM_H
+#define FFMPEGX_TRIM_H
+
+#ifdef HAVE_FFMPEG_STATIC
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Gaps between ranges shorter than this are read through rather than seeked over
+#define FFMPEGX_TRIM_SEEK_GAP_US 2000000
+
+typedef struct FFmpegxTrimRange {
+    double start;           // seconds from the start of the file
+    double duration;        // seconds, <= 0 for the rest of the file
+    const char *output;
+} FFmpegxTrimRange;
+
+// Stream-copies each range of input_file to its output like a single trim: video
+// starts at the last keyframe at or before the range start (from the keyframe
+// index, ffmpeg_index.h), all streams are copied. Ranges may overlap and come in
+// any order. Returns 0 or the first AVERROR code; outputs are written in parallel
+// and a failure leaves the unfinished ones incomplete.
+int ffmpegx_trim_ranges(const char *input_file, const FFmpegxTrimRange *ranges, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAVE_FFMPEG_STATIC
+
+#endif // FFMPEGX_TRIM_H
@@ -13,6 +13,11 @@ object FFmpegExecutor {
     private val sessionCounter = AtomicLong(0)
     private val runningProcesses = mutableMapOf<Long, Process>()
     
+    /**
+     * Session ids are shared with native sessions so both kinds can live in one FFmpegSessionManager
+     */
+    internal fun nextSessionId(): Long = sessionCounter.incrementAndGet()
+    
     interface ExecutorCallback {
         fun onOutput(output: String)
         fun onError(error: String)
@@ -24,7 +29,7 @@ object FFmpegExecutor {
         command: String,
         callback: ExecutorCallback?
     ): Long {
-        val sessionId = sessionCounter.incrementAndGet()
+        val sessionId = nextSessionId()
         Log.d(TAG, "Starting session $sessionId with command: $command")
         
         return try {
@@ -5,6 +5,8 @@ import android.util.Log
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.suspendCancellableCoroutine
 import kotlinx.coroutines.withContext
+import org.json.JSONException
+import org.json.JSONObject
 import java.io.File
 import kotlin.coroutines.resume
 
@@ -162,6 +164,8 @@ class FFmpegHelper(private val context: Context) {
     }
 
     fun getMediaInformation(path: String): MediaInformation? {
+        probeMediaInformation(path)?.let { return it }
+        
         val command = "-i \"$path\" -f null -"
         val outputBuilder = StringBuilder()
         val errorBuilder = StringBuilder()
@@ -199,6 +203,60 @@ class FFmpegHelper(private val context: Context) {
             getMediaInformation(path)
         }
 
+    /**
+     * Native fast probe, cached in memory and under the app's cache directory;
+     * null when the native library lacks it or the file cannot be probed
+     */
+    private fun probeMediaInformation(path: String): MediaInformation? {
+        return try {
+            FFmpegNative.configureCacheDirs(context)
+            FFmpegNative.nativeProbe(path, true)?.let { parseProbeJson(it) }
+        } catch (e: UnsatisfiedLinkError) {
+            null
+        } catch (e: JSONException) {
+            Log.w(TAG, "Invalid probe result for $path", e)
+            null
+        }
+    }
+    
+    private fun parseProbeJson(json: String): MediaInformation? {
+        val root = JSONObject(json)
+        val mediaInfo = MediaInformation(
+            duration = root.optLong("durationUs") / 1000,
+            bitrate = root.optLong("bitRate")
+        )
+        
+        val streams = root.optJSONArray("streams") ?: return null
+        for (i in 0 until streams.length()) {
+            val stream = streams.getJSONObject(i)
+            when (stream.optString("type")) {
+                "video" -> {
+                    val fpsDen = stream.optInt("fpsDen")
+                    mediaInfo.videoStreams.add(VideoStream(
+                        codec = stream.optString("codec"),
+                        width = stream.optInt("width"),
+                        height = stream.optInt("height"),
+                        frameRate = if (fpsDen > 0) stream.optInt("fpsNum").toDouble() / fpsDen else 0.0,
+                        rotation = stream.optInt("rotation"),
+                        bitrate = stream.optLong("bitRate")
+                    ))
+                }
+                "audio" -> mediaInfo.audioStreams.add(AudioStream(
+                    codec = stream.optString("codec"),
+                    sampleRate = stream.optInt("sampleRate"),
+                    channels = stream.optInt("channels"),
+                    bitrate = stream.optLong("bitRate")
+                ))
+            }
+        }
+        
+        return if (mediaInfo.videoStreams.isNotEmpty() || mediaInfo.audioStreams.isNotEmpty()) {
+            mediaInfo
+        } else {
+            null
+        }
+    }
+
     private fun parseMediaInformation(output: String): MediaInformation? {
         if (output.isEmpty()) return null
         
@@ -344,11 +402,14 @@ data class VideoStream(
     var codec: String = "",
     var width: Int = 0,
     var height: Int = 0,
-    var frameRate: Double = 0.0
+    var frameRate: Double = 0.0,
+    var rotation: Int = 0,
+    var bitrate: Long = 0
 )
 
 data class AudioStream(
     var codec: String = "",
     var sampleRate: Int = 0,
-    var channels: Int = 0
+    var channels: Int = 0,
+    var bitrate: Long = 0
 )
\ No newline at end of file
@@ -1,6 +1,9 @@
 package com.mzgs.ffmpegx
 
+import android.content.Context
+import android.graphics.Bitmap
 import android.util.Log
+import java.io.File
 
 /**
  * Native FFmpeg implementation using JNI
@@ -47,6 +50,248 @@ object FFmpegNative {
      */
     external fun nativeIsAvailable(): Boolean
     
+    /**
+     * Receives native output and progress. Lines are queued on the native side and
+     * delivered from a single background thread, so implementations must be thread-safe
+     */
+    interface NativeCallback {
+        fun onProgress(progress: String)
+        fun onOutput(line: String)
+        fun onError(error: String)
+        
+        /**
+         * Several output lines at once; called instead of [onOutput] when lines arrive in bursts
+         */
+        fun onOutputBatch(lines: Array<String>) {
+            lines.forEach { onOutput(it) }
+        }
+        
+        /**
+         * A job queued with [nativeSubmitSession] finished, called on a native worker thread
+         */
+        fun onComplete(exitCode: Int) {}
+    }
+    
+    /**
+     * Register (or clear with null) the callback for native output and progress
+     */
+    external fun nativeSetCallback(callback: NativeCallback?)
+    
+    /**
+     * Direct view of the native progress block, read through [FFmpegNativeProgress]
+     */
+    external fun nativeGetProgressBuffer(): java.nio.ByteBuffer?
+    
+    /**
+     * Consistent copy of a progress block from [nativeGetProgressBuffer] or
+     * [nativeGetSessionProgressBuffer], taken under its seqlock with acquire loads.
+     * [out] needs 10 + [FFmpegNativeProgress.STAGE_COUNT] elements.
+     * @return false if the buffer is not a progress block or out is too short
+     */
+    external fun nativeReadProgress(buffer: java.nio.ByteBuffer, out: LongArray): Boolean
+    
+    /**
+     * Create a native session with its own callback, progress block and cancellation flag.
+     * Sessions are independent, so several can execute at the same time.
+     * @return Session handle, 0 on failure
+     */
+    external fun nativeCreateSession(callback: NativeCallback?): Long
+    
+    /**
+     * Execute FFmpeg command synchronously on the calling thread within a session
+     */
+    external fun nativeExecuteSession(session: Long, args: Array<String>): Int
+    
+    /**
+     * Queue a command on the native scheduler. It runs on a worker thread once one is
+     * free, higher [priority] first; the exit code goes to the session's onComplete().
+     * @return 0 if queued
+     */
+    external fun nativeSubmitSession(session: Long, args: Array<String>, priority: Int): Int
+    
+    /**
+     * Size the scheduler's worker pool (0 = from the core count). Only the first call,
+     * or the first queued job, decides the size.
+     * @return Number of workers
+     */
+    external fun nativeStartScheduler(workers: Int): Int
+    
+    /**
+     * Scheduler counters:
+     * [workers, threadBudget, queued, running, submitted, completed, totalWaitNs, maxWaitNs]
+     */
+    external fun nativeGetSchedulerStats(): LongArray?
+    
+    /**
+     * Request cancellation of whatever the session is running
+     */
+    external fun nativeCancelSession(session: Long): Boolean
+    
+    /**
+     * Release a session; its progress buffer must not be read afterwards
+     */
+    external fun nativeReleaseSession(session: Long)
+    
+    /**
+     * Direct view of a session's progress block, valid until [nativeReleaseSession]
+     */
+    external fun nativeGetSessionProgressBuffer(session: Long): java.nio.ByteBuffer?
+    
+    /**
+     * Stage timing as {totalNs, count, maxNs} per stage (see [FFmpegNativeStageStats]);
+     * session 0 reads the counters of commands run without a session
+     */
+    external fun nativeGetStageStats(session: Long): LongArray?
+    
+    /**
+     * Warm context cache counters: [inputHits, inputMisses, codecHits, codecMisses]
+     */
+    external fun nativeGetContextCacheStats(): LongArray?
+    
+    /**
+     * Close the probed inputs and opened codecs kept between jobs, e.g. on memory pressure
+     */
+    external fun nativeClearContextCache()
+    
+    /**
+     * Describe a media file as JSON: format, durationUs, startUs, bitRate and streams
+     * (type, codec, size, rotation, frame rate, sample rate, channels, bit rate).
+     * Results are cached per path, size and mtime.
+     * @param fast Trust the container header when it describes every stream
+     * @return JSON, or null when the file cannot be probed
+     */
+    external fun nativeProbe(path: String, fast: Boolean): String?
+    
+    /**
+     * Directory for the on-disk probe cache (null disables it)
+     * @return 0 on success
+     */
+    external fun nativeSetProbeCacheDir(dir: String?): Int
+    
+    /**
+     * Directory for keyframe index files (null keeps them next to the media as *.ffxidx)
+     * @return 0 on success
+     */
+    external fun nativeSetKeyframeIndexDir(dir: String?): Int
+    
+    /** Output formats of [nativeExtractThumbnails] */
+    const val THUMBNAIL_JPEG = 0
+    const val THUMBNAIL_PNG = 1
+    const val THUMBNAIL_RGBA = 2
+    const val THUMBNAIL_NV21 = 3
+    
+    /**
+     * Receives each thumbnail of [nativeExtractThumbnails] as soon as it is written.
+     * Called on native worker threads, concurrently and in no particular order.
+     */
+    interface ThumbnailListener {
+        /**
+         * @param index Position of the thumbnail's timestamp in timesUs
+         * @param ptsUs Time of the keyframe it was taken from
+         * @param result 0, or a negative error code when this thumbnail failed
+         */
+        fun onThumbnail(index: Int, ptsUs: Long, path: String, result: Int)
+    }
+    
+    /**
+     * Write one thumbnail per timestamp, each taken from the keyframe nearest to it:
+     * a seek and a single keyframe decode per thumbnail instead of a full decode.
+     * Larger batches are shared by several workers, each with its own demuxer and decoder.
+     * @param timesUs Timestamps in microseconds from the start of the file
+     * @param outputPattern File name with a %d numbered from 1, e.g. "thumb_%03d.jpg"
+     * @param width Thumbnail width, <= 0 to follow the aspect ratio
+     * @param height Thumbnail height, <= 0 to follow the aspect ratio
+     * @param format [THUMBNAIL_JPEG], [THUMBNAIL_PNG], or raw pixels: [THUMBNAIL_RGBA] or [THUMBNAIL_NV21]
+     * @param quality JPEG quality 1-100, 0 for the default
+     * @param listener Told about each thumbnail as soon as it is ready, may be null
+     * @return 0 on success, a negative error code otherwise
+     */
+    external fun nativeExtractThumbnails(
+        path: String,
+        timesUs: LongArray,
+        outputPattern: String,
+        width: Int,
+        height: Int,
+        format: Int,
+        quality: Int,
+        listener: ThumbnailListener?
+    ): Int
+    
+    /**
+     * Buffer layout for raw thumbnails of path: the thumbnail size (even for NV21)
+     * and a row stride aligned for the scaler. Only probes the file.
+     * @param width Thumbnail width, <= 0 to follow the aspect ratio
+     * @param height Thumbnail height, <= 0 to follow the aspect ratio
+     * @param format [THUMBNAIL_RGBA] or [THUMBNAIL_NV21]
+     * @return [width, height, rowStride, bufferSize], or null when path has no video
+     */
+    external fun nativeGetThumbnailLayout(path: String, width: Int, height: Int, format: Int): IntArray?
+    
+    /**
+     * Decode the keyframe nearest to timeUs and scale it straight into buffer, with
+     * no file and no copy on the Java side
+     * @param buffer Direct buffer of at least the size [nativeGetThumbnailLayout] reports
+     * @param rowStride Bytes between rows, 0 for packed rows; NV21 chroma rows follow the luma rows
+     * @param format [THUMBNAIL_RGBA] or [THUMBNAIL_NV21] (even width and height)
+     * @return Time of the keyframe in microseconds, or a negative error code
+     */
+    external fun nativeGrabFrameToBuffer(
+        path: String,
+        timeUs: Long,
+        buffer: java.nio.ByteBuffer,
+        width: Int,
+        height: Int,
+        rowStride: Int,
+        format: Int
+    ): Long
+    
+    /**
+     * Decode the keyframe nearest to timeUs and scale it straight into the pixels of
+     * an ARGB_8888 bitmap, at the bitmap's size
+     * @return Time of the keyframe in microseconds, or a negative error code
+     */
+    external fun nativeGrabFrameToBitmap(path: String, timeUs: Long, bitmap: Bitmap): Long
+    
+    /**
+     * Tile one keyframe thumbnail per timestamp into a single image, encoded once,
+     * with an optional WebVTT file mapping time spans to tile regions for web players
+     * @param columns Tiles per row, <= 0 for a square-ish grid
+     * @param tileWidth Tile width, <= 0 to follow the aspect ratio (rounded down to even)
+     * @param tileHeight Tile height, <= 0 to follow the aspect ratio (rounded down to even)
+     * @param format [THUMBNAIL_JPEG] or [THUMBNAIL_PNG]
+     * @param vttPath WebVTT output, referring to the image by file name, or null
+     * @return 0 on success, a negative error code otherwise
+     */
+    external fun nativeCreateSpriteSheet(
+        path: String,
+        timesUs: LongArray,
+        columns: Int,
+        tileWidth: Int,
+        tileHeight: Int,
+        format: Int,
+        quality: Int,
+        imagePath: String,
+        vttPath: String?
+    ): Int
+    
+    @Volatile
+    private var cacheDirsConfigured = false
+    
+    /**
+     * Keep probe results and keyframe indexes under the app's cache directory.
+     * Only the first call has an effect.
+     */
+    fun configureCacheDirs(context: Context) {
+        if (cacheDirsConfigured) return
+        cacheDirsConfigured = true
+        try {
+            nativeSetProbeCacheDir(File(context.cacheDir, "ffmpegx-probe").absolutePath)
+            nativeSetKeyframeIndexDir(File(context.cacheDir, "ffmpegx-index").absolutePath)
+        } catch (e: UnsatisfiedLinkError) {
+            Log.w(TAG, "Native caches not available", e)
+        }
+    }
+    
     // Legacy methods for compatibility
     /**
      * Execute FFmpeg binary through JNI (legacy)
@@ -122,7 +367,7 @@ object FFmpegNative {
         }
     }
     
-    private fun parseCommand(command: String): List<String> {
+    internal fun parseCommand(command: String): List<String> {
         val args = mutableListOf<String>()
         val regex = Regex("""[^\s"]+|"[^"]*"""")
         regex.findAll(command).forEach { matchResult ->
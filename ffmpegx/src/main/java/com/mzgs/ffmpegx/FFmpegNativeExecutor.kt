@@ -31,6 +31,7 @@ object FFmpegNativeExecutor {
         callback: FFmpegExecutor.ExecutorCallback?
     ): Long {
         Log.d(TAG, "Attempting to execute FFmpeg command: $command")
+        FFmpegNative.configureCacheDirs(context)
         
         // Try different execution strategies based on Android version
         return when {
@@ -48,6 +49,15 @@ object FFmpegNativeExecutor {
         }
     }
     
+    /**
+     * Whether executeFFmpeg() hands commands to the built-in ffmpeg_main() over JNI.
+     * Only that path understands the native-only options (-segments, -smartcut); the
+     * ffmpeg binary used otherwise rejects them.
+     */
+    fun usesDirectJNI(): Boolean {
+        return Build.VERSION.SDK_INT >= Build.VERSION_CODES.Q && FFmpegNative.isDirectJNIAvailable()
+    }
+    
     private fun executeFromDataDir(
         context: Context,
         command: String,
@@ -0,0 +1,123 @@
+package com.mzgs.ffmpegx
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Reader for the binary progress block the native pipeline updates in place.
+ * Polling it costs one short JNI call; no strings are formatted or parsed.
+ * Field order mirrors FFmpegxProgress in ffmpeg_progress.h.
+ */
+class FFmpegNativeProgress(private val buffer: ByteBuffer) {
+    
+    companion object {
+        const val VERSION = 2
+        
+        const val STATE_IDLE = 0
+        const val STATE_RUNNING = 1
+        const val STATE_FINISHED = 2
+        const val STATE_FAILED = 3
+        const val STATE_CANCELLED = 4
+        
+        const val STAGE_COUNT = 6
+        
+        /** Stage order of [Snapshot.stageNs] and [FFmpegNativeStageStats] */
+        val STAGE_NAMES = listOf("demux", "decode", "scale", "filter", "encode", "mux")
+        
+        // Element order of nativeReadProgress()
+        private const val INDEX_VERSION = 0
+        private const val INDEX_STATE = 1
+        private const val INDEX_ERROR = 2
+        private const val INDEX_FRAMES = 3
+        private const val INDEX_PTS_US = 4
+        private const val INDEX_DURATION_US = 5
+        private const val INDEX_BYTES = 6
+        private const val INDEX_FPS = 7
+        private const val INDEX_SPEED = 8
+        private const val INDEX_ELAPSED_NS = 9
+        private const val INDEX_STAGE_NS = 10
+        
+        /**
+         * Reader for the process-wide block, or null when the native library lacks it
+         */
+        fun default(): FFmpegNativeProgress? {
+            return try {
+                FFmpegNative.nativeGetProgressBuffer()?.let { FFmpegNativeProgress(it) }
+            } catch (e: UnsatisfiedLinkError) {
+                null
+            }
+        }
+    }
+    
+    data class Snapshot(
+        val state: Int,
+        val error: Int,
+        val frames: Long,
+        val ptsUs: Long,
+        val durationUs: Long,
+        val bytesWritten: Long,
+        val fps: Double,
+        val speed: Double,
+        val elapsedNs: Long,
+        /** Busy time per stage: demux, decode, scale, filter, encode, mux */
+        val stageNs: LongArray
+    ) {
+        val isRunning: Boolean get() = state == STATE_RUNNING
+        val isDone: Boolean get() = state == STATE_FINISHED || state == STATE_FAILED || state == STATE_CANCELLED
+        
+        /** Completed share between 0 and 1 */
+        val fraction: Float
+            get() = when {
+                state == STATE_FINISHED -> 1f
+                durationUs > 0 -> (ptsUs.toFloat() / durationUs).coerceIn(0f, 1f)
+                else -> 0f
+            }
+        
+        fun toProgressInfo(): ProgressInfo {
+            val timeMs = ptsUs / 1000
+            val totalMs = durationUs / 1000
+            val percentage = if (totalMs > 0) {
+                (timeMs.toFloat() / totalMs * 100f).coerceIn(0f, 100f)
+            } else 0f
+            val bitrate = if (ptsUs > 0) bytesWritten * 8.0 / (ptsUs / 1000.0) else 0.0
+            return ProgressInfo(
+                timeMs = timeMs,
+                totalDurationMs = totalMs,
+                percentage = percentage,
+                fps = fps.toFloat(),
+                speed = speed.toFloat(),
+                bitrate = bitrate,
+                size = bytesWritten,
+                frame = frames.toInt()
+            )
+        }
+    }
+    
+    private val values = LongArray(INDEX_STAGE_NS + STAGE_COUNT)
+    
+    val isCompatible: Boolean
+        get() = buffer.duplicate().order(ByteOrder.nativeOrder()).getInt(0) == VERSION
+    
+    /**
+     * Consistent copy of the block, or null if it is not a block of this layout or
+     * writers kept it busy; poll again on the next tick
+     */
+    @Synchronized
+    fun read(): Snapshot? {
+        if (!FFmpegNative.nativeReadProgress(buffer, values) || values[INDEX_VERSION] != VERSION.toLong()) {
+            return null
+        }
+        return Snapshot(
+            state = values[INDEX_STATE].toInt(),
+            error = values[INDEX_ERROR].toInt(),
+            frames = values[INDEX_FRAMES],
+            ptsUs = values[INDEX_PTS_US],
+            durationUs = values[INDEX_DURATION_US],
+            bytesWritten = values[INDEX_BYTES],
+            fps = Double.fromBits(values[INDEX_FPS]),
+            speed = Double.fromBits(values[INDEX_SPEED]),
+            elapsedNs = values[INDEX_ELAPSED_NS],
+            stageNs = values.copyOfRange(INDEX_STAGE_NS, INDEX_STAGE_NS + STAGE_COUNT)
+        )
+    }
+}
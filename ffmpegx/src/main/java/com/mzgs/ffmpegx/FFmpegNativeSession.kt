@@ -0,0 +1,71 @@
+package com.mzgs.ffmpegx
+
+import java.io.Closeable
+
+/**
+ * Handle to a native session. Each session owns its callback, progress block, stage
+ * timing and cancellation flag, so commands in different sessions can run concurrently.
+ */
+class FFmpegNativeSession(callback: FFmpegNative.NativeCallback? = null) : Closeable {
+    
+    val handle: Long = FFmpegNative.nativeCreateSession(callback)
+    
+    private val progress: FFmpegNativeProgress? =
+        if (handle != 0L) FFmpegNative.nativeGetSessionProgressBuffer(handle)?.let { FFmpegNativeProgress(it) } else null
+    
+    @Volatile
+    private var closed = handle == 0L
+    
+    val isValid: Boolean
+        get() = !closed
+    
+    /**
+     * Run a command on the calling thread; blocks until it finishes
+     */
+    fun execute(command: String): Int {
+        return execute(FFmpegNative.parseCommand(command).toTypedArray())
+    }
+    
+    fun execute(args: Array<String>): Int {
+        check(!closed) { "Session is closed" }
+        return FFmpegNative.nativeExecuteSession(handle, args)
+    }
+    
+    /**
+     * Queue a command on the native scheduler and return immediately;
+     * the callback's onComplete() receives the exit code
+     */
+    fun submit(command: String, priority: Int): Boolean {
+        check(!closed) { "Session is closed" }
+        return FFmpegNative.nativeSubmitSession(handle, FFmpegNative.parseCommand(command).toTypedArray(), priority) == 0
+    }
+    
+    fun cancel(): Boolean {
+        return !closed && FFmpegNative.nativeCancelSession(handle)
+    }
+    
+    /**
+     * Latest progress of this session, null once closed
+     */
+    fun readProgress(): FFmpegNativeProgress.Snapshot? = synchronized(this) {
+        if (closed) null else progress?.read()
+    }
+    
+    /**
+     * Stage timing of the running or last command, null once closed
+     */
+    fun readStageStats(): FFmpegNativeStageStats? = synchronized(this) {
+        if (closed) null else FFmpegNative.nativeGetStageStats(handle)?.let { FFmpegNativeStageStats.fromArray(it) }
+    }
+    
+    /**
+     * Release the native session. A command still running keeps the native side alive
+     * until it returns.
+     */
+    override fun close() = synchronized(this) {
+        if (!closed) {
+            closed = true
+            FFmpegNative.nativeReleaseSession(handle)
+        }
+    }
+}
@@ -0,0 +1,47 @@
+package com.mzgs.ffmpegx
+
+/**
+ * Where a native command spent its time: busy time, units of work (packets, frames,
+ * conversions) and the slowest unit for each stage, summed over all of its threads.
+ * Readable while the command runs; mirrors FFmpegxStats in ffmpeg_progress.h.
+ */
+data class FFmpegNativeStageStats(val stages: List<Stage>) {
+    
+    data class Stage(
+        val name: String,
+        val totalNs: Long,
+        val count: Long,
+        val maxNs: Long
+    ) {
+        val averageNs: Long
+            get() = if (count > 0) totalNs / count else 0
+    }
+    
+    operator fun get(name: String): Stage? = stages.firstOrNull { it.name == name }
+    
+    /** The stage with the most busy time, null when nothing has run */
+    val bottleneck: Stage?
+        get() = stages.filter { it.count > 0 }.maxByOrNull { it.totalNs }
+    
+    companion object {
+        internal fun fromArray(values: LongArray): FFmpegNativeStageStats? {
+            val names = FFmpegNativeProgress.STAGE_NAMES
+            if (values.size < names.size * 3) return null
+            
+            return FFmpegNativeStageStats(names.mapIndexed { i, name ->
+                Stage(name, values[i * 3], values[i * 3 + 1], values[i * 3 + 2])
+            })
+        }
+        
+        /**
+         * Counters of commands run without a session, or null when the native library lacks them
+         */
+        fun readDefault(): FFmpegNativeStageStats? {
+            return try {
+                FFmpegNative.nativeGetStageStats(0)?.let { fromArray(it) }
+            } catch (e: UnsatisfiedLinkError) {
+                null
+            }
+        }
+    }
+}
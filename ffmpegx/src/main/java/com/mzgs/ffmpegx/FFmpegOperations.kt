@@ -1,11 +1,12 @@
 package com.mzgs.ffmpegx
 
 import android.content.Context
+import android.graphics.Bitmap
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.withContext
 import java.io.File
 
-class FFmpegOperations(context: Context) {
+class FFmpegOperations(private val context: Context) {
     
     private val ffmpegHelper = FFmpegHelper(context)
     
@@ -13,12 +14,25 @@ class FFmpegOperations(context: Context) {
         inputPath: String,
         outputPath: String,
         quality: VideoQuality = VideoQuality.MEDIUM,
-        callback: FFmpegHelper.FFmpegCallback? = null
+        callback: FFmpegHelper.FFmpegCallback? = null,
+        parallelSegments: Int = 1
     ): Boolean {
         android.util.Log.d("FFmpegOperations", "compressVideo called with input: $inputPath, output: $outputPath, quality: $quality")
         
+        // Native transcoder only: split at keyframes and encode up to N segments in parallel (0 = auto).
+        // The segmented transcoder copies the source audio and takes only the plain video options.
+        val segmented = parallelSegments != 1 && FFmpegNativeExecutor.usesDirectJNI()
+        
         // Build compression commands with aggressive settings for testing
-        val command = when (quality) {
+        val command = if (segmented) {
+            val video = when (quality) {
+                VideoQuality.LOW -> "-vf scale=640:360 -c:v mpeg4 -b:v 200k"
+                VideoQuality.MEDIUM -> "-c:v mpeg4 -b:v 800k -s 854x480 -r 24"
+                VideoQuality.HIGH -> "-c:v mpeg4 -b:v 2000k -s 1280x720 -r 30"
+                VideoQuality.VERY_HIGH -> "-c:v mpeg4 -b:v 4000k -r 30"
+            }
+            "-i \"$inputPath\" -segments $parallelSegments $video -c:a copy -y \"$outputPath\""
+        } else when (quality) {
             VideoQuality.LOW -> {
                 // VERY aggressive compression for testing
                 // Using simpler command that should work with our implementation
@@ -115,20 +129,45 @@ class FFmpegOperations(context: Context) {
         outputPath: String,
         startTimeSeconds: Double,
         durationSeconds: Double,
-        callback: FFmpegHelper.FFmpegCallback? = null
+        callback: FFmpegHelper.FFmpegCallback? = null,
+        frameAccurate: Boolean = false
     ): Boolean {
-        val command = FFmpegCommandBuilder()
+        val builder = FFmpegCommandBuilder()
             .input(inputPath)
             .overwriteOutput()
             .startTime(startTimeSeconds)
             .duration(durationSeconds)
             .copyAllCodecs()
+        // Understood by the built-in ffmpeg_main() only; the ffmpeg binary cuts at keyframes
+        if (frameAccurate && FFmpegNativeExecutor.usesDirectJNI()) {
+            builder.customOption("-smartcut")
+        }
+        val command = builder
             .output(outputPath)
             .build()
         
         return ffmpegHelper.execute(command, callback)
     }
     
+    // All clips in one command: the input is read once, each packet goes to every clip containing it
+    suspend fun trimRanges(
+        inputPath: String,
+        ranges: List<TrimRange>,
+        callback: FFmpegHelper.FFmpegCallback? = null
+    ): Boolean {
+        val builder = FFmpegCommandBuilder()
+            .input(inputPath)
+            .overwriteOutput()
+        for (range in ranges) {
+            builder.startTime(range.startSeconds)
+                .duration(range.durationSeconds)
+                .copyAllCodecs()
+                .output(range.outputPath)
+        }
+        
+        return ffmpegHelper.execute(builder.build(), callback)
+    }
+    
     suspend fun mergeVideos(
         videoPaths: List<String>,
         outputPath: String,
@@ -234,8 +273,23 @@ class FFmpegOperations(context: Context) {
         videoPath: String,
         outputPattern: String,
         fps: Int = 1,
-        callback: FFmpegHelper.FFmpegCallback? = null
+        callback: FFmpegHelper.FFmpegCallback? = null,
+        keyframesOnly: Boolean = false
     ): Boolean {
+        // The keyframe nearest to each interval instead of decoding every frame
+        if (keyframesOnly) {
+            val durationMs = withContext(Dispatchers.IO) {
+                ffmpegHelper.getMediaInformation(videoPath)?.duration ?: 0L
+            }
+            val count = (durationMs * fps / 1000).toInt().coerceAtLeast(1)
+            if (durationMs > 0 &&
+                extractThumbnails(videoPath, List(count) { it.toDouble() / fps }, outputPattern, width = 0)) {
+                callback?.onSuccess(null)
+                callback?.onFinish()
+                return true
+            }
+        }
+        
         val command = FFmpegCommandBuilder()
             .input(videoPath)
             .videoFilter("fps=$fps")
@@ -245,6 +299,108 @@ class FFmpegOperations(context: Context) {
         return ffmpegHelper.execute(command, callback)
     }
     
+    /**
+     * One thumbnail per timestamp from the nearest keyframe, see [FFmpegNative.nativeExtractThumbnails].
+     * The extension of outputPattern picks the format: .png, .rgba or .nv21 (raw pixels) or JPEG.
+     * onThumbnail gets the index into timesSeconds, the keyframe's time and the file of
+     * each thumbnail as soon as it is written, on a native worker thread.
+     */
+    suspend fun extractThumbnails(
+        videoPath: String,
+        timesSeconds: List<Double>,
+        outputPattern: String,
+        width: Int = 320,
+        height: Int = -1,
+        quality: Int = 0,
+        onThumbnail: ((index: Int, timeSeconds: Double, path: String) -> Unit)? = null
+    ): Boolean = withContext(Dispatchers.IO) {
+        val format = when (outputPattern.substringAfterLast('.').lowercase()) {
+            "png" -> FFmpegNative.THUMBNAIL_PNG
+            "rgba", "raw" -> FFmpegNative.THUMBNAIL_RGBA
+            "nv21" -> FFmpegNative.THUMBNAIL_NV21
+            else -> FFmpegNative.THUMBNAIL_JPEG
+        }
+        val timesUs = LongArray(timesSeconds.size) { (timesSeconds[it] * 1_000_000).toLong() }
+        val listener = onThumbnail?.let { onReady ->
+            object : FFmpegNative.ThumbnailListener {
+                override fun onThumbnail(index: Int, ptsUs: Long, path: String, result: Int) {
+                    if (result == 0) {
+                        onReady(index, ptsUs / 1_000_000.0, path)
+                    }
+                }
+            }
+        }
+        try {
+            FFmpegNative.configureCacheDirs(context)
+            FFmpegNative.nativeExtractThumbnails(videoPath, timesUs, outputPattern, width, height,
+                                                 format, quality, listener) == 0
+        } catch (e: UnsatisfiedLinkError) {
+            false
+        }
+    }
+    
+    /**
+     * The keyframe nearest to timeSeconds as a Bitmap, decoded and scaled straight into
+     * its pixels with no file in between, see [FFmpegNative.nativeGrabFrameToBitmap].
+     * A width or height <= 0 follows the aspect ratio. Null when the file cannot be read.
+     */
+    suspend fun grabThumbnail(
+        videoPath: String,
+        timeSeconds: Double,
+        width: Int = 320,
+        height: Int = -1
+    ): Bitmap? = withContext(Dispatchers.IO) {
+        try {
+            FFmpegNative.configureCacheDirs(context)
+            val layout = FFmpegNative.nativeGetThumbnailLayout(videoPath, width, height,
+                                                               FFmpegNative.THUMBNAIL_RGBA)
+                ?: return@withContext null
+            val bitmap = Bitmap.createBitmap(layout[0], layout[1], Bitmap.Config.ARGB_8888)
+            if (FFmpegNative.nativeGrabFrameToBitmap(videoPath, (timeSeconds * 1_000_000).toLong(), bitmap) < 0) {
+                bitmap.recycle()
+                null
+            } else {
+                bitmap
+            }
+        } catch (e: UnsatisfiedLinkError) {
+            null
+        }
+    }
+    
+    /**
+     * A sprite sheet of keyframe thumbnails every intervalSeconds plus its WebVTT map,
+     * see [FFmpegNative.nativeCreateSpriteSheet]. A .png imagePath gives a PNG sheet, JPEG otherwise.
+     */
+    suspend fun createSpriteSheet(
+        videoPath: String,
+        imagePath: String,
+        vttPath: String? = null,
+        intervalSeconds: Double = 5.0,
+        columns: Int = 10,
+        tileWidth: Int = 160,
+        tileHeight: Int = -1,
+        quality: Int = 0
+    ): Boolean = withContext(Dispatchers.IO) {
+        val durationMs = ffmpegHelper.getMediaInformation(videoPath)?.duration ?: 0L
+        if (durationMs <= 0 || intervalSeconds <= 0) {
+            return@withContext false
+        }
+        val count = Math.ceil(durationMs / 1000.0 / intervalSeconds).toInt().coerceAtLeast(1)
+        val timesUs = LongArray(count) { (it * intervalSeconds * 1_000_000).toLong() }
+        val format = if (imagePath.substringAfterLast('.').lowercase() == "png") {
+            FFmpegNative.THUMBNAIL_PNG
+        } else {
+            FFmpegNative.THUMBNAIL_JPEG
+        }
+        try {
+            FFmpegNative.configureCacheDirs(context)
+            FFmpegNative.nativeCreateSpriteSheet(videoPath, timesUs, columns, tileWidth, tileHeight,
+                                                 format, quality, imagePath, vttPath) == 0
+        } catch (e: UnsatisfiedLinkError) {
+            false
+        }
+    }
+    
     suspend fun createGif(
         inputPath: String,
         outputPath: String,
@@ -327,6 +483,12 @@ class FFmpegOperations(context: Context) {
         return ffmpegHelper.execute(builder.build(), callback)
     }
     
+    data class TrimRange(
+        val startSeconds: Double,
+        val durationSeconds: Double,
+        val outputPath: String
+    )
+    
     enum class VideoQuality(val preset: String, val crf: Int) {
         LOW("ultrafast", 28),
         MEDIUM("medium", 23),
@@ -3,12 +3,125 @@ package com.mzgs.ffmpegx
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
 import kotlinx.coroutines.flow.asStateFlow
+import kotlinx.coroutines.flow.update
+import kotlinx.coroutines.suspendCancellableCoroutine
+import java.util.concurrent.ConcurrentHashMap
+import kotlin.coroutines.resume
 
 class FFmpegSessionManager {
     
     private val _activeSessions = MutableStateFlow<Map<Long, SessionInfo>>(emptyMap())
     val activeSessions: StateFlow<Map<Long, SessionInfo>> = _activeSessions.asStateFlow()
     
+    // Sessions running in-process through JNI, keyed by session id
+    private val nativeSessions = ConcurrentHashMap<Long, FFmpegNativeSession>()
+    
+    /**
+     * Queue a command on the native scheduler in its own session and return its id
+     * right away. At most as many jobs as the scheduler has workers run at once;
+     * the rest wait in priority order.
+     * @param onComplete Receives the exit code on a native worker thread
+     */
+    fun submitNative(
+        command: String,
+        description: String = "FFmpeg Command",
+        priority: Priority = Priority.NORMAL,
+        callback: FFmpegNative.NativeCallback? = null,
+        onComplete: ((Int) -> Unit)? = null
+    ): Long {
+        val sessionId = FFmpegExecutor.nextSessionId()
+        
+        val sessionCallback = object : FFmpegNative.NativeCallback {
+            override fun onProgress(progress: String) { callback?.onProgress(progress) }
+            override fun onOutput(line: String) { callback?.onOutput(line) }
+            override fun onError(error: String) { callback?.onError(error) }
+            override fun onOutputBatch(lines: Array<String>) {
+                callback?.onOutputBatch(lines)
+                lines.lastOrNull()?.let { updateSessionOutput(sessionId, it) }
+            }
+            override fun onComplete(exitCode: Int) {
+                finishNative(sessionId, exitCode)
+                callback?.onComplete(exitCode)
+                onComplete?.invoke(exitCode)
+            }
+        }
+        
+        val session = FFmpegNativeSession(sessionCallback)
+        if (!session.isValid) {
+            onComplete?.invoke(-1)
+            return sessionId
+        }
+        nativeSessions[sessionId] = session
+        addSession(sessionId, description, command)
+        
+        if (!session.submit(command, priority.value)) {
+            finishNative(sessionId, -1)
+            onComplete?.invoke(-1)
+        }
+        return sessionId
+    }
+    
+    /**
+     * Run a command through the native scheduler and wait for it. Each call gets a
+     * separate native session, so any number of these can be in flight.
+     * @param onStart Receives the session id once the command is queued
+     * @return FFmpeg exit code (0 for success)
+     */
+    suspend fun executeNative(
+        command: String,
+        description: String = "FFmpeg Command",
+        priority: Priority = Priority.NORMAL,
+        callback: FFmpegNative.NativeCallback? = null,
+        onStart: ((Long) -> Unit)? = null
+    ): Int = suspendCancellableCoroutine { continuation ->
+        val sessionId = submitNative(command, description, priority, callback) { exitCode ->
+            continuation.resume(exitCode)
+        }
+        continuation.invokeOnCancellation { cancelSession(sessionId) }
+        onStart?.invoke(sessionId)
+    }
+    
+    private fun finishNative(sessionId: Long, exitCode: Int) {
+        val session = nativeSessions.remove(sessionId) ?: return
+        session.readProgress()?.let { updateSessionProgress(sessionId, it.fraction) }
+        val state = when {
+            getSessionInfo(sessionId)?.isCancelled == true -> SessionState.CANCELLED
+            exitCode == 0 -> SessionState.COMPLETED
+            else -> SessionState.FAILED
+        }
+        updateSessionState(sessionId, state)
+        session.close()
+    }
+    
+    /**
+     * Queue depth, wait times and pool size of the native scheduler
+     */
+    fun getSchedulerStats(): SchedulerStats? {
+        val values = try {
+            FFmpegNative.nativeGetSchedulerStats()
+        } catch (e: UnsatisfiedLinkError) {
+            null
+        } ?: return null
+        val started = values[4] - values[2]
+        return SchedulerStats(
+            workers = values[0].toInt(),
+            threadsPerJob = values[1].toInt(),
+            queued = values[2].toInt(),
+            running = values[3].toInt(),
+            submitted = values[4],
+            completed = values[5],
+            averageWaitMs = if (started > 0) values[6] / started / 1_000_000 else 0,
+            maxWaitMs = values[7] / 1_000_000
+        )
+    }
+    
+    /**
+     * Live progress of a native session, null for other sessions or once it finished
+     */
+    fun getNativeProgress(sessionId: Long): FFmpegNativeProgress.Snapshot? {
+        return nativeSessions[sessionId]?.readProgress()
+    }
+    
     fun addSession(sessionId: Long, description: String, command: String) {
         val sessionInfo = SessionInfo(
             sessionId = sessionId,
@@ -17,45 +130,52 @@ class FFmpegSessionManager {
             startTime = System.currentTimeMillis(),
             state = SessionState.RUNNING
         )
-        _activeSessions.value = _activeSessions.value + (sessionId to sessionInfo)
+        _activeSessions.update { it + (sessionId to sessionInfo) }
     }
     
+    // Sessions finish on their own threads; update() keeps concurrent changes from getting lost
     fun updateSessionState(sessionId: Long, state: SessionState) {
-        _activeSessions.value = _activeSessions.value.mapValues { (id, info) ->
-            if (id == sessionId) {
-                info.copy(state = state, endTime = System.currentTimeMillis())
-            } else {
-                info
+        _activeSessions.update { sessions ->
+            sessions.mapValues { (id, info) ->
+                if (id == sessionId) {
+                    info.copy(state = state, endTime = System.currentTimeMillis())
+                } else {
+                    info
+                }
             }
         }
     }
     
     fun updateSessionProgress(sessionId: Long, progress: Float) {
-        _activeSessions.value = _activeSessions.value.mapValues { (id, info) ->
-            if (id == sessionId) {
-                info.copy(progress = progress)
-            } else {
-                info
+        _activeSessions.update { sessions ->
+            sessions.mapValues { (id, info) ->
+                if (id == sessionId) {
+                    info.copy(progress = progress)
+                } else {
+                    info
+                }
             }
         }
     }
     
     fun updateSessionOutput(sessionId: Long, output: String) {
-        _activeSessions.value = _activeSessions.value.mapValues { (id, info) ->
-            if (id == sessionId) {
-                info.copy(lastOutput = output)
-            } else {
-                info
+        _activeSessions.update { sessions ->
+            sessions.mapValues { (id, info) ->
+                if (id == sessionId) {
+                    info.copy(lastOutput = output)
+                } else {
+                    info
+                }
             }
         }
     }
     
     fun removeSession(sessionId: Long) {
-        _activeSessions.value = _activeSessions.value - sessionId
+        _activeSessions.update { it - sessionId }
     }
     
     fun cancelSession(sessionId: Long): Boolean {
-        val success = FFmpegExecutor.cancel(sessionId)
+        val success = nativeSessions[sessionId]?.cancel() ?: FFmpegExecutor.cancel(sessionId)
         if (success) {
             updateSessionState(sessionId, SessionState.CANCELLED)
         }
@@ -64,13 +184,14 @@ class FFmpegSessionManager {
     
     fun cancelAllSessions() {
         FFmpegExecutor.cancelAll()
+        nativeSessions.values.forEach { it.cancel() }
         _activeSessions.value.keys.forEach { sessionId ->
             updateSessionState(sessionId, SessionState.CANCELLED)
         }
     }
     
     fun isSessionRunning(sessionId: Long): Boolean {
-        return FFmpegExecutor.isRunning(sessionId)
+        return nativeSessions.containsKey(sessionId) || FFmpegExecutor.isRunning(sessionId)
     }
     
     fun getSessionInfo(sessionId: Long): SessionInfo? {
@@ -78,8 +199,10 @@ class FFmpegSessionManager {
     }
     
     fun clearCompletedSessions() {
-        _activeSessions.value = _activeSessions.value.filterValues { sessionInfo ->
-            sessionInfo.state == SessionState.RUNNING
+        _activeSessions.update { sessions ->
+            sessions.filterValues { sessionInfo ->
+                sessionInfo.state == SessionState.RUNNING
+            }
         }
     }
     
@@ -95,6 +218,23 @@ class FFmpegSessionManager {
         return _activeSessions.value.values.filter { it.state == SessionState.RUNNING }
     }
     
+    enum class Priority(val value: Int) {
+        LOW(0),
+        NORMAL(1),
+        HIGH(2)
+    }
+    
+    data class SchedulerStats(
+        val workers: Int,
+        val threadsPerJob: Int,
+        val queued: Int,
+        val running: Int,
+        val submitted: Long,
+        val completed: Long,
+        val averageWaitMs: Long,
+        val maxWaitMs: Long
+    )
+    
     enum class SessionState {
         RUNNING,
         COMPLETED,
@@ -2,6 +2,7 @@ package com.mzgs.ffmpegx
 
 import android.content.Context
 import android.net.Uri
+import android.os.ParcelFileDescriptor
 import java.io.File
 import java.io.FileOutputStream
 import java.io.InputStream
@@ -33,6 +34,33 @@ object FFmpegUtils {
         return File.createTempFile(prefix, ".$extension", tempDir)
     }
     
+    /**
+     * Runs block with an "fd:<n>" path for uri that the native library reads or writes
+     * directly, with no copy to a temporary file, and closes the descriptor afterwards.
+     * Use mode "r" for inputs and "rwt" for outputs (MP4 needs a seekable one); extension
+     * names an output's format, e.g. "mp4". Returns null when uri cannot be opened.
+     */
+    inline fun <T> withUriPath(
+        context: Context,
+        uri: Uri,
+        mode: String = "r",
+        extension: String? = null,
+        block: (String) -> T
+    ): T? {
+        val pfd = try {
+            context.contentResolver.openFileDescriptor(uri, mode)
+        } catch (e: Exception) {
+            null
+        } ?: return null
+        return pfd.use { block(fdPath(it, extension)) }
+    }
+    
+    /** Native path of an open descriptor, valid while pfd stays open; see [withUriPath] */
+    fun fdPath(pfd: ParcelFileDescriptor, extension: String? = null): String {
+        return if (extension.isNullOrEmpty()) "fd:${pfd.fd}" else "fd:${pfd.fd}.$extension"
+    }
+    
+    /** Copies uri into outputFile; prefer [withUriPath], which needs no copy */
     fun copyUriToFile(context: Context, uri: Uri, outputFile: File): Boolean {
         return try {
             context.contentResolver.openInputStream(uri)?.use { input ->